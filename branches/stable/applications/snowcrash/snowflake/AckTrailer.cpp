@@ -0,0 +1,49 @@
+#include "stdafx.h"
+#include "./AckTrailer.h"
+
+CAckTrailer::CAckTrailer(void)
+{
+	m_lpAcks = NULL;
+	m_cAcks = 0;
+	m_nBodyLen = 0;
+	m_nLen = 0;
+}
+
+CAckTrailer::~CAckTrailer(void)
+{
+}
+
+// Find the trailer of a wire packet. A packet without MSG_APPENDED_ACKS
+// parses as an empty trailer; one whose count runs into the header fails.
+bool CAckTrailer::Parse(LPBYTE lpBuffer, int nLen)
+{
+	m_lpAcks = NULL;
+	m_cAcks = 0;
+	m_nBodyLen = nLen;
+	m_nLen = 0;
+
+	if (nLen <= MSG_HEADER_LEN || !(lpBuffer[0] & MSG_APPENDED_ACKS))
+		return true;
+
+	BYTE cAcks = lpBuffer[nLen - 1];
+	int nTrailerLen = 1 + cAcks * sizeof(DWORD);
+
+	if (nLen - nTrailerLen <= MSG_HEADER_LEN)
+		return false;
+
+	m_cAcks = cAcks;
+	m_nLen = nTrailerLen;
+	m_nBodyLen = nLen - nTrailerLen;
+	m_lpAcks = cAcks ? &lpBuffer[m_nBodyLen] : NULL;
+
+	return true;
+}
+
+DWORD CAckTrailer::GetAck(int nIndex)
+{
+	DWORD dwID;
+
+	memcpy(&dwID, &m_lpAcks[nIndex * sizeof(dwID)], sizeof(dwID));
+
+	return ntohl(dwID);
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#pragma once
+
+// The appended acks of a received packet, read where they lie: a big endian
+// U32 per acked sequence, followed by their count in the last byte. Nothing
+// is copied, so the view is only good while the packet buffer is.
+class CAckTrailer
+{
+public:
+	CAckTrailer(void);
+	~CAckTrailer(void);
+
+	bool Parse(LPBYTE lpBuffer, int nLen);
+	DWORD GetAck(int nIndex);
+
+	LPBYTE m_lpAcks;	// First ID, inside the packet; NULL when there are none
+	BYTE m_cAcks;
+	int m_nBodyLen;		// Packet length without the trailer
+	int m_nLen;			// Trailer length, count byte included
+};
\ No newline at end of file
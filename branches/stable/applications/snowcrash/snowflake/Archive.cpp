@@ -0,0 +1,657 @@
+#include "stdafx.h"
+#include "./Archive.h"
+#include "./Compress.h"
+#include "./Protocol.h"
+#include "./Latency.h"
+
+#define ARCHIVE_CIRCUIT_TABLE	(ARCHIVE_SEGMENT_PACKETS * 2)
+
+static int message_bit(DWORD dwMessage)
+{
+	return (int)((dwMessage * 2654435761U) >> 21) % ARCHIVE_BITMAP_BITS;
+}
+
+// A message type as numbered on the wire, independent of any template:
+// the high frequency ID, 0xff00 plus a medium one, or 0xffff0000 plus a
+// low one
+DWORD message_number(LPBYTE lpData, int nLen)
+{
+	BYTE bPeek[PEEK_LEN];
+
+	peek_command(lpData, nLen, bPeek);
+
+	if (bPeek[0] != 0xff)
+		return bPeek[0];
+
+	if (bPeek[1] != 0xff)
+		return 0xff00 | bPeek[1];
+
+	return 0xffff0000 | (bPeek[2] << 8) | bPeek[3];
+}
+
+CArchive::CArchive(void)
+{
+	m_fp = NULL;
+	m_bWait = false;
+
+	m_dwWritten = 0;
+	m_dwDropped = 0;
+	m_dwSegments = 0;
+
+	ZeroMemory(m_buffers, sizeof(m_buffers));
+	m_lFilled = 0;
+	m_lFlushed = 0;
+
+	m_lpSegment = NULL;
+	m_lpEntries = NULL;
+	m_lpCircuits = NULL;
+	m_lpCircuitTable = NULL;
+
+	m_hWake = NULL;
+	m_hThread = NULL;
+	m_bStop = false;
+
+	InitializeCriticalSection(&m_csWrite);
+}
+
+CArchive::~CArchive(void)
+{
+	Close();
+	DeleteCriticalSection(&m_csWrite);
+}
+
+bool CArchive::Create(const char *lpszPath, bool bWait)
+{
+	ARCHIVEHEADER header;
+
+	Close();
+
+	m_fp = fopen(lpszPath, "wb");
+
+	if (!m_fp)
+		return false;
+
+	header.dwMagic = ARCHIVE_MAGIC;
+	header.dwVersion = ARCHIVE_VERSION;
+
+	if (fwrite(&header, sizeof(header), 1, m_fp) != 1)
+	{
+		Close();
+		return false;
+	}
+
+	for (int i = 0; i < ARCHIVE_BUFFERS; i++)
+	{
+		m_buffers[i].lpData = (LPBYTE)malloc(ARCHIVE_SEGMENT_LEN);
+		m_buffers[i].lpPackets = (ARCHIVEPENDING *)malloc(ARCHIVE_SEGMENT_PACKETS * sizeof(ARCHIVEPENDING));
+
+		if (!m_buffers[i].lpData || !m_buffers[i].lpPackets)
+		{
+			Close();
+			return false;
+		}
+	}
+
+	m_lpSegment = (LPBYTE)malloc(LZ_BOUND(ARCHIVE_SEGMENT_LEN));
+	m_lpEntries = (ARCHIVEENTRY *)malloc(ARCHIVE_SEGMENT_PACKETS * sizeof(ARCHIVEENTRY));
+	m_lpCircuits = (ARCHIVECIRCUIT *)malloc(ARCHIVE_SEGMENT_PACKETS * sizeof(ARCHIVECIRCUIT));
+	m_lpCircuitTable = (int *)malloc(ARCHIVE_CIRCUIT_TABLE * sizeof(int));
+
+	if (!m_lpSegment || !m_lpEntries || !m_lpCircuits || !m_lpCircuitTable)
+	{
+		Close();
+		return false;
+	}
+
+	m_bWait = bWait;
+	m_bStop = false;
+	m_lFilled = 0;
+	m_lFlushed = 0;
+	m_dwWritten = 0;
+	m_dwDropped = 0;
+	m_dwSegments = 0;
+
+	m_hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	if (m_hWake)
+		m_hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+
+	if (!m_hThread)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+// Copy a packet into the current segment, the only work done on the
+// hooked thread. A ullTime of 0 stamps it now.
+bool CArchive::Write(LPBYTE lpData, int nLen, struct sockaddr_in *address, bool bSent, ULONGLONG ullTime)
+{
+	ARCHIVEBUFFER *buffer;
+
+	if (!m_hThread || nLen <= 0 || nLen > 0xffff)
+		return false;
+
+	EnterCriticalSection(&m_csWrite);
+
+	// Stamped under the lock, so both hooked threads' packets stay in order
+	if (!ullTime)
+		ullTime = CLatency::GetWallTime();
+
+	for (;;)
+	{
+		if (m_lFilled - m_lFlushed < ARCHIVE_BUFFERS)
+		{
+			buffer = &m_buffers[m_lFilled % ARCHIVE_BUFFERS];
+
+			if (!buffer->nPackets)
+				break;
+
+			ULONGLONG ullFirst = (ullTime < buffer->ullFirstTime) ? ullTime : buffer->ullFirstTime;
+			ULONGLONG ullLast = (ullTime > buffer->ullLastTime) ? ullTime : buffer->ullLastTime;
+
+			if (buffer->nLen + nLen <= ARCHIVE_SEGMENT_LEN && buffer->nPackets < ARCHIVE_SEGMENT_PACKETS &&
+				ullLast - ullFirst <= ARCHIVE_SEGMENT_SPAN)
+				break;
+
+			Handoff();
+			continue;
+		}
+
+		if (!m_bWait)
+		{
+			m_dwDropped++;
+			LeaveCriticalSection(&m_csWrite);
+			return false;
+		}
+
+		// Let the writer catch up without holding it off the lock
+		LeaveCriticalSection(&m_csWrite);
+		SetEvent(m_hWake);
+		Sleep(1);
+		EnterCriticalSection(&m_csWrite);
+	}
+
+	if (!buffer->nPackets)
+	{
+		buffer->ullFirstTime = ullTime;
+		buffer->ullLastTime = ullTime;
+		buffer->dwStarted = GetTickCount();
+	}
+	else if (ullTime < buffer->ullFirstTime)
+		buffer->ullFirstTime = ullTime;
+	else if (ullTime > buffer->ullLastTime)
+		buffer->ullLastTime = ullTime;
+
+	ARCHIVEPENDING *lpPending = &buffer->lpPackets[buffer->nPackets++];
+
+	lpPending->ullTime = ullTime;
+	lpPending->dwAddress = address->sin_addr.s_addr;
+	lpPending->wPort = address->sin_port;
+	lpPending->wLen = (WORD)nLen;
+	lpPending->cFlags = bSent ? ARCHIVE_SENT : 0;
+
+	memcpy(&buffer->lpData[buffer->nLen], lpData, nLen);
+	buffer->nLen += nLen;
+
+	m_dwWritten++;
+
+	LeaveCriticalSection(&m_csWrite);
+
+	return true;
+}
+
+// Write out what is buffered, then stop the writer
+void CArchive::Close(void)
+{
+	if (m_hThread)
+	{
+		EnterCriticalSection(&m_csWrite);
+
+		if (m_lFilled - m_lFlushed < ARCHIVE_BUFFERS && m_buffers[m_lFilled % ARCHIVE_BUFFERS].nPackets)
+			Handoff();
+
+		LeaveCriticalSection(&m_csWrite);
+
+		m_bStop = true;
+		SetEvent(m_hWake);
+		WaitForSingleObject(m_hThread, INFINITE);
+		CloseHandle(m_hThread);
+		m_hThread = NULL;
+	}
+
+	if (m_hWake)
+	{
+		CloseHandle(m_hWake);
+		m_hWake = NULL;
+	}
+
+	if (m_fp)
+	{
+		fclose(m_fp);
+		m_fp = NULL;
+	}
+
+	for (int i = 0; i < ARCHIVE_BUFFERS; i++)
+	{
+		SAFE_FREE(m_buffers[i].lpData);
+		SAFE_FREE(m_buffers[i].lpPackets);
+		m_buffers[i].nLen = 0;
+		m_buffers[i].nPackets = 0;
+	}
+
+	SAFE_FREE(m_lpSegment);
+	SAFE_FREE(m_lpEntries);
+	SAFE_FREE(m_lpCircuits);
+	SAFE_FREE(m_lpCircuitTable);
+}
+
+// Pass the current segment to the writer. Called with m_csWrite held.
+void CArchive::Handoff(void)
+{
+	InterlockedIncrement(&m_lFilled);
+	SetEvent(m_hWake);
+}
+
+DWORD WINAPI CArchive::ThreadProc(LPVOID lpParam)
+{
+	((CArchive *)lpParam)->Run();
+
+	return 0;
+}
+
+void CArchive::Run(void)
+{
+	for (;;)
+	{
+		while (m_lFlushed != m_lFilled)
+		{
+			Flush(&m_buffers[m_lFlushed % ARCHIVE_BUFFERS]);
+			InterlockedIncrement(&m_lFlushed);
+		}
+
+		if (m_bStop)
+		{
+			if (m_lFlushed == m_lFilled)
+				break;
+
+			continue;
+		}
+
+		WaitForSingleObject(m_hWake, ARCHIVE_FLUSH_MS / 4);
+
+		// A quiet circuit still gets its packets written out
+		EnterCriticalSection(&m_csWrite);
+
+		if (m_lFilled - m_lFlushed < ARCHIVE_BUFFERS)
+		{
+			ARCHIVEBUFFER *buffer = &m_buffers[m_lFilled % ARCHIVE_BUFFERS];
+
+			if (buffer->nPackets && GetTickCount() - buffer->dwStarted >= ARCHIVE_FLUSH_MS)
+				Handoff();
+		}
+
+		LeaveCriticalSection(&m_csWrite);
+	}
+}
+
+// Index, compress and append one segment, then hand the buffer back
+bool CArchive::Flush(ARCHIVEBUFFER *buffer)
+{
+	ARCHIVEFOOTER footer;
+	ARCHIVESEGMENTHEADER header;
+	ARCHIVETRAILER trailer;
+	DWORD dwOffset = 0;
+
+	ZeroMemory(&footer, sizeof(footer));
+
+	footer.ullFirstTime = buffer->ullFirstTime;
+	footer.ullLastTime = buffer->ullLastTime;
+	footer.dwPackets = buffer->nPackets;
+	footer.dwRawLen = buffer->nLen;
+
+	for (int i = 0; i < ARCHIVE_CIRCUIT_TABLE; i++)
+		m_lpCircuitTable[i] = -1;
+
+	for (int i = 0; i < buffer->nPackets; i++)
+	{
+		ARCHIVEPENDING *lpPending = &buffer->lpPackets[i];
+		ARCHIVEENTRY *lpEntry = &m_lpEntries[i];
+		DWORD dwHash = (lpPending->dwAddress * 2654435761U) ^ lpPending->wPort;
+		int h = (int)(dwHash % ARCHIVE_CIRCUIT_TABLE);
+
+		while (m_lpCircuitTable[h] >= 0)
+		{
+			ARCHIVECIRCUIT *lpCircuit = &m_lpCircuits[m_lpCircuitTable[h]];
+
+			if (lpCircuit->dwAddress == lpPending->dwAddress && lpCircuit->wPort == lpPending->wPort)
+				break;
+
+			h = (h + 1) % ARCHIVE_CIRCUIT_TABLE;
+		}
+
+		if (m_lpCircuitTable[h] < 0)
+		{
+			ARCHIVECIRCUIT *lpCircuit = &m_lpCircuits[footer.wCircuits];
+
+			lpCircuit->dwAddress = lpPending->dwAddress;
+			lpCircuit->wPort = lpPending->wPort;
+			lpCircuit->wReserved = 0;
+			lpCircuit->dwPackets = 0;
+
+			m_lpCircuitTable[h] = footer.wCircuits++;
+		}
+
+		m_lpCircuits[m_lpCircuitTable[h]].dwPackets++;
+
+		lpEntry->dwTime = (DWORD)(lpPending->ullTime - footer.ullFirstTime);
+		lpEntry->dwOffset = dwOffset;
+		lpEntry->dwMessage = message_number(&buffer->lpData[dwOffset], lpPending->wLen);
+		lpEntry->wLen = lpPending->wLen;
+		lpEntry->wCircuit = (WORD)m_lpCircuitTable[h];
+		lpEntry->cFlags = lpPending->cFlags;
+		lpEntry->cReserved = 0;
+		lpEntry->wReserved = 0;
+
+		int nBit = message_bit(lpEntry->dwMessage);
+		footer.bMessages[nBit / 8] |= (BYTE)(1 << (nBit % 8));
+
+		dwOffset += lpPending->wLen;
+	}
+
+	// Keep the data as it was if compressing doesn't make it smaller
+	LPBYTE lpData = m_lpSegment;
+	int nDataLen = lz_compress(buffer->lpData, buffer->nLen, m_lpSegment, LZ_BOUND(ARCHIVE_SEGMENT_LEN));
+
+	footer.cCompression = ARCHIVE_LZ;
+
+	if (nDataLen < 0 || nDataLen >= buffer->nLen)
+	{
+		lpData = buffer->lpData;
+		nDataLen = buffer->nLen;
+		footer.cCompression = ARCHIVE_STORED;
+	}
+
+	footer.dwDataLen = nDataLen;
+
+	trailer.dwFooterLen = sizeof(footer) + footer.wCircuits * sizeof(ARCHIVECIRCUIT) + footer.dwPackets * sizeof(ARCHIVEENTRY);
+	trailer.dwMagic = ARCHIVE_SEGMENT_MAGIC;
+
+	header.dwMagic = ARCHIVE_SEGMENT_MAGIC;
+	header.dwLen = sizeof(header) + nDataLen + trailer.dwFooterLen + sizeof(trailer);
+
+	bool bWritten = fwrite(&header, sizeof(header), 1, m_fp) == 1 &&
+		fwrite(lpData, nDataLen, 1, m_fp) == 1 &&
+		fwrite(&footer, sizeof(footer), 1, m_fp) == 1 &&
+		fwrite(m_lpCircuits, sizeof(ARCHIVECIRCUIT), footer.wCircuits, m_fp) == footer.wCircuits &&
+		fwrite(m_lpEntries, sizeof(ARCHIVEENTRY), footer.dwPackets, m_fp) == footer.dwPackets &&
+		fwrite(&trailer, sizeof(trailer), 1, m_fp) == 1;
+
+	fflush(m_fp);
+
+	if (bWritten)
+		m_dwSegments++;
+
+	buffer->nLen = 0;
+	buffer->nPackets = 0;
+
+	return bWritten;
+}
+
+CArchiveReader::CArchiveReader(void)
+{
+	m_nSegments = 0;
+	m_dwPackets = 0;
+	m_nLoaded = 0;
+
+	m_lpSegments = NULL;
+	m_nMaxSegments = 0;
+
+	ZeroMemory(&m_query, sizeof(m_query));
+	m_query.dwMessage = ARCHIVE_ANY_MESSAGE;
+	m_nSegment = -1;
+	m_dwEntry = 0;
+	m_lpCurrent = NULL;
+
+	m_lpData = NULL;
+	m_nMaxData = 0;
+}
+
+CArchiveReader::~CArchiveReader(void)
+{
+	Close();
+}
+
+// Find every complete segment. One still being written at the end of a
+// live archive is left out.
+bool CArchiveReader::Open(const char *lpszPath)
+{
+	Close();
+
+	if (!m_file.Open(lpszPath) || m_file.m_stLen < sizeof(ARCHIVEHEADER))
+	{
+		Close();
+		return false;
+	}
+
+	ARCHIVEHEADER *lpHeader = (ARCHIVEHEADER *)m_file.m_lpData;
+
+	if (lpHeader->dwMagic != ARCHIVE_MAGIC || lpHeader->dwVersion != ARCHIVE_VERSION)
+	{
+		Close();
+		return false;
+	}
+
+	size_t stPos = sizeof(ARCHIVEHEADER);
+
+	while (m_file.m_stLen - stPos >= sizeof(ARCHIVESEGMENTHEADER))
+	{
+		ARCHIVESEGMENTHEADER *lpSegment = (ARCHIVESEGMENTHEADER *)&m_file.m_lpData[stPos];
+		size_t stMin = sizeof(ARCHIVESEGMENTHEADER) + sizeof(ARCHIVEFOOTER) + sizeof(ARCHIVETRAILER);
+
+		if (lpSegment->dwMagic != ARCHIVE_SEGMENT_MAGIC || lpSegment->dwLen < stMin || lpSegment->dwLen > m_file.m_stLen - stPos)
+			break;
+
+		ARCHIVETRAILER *lpTrailer = (ARCHIVETRAILER *)&m_file.m_lpData[stPos + lpSegment->dwLen - sizeof(ARCHIVETRAILER)];
+
+		if (lpTrailer->dwMagic != ARCHIVE_SEGMENT_MAGIC || lpTrailer->dwFooterLen < sizeof(ARCHIVEFOOTER) ||
+			lpTrailer->dwFooterLen > lpSegment->dwLen - sizeof(ARCHIVESEGMENTHEADER) - sizeof(ARCHIVETRAILER))
+			break;
+
+		ARCHIVEFOOTER *lpFooter = (ARCHIVEFOOTER *)((LPBYTE)lpTrailer - lpTrailer->dwFooterLen);
+		size_t stData = lpSegment->dwLen - sizeof(ARCHIVESEGMENTHEADER) - sizeof(ARCHIVETRAILER) - lpTrailer->dwFooterLen;
+
+		if (lpFooter->dwDataLen != stData || lpTrailer->dwFooterLen != sizeof(ARCHIVEFOOTER) +
+			lpFooter->wCircuits * sizeof(ARCHIVECIRCUIT) + (size_t)lpFooter->dwPackets * sizeof(ARCHIVEENTRY))
+			break;
+
+		if (m_nSegments >= m_nMaxSegments)
+		{
+			int nMax = m_nMaxSegments ? m_nMaxSegments * 2 : 256;
+			size_t *lpSegments = (size_t *)realloc(m_lpSegments, nMax * sizeof(size_t));
+
+			if (!lpSegments)
+			{
+				Close();
+				return false;
+			}
+
+			m_lpSegments = lpSegments;
+			m_nMaxSegments = nMax;
+		}
+
+		m_lpSegments[m_nSegments++] = stPos;
+		m_dwPackets += lpFooter->dwPackets;
+
+		stPos += lpSegment->dwLen;
+	}
+
+	Seek(&m_query);
+
+	return true;
+}
+
+void CArchiveReader::Close(void)
+{
+	m_file.Close();
+
+	SAFE_FREE(m_lpSegments);
+	SAFE_FREE(m_lpData);
+
+	m_nSegments = 0;
+	m_nMaxSegments = 0;
+	m_dwPackets = 0;
+	m_nMaxData = 0;
+	m_lpCurrent = NULL;
+}
+
+void CArchiveReader::Seek(ARCHIVEQUERY *lpQuery)
+{
+	if (lpQuery != &m_query)
+		memcpy(&m_query, lpQuery, sizeof(m_query));
+
+	m_nSegment = -1;
+	m_dwEntry = 0;
+	m_lpCurrent = NULL;
+	m_nLoaded = 0;
+}
+
+// The next packet matching the query, in the order they were written
+bool CArchiveReader::Next(LPARCHIVEPACKET lpPacket)
+{
+	ARCHIVEFOOTER *lpFooter = (m_nSegment >= 0) ? GetFooter(m_nSegment) : NULL;
+
+	for (;;)
+	{
+		while (!lpFooter || m_dwEntry >= lpFooter->dwPackets)
+		{
+			if (++m_nSegment >= m_nSegments)
+			{
+				m_nSegment = m_nSegments;
+				return false;
+			}
+
+			lpFooter = GetFooter(m_nSegment);
+			m_dwEntry = 0;
+			m_lpCurrent = NULL;
+
+			if (!Match(lpFooter))
+				lpFooter = NULL;
+		}
+
+		ARCHIVECIRCUIT *lpCircuits = (ARCHIVECIRCUIT *)(lpFooter + 1);
+		ARCHIVEENTRY *lpEntry = &((ARCHIVEENTRY *)(lpCircuits + lpFooter->wCircuits))[m_dwEntry++];
+		ULONGLONG ullTime = lpFooter->ullFirstTime + lpEntry->dwTime;
+
+		if (lpEntry->wCircuit >= lpFooter->wCircuits || !MatchCircuit(&lpCircuits[lpEntry->wCircuit]))
+			continue;
+
+		if (m_query.dwMessage != ARCHIVE_ANY_MESSAGE && lpEntry->dwMessage != m_query.dwMessage)
+			continue;
+
+		if ((m_query.ullFrom && ullTime < m_query.ullFrom) || (m_query.ullTo && ullTime > m_query.ullTo))
+			continue;
+
+		if (!m_lpCurrent && !Load(m_nSegment))
+		{
+			m_dwEntry = lpFooter->dwPackets;
+			continue;
+		}
+
+		if ((ULONGLONG)lpEntry->dwOffset + lpEntry->wLen > lpFooter->dwRawLen)
+			continue;
+
+		ZeroMemory(&lpPacket->address, sizeof(lpPacket->address));
+		lpPacket->address.sin_family = AF_INET;
+		lpPacket->address.sin_addr.s_addr = lpCircuits[lpEntry->wCircuit].dwAddress;
+		lpPacket->address.sin_port = lpCircuits[lpEntry->wCircuit].wPort;
+
+		lpPacket->ullTime = ullTime;
+		lpPacket->bSent = (lpEntry->cFlags & ARCHIVE_SENT) != 0;
+		lpPacket->dwMessage = lpEntry->dwMessage;
+		lpPacket->lpData = &m_lpCurrent[lpEntry->dwOffset];
+		lpPacket->nLen = lpEntry->wLen;
+
+		return true;
+	}
+}
+
+ARCHIVEFOOTER *CArchiveReader::GetFooter(int nSegment)
+{
+	LPBYTE lpSegment = &m_file.m_lpData[m_lpSegments[nSegment]];
+	ARCHIVETRAILER *lpTrailer = (ARCHIVETRAILER *)&lpSegment[((ARCHIVESEGMENTHEADER *)lpSegment)->dwLen - sizeof(ARCHIVETRAILER)];
+
+	return (ARCHIVEFOOTER *)((LPBYTE)lpTrailer - lpTrailer->dwFooterLen);
+}
+
+// Rule a segment out from its footer alone
+bool CArchiveReader::Match(ARCHIVEFOOTER *lpFooter)
+{
+	if ((m_query.ullFrom && lpFooter->ullLastTime < m_query.ullFrom) || (m_query.ullTo && lpFooter->ullFirstTime > m_query.ullTo))
+		return false;
+
+	if (m_query.dwMessage != ARCHIVE_ANY_MESSAGE)
+	{
+		int nBit = message_bit(m_query.dwMessage);
+
+		if (!(lpFooter->bMessages[nBit / 8] & (1 << (nBit % 8))))
+			return false;
+	}
+
+	ARCHIVECIRCUIT *lpCircuits = (ARCHIVECIRCUIT *)(lpFooter + 1);
+
+	for (int i = 0; i < lpFooter->wCircuits; i++)
+	{
+		if (MatchCircuit(&lpCircuits[i]))
+			return true;
+	}
+
+	return false;
+}
+
+bool CArchiveReader::MatchCircuit(ARCHIVECIRCUIT *lpCircuit)
+{
+	return (!m_query.dwAddress || lpCircuit->dwAddress == m_query.dwAddress) && (!m_query.wPort || lpCircuit->wPort == m_query.wPort);
+}
+
+// Stored data is read straight from the map; compressed data is unpacked
+// into a buffer kept between segments
+bool CArchiveReader::Load(int nSegment)
+{
+	ARCHIVEFOOTER *lpFooter = GetFooter(nSegment);
+	LPBYTE lpData = &m_file.m_lpData[m_lpSegments[nSegment] + sizeof(ARCHIVESEGMENTHEADER)];
+
+	m_nLoaded++;
+
+	if (lpFooter->cCompression == ARCHIVE_STORED)
+	{
+		if (lpFooter->dwRawLen != lpFooter->dwDataLen)
+			return false;
+
+		m_lpCurrent = lpData;
+		return true;
+	}
+
+	if (lpFooter->cCompression != ARCHIVE_LZ || lpFooter->dwRawLen > ARCHIVE_SEGMENT_LEN)
+		return false;
+
+	if ((int)lpFooter->dwRawLen > m_nMaxData)
+	{
+		LPBYTE lpNew = (LPBYTE)realloc(m_lpData, ARCHIVE_SEGMENT_LEN);
+
+		if (!lpNew)
+			return false;
+
+		m_lpData = lpNew;
+		m_nMaxData = ARCHIVE_SEGMENT_LEN;
+	}
+
+	if (lz_decompress(lpData, lpFooter->dwDataLen, m_lpData, lpFooter->dwRawLen) != (int)lpFooter->dwRawLen)
+		return false;
+
+	m_lpCurrent = m_lpData;
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "./MappedFile.h"
+
+#define ARCHIVE_MAGIC			0x52414e53	// "SNAR"
+#define ARCHIVE_VERSION			1
+#define ARCHIVE_SEGMENT_MAGIC	0x47455353	// "SSEG"
+
+// A segment is cut when either runs out, or after ARCHIVE_FLUSH_MS so a
+// live archive never lags far behind
+#define ARCHIVE_SEGMENT_LEN		(1 << 20)
+#define ARCHIVE_SEGMENT_PACKETS	4096
+#define ARCHIVE_FLUSH_MS		1000
+
+// Longest a segment may span, keeping entry times within a DWORD
+#define ARCHIVE_SEGMENT_SPAN	((ULONGLONG)600 * 1000000)
+
+// Segments filled by the hooks while earlier ones are being written out.
+// With all of them waiting, new packets are dropped rather than stall the
+// hooked thread, unless the archive was created to wait.
+#define ARCHIVE_BUFFERS			4
+
+#define ARCHIVE_STORED			0
+#define ARCHIVE_LZ				1
+
+#define ARCHIVE_SENT			0x01		// Sent by the viewer, otherwise received
+
+// Message numbers are hashed into this many bits per segment. A set bit
+// may be a collision, so a match still has to be checked packet by packet,
+// but a clear bit rules the segment out.
+#define ARCHIVE_BITMAP_BITS		2048
+
+#define ARCHIVE_ANY_MESSAGE		0xffffffff
+
+#pragma pack(push, 1)
+
+typedef struct
+{
+	DWORD dwMagic;
+	DWORD dwVersion;
+} ARCHIVEHEADER;
+
+// On disk a segment is this header, the packet data (compressed or not),
+// the footer, its circuits and entries, and the trailer. The footer lets a
+// reader rule the segment out without touching the data.
+typedef struct
+{
+	DWORD dwMagic;
+	DWORD dwLen;				// Whole segment, header and trailer included
+} ARCHIVESEGMENTHEADER;
+
+typedef struct
+{
+	ULONGLONG ullFirstTime;		// Microseconds since the epoch
+	ULONGLONG ullLastTime;
+	DWORD dwPackets;
+	DWORD dwRawLen;				// Packet data as written
+	DWORD dwDataLen;			// Packet data as stored
+	WORD wCircuits;
+	BYTE cCompression;
+	BYTE cReserved;
+	BYTE bMessages[ARCHIVE_BITMAP_BITS / 8];
+} ARCHIVEFOOTER;
+
+typedef struct
+{
+	DWORD dwAddress;			// Simulator's IPv4 address, network order
+	WORD wPort;					// Network order
+	WORD wReserved;
+	DWORD dwPackets;
+} ARCHIVECIRCUIT;
+
+typedef struct
+{
+	DWORD dwTime;				// Microseconds after the footer's first time
+	DWORD dwOffset;				// Into the packet data once decompressed
+	DWORD dwMessage;			// Message number, see message_number()
+	WORD wLen;
+	WORD wCircuit;
+	BYTE cFlags;
+	BYTE cReserved;
+	WORD wReserved;
+} ARCHIVEENTRY;
+
+typedef struct
+{
+	DWORD dwFooterLen;			// Footer, circuits and entries
+	DWORD dwMagic;
+} ARCHIVETRAILER;
+
+#pragma pack(pop)
+
+// A packet waiting in a segment buffer
+typedef struct
+{
+	ULONGLONG ullTime;
+	DWORD dwAddress;
+	WORD wPort;
+	WORD wLen;
+	BYTE cFlags;
+} ARCHIVEPENDING;
+
+typedef struct
+{
+	LPBYTE lpData;
+	int nLen;
+	ARCHIVEPENDING *lpPackets;
+	int nPackets;
+	ULONGLONG ullFirstTime;
+	ULONGLONG ullLastTime;
+	DWORD dwStarted;			// GetTickCount() of the first packet
+} ARCHIVEBUFFER;
+
+DWORD message_number(LPBYTE lpData, int nLen);
+
+// Writes an archive of packets in compressed, append only segments. The
+// hooks only copy a packet into the current segment; a writer thread
+// indexes, compresses and writes out segments once they fill up.
+class CArchive
+{
+public:
+	CArchive(void);
+	~CArchive(void);
+
+	bool Create(const char *lpszPath, bool bWait = false);
+	bool Write(LPBYTE lpData, int nLen, struct sockaddr_in *address, bool bSent, ULONGLONG ullTime = 0);
+	void Close(void);
+
+	DWORD m_dwWritten;
+	DWORD m_dwDropped;
+	DWORD m_dwSegments;
+
+protected:
+	static DWORD WINAPI ThreadProc(LPVOID lpParam);
+	void Run(void);
+	void Handoff(void);
+	bool Flush(ARCHIVEBUFFER *buffer);
+
+	FILE *m_fp;
+	bool m_bWait;
+
+	ARCHIVEBUFFER m_buffers[ARCHIVE_BUFFERS];
+	volatile LONG m_lFilled;	// Buffers handed to the writer so far
+	volatile LONG m_lFlushed;	// Buffers written out so far
+	CRITICAL_SECTION m_csWrite;
+
+	// The writer thread's own
+	LPBYTE m_lpSegment;
+	ARCHIVEENTRY *m_lpEntries;
+	ARCHIVECIRCUIT *m_lpCircuits;
+	int *m_lpCircuitTable;
+
+	HANDLE m_hWake;
+	HANDLE m_hThread;
+	volatile bool m_bStop;
+};
+
+// Which packets to read back. Zero times, a zero address or port, and
+// ARCHIVE_ANY_MESSAGE match anything.
+typedef struct
+{
+	ULONGLONG ullFrom;
+	ULONGLONG ullTo;
+	DWORD dwAddress;
+	WORD wPort;
+	DWORD dwMessage;
+} ARCHIVEQUERY;
+
+typedef struct
+{
+	ULONGLONG ullTime;
+	struct sockaddr_in address;
+	bool bSent;
+	DWORD dwMessage;
+	LPBYTE lpData;				// Good until the reader moves to the next segment
+	int nLen;
+} ARCHIVEPACKET, *LPARCHIVEPACKET;
+
+// Maps an archive and walks it segment by segment, skipping any whose
+// footer rules out the query. Only segments with a match are decompressed.
+class CArchiveReader
+{
+public:
+	CArchiveReader(void);
+	~CArchiveReader(void);
+
+	bool Open(const char *lpszPath);
+	void Close(void);
+	void Seek(ARCHIVEQUERY *lpQuery);
+	bool Next(LPARCHIVEPACKET lpPacket);
+
+	int m_nSegments;
+	DWORD m_dwPackets;
+	int m_nLoaded;				// Segments the last query had to decompress
+
+protected:
+	ARCHIVEFOOTER *GetFooter(int nSegment);
+	bool Match(ARCHIVEFOOTER *lpFooter);
+	bool MatchCircuit(ARCHIVECIRCUIT *lpCircuit);
+	bool Load(int nSegment);
+
+	CMappedFile m_file;
+	size_t *m_lpSegments;		// Offset of every segment header
+	int m_nMaxSegments;
+
+	ARCHIVEQUERY m_query;
+	int m_nSegment;
+	DWORD m_dwEntry;
+	LPBYTE m_lpCurrent;			// The segment's packet data, NULL until loaded
+
+	LPBYTE m_lpData;			// Decompression buffer
+	int m_nMaxData;
+};
\ No newline at end of file
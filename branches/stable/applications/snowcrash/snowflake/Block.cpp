@@ -1,85 +1,23 @@
-#include "StdAfx.h"
-#include ".\Block.h"
-#include ".\keywords.h"
+#include "stdafx.h"
+#include "./Block.h"
+#include "./keywords.h"
 
 CBlock::CBlock(void)
 {
+	cItems = 0;
 	m_lpVars = NULL;
-
-	m_lpPrev = NULL;
-	m_lpNext = NULL;
 }
 
 CBlock::~CBlock(void)
 {
 }
 
-void CBlock::FreeVars(void)
-{
-	CVar *var = m_lpVars;
-
-	while (var)
-	{
-		if (var->m_lpNext)
-		{
-			var = var->m_lpNext;
-
-			if (var->m_lpPrev)
-				SAFE_DELETE(var->m_lpPrev);
-		}
-		else
-			SAFE_DELETE(var);
-	}
-
-	m_lpVars = NULL;
-}
-
-bool CBlock::AddVar(CVar *lpVar)
-{
-	CVar *var = NULL;
-
-	if (m_lpVars)
-	{
-		var = m_lpVars;
-
-		while (var->m_lpNext)
-			var = var->m_lpNext;
-
-		var->m_lpNext = lpVar;
-
-		if (!var->m_lpNext) return false;
-
-		var->m_lpNext->m_lpNext = NULL;
-		var->m_lpNext->m_lpPrev = var;
-
-		return true;
-	}
-	else
-	{
-		var = lpVar;
-
-		if (!var) return false;
-
-		m_lpVars = var;
-		m_lpVars->m_lpNext = NULL;
-		m_lpVars->m_lpPrev = NULL;
-
-		return true;
-	}
-
-	return false;
-}
-
 CVar *CBlock::FindVar(char *lpszVar)
 {
-	CVar *var= m_lpVars;
-
-	while (var)
+	for (int i = 0; i < cItems; i++)
 	{
-		if (var->m_lpszVar && !stricmp(lpszVar, var->m_lpszVar))
-			return var;
-		
-		var = var->m_lpNext;
+		if (m_lpVars[i].m_lpszVar && !stricmp(lpszVar, m_lpVars[i].m_lpszVar))
+			return &m_lpVars[i];
 	}
 
 	return NULL;
@@ -87,15 +25,12 @@ CVar *CBlock::FindVar(char *lpszVar)
 
 int CBlock::CountVar(char *lpszVar)
 {
-	CVar *var= m_lpVars;
 	int nCount = 0;
 
-	while (var)
+	for (int i = 0; i < cItems; i++)
 	{
-		if (var->m_lpszVar && !stricmp(lpszVar, var->m_lpszVar))
+		if (m_lpVars[i].m_lpszVar && !stricmp(lpszVar, m_lpVars[i].m_lpszVar))
 			nCount++;
-		
-		var = var->m_lpNext;
 	}
 
 	return nCount;
@@ -103,28 +38,20 @@ int CBlock::CountVar(char *lpszVar)
 
 void CBlock::Dump(void)
 {
-	CVar *var = m_lpVars;
-
-	while (var)
-	{
-		var->Dump();
-		var = var->m_lpNext;
-	}
+	for (int i = 0; i < cItems; i++)
+		m_lpVars[i].Dump();
 }
 
 int CBlock::Pack(LPBYTE lpData)
 {
 	int nTotalWrote = 0;
-	int nWrote = 0;
 	LPBYTE lpPtr = lpData;
-	CVar *var = m_lpVars;
 
-	while (var)
+	for (int i = 0; i < cItems; i++)
 	{
-		nWrote = var->Pack(lpPtr);
+		int nWrote = m_lpVars[i].Pack(lpPtr);
 		lpPtr += nWrote;
 		nTotalWrote += nWrote;
-		var = var->m_lpNext;
 	}
 
 	return nTotalWrote;
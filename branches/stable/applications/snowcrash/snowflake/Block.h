@@ -1,6 +1,6 @@
 #pragma once
 
-#include ".\Var.h"
+#include "./Var.h"
 
 class CBlock
 {
@@ -10,13 +10,9 @@ public:
 
 	BYTE cItems;
 	
+	// Slice of the owning message's field array
 	CVar *m_lpVars;
 
-	CBlock *m_lpNext;
-	CBlock *m_lpPrev;
-
-	void FreeVars(void);
-	bool AddVar(CVar *lpVar);
 	CVar *FindVar(char *lpszVar);
 	int CountVar(char *lpszVar);
 	void Dump(void);
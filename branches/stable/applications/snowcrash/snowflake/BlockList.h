@@ -1,6 +1,6 @@
 #pragma once
 
-#include ".\Block.h"
+#include "./Block.h"
 
 class CBlockList
 {
@@ -8,16 +8,13 @@ public:
 	CBlockList(void);
 	~CBlockList(void);
 
+	// Slice of the owning message's block array
 	CBlock	*m_lpBlocks;
+	// Points into the message template, not owned
 	char *m_lpszBlock;
 	int m_nType;
 	BYTE cItems;
-	
-	CBlockList *m_lpNext;
-	CBlockList *m_lpPrev;
 
-	void FreeBlocks(void);
-	bool AddBlock(CBlock *lpBlock);
 	CBlock *GetBlock(int nIndex = 0);
 	int CountBlock(void);
 	void Dump(void);
@@ -0,0 +1,135 @@
+#include "stdafx.h"
+#include "./Capture.h"
+
+CCapture::CCapture(void)
+{
+	m_fp = NULL;
+	m_lpLoaded = NULL;
+	m_nLoaded = 0;
+	m_nPos = 0;
+	m_nRecords = 0;
+}
+
+CCapture::~CCapture(void)
+{
+	Close();
+}
+
+bool CCapture::Create(const char *lpszPath)
+{
+	CAPTUREHEADER header;
+
+	Close();
+
+	m_fp = fopen(lpszPath, "wb");
+
+	if (!m_fp)
+		return false;
+
+	header.dwMagic = CAPTURE_MAGIC;
+	header.dwVersion = CAPTURE_VERSION;
+
+	return fwrite(&header, sizeof(header), 1, m_fp) == 1;
+}
+
+bool CCapture::Write(LPBYTE lpData, int nLen, struct sockaddr_in *address, bool bSent)
+{
+	BYTE bRecord[sizeof(CAPTURERECORD) + CAPTURE_MAX_PACKET];
+	CAPTURERECORD *record = (CAPTURERECORD *)bRecord;
+
+	if (!m_fp || nLen <= 0 || nLen > CAPTURE_MAX_PACKET)
+		return false;
+
+	record->dwTime = GetTickCount();
+	record->dwAddress = address->sin_addr.s_addr;
+	record->wPort = address->sin_port;
+	record->cFlags = bSent ? CAPTURE_SENT : 0;
+	record->cReserved = 0;
+	record->wLen = (WORD)nLen;
+	memcpy(&bRecord[sizeof(CAPTURERECORD)], lpData, nLen);
+
+	m_nRecords++;
+
+	return fwrite(bRecord, sizeof(CAPTURERECORD) + nLen, 1, m_fp) == 1;
+}
+
+// Read a whole capture into memory for replay
+bool CCapture::Load(const char *lpszPath)
+{
+	CAPTUREHEADER header;
+
+	Close();
+
+	FILE *fp = fopen(lpszPath, "rb");
+
+	if (!fp)
+		return false;
+
+	fseek(fp, 0, SEEK_END);
+	long lSize = ftell(fp) - (long)sizeof(header);
+	fseek(fp, 0, SEEK_SET);
+
+	if (lSize < 0 || fread(&header, sizeof(header), 1, fp) != 1 ||
+		header.dwMagic != CAPTURE_MAGIC || header.dwVersion != CAPTURE_VERSION)
+	{
+		fclose(fp);
+		return false;
+	}
+
+	m_lpLoaded = (LPBYTE)malloc(lSize > 0 ? lSize : 1);
+
+	if (!m_lpLoaded || (lSize > 0 && fread(m_lpLoaded, lSize, 1, fp) != 1))
+	{
+		fclose(fp);
+		Close();
+		return false;
+	}
+
+	fclose(fp);
+
+	m_nLoaded = (int)lSize;
+	m_nRecords = 0;
+
+	for (int nPos = 0; nPos + (int)sizeof(CAPTURERECORD) <= m_nLoaded; m_nRecords++)
+		nPos += sizeof(CAPTURERECORD) + ((CAPTURERECORD *)&m_lpLoaded[nPos])->wLen;
+
+	Rewind();
+
+	return true;
+}
+
+// Step through a loaded capture. A record cut short at the end is ignored.
+bool CCapture::Next(CAPTURERECORD **lpRecord, LPBYTE *lpData)
+{
+	if (m_nPos + (int)sizeof(CAPTURERECORD) > m_nLoaded)
+		return false;
+
+	CAPTURERECORD *record = (CAPTURERECORD *)&m_lpLoaded[m_nPos];
+
+	if (m_nPos + (int)sizeof(CAPTURERECORD) + record->wLen > m_nLoaded)
+		return false;
+
+	*lpRecord = record;
+	*lpData = &m_lpLoaded[m_nPos + sizeof(CAPTURERECORD)];
+	m_nPos += sizeof(CAPTURERECORD) + record->wLen;
+
+	return true;
+}
+
+void CCapture::Rewind(void)
+{
+	m_nPos = 0;
+}
+
+void CCapture::Close(void)
+{
+	if (m_fp)
+	{
+		fclose(m_fp);
+		m_fp = NULL;
+	}
+
+	SAFE_FREE(m_lpLoaded);
+	m_nLoaded = 0;
+	m_nPos = 0;
+}
\ No newline at end of file
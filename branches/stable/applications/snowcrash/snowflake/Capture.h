@@ -0,0 +1,55 @@
+#pragma once
+
+#define CAPTURE_MAGIC		0x50414e53	// "SNAP"
+#define CAPTURE_VERSION		1
+
+#define CAPTURE_SENT		0x01		// Sent by the viewer, otherwise received
+
+#pragma pack(push, 1)
+
+typedef struct
+{
+	DWORD dwMagic;
+	DWORD dwVersion;
+} CAPTUREHEADER;
+
+// One packet as it was on the wire, followed by wLen bytes of data
+typedef struct
+{
+	DWORD dwTime;			// GetTickCount() when seen
+	DWORD dwAddress;		// Remote IPv4 address, network order
+	WORD wPort;				// Remote port, network order
+	BYTE cFlags;
+	BYTE cReserved;
+	WORD wLen;
+} CAPTURERECORD;
+
+#pragma pack(pop)
+
+#define CAPTURE_MAX_PACKET	8192
+
+// Raw log of the packets passing through the hooks, so a session can be
+// replayed offline. Records are appended with a single write each, so both
+// hooked threads can share one capture.
+class CCapture
+{
+public:
+	CCapture(void);
+	~CCapture(void);
+
+	bool Create(const char *lpszPath);
+	bool Write(LPBYTE lpData, int nLen, struct sockaddr_in *address, bool bSent);
+	bool Load(const char *lpszPath);
+	bool Next(CAPTURERECORD **lpRecord, LPBYTE *lpData);
+	void Rewind(void);
+	void Close(void);
+
+	int m_nRecords;
+
+protected:
+	FILE *m_fp;
+
+	LPBYTE m_lpLoaded;
+	int m_nLoaded;
+	int m_nPos;
+};
\ No newline at end of file
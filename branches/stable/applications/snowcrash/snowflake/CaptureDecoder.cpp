@@ -0,0 +1,436 @@
+#include "stdafx.h"
+#include "./CaptureDecoder.h"
+#include "./Decoder.h"
+
+// Grow an array to hold at least dwNeed entries, keeping its contents
+static bool grow_array(void **lpArray, DWORD &dwMax, DWORD dwNeed, size_t stSize)
+{
+	if (dwNeed <= dwMax)
+		return true;
+
+	DWORD dwNewMax = (dwMax > 0) ? dwMax : 1024;
+
+	while (dwNewMax < dwNeed)
+		dwNewMax *= 2;
+
+	void *lpNew = realloc(*lpArray, dwNewMax * stSize);
+
+	if (!lpNew)
+		return false;
+
+	*lpArray = lpNew;
+	dwMax = dwNewMax;
+
+	return true;
+}
+
+static int compare_streams(const void *a, const void *b)
+{
+	DWORD dwA = (*(LPDECODESTREAM *)a)->dwPackets;
+	DWORD dwB = (*(LPDECODESTREAM *)b)->dwPackets;
+
+	return (dwA < dwB) ? 1 : (dwA > dwB) ? -1 : 0;
+}
+
+// Timestamp order, keeping the capture's order between equal stamps
+static int compare_results(const void *a, const void *b)
+{
+	LPDECODERESULT lpA = (LPDECODERESULT)a;
+	LPDECODERESULT lpB = (LPDECODERESULT)b;
+
+	if (lpA->ullTime != lpB->ullTime)
+		return (lpA->ullTime < lpB->ullTime) ? -1 : 1;
+
+	return (lpA->dwPacket < lpB->dwPacket) ? -1 : (lpA->dwPacket > lpB->dwPacket) ? 1 : 0;
+}
+
+CDecodeWorker::CDecodeWorker(void)
+{
+	m_lpStreams = NULL;
+	m_nHead = 0;
+	m_nTail = 0;
+
+	m_hThread = NULL;
+	m_lpDecoder = NULL;
+	m_dwPackets = 0;
+	m_dwStolen = 0;
+
+	InitializeCriticalSection(&m_csStreams);
+}
+
+CDecodeWorker::~CDecodeWorker(void)
+{
+	SAFE_FREE(m_lpStreams);
+	DeleteCriticalSection(&m_csStreams);
+}
+
+// Streams are whole circuits, so the lock is taken once per circuit rather
+// than per packet
+int CDecodeWorker::Pop(void)
+{
+	int nStream = -1;
+
+	EnterCriticalSection(&m_csStreams);
+
+	if (m_nHead < m_nTail)
+		nStream = m_lpStreams[m_nHead++];
+
+	LeaveCriticalSection(&m_csStreams);
+
+	return nStream;
+}
+
+int CDecodeWorker::Steal(void)
+{
+	int nStream = -1;
+
+	EnterCriticalSection(&m_csStreams);
+
+	if (m_nHead < m_nTail)
+		nStream = m_lpStreams[--m_nTail];
+
+	LeaveCriticalSection(&m_csStreams);
+
+	return nStream;
+}
+
+CCaptureDecoder::CCaptureDecoder(void)
+{
+	m_lpPackets = NULL;
+	m_dwPackets = 0;
+	m_dwMaxPackets = 0;
+
+	m_lpStreams = NULL;
+	m_nStreams = 0;
+	m_dwMaxStreams = 0;
+
+	m_lpResults = NULL;
+	m_dwDecoded = 0;
+	m_dwStolen = 0;
+
+	m_lpOrder = NULL;
+	m_lpTable = NULL;
+	m_nTableSize = 0;
+
+	m_lpWorkers = NULL;
+	m_nWorkers = 0;
+}
+
+CCaptureDecoder::~CCaptureDecoder(void)
+{
+	Free();
+}
+
+void CCaptureDecoder::Free(void)
+{
+	SAFE_FREE(m_lpPackets);
+	SAFE_FREE(m_lpStreams);
+	SAFE_FREE(m_lpResults);
+	SAFE_FREE(m_lpOrder);
+	SAFE_FREE(m_lpTable);
+
+	m_dwPackets = m_dwMaxPackets = 0;
+	m_nStreams = 0;
+	m_dwMaxStreams = 0;
+	m_nTableSize = 0;
+	m_dwDecoded = 0;
+	m_dwStolen = 0;
+}
+
+// Packets of a circuit must be added in the order they were seen
+bool CCaptureDecoder::Add(ULONGLONG ullTime, struct sockaddr_in *address, LPBYTE lpData, int nLen, bool bSent)
+{
+	if (!grow_array((void **)&m_lpPackets, m_dwMaxPackets, m_dwPackets + 1, sizeof(DECODEPACKET)))
+		return false;
+
+	LPDECODEPACKET lpPacket = &m_lpPackets[m_dwPackets++];
+
+	lpPacket->ullTime = ullTime;
+	memcpy(&lpPacket->address, address, sizeof(lpPacket->address));
+	lpPacket->lpData = lpData;
+	lpPacket->nLen = nLen;
+	lpPacket->bSent = bSent;
+	lpPacket->nStream = -1;
+
+	// Anything added since the last index needs indexing again
+	SAFE_FREE(m_lpOrder);
+
+	return true;
+}
+
+// Split the packets into streams: count each circuit's packets while
+// finding its stream, then lay the streams out end to end in the order
+// table. Two passes over the packets and no per stream allocations.
+bool CCaptureDecoder::Index(void)
+{
+	SAFE_FREE(m_lpOrder);
+	SAFE_FREE(m_lpTable);
+	m_nTableSize = 0;
+	m_nStreams = 0;
+
+	for (DWORD i = 0; i < m_dwPackets; i++)
+	{
+		LPDECODEPACKET lpPacket = &m_lpPackets[i];
+
+		lpPacket->nStream = FindStream(&lpPacket->address);
+
+		if (lpPacket->nStream < 0)
+			return false;
+
+		m_lpStreams[lpPacket->nStream].dwPackets++;
+	}
+
+	m_lpOrder = (DWORD *)malloc((m_dwPackets ? m_dwPackets : 1) * sizeof(DWORD));
+
+	if (!m_lpOrder)
+		return false;
+
+	DWORD dwFirst = 0;
+
+	for (int i = 0; i < m_nStreams; i++)
+	{
+		m_lpStreams[i].dwFirst = dwFirst;
+		dwFirst += m_lpStreams[i].dwPackets;
+		m_lpStreams[i].dwPackets = 0;
+	}
+
+	for (DWORD i = 0; i < m_dwPackets; i++)
+	{
+		LPDECODESTREAM stream = &m_lpStreams[m_lpPackets[i].nStream];
+
+		m_lpOrder[stream->dwFirst + stream->dwPackets++] = i;
+	}
+
+	return true;
+}
+
+// Decode every stream on nThreads threads, each with circuits of its own.
+// Nothing is kept between calls, so the same capture can be decoded again
+// with a different number of threads.
+bool CCaptureDecoder::Decode(int nThreads, int nCommands)
+{
+	if (!m_lpOrder && !Index())
+		return false;
+
+	if (nThreads > MAX_DECODE_THREADS)
+		nThreads = MAX_DECODE_THREADS;
+
+	if (nThreads > m_nStreams)
+		nThreads = m_nStreams;
+
+	if (nThreads < 1)
+		nThreads = 1;
+
+	SAFE_FREE(m_lpResults);
+	m_lpResults = (LPDECODERESULT)malloc((m_dwPackets ? m_dwPackets : 1) * sizeof(DECODERESULT));
+
+	LPDECODESTREAM *lpSorted = (LPDECODESTREAM *)malloc((m_nStreams ? m_nStreams : 1) * sizeof(LPDECODESTREAM));
+
+	m_lpWorkers = new CDecodeWorker[nThreads];
+	m_nWorkers = m_lpWorkers ? nThreads : 0;
+
+	bool bStarted = (m_lpResults && lpSorted && m_lpWorkers);
+
+	// Deal the streams out largest first, so the long ones start early and
+	// what is left to steal at the end is short
+	if (bStarted)
+	{
+		for (int i = 0; i < m_nStreams; i++)
+			lpSorted[i] = &m_lpStreams[i];
+
+		qsort(lpSorted, m_nStreams, sizeof(LPDECODESTREAM), compare_streams);
+
+		for (int i = 0; i < nThreads && bStarted; i++)
+		{
+			CDecodeWorker *worker = &m_lpWorkers[i];
+
+			worker->m_lpDecoder = this;
+			worker->m_lpStreams = (int *)malloc((m_nStreams / nThreads + 1) * sizeof(int));
+
+			if (!worker->m_lpStreams || !worker->m_shard.m_scratch.Init(nCommands))
+				bStarted = false;
+		}
+
+		for (int i = 0; i < m_nStreams && bStarted; i++)
+		{
+			CDecodeWorker *worker = &m_lpWorkers[i % nThreads];
+
+			worker->m_lpStreams[worker->m_nTail++] = (int)(lpSorted[i] - m_lpStreams);
+		}
+	}
+
+	SAFE_FREE(lpSorted);
+
+	for (int i = 0; i < nThreads && bStarted; i++)
+	{
+		m_lpWorkers[i].m_hThread = CreateThread(NULL, 0, ThreadProc, &m_lpWorkers[i], 0, NULL);
+
+		if (!m_lpWorkers[i].m_hThread)
+			bStarted = false;
+	}
+
+	m_dwDecoded = 0;
+	m_dwStolen = 0;
+
+	for (int i = 0; i < m_nWorkers; i++)
+	{
+		CDecodeWorker *worker = &m_lpWorkers[i];
+
+		// Threads that did start drain the streams of any that didn't
+		if (worker->m_hThread)
+		{
+			WaitForSingleObject(worker->m_hThread, INFINITE);
+			CloseHandle(worker->m_hThread);
+			worker->m_hThread = NULL;
+		}
+
+		worker->m_shard.m_scratch.MergeStats();
+		m_dwDecoded += worker->m_dwPackets;
+		m_dwStolen += worker->m_dwStolen;
+	}
+
+	SAFE_DELETE_ARRAY(m_lpWorkers);
+	m_nWorkers = 0;
+
+	if (!bStarted)
+	{
+		SAFE_FREE(m_lpResults);
+		return false;
+	}
+
+	Merge();
+
+	return true;
+}
+
+DWORD WINAPI CCaptureDecoder::ThreadProc(LPVOID lpParam)
+{
+	CDecodeWorker *worker = (CDecodeWorker *)lpParam;
+
+	worker->m_lpDecoder->Run(worker);
+
+	return 0;
+}
+
+// Work through our own streams, then steal from the others until there is
+// nothing left anywhere. No new streams turn up once decoding has started.
+void CCaptureDecoder::Run(CDecodeWorker *worker)
+{
+	int nSelf = (int)(worker - m_lpWorkers);
+
+	for (;;)
+	{
+		int nStream = worker->Pop();
+
+		for (int i = 1; nStream < 0 && i < m_nWorkers; i++)
+		{
+			nStream = m_lpWorkers[(nSelf + i) % m_nWorkers].Steal();
+
+			if (nStream >= 0)
+				worker->m_dwStolen++;
+		}
+
+		if (nStream < 0)
+			break;
+
+		DecodeStream(worker, nStream);
+	}
+}
+
+// Results go to the packet's own slot, so workers never share one
+void CCaptureDecoder::DecodeStream(CDecodeWorker *worker, int nStream)
+{
+	LPDECODESTREAM stream = &m_lpStreams[nStream];
+
+	for (DWORD i = 0; i < stream->dwPackets; i++)
+	{
+		DWORD dwPacket = m_lpOrder[stream->dwFirst + i];
+		LPDECODEPACKET lpPacket = &m_lpPackets[dwPacket];
+		LPDECODERESULT lpResult = &m_lpResults[dwPacket];
+
+		lpResult->ullTime = lpPacket->ullTime;
+		lpResult->dwPacket = dwPacket;
+		lpResult->nStream = nStream;
+		lpResult->bSent = lpPacket->bSent;
+		lpResult->lpCommand = decode_packet(&worker->m_shard.m_servers, &worker->m_shard, lpPacket->lpData, lpPacket->nLen, &lpPacket->address, lpPacket->bSent,
+			lpPacket->ullTime);
+
+		if (lpResult->lpCommand)
+			worker->m_dwPackets++;
+	}
+}
+
+// Results are already in capture order, which is nearly always timestamp
+// order too; only a capture merged from several interfaces needs sorting
+void CCaptureDecoder::Merge(void)
+{
+	for (DWORD i = 1; i < m_dwPackets; i++)
+	{
+		if (m_lpResults[i].ullTime < m_lpResults[i - 1].ullTime)
+		{
+			qsort(m_lpResults, m_dwPackets, sizeof(DECODERESULT), compare_results);
+			break;
+		}
+	}
+}
+
+int CCaptureDecoder::FindStream(struct sockaddr_in *address)
+{
+	if ((m_nStreams + 1) * 2 > m_nTableSize && !GrowTable())
+		return -1;
+
+	int nMask = m_nTableSize - 1;
+	int i = CServerList::HashAddress(address) & nMask;
+
+	while (m_lpTable[i] >= 0)
+	{
+		LPDECODESTREAM stream = &m_lpStreams[m_lpTable[i]];
+
+		if (stream->address.sin_addr.s_addr == address->sin_addr.s_addr && stream->address.sin_port == address->sin_port)
+			return m_lpTable[i];
+
+		i = (i + 1) & nMask;
+	}
+
+	if (!grow_array((void **)&m_lpStreams, m_dwMaxStreams, m_nStreams + 1, sizeof(DECODESTREAM)))
+		return -1;
+
+	LPDECODESTREAM stream = &m_lpStreams[m_nStreams];
+
+	memcpy(&stream->address, address, sizeof(stream->address));
+	stream->dwFirst = 0;
+	stream->dwPackets = 0;
+
+	m_lpTable[i] = m_nStreams;
+
+	return m_nStreams++;
+}
+
+// Double the table and put every stream back in it
+bool CCaptureDecoder::GrowTable(void)
+{
+	int nSize = m_nTableSize ? m_nTableSize * 2 : 256;
+	int *lpTable = (int *)malloc(nSize * sizeof(int));
+
+	if (!lpTable)
+		return false;
+
+	for (int i = 0; i < nSize; i++)
+		lpTable[i] = -1;
+
+	for (int s = 0; s < m_nStreams; s++)
+	{
+		int i = CServerList::HashAddress(&m_lpStreams[s].address) & (nSize - 1);
+
+		while (lpTable[i] >= 0)
+			i = (i + 1) & (nSize - 1);
+
+		lpTable[i] = s;
+	}
+
+	SAFE_FREE(m_lpTable);
+	m_lpTable = lpTable;
+	m_nTableSize = nSize;
+
+	return true;
+}
\ No newline at end of file
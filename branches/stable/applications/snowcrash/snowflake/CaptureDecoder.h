@@ -0,0 +1,111 @@
+#pragma once
+
+#include "./Template.h"
+#include "./Shard.h"
+
+#define MAX_DECODE_THREADS	MAX_SHARDS
+
+class CCaptureDecoder;
+
+// One packet of a capture, pointing at its data wherever the capture is
+// held, which has to stay put until the decode is done
+typedef struct
+{
+	ULONGLONG ullTime;				// Microseconds
+	struct sockaddr_in address;		// The simulator's end of the circuit
+	LPBYTE lpData;
+	int nLen;
+	bool bSent;
+	int nStream;					// Filled in by Index
+} DECODEPACKET, *LPDECODEPACKET;
+
+// What became of one packet
+typedef struct
+{
+	ULONGLONG ullTime;
+	DWORD dwPacket;					// Index of the packet as it was added
+	int nStream;
+	LPCOMMAND lpCommand;			// NULL for a duplicate or unreadable packet
+	bool bSent;
+} DECODERESULT, *LPDECODERESULT;
+
+// Every packet of one circuit, in the order they were added
+typedef struct
+{
+	struct sockaddr_in address;
+	DWORD dwFirst;					// First entry in the stream order table
+	DWORD dwPackets;
+} DECODESTREAM, *LPDECODESTREAM;
+
+// A decode thread. Its circuits and scratch are kept in a shard that is
+// never started, so handlers find them as they would on a live shard. The
+// streams it has yet to decode are taken from the front by the worker and
+// from the back by thieves.
+class CDecodeWorker
+{
+public:
+	CDecodeWorker(void);
+	~CDecodeWorker(void);
+
+	CShard m_shard;
+
+	int *m_lpStreams;
+	int m_nHead;
+	int m_nTail;
+
+	HANDLE m_hThread;
+	CCaptureDecoder *m_lpDecoder;
+	DWORD m_dwPackets;
+	DWORD m_dwStolen;
+
+	int Pop(void);
+	int Steal(void);
+
+protected:
+	CRITICAL_SECTION m_csStreams;
+};
+
+// Decodes a whole capture across threads. An indexing pass splits the
+// packets into one stream per circuit, and each stream is decoded in order
+// by a single thread since sequence and ack state is per circuit. Streams
+// are dealt out largest first and idle threads steal whole streams from
+// busy ones. Results come back in timestamp order.
+class CCaptureDecoder
+{
+public:
+	CCaptureDecoder(void);
+	~CCaptureDecoder(void);
+
+	LPDECODEPACKET m_lpPackets;
+	DWORD m_dwPackets;
+
+	LPDECODESTREAM m_lpStreams;
+	int m_nStreams;
+
+	LPDECODERESULT m_lpResults;		// One per packet after Decode
+	DWORD m_dwDecoded;				// Packets that were dispatched
+	DWORD m_dwStolen;
+
+	bool Add(ULONGLONG ullTime, struct sockaddr_in *address, LPBYTE lpData, int nLen, bool bSent);
+	bool Index(void);
+	bool Decode(int nThreads, int nCommands);
+	void Free(void);
+
+protected:
+	static DWORD WINAPI ThreadProc(LPVOID lpParam);
+	void Run(CDecodeWorker *worker);
+	void DecodeStream(CDecodeWorker *worker, int nStream);
+	void Merge(void);
+	int FindStream(struct sockaddr_in *address);
+	bool GrowTable(void);
+
+	DWORD m_dwMaxPackets;
+	DWORD m_dwMaxStreams;
+	DWORD *m_lpOrder;				// Packet indices grouped by stream
+
+	int *m_lpTable;					// Open addressed, stream index or -1
+	int m_nTableSize;
+
+	CDecodeWorker *m_lpWorkers;
+	int m_nWorkers;
+};
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include "stdafx.h"
+#include "./Compress.h"
+
+static DWORD read32(LPBYTE lpData)
+{
+	DWORD dwValue;
+	memcpy(&dwValue, lpData, sizeof(dwValue));
+
+	return dwValue;
+}
+
+static int lz_hash(DWORD dwValue)
+{
+	return (int)((dwValue * 2654435761U) >> (32 - LZ_HASH_BITS));
+}
+
+// A length that doesn't fit its nibble carries on in bytes of 255 and a
+// remainder
+static bool write_length(LPBYTE *lpOut, LPBYTE lpEnd, int nLen)
+{
+	while (nLen >= 255)
+	{
+		if (*lpOut >= lpEnd)
+			return false;
+
+		*(*lpOut)++ = 255;
+		nLen -= 255;
+	}
+
+	if (*lpOut >= lpEnd)
+		return false;
+
+	*(*lpOut)++ = (BYTE)nLen;
+
+	return true;
+}
+
+static bool read_length(LPBYTE *lpIn, LPBYTE lpEnd, int *nLen)
+{
+	BYTE c;
+
+	do
+	{
+		if (*lpIn >= lpEnd)
+			return false;
+
+		c = *(*lpIn)++;
+		*nLen += c;
+	}
+	while (c == 255);
+
+	return true;
+}
+
+// One sequence: literals, then a match unless it is the last
+static bool write_sequence(LPBYTE *lpOut, LPBYTE lpEnd, LPBYTE lpLiterals, int nLiterals, int nOffset, int nMatch)
+{
+	int nMatchCode = nMatch ? nMatch - LZ_MIN_MATCH : 0;
+
+	if (*lpOut >= lpEnd)
+		return false;
+
+	*(*lpOut)++ = (BYTE)(((nLiterals < 15 ? nLiterals : 15) << 4) | (nMatchCode < 15 ? nMatchCode : 15));
+
+	if (nLiterals >= 15 && !write_length(lpOut, lpEnd, nLiterals - 15))
+		return false;
+
+	if (lpEnd - *lpOut < nLiterals)
+		return false;
+
+	memcpy(*lpOut, lpLiterals, nLiterals);
+	*lpOut += nLiterals;
+
+	if (!nMatch)
+		return true;
+
+	if (lpEnd - *lpOut < 2)
+		return false;
+
+	*(*lpOut)++ = (BYTE)(nOffset & 0xff);
+	*(*lpOut)++ = (BYTE)(nOffset >> 8);
+
+	if (nMatchCode >= 15 && !write_length(lpOut, lpEnd, nMatchCode - 15))
+		return false;
+
+	return true;
+}
+
+// Greedy matching against the last position each 4 byte hash was seen at.
+// Misses step further the longer they run, so data that doesn't compress
+// goes through quickly. Returns the compressed length, or -1 if it would
+// not fit in nDestLen.
+int lz_compress(LPBYTE lpSrc, int nSrcLen, LPBYTE lpDest, int nDestLen)
+{
+	int nTable[1 << LZ_HASH_BITS];
+	LPBYTE lpOut = lpDest;
+	LPBYTE lpEnd = lpDest + nDestLen;
+	int nAnchor = 0;
+	int nPos = 0;
+
+	for (int i = 0; i < (1 << LZ_HASH_BITS); i++)
+		nTable[i] = -1;
+
+	while (nPos + LZ_MIN_MATCH <= nSrcLen)
+	{
+		DWORD dwValue = read32(&lpSrc[nPos]);
+		int nHash = lz_hash(dwValue);
+		int nRef = nTable[nHash];
+
+		nTable[nHash] = nPos;
+
+		if (nRef < 0 || nPos - nRef > LZ_MAX_OFFSET || read32(&lpSrc[nRef]) != dwValue)
+		{
+			nPos += 1 + ((nPos - nAnchor) >> 6);
+			continue;
+		}
+
+		int nMatch = LZ_MIN_MATCH;
+
+		while (nPos + nMatch < nSrcLen && lpSrc[nRef + nMatch] == lpSrc[nPos + nMatch])
+			nMatch++;
+
+		if (!write_sequence(&lpOut, lpEnd, &lpSrc[nAnchor], nPos - nAnchor, nPos - nRef, nMatch))
+			return -1;
+
+		nPos += nMatch;
+		nAnchor = nPos;
+	}
+
+	if (!write_sequence(&lpOut, lpEnd, &lpSrc[nAnchor], nSrcLen - nAnchor, 0, 0))
+		return -1;
+
+	return (int)(lpOut - lpDest);
+}
+
+// Returns the decompressed length, or -1 for input that is corrupt or
+// would overrun nDestLen
+int lz_decompress(LPBYTE lpSrc, int nSrcLen, LPBYTE lpDest, int nDestLen)
+{
+	LPBYTE lpIn = lpSrc;
+	LPBYTE lpInEnd = lpSrc + nSrcLen;
+	LPBYTE lpOut = lpDest;
+	LPBYTE lpOutEnd = lpDest + nDestLen;
+
+	while (lpIn < lpInEnd)
+	{
+		BYTE cToken = *lpIn++;
+		int nLiterals = cToken >> 4;
+
+		if (nLiterals == 15 && !read_length(&lpIn, lpInEnd, &nLiterals))
+			return -1;
+
+		if (lpInEnd - lpIn < nLiterals || lpOutEnd - lpOut < nLiterals)
+			return -1;
+
+		memcpy(lpOut, lpIn, nLiterals);
+		lpIn += nLiterals;
+		lpOut += nLiterals;
+
+		// The last sequence is literals only
+		if (lpIn == lpInEnd)
+			break;
+
+		if (lpInEnd - lpIn < 2)
+			return -1;
+
+		int nOffset = lpIn[0] | (lpIn[1] << 8);
+		int nMatch = (cToken & 15) + LZ_MIN_MATCH;
+
+		lpIn += 2;
+
+		if ((cToken & 15) == 15 && !read_length(&lpIn, lpInEnd, &nMatch))
+			return -1;
+
+		if (!nOffset || nOffset > lpOut - lpDest || lpOutEnd - lpOut < nMatch)
+			return -1;
+
+		// Byte at a time, as the match may overlap what it is copying
+		LPBYTE lpMatch = lpOut - nOffset;
+
+		for (int i = 0; i < nMatch; i++)
+			*lpOut++ = *lpMatch++;
+	}
+
+	return (int)(lpOut - lpDest);
+}
\ No newline at end of file
@@ -0,0 +1,15 @@
+#pragma once
+
+// Byte oriented LZ77 in the style of LZ4 blocks: a token with the literal
+// and match lengths in its two nibbles, the literals, then a two byte
+// little endian offset back into what has already been written. Quick
+// enough to run at capture rate and needs no outside library.
+#define LZ_MIN_MATCH		4
+#define LZ_MAX_OFFSET		65535
+#define LZ_HASH_BITS		12
+
+// Worst case output for nLen bytes that don't compress at all
+#define LZ_BOUND(nLen)		((nLen) + (nLen) / 255 + 16)
+
+int lz_compress(LPBYTE lpSrc, int nSrcLen, LPBYTE lpDest, int nDestLen);
+int lz_decompress(LPBYTE lpSrc, int nSrcLen, LPBYTE lpDest, int nDestLen);
\ No newline at end of file
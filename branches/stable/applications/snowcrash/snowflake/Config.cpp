@@ -1,5 +1,5 @@
-#include "StdAfx.h"
-#include ".\Config.h"
+#include "stdafx.h"
+#include "./Config.h"
 
 CConfig::CConfig()
 {
@@ -30,6 +30,12 @@ void CConfig::LoadConfig()
 
 			::PathCombine(lpszPath, szItem, "snowcrash.txt");
 			m_pSnowcrashTxtPath = lpszPath;
+
+			::PathCombine(lpszPath, szItem, "snowcrash_verify.txt");
+			m_pVerifyReportPath = lpszPath;
+
+			::PathCombine(lpszPath, szItem, "snowcrash_latency.txt");
+			m_pLatencyReportPath = lpszPath;
 		}
 		RegCloseKey(hKey);
 	}
@@ -6,6 +6,8 @@ public:
 	CString m_pCommDatPath;
 	CString m_pMessageTemplatePath;
 	CString m_pSnowcrashTxtPath;
+	CString m_pVerifyReportPath;
+	CString m_pLatencyReportPath;
 
 	unsigned int GetConfigInt(LPSTR lpSection, LPSTR lpSubKey, UINT iDefault);
 	BOOL GetConfigBool(LPSTR lpSection, LPSTR lpSubKey, BOOL bDefault);
@@ -0,0 +1,1137 @@
+#include "stdafx.h"
+#include "./Decoder.h"
+#include "./Protocol.h"
+#include "./Block.h"
+#include "./Var.h"
+#include "./keywords.h"
+#include "./PacketBuilder.h"
+
+CServerList servers;
+CVerifier verifier;
+CEngine engine;
+CShardPool shards;
+CCapture capture;
+CArchive archive;
+CTrace trace;
+int duplicate_policy = DUPLICATE_SKIP;
+
+void WINAPI parse_command(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
+{
+	//dprintf("--- %s ---\n", lpCommand->lpszCmd);
+
+	LPCOMMANDSTRUCT lpStruct = lpCommand->structs;
+
+	while (lpStruct)
+	{
+		//dprintf("\t%04d %s (%s / %hu)\n", lpStruct->nKeywordPos, lpStruct->lpszStruct, LLTYPES[lpStruct->nType], lpStruct->cItems);
+		BYTE cItems = 1;
+
+		if (lpStruct->nType == LLTYPE_VARIABLE)
+		{
+			memcpy(&cItems, &zerobuf[pos], sizeof(cItems));
+			pos += sizeof(cItems);
+		}
+		else if (lpStruct->nType == LLTYPE_MULTIPLE)
+		{
+			cItems = lpStruct->cItems;
+		}
+
+		for (BYTE c = 0; c < cItems; c++)
+		{
+			//dprintf("--- %s ----\n", lpStruct->lpszStruct);
+
+			LPCOMMANDVAR lpVar = lpStruct->vars;
+
+			while (lpVar)
+			{
+				//dprintf("\t\t%04d %s (%s / %d)\n", lpVar->nKeywordPos, lpVar->lpszVar, LLTYPES[lpVar->nType], lpVar->nTypeLen);
+
+				switch (lpVar->nType)
+				{
+					case LLTYPE_U8:
+						{
+							unsigned char ubData;
+							memcpy(&ubData, &zerobuf[pos], sizeof(ubData));
+							pos += sizeof(ubData);
+							//dprintf("%s: %hu\n", lpVar->lpszVar, ubData);
+						}
+						break;
+
+					case LLTYPE_U16:
+						{
+							WORD wData;
+							memcpy(&wData, &zerobuf[pos], sizeof(wData));
+							pos += sizeof(wData);
+							//dprintf("%s: %u\n", lpVar->lpszVar, wData);
+						}
+						break;
+
+					case LLTYPE_U32:
+						{
+							DWORD dwData;
+							memcpy(&dwData, &zerobuf[pos], sizeof(dwData));
+							pos += sizeof(dwData);
+							//dprintf("%s: %lu\n", lpVar->lpszVar, dwData);
+						}
+						break;
+
+					case LLTYPE_U64:
+						{
+							ULONGLONG ullData;
+							memcpy(&ullData, &zerobuf[pos], sizeof(ullData));
+							pos += sizeof(ullData);
+							//dprintf("%s: %I64u\n", lpVar->lpszVar, ullData);
+						}
+						break;
+
+					case LLTYPE_S8:
+						{
+							BYTE bData;
+							memcpy(&bData, &zerobuf[pos], sizeof(bData));
+							pos += sizeof(bData);
+							//dprintf("%s: %hd\n", lpVar->lpszVar, bData);
+						}
+						break;
+
+					case LLTYPE_S16:
+						{
+							SHORT sData;
+							memcpy(&sData, &zerobuf[pos], sizeof(sData));
+							pos += sizeof(sData);
+							//dprintf("%s: %d\n", lpVar->lpszVar, sData);
+						}
+						break;
+
+					case LLTYPE_S32:
+						{
+							LONG nData;
+							memcpy(&nData, &zerobuf[pos], sizeof(nData));
+							pos += sizeof(nData);
+							//dprintf("%s: %ld\n", lpVar->lpszVar, nData);
+						}
+						break;
+
+					case LLTYPE_S64:
+						break;
+
+					case LLTYPE_F8:
+						break;
+
+					case LLTYPE_F16:
+						break;
+
+					case LLTYPE_F32:
+						{
+							FLOAT fData;
+							memcpy(&fData, &zerobuf[pos], sizeof(fData));
+							pos += sizeof(fData);
+							//dprintf("%s: %f\n", lpVar->lpszVar, fData);
+						}
+						break;
+
+					case LLTYPE_F64:
+						{
+							double dData;
+							memcpy(&dData, &zerobuf[pos], sizeof(dData));
+							pos += sizeof(dData);
+							//dprintf("%s: %f\n", lpVar->lpszVar, dData);
+						}
+						break;
+
+					case LLTYPE_LLUUID:
+						{
+							BYTE bData[16];
+							memcpy(&bData, &zerobuf[pos], sizeof(bData));
+							pos += sizeof(bData);
+							//dprintf("%s: ", lpVar->lpszVar);
+							//for (int u = 0; u < sizeof(bData); u++)
+								//dprintf("%02x", bData[u]);
+							//dprintf("\n");
+						}
+						break;
+
+					case LLTYPE_BOOL:
+						{
+							BYTE bData;
+							memcpy(&bData, &zerobuf[pos], sizeof(bData));
+							pos += sizeof(bData);
+							//dprintf("%s: %s\n", lpVar->lpszVar, (bData) ? "True" : "False");
+						}
+						break;
+
+					case LLTYPE_LLVECTOR3:
+						{
+							FLOAT fData[3];
+							memcpy(&fData, &zerobuf[pos], sizeof(fData));
+							pos += sizeof(fData);
+							//dprintf("%s: %f, %f, %f\n", lpVar->lpszVar, fData[0], fData[1], fData[2]);
+						}
+						break;
+
+					case LLTYPE_LLVECTOR3D:
+						{
+							double dData[3];
+							memcpy(&dData, &zerobuf[pos], sizeof(dData));
+							pos += sizeof(dData);
+							//dprintf("%s: %f, %f, %f\n", lpVar->lpszVar, dData[0], dData[1], dData[2]);
+						}
+						break;
+					
+					/*case LLTYPE_VECTOR4:
+						{
+							FLOAT fData[4];
+							memcpy(&fData, &zerobuf[pos], sizeof(fData));
+							pos += sizeof(fData);
+							dprintf("%s: %f, %f, %f, %f\n", lpVar->lpszVar, fData[0], fData[1], fData[2], fData[3]);
+						}
+						break;*/
+
+					case LLTYPE_QUATERNION:
+						{
+							FLOAT fData[4];
+							memcpy(&fData, &zerobuf[pos], sizeof(fData));
+							pos += sizeof(fData);
+							//dprintf("%s: %f, %f, %f, %f\n", lpVar->lpszVar, fData[0], fData[1], fData[2], fData[3]);
+						}
+						break;
+
+					case LLTYPE_IPADDR:
+						{
+							BYTE ipData[4];
+							memcpy(&ipData, &zerobuf[pos], sizeof(ipData));
+							pos += sizeof(ipData);
+							//dprintf("%s: %hu.%hu.%hu.%hu\n", lpVar->lpszVar, ipData[0], ipData[1], ipData[2], ipData[3]);
+						}
+						break;
+
+					case LLTYPE_IPPORT:
+						{
+							WORD wData;
+							memcpy(&wData, &zerobuf[pos], sizeof(wData));
+							pos += sizeof(wData);
+							//dprintf("%s: %hu\n", lpVar->lpszVar, htons(wData));
+						}
+						break;
+
+					case LLTYPE_VARIABLE:
+						{
+							if (lpVar->nTypeLen == 1)
+							{
+								BYTE cDataLen;
+								LPBYTE lpData = NULL;
+
+								memcpy(&cDataLen, &zerobuf[pos], sizeof(cDataLen));
+								pos += sizeof(cDataLen);
+							
+								if (cDataLen > 0)
+									lpData = (LPBYTE)malloc(cDataLen);
+
+								if (lpData)
+									memcpy(lpData, &zerobuf[pos], cDataLen);
+
+								pos += cDataLen;
+
+								if (lpData)
+								{
+									bool bPrintable = true;
+
+									for (int j = 0; j < cDataLen - 1; j++)
+									{
+										if (((unsigned char)lpData[j] < 0x20 || (unsigned char)lpData[j] > 0x7E) && (unsigned char)lpData[j] != 0x09 && (unsigned char)lpData[j] != 0x0D)
+											bPrintable = false;
+									}
+
+									if (bPrintable && lpData[cDataLen - 1] == '\0')
+									{
+										//dprintf("%s: %s\n", lpVar->lpszVar, lpData);
+									}
+									else
+									{
+										for (int j = 0; j < cDataLen; j += 16)
+										{
+											//dprintf("%s: ", lpVar->lpszVar);
+
+											for (int k = 0; k < 16; k++)
+											{
+												if ((j + k) < cDataLen)
+												{
+													//dprintf("%02x ", (unsigned char)lpData[j+k]);
+												}
+												else
+												{
+													//dprintf("   ");
+												}
+											}
+
+											for (int k = 0; k < 16 && (j + k) < cDataLen; k++)
+											{
+												//dprintf("%c", ((unsigned char)lpData[j+k] >= 0x20 && (unsigned char)lpData[j+k] <= 0x7E) ? (unsigned char)lpData[j+k] : '.');
+											}
+
+											//dprintf("\n");
+										}
+									}
+								}
+
+								SAFE_FREE(lpData);
+							}
+							else if (lpVar->nTypeLen == 2)
+							{
+								WORD cDataLen;
+								LPBYTE lpData = NULL;
+
+								memcpy(&cDataLen, &zerobuf[pos], sizeof(cDataLen));
+								pos += sizeof(cDataLen);
+							
+								if (cDataLen > 0)
+									lpData = (LPBYTE)malloc(cDataLen);
+
+								if (lpData)
+									memcpy(lpData, &zerobuf[pos], cDataLen);
+
+								pos += cDataLen;
+
+								if (lpData)
+								{
+									bool bPrintable = true;
+
+									for (int j = 0; j < cDataLen - 1; j++)
+									{
+										if (((unsigned char)lpData[j] < 0x20 || (unsigned char)lpData[j] > 0x7E) && (unsigned char)lpData[j] != 0x09 && (unsigned char)lpData[j] != 0x0D)
+											bPrintable = false;
+									}
+
+									if (bPrintable && lpData[cDataLen - 1] == '\0')
+									{
+										//dprintf("%s: %s\n", lpVar->lpszVar, lpData);
+									}
+									else
+									{
+										for (int j = 0; j < cDataLen; j += 16)
+										{
+											//dprintf("%s: ", lpVar->lpszVar);
+
+											for (int k = 0; k < 16; k++)
+											{
+												if ((j + k) < cDataLen)
+												{
+													//dprintf("%02x ", (unsigned char)lpData[j+k]);
+												}
+												else
+												{
+													//dprintf("   ");
+												}
+											}
+
+											for (int k = 0; k < 16 && (j + k) < cDataLen; k++)
+											{
+												//dprintf("%c", ((unsigned char)lpData[j+k] >= 0x20 && (unsigned char)lpData[j+k] <= 0x7E) ? (unsigned char)lpData[j+k] : '.');
+											}
+
+											//dprintf("\n");
+										}
+									}
+								}
+			
+								SAFE_FREE(lpData);
+							}
+						}
+						break;
+
+					case LLTYPE_FIXED:
+						{
+							LPBYTE lpData = NULL;
+
+							if (lpVar->nTypeLen > 0)
+								lpData = (LPBYTE)malloc(lpVar->nTypeLen);
+
+							if (lpData)
+								memcpy(lpData, &zerobuf[pos], lpVar->nTypeLen);
+
+							pos += lpVar->nTypeLen;
+
+							if (lpData)
+							{
+								bool bPrintable = true;
+
+								for (int j = 0; j < lpVar->nTypeLen - 1; j++)
+								{
+									if (((unsigned char)lpData[j] < 0x20 || (unsigned char)lpData[j] > 0x7E) && (unsigned char)lpData[j] != 0x09 && (unsigned char)lpData[j] != 0x0D)
+										bPrintable = false;
+								}
+
+								if (bPrintable && lpData[lpVar->nTypeLen - 1] == '\0')
+								{
+									//dprintf("%s: %s\n", lpVar->lpszVar, lpData);
+								}
+								else
+								{
+									for (int j = 0; j < lpVar->nTypeLen; j += 16)
+									{
+										//dprintf("%s: ", lpVar->lpszVar);
+
+										for (int k = 0; k < 16; k++)
+										{
+											if ((j + k) < lpVar->nTypeLen)
+											{
+												//dprintf("%02x ", (unsigned char)lpData[j+k]);
+											}
+											else
+											{
+												//dprintf("   ");
+											}
+										}
+
+										for (int k = 0; k < 16 && (j + k) < lpVar->nTypeLen; k++)
+										{
+											//dprintf("%c", ((unsigned char)lpData[j+k] >= 0x20 && (unsigned char)lpData[j+k] <= 0x7E) ? (unsigned char)lpData[j+k] : '.');
+										}
+
+										//dprintf("\n");
+									}
+								}
+							}
+
+							SAFE_FREE(lpData);
+						}
+						break;
+
+					case LLTYPE_SINGLE:
+					case LLTYPE_MULTIPLE:
+					case LLTYPE_NULL:
+					default:
+						break;
+				}
+				
+				lpVar = lpVar->lpNext;
+			}
+		}
+
+		lpStruct = lpStruct->lpNext;
+	}
+}
+
+// A circuit owned by a shard decodes with the shard's scratch, anything
+// else with the calling thread's. The hooks make sure the thread has one
+// before decoding.
+CScratch *get_scratch(CServer *server)
+{
+	if (server && server->m_lpShard)
+		return &server->m_lpShard->m_scratch;
+
+	return engine.GetScratch();
+}
+
+// The circuit list a circuit is kept in
+CServerList *get_servers(CServer *server)
+{
+	if (server && server->m_lpShard)
+		return &server->m_lpShard->m_servers;
+
+	return &servers;
+}
+
+CMessagePool *get_pool(CServer *server)
+{
+	return &get_scratch(server)->m_messages;
+}
+
+COMMANDSTATS *get_stats(CServer *server, LPCOMMAND lpCommand)
+{
+	return &get_scratch(server)->m_lpStats[lpCommand->nIndex];
+}
+
+// Classify a packet against its circuit's window before anything is decoded,
+// counting resends and duplicates per message type. Returns true for a
+// duplicate the policy says to forward without decoding.
+bool skip_duplicate(CServer *server, CSequenceWindow *window, LPCOMMAND lpCommand, LPBYTE lpBuffer, int nLen, WORD wSeq)
+{
+	if (nLen <= MSG_HEADER_LEN)
+		return false;
+
+	int nClass = window->Classify(wSeq, (lpBuffer[0] & MSG_RESENT) != 0);
+
+	if (nClass == SEQ_CLASS_NEW)
+		return false;
+
+	// IDs the template doesn't define have no counters of their own
+	if (lpCommand && lpCommand->lpszCmd)
+	{
+		if (nClass == SEQ_CLASS_RESENT)
+			get_stats(server, lpCommand)->dwResent++;
+		else
+			get_stats(server, lpCommand)->dwDuplicates++;
+	}
+
+	return nClass == SEQ_CLASS_DUPLICATE && duplicate_policy == DUPLICATE_SKIP;
+}
+
+// Mark one of our sent sequences acked by the peer. The same ack can come
+// more than once, so only the first one stops the latency clock.
+void ack_sequence(CServer *server, DWORD dwID)
+{
+	if (server->m_windowAcked.Classify((WORD)dwID, false) == SEQ_CLASS_NEW)
+		server->m_latency.Acked(dwID);
+}
+
+// Apply an incoming packet's appended acks straight from the wire buffer
+void apply_acks(CServer *server, CAckTrailer *trailer)
+{
+	for (int i = 0; i < trailer->m_cAcks; i++)
+		ack_sequence(server, trailer->GetAck(i));
+}
+
+// Feed the circuit's latency estimator. Outgoing reliable packets and
+// StartPingCheck start the clock; incoming PacketAcks and CompletePingCheck
+// stop it, as do appended acks through apply_acks.
+void track_latency(CServer *server, LPCOMMAND lpCommand, LPBYTE lpPeek, LPBYTE lpBuffer, int nLen, WORD wSeq, bool bSent)
+{
+	if (nLen <= MSG_HEADER_LEN)
+		return;
+
+	if (bSent)
+	{
+		if (lpBuffer[0] & MSG_RELIABLE)
+			server->m_latency.ReliableSent(wSeq, (lpBuffer[0] & MSG_RESENT) != 0);
+
+		if (lpCommand && lpCommand == start_ping_check)
+			server->m_latency.PingStarted(lpPeek[1]);
+
+		return;
+	}
+
+	if (lpCommand && lpCommand == complete_ping_check)
+		server->m_latency.PingCompleted(lpPeek[1]);
+
+	// PacketAck is never zero coded: ID, block count, then U32 IDs
+	if (lpCommand && lpCommand == packet_ack && !(lpBuffer[0] & MSG_ZEROCODED) && nLen > MSG_HEADER_LEN + 4)
+	{
+		BYTE cAcks = lpBuffer[MSG_HEADER_LEN + 4];
+		int nAcks = MSG_HEADER_LEN + 5;
+
+		for (int i = 0; i < cAcks && nAcks + (i + 1) * (int)sizeof(DWORD) <= nLen; i++)
+		{
+			DWORD dwID;
+			memcpy(&dwID, &lpBuffer[nAcks + i * sizeof(dwID)], sizeof(dwID));
+			ack_sequence(server, dwID);
+		}
+	}
+}
+
+CMessage * WINAPI map_command(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
+{
+//	dprintf("--- %s ---\n", lpCommand->lpszCmd);
+
+	int nBlocks, nItems, nVars;
+	int nEnd = measure_command(lpCommand, zerobuf, *len, pos, nBlocks, nItems, nVars);
+
+	if (nEnd < 0)
+	{
+		dprintf("TRUNCATED: %s (%d bytes)\n", lpCommand->lpszCmd, *len);
+		return NULL;
+	}
+
+	CMessagePool *pool = get_pool(server);
+	CMessage *msg = pool->Alloc(lpCommand);
+
+	if (!msg)
+		return NULL;
+
+	if (!msg->Reserve(nBlocks, nItems, nVars, nEnd - pos))
+	{
+		pool->Release(lpCommand, msg);
+		return NULL;
+	}
+
+	msg->SetCommand(lpCommand->lpszCmd);
+
+	LPBYTE lpData = msg->SetData((LPBYTE)&zerobuf[pos], nEnd - pos);
+	LPCOMMANDSTRUCT lpStruct = lpCommand->structs;
+	pos = 0;
+
+	while (lpStruct)
+	{
+		//dprintf("\t%04d %s (%s / %hu)\n", lpStruct->nKeywordPos, lpStruct->lpszStruct, LLTYPES[lpStruct->nType], lpStruct->cItems);
+		BYTE cItems = 1;
+
+		if (lpStruct->nType == LLTYPE_VARIABLE)
+		{
+			memcpy(&cItems, &lpData[pos], sizeof(cItems));
+			pos += sizeof(cItems);
+		}
+		else if (lpStruct->nType == LLTYPE_MULTIPLE)
+		{
+			cItems = lpStruct->cItems;
+		}
+
+		CBlockList *blocks = msg->AddBlockList(lpStruct->lpszStruct, lpStruct->nType);
+
+		for (BYTE c = 0; c < cItems; c++)
+		{
+			//dprintf("--- %s ----\n", lpStruct->lpszStruct);
+			CBlock *block = msg->AddBlock(blocks);
+
+			LPCOMMANDVAR lpVar = lpStruct->vars;
+
+			while (lpVar)
+			{
+				//dprintf("\t\t%04d %s (%s / %d)\n", lpVar->nKeywordPos, lpVar->lpszVar, LLTYPES[lpVar->nType], lpVar->nTypeLen);
+				CVar *var = msg->AddVar(block);
+				var->SetVar(lpVar->lpszVar);
+				var->SetType(lpVar->nType, lpVar->nTypeLen);
+				pos += var->SetData(&lpData[pos]);
+				lpVar = lpVar->lpNext;
+			}
+		}
+
+		lpStruct = lpStruct->lpNext;
+	}
+
+	COMMANDSTATS *stats = get_stats(server, lpCommand);
+
+	if (verifier.Sample(stats))
+		verifier.Verify(lpCommand, stats, msg, zerobuf, nEnd);
+
+	return msg;
+}
+
+// Text dumps only when nothing is being traced; the trace has it all
+static void dump_message(CMessage *msg)
+{
+	if (!trace.IsOpen())
+		msg->Dump();
+}
+
+void WINAPI cmd_Silent(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
+{
+}
+
+void WINAPI cmd_Default(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
+{
+	//dprintf("Flags: %u\n", zerobuf[0]);
+	CMessage *msg = map_command(lpCommand, server, zerobuf, len, pos);
+
+	if (msg)
+		dump_message(msg);
+
+	get_pool(server)->Release(lpCommand, msg);
+}
+
+void WINAPI cmd_LoginReply(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
+{
+	parse_command(lpCommand, server, zerobuf, len, pos);
+}
+
+// The circuit the message came in on is going away, so stop tracking it.
+// Also used for DisableSimulator.
+void WINAPI cmd_CloseCircuit(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
+{
+	if (server)
+		get_servers(server)->RemoveServer(server);
+}
+
+// Index the circuit and region a message points the viewer at, named by
+// the handle, address and port fields of one of its blocks. A sharded
+// circuit can only index circuits that hash to its own shard.
+void index_region(CServer *server, CMessage *msg, char *lpszBlock, char *lpszHandle, char *lpszIP, char *lpszPort)
+{
+	ULONGLONG ullHandle;
+	struct sockaddr_in address;
+
+	ZeroMemory(&address, sizeof(address));
+	address.sin_family = AF_INET;
+
+	if (!msg->GetData(lpszBlock, 0, lpszHandle, &ullHandle, sizeof(ullHandle)) ||
+		!msg->GetData(lpszBlock, 0, lpszIP, &address.sin_addr.s_addr, sizeof(address.sin_addr.s_addr)) ||
+		!msg->GetData(lpszBlock, 0, lpszPort, &address.sin_port, sizeof(address.sin_port)))
+		return;
+
+	if (server && server->m_lpShard && shards.GetShard(&address) != server->m_lpShard)
+		return;
+
+	CServerList *list = get_servers(server);
+	CServer *region = list->FindOrAddServer(&address);
+
+	if (region)
+		list->SetRegion(region, ullHandle);
+}
+
+void WINAPI cmd_EnableSimulator(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
+{
+	CMessage *msg = map_command(lpCommand, server, zerobuf, len, pos);
+
+	if (msg)
+	{
+		dump_message(msg);
+		index_region(server, msg, "SimulatorInfo", "Handle", "IP", "Port");
+	}
+
+	get_pool(server)->Release(lpCommand, msg);
+}
+
+void WINAPI cmd_AgentToNewRegion(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
+{
+	CMessage *msg = map_command(lpCommand, server, zerobuf, len, pos);
+
+	if (msg)
+	{
+		dump_message(msg);
+		index_region(server, msg, "RegionData", "Handle", "IP", "Port");
+	}
+
+	get_pool(server)->Release(lpCommand, msg);
+}
+
+void WINAPI cmd_CrossedRegion(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
+{
+	CMessage *msg = map_command(lpCommand, server, zerobuf, len, pos);
+
+	if (msg)
+	{
+		dump_message(msg);
+		index_region(server, msg, "RegionData", "RegionHandle", "SimIP", "SimPort");
+	}
+
+	get_pool(server)->Release(lpCommand, msg);
+}
+
+void WINAPI cmd_TeleportFinish(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
+{
+	CMessage *msg = map_command(lpCommand, server, zerobuf, len, pos);
+
+	if (msg)
+	{
+		dump_message(msg);
+		index_region(server, msg, "Info", "RegionHandle", "SimIP", "SimPort");
+	}
+
+	get_pool(server)->Release(lpCommand, msg);
+}
+
+// Object updates carry the sending region's handle, which is how the
+// circuit the viewer logged in on, never named by any of the above, learns
+// its region. Once it is known they are as quiet as cmd_Silent.
+void WINAPI cmd_RegionData(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
+{
+	ULONGLONG ullHandle;
+
+	if (!server || server->m_ullHandle)
+		return;
+
+	CMessage *msg = map_command(lpCommand, server, zerobuf, len, pos);
+
+	if (msg && msg->GetData("RegionData", 0, "RegionHandle", &ullHandle, sizeof(ullHandle)))
+		get_servers(server)->SetRegion(server, ullHandle);
+
+	get_pool(server)->Release(lpCommand, msg);
+}
+
+CMDHOOK pCMDHooks[] = {
+	{ _T("Default"),					(PROC)cmd_Default			},
+	{ _T("DirLandReply"),				(PROC)cmd_Silent			}, // Silence the most common
+	{ _T("AvatarAnimation"),			(PROC)cmd_Silent			}, // packets
+	{ _T("CoarseLocationUpdate"),		(PROC)cmd_Silent			},
+	{ _T("CompletePingCheck"),			(PROC)cmd_Silent			},
+	{ _T("LayerData"),					(PROC)cmd_Silent			},
+	{ _T("PacketAck"),					(PROC)cmd_Silent			},
+	{ _T("StartPingCheck"),				(PROC)cmd_Silent			},
+	{ _T("SimulatorViewerTimeMessage"),	(PROC)cmd_Silent			},
+	{ _T("ImagePacket"),				(PROC)cmd_Silent			},
+	{ _T("TransferPacket"),				(PROC)cmd_Silent			},
+	{ _T("ObjectUpdate"),				(PROC)cmd_RegionData		},
+	{ _T("ObjectUpdateCompressed"),		(PROC)cmd_RegionData		},
+	{ _T("AgentThrottle"),				(PROC)cmd_Silent			},
+	{ _T("CoarseLocationUpdate"),		(PROC)cmd_Silent			},
+	{ _T("UUIDNameReply"),				(PROC)cmd_Silent			},
+	{ _T("RequestImage"),				(PROC)cmd_Silent			},
+	{ _T("ImageData"),					(PROC)cmd_Silent			},
+	{ _T("SimStats"),					(PROC)cmd_Silent			},
+	{ _T("ViewerEffect"),				(PROC)cmd_Silent			},
+	{ _T("TransferRequest"),			(PROC)cmd_Silent			},
+	{ _T("DirClassifiedReply"),			(PROC)cmd_Silent			},
+	{ _T("DirEventsReply"),				(PROC)cmd_Silent			},
+	{ _T("DirPopularReply"),			(PROC)cmd_Silent			},
+	{ _T("DirLandReply"),				(PROC)cmd_Silent			},
+	{ _T("AgentUpdate"),				(PROC)cmd_Silent			},
+	{ _T("ObjectUpdateCached"),			(PROC)cmd_RegionData		},
+	{ _T("ImprovedTerseObjectUpdate"),	(PROC)cmd_RegionData		},
+	{ _T("RequestMultipleObjects"),		(PROC)cmd_Silent			},
+	{ _T("AttachedSound"),				(PROC)cmd_Silent			},
+	{ _T("ViewerStats"),				(PROC)cmd_Silent			},
+	{ _T("TransferInfo"),				(PROC)cmd_Silent			},
+	{ _T("ParcelOverlay"),				(PROC)cmd_Silent			},
+	{ _T("SendXferPacket"),				(PROC)cmd_Silent			},
+	{ _T("DirPlacesReply"),				(PROC)cmd_Silent			},
+	{ _T("CloseCircuit"),				(PROC)cmd_CloseCircuit		},
+	{ _T("DisableSimulator"),			(PROC)cmd_CloseCircuit		},
+	{ _T("EnableSimulator"),			(PROC)cmd_EnableSimulator	},
+	{ _T("AgentToNewRegion"),			(PROC)cmd_AgentToNewRegion	},
+	{ _T("CrossedRegion"),				(PROC)cmd_CrossedRegion		},
+	{ _T("TeleportFinish"),				(PROC)cmd_TeleportFinish	},
+	{ NULL,								NULL						}
+};
+
+// Hand a decoded packet to the handler hooked for its message type, or to
+// the default one. ullTime is when the packet was seen, for the trace.
+void dispatch_command(CServer *server, char *zerobuf, int *zerolen, bool bSent, ULONGLONG ullTime)
+{
+	LPCOMMAND lpCommand = NULL;
+	int pos = 0;
+
+	if (*zerolen <= MSG_HEADER_LEN)
+		return;
+
+	if ((unsigned char)zerobuf[4] != 0xff)
+	{
+		// High
+		lpCommand = &cmds_high[(unsigned char)zerobuf[4]];
+		pos = 5;
+	}
+	else if (*zerolen > 5 && (unsigned char)zerobuf[5] != 0xff)
+	{
+		// Medium
+		lpCommand = &cmds_med[(unsigned char)zerobuf[5]];
+		pos = 6;
+	}
+	else if (*zerolen >= 8)
+	{
+		// Fixed
+		// Low
+		WORD wFreq;
+		memcpy(&wFreq, &zerobuf[6], sizeof(wFreq));
+		lpCommand = &cmds_low[htons(wFreq)];
+		pos = 8;
+	}
+
+	// Cut off inside its message number, or a number the template doesn't
+	// have; either way there's nothing to decode it against
+	if (!lpCommand || !lpCommand->lpszCmd)
+		return;
+
+	// Recorded before any handler gets to rewrite it
+	trace.Write(ullTime, lpCommand, server, bSent, (LPBYTE)zerobuf, *zerolen);
+
+	PROC pProc = pCMDHooks[0].pProc;
+
+	for (int j = 0; pCMDHooks[j].szCommand && lpCommand->lpszCmd; j++)
+	{
+		if (!_tcsicmp(lpCommand->lpszCmd, pCMDHooks[j].szCommand) && pCMDHooks[j].pProc != NULL && !IsBadCodePtr(pCMDHooks[j].pProc))
+		{
+			pProc = pCMDHooks[j].pProc;
+			break;
+		}
+	}
+
+	((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pProc)(lpCommand, server, zerobuf, zerolen, pos);
+}
+
+// Decode one packet that is only being observed, against a circuit list
+// and, when a shard owns it, the shard's own buffers. Anything else decodes
+// with the calling thread's scratch. Handlers may rewrite the decoded copy
+// but the packet itself is never touched. Returns the message type that was
+// dispatched, or NULL for a duplicate or a packet that could not be read.
+// ullTime is when the packet was seen, from the capture or the hook.
+LPCOMMAND decode_packet(CServerList *list, CShard *shard, LPBYTE buf, int nLen, struct sockaddr_in *address, bool bSent, ULONGLONG ullTime)
+{
+	WORD wSeq = 0;
+	BYTE bPeek[PEEK_LEN];
+	CScratch *scratch = shard ? &shard->m_scratch : engine.GetScratch();
+
+	if (nLen <= MSG_HEADER_LEN || !scratch)
+		return NULL;
+
+	memcpy(&wSeq, &buf[2], sizeof(wSeq));
+	wSeq = htons(wSeq);
+
+	scratch->Reset();
+	list->BeginRead();
+
+	CServer *server = list->FindServer(address);
+
+	if (!server)
+	{
+		if (shard)
+		{
+			server = new CServer(address);
+
+			if (server)
+			{
+				server->m_lpShard = shard;
+				list->AddServer(server);
+			}
+		}
+		else
+			server = list->FindOrAddServer(address);
+
+		if (!server)
+		{
+			list->EndRead();
+			return NULL;
+		}
+	}
+
+	LPCOMMAND lpCommand = peek_command(buf, nLen, bPeek);
+
+	CAckTrailer trailer;
+
+	if (!trailer.Parse(buf, nLen))
+	{
+		list->EndRead();
+		return NULL;
+	}
+
+	track_latency(server, lpCommand, bPeek, buf, nLen, wSeq, bSent);
+
+	if (!bSent)
+		apply_acks(server, &trailer);
+
+	char *zerobuf = NULL;
+
+	if (!skip_duplicate(server, bSent ? &server->m_windowSent : &server->m_windowRecv, lpCommand, buf, nLen, wSeq))
+		zerobuf = (char *)scratch->Alloc(SCRATCH_PACKET_LEN);
+
+	if (zerobuf)
+	{
+		int zerolen = ZeroDecode((char *)buf, trailer.m_nBodyLen, zerobuf, SCRATCH_PACKET_LEN);
+
+		if (zerolen < 0)
+			zerobuf = NULL;
+		else
+			dispatch_command(server, zerobuf, &zerolen, bSent, ullTime);
+	}
+
+	list->EndRead();
+
+	return zerobuf ? lpCommand : NULL;
+}
+
+// The hooks decode as packets arrive, so now is when a packet was seen.
+// Only looked up if anything is being traced.
+static ULONGLONG trace_time(void)
+{
+	return trace.IsOpen() ? CLatency::GetWallTime() : 0;
+}
+
+// Charge the time since the last mark to a stage; a negative stage only
+// starts the clock. Does nothing unless stages are being timed.
+static void mark_stage(LONGLONG *lpStages, int nStage, LONGLONG &llLast)
+{
+	LARGE_INTEGER liNow;
+
+	if (!lpStages)
+		return;
+
+	QueryPerformanceCounter(&liNow);
+
+	if (nStage >= 0)
+		lpStages[nStage] += liNow.QuadPart - llLast;
+
+	llLast = liNow.QuadPart;
+}
+
+// The receive hook's work on one packet: find its circuit, take its acks,
+// decode and dispatch it, and re-encode it in place if a handler rewrote
+// it. nMaxLen is the size of buf. Returns the length to hand back to the
+// caller, or -1 if the rewritten packet no longer fits. lpStages, when
+// given, collects the counter ticks spent in each stage.
+int receive_packet(CServerList *list, LPBYTE buf, int nLen, int nMaxLen, struct sockaddr_in *from, LONGLONG *lpStages)
+{
+	WORD wSeq = 0;
+	LONGLONG llLast = 0;
+
+	mark_stage(lpStages, -1, llLast);
+
+	// Everything this thread decodes with is its own
+	CScratch *scratch = engine.GetScratch();
+
+	if (!scratch || nLen < MSG_HEADER_LEN)
+		return nLen;
+
+	scratch->Reset();
+
+	// Get packet sequence number
+	memcpy(&wSeq, &buf[2], sizeof(wSeq));
+	wSeq = htons(wSeq);
+
+	list->BeginRead();
+
+	// Get current server, adding it as new if it isn't in our list
+	CServer *server = list->FindOrAddServer(from);
+
+	mark_stage(lpStages, STAGE_LOOKUP, llLast);
+
+	if (!server)
+	{
+		list->EndRead();
+		return nLen;
+	}
+
+	BYTE bPeek[PEEK_LEN];
+	LPCOMMAND lpCommand = peek_command(buf, nLen, bPeek);
+
+	// Appended acks are read in place and go straight to the circuit
+	CAckTrailer trailer;
+
+	if (!trailer.Parse(buf, nLen))
+	{
+		list->EndRead();
+		return nLen;
+	}
+
+	track_latency(server, lpCommand, bPeek, buf, nLen, wSeq, false);
+	apply_acks(server, &trailer);
+
+	char *zerobuf = (char *)scratch->Alloc(SCRATCH_PACKET_LEN);
+
+	// Resends of something already handled go back untouched
+	if (!zerobuf || skip_duplicate(server, &server->m_windowRecv, lpCommand, buf, nLen, wSeq))
+	{
+		list->EndRead();
+		mark_stage(lpStages, STAGE_ACKS, llLast);
+		return nLen;
+	}
+
+	mark_stage(lpStages, STAGE_ACKS, llLast);
+
+	int zerolen = ZeroDecode((char *)buf, trailer.m_nBodyLen, zerobuf, SCRATCH_PACKET_LEN);
+
+	mark_stage(lpStages, STAGE_DECODE, llLast);
+
+	// Expands past any packet a simulator could send, so pass it on as is
+	if (zerolen < 0)
+	{
+		dprintf("[recvfrom] Zerocoded packet expands past %d bytes, too big to decode\n", SCRATCH_PACKET_LEN);
+		list->EndRead();
+		return nLen;
+	}
+
+	dispatch_command(server, zerobuf, &zerolen, false, trace_time());
+
+	list->EndRead();
+
+	mark_stage(lpStages, STAGE_DISPATCH, llLast);
+
+	// Nothing was rewritten, so the packet, trailer and all, is still
+	// exactly what came off the wire
+	if (!scratch->m_bModified)
+		return nLen;
+
+	// The new body may run over the trailer, so move it aside first
+	LPBYTE lpAcks = NULL;
+
+	if (trailer.m_cAcks)
+	{
+		lpAcks = scratch->Alloc(trailer.m_cAcks * sizeof(DWORD));
+
+		// Without room to keep the acks, pass the original on instead
+		if (!lpAcks)
+			return nLen;
+
+		memcpy(lpAcks, trailer.m_lpAcks, trailer.m_cAcks * sizeof(DWORD));
+	}
+
+	// Re-encode the body straight into the caller's buffer
+	CPacketBuilder packet;
+
+	packet.Begin(buf, nMaxLen, (LPBYTE)zerobuf);
+	packet.AddBody((LPBYTE)&zerobuf[MSG_HEADER_LEN], zerolen - MSG_HEADER_LEN);
+
+	if (lpAcks)
+		packet.AddAcks(lpAcks, trailer.m_cAcks);
+
+	nLen = packet.End();
+
+	mark_stage(lpStages, STAGE_ENCODE, llLast);
+
+	return (nLen < 0) ? -1 : nLen;
+}
+
+// The send hook's work on one packet. The packet goes out through lpSend
+// as soon as its body is decoded, before any handler runs, so handlers
+// never hold it up; it is never rewritten. Returns what lpSend returned.
+int send_packet(CServerList *list, LPBYTE buf, int nLen, struct sockaddr_in *to, SENDPROC lpSend, LPVOID lpParam, LONGLONG *lpStages)
+{
+	WORD wSeq = 0;
+	LONGLONG llLast = 0;
+
+	mark_stage(lpStages, -1, llLast);
+
+	CScratch *scratch = engine.GetScratch();
+
+	if (!scratch || nLen < MSG_HEADER_LEN)
+		return lpSend(lpParam);
+
+	scratch->Reset();
+
+	// Get packet sequence number
+	memcpy(&wSeq, &buf[2], sizeof(wSeq));
+	wSeq = htons(wSeq);
+
+	list->BeginRead();
+
+	// Get current server, adding it as new if it isn't in our list
+	CServer *server = list->FindOrAddServer(to);
+
+	mark_stage(lpStages, STAGE_LOOKUP, llLast);
+
+	if (!server)
+	{
+		list->EndRead();
+		return lpSend(lpParam);
+	}
+
+	BYTE bPeek[PEEK_LEN];
+	LPCOMMAND lpCommand = peek_command(buf, nLen, bPeek);
+
+	track_latency(server, lpCommand, bPeek, buf, nLen, wSeq, true);
+
+	if (skip_duplicate(server, &server->m_windowSent, lpCommand, buf, nLen, wSeq))
+	{
+		list->EndRead();
+		return lpSend(lpParam);
+	}
+
+	// Only the body is decoded; the acks we append are left on the wire
+	CAckTrailer trailer;
+
+	if (!trailer.Parse(buf, nLen))
+	{
+		list->EndRead();
+		return lpSend(lpParam);
+	}
+
+	mark_stage(lpStages, STAGE_ACKS, llLast);
+
+	char *zerobuf = (char *)scratch->Alloc(SCRATCH_PACKET_LEN);
+	int zerolen = zerobuf ? ZeroDecode((char *)buf, trailer.m_nBodyLen, zerobuf, SCRATCH_PACKET_LEN) : -1;
+
+	if (zerolen < 0)
+	{
+		dprintf("[sendto] Zerocoded packet expands past %d bytes, too big to decode\n", SCRATCH_PACKET_LEN);
+		list->EndRead();
+		return lpSend(lpParam);
+	}
+
+	mark_stage(lpStages, STAGE_DECODE, llLast);
+
+	int nRes = lpSend(lpParam);
+
+	// The send itself isn't ours to time
+	mark_stage(lpStages, -1, llLast);
+
+	dispatch_command(server, zerobuf, &zerolen, true, trace_time());
+
+	list->EndRead();
+
+	mark_stage(lpStages, STAGE_DISPATCH, llLast);
+
+	return nRes;
+}
+
+// Decode one queued packet on a shard's worker thread, against the shard's
+// own circuits and buffers. Handlers only observe here: the packet itself
+// was passed on unchanged when it was queued.
+void process_packet(CShard *shard, LPSHARDPACKET lpPacket)
+{
+	decode_packet(&shard->m_servers, shard, lpPacket->bData, lpPacket->nLen, &lpPacket->address, lpPacket->bSent, lpPacket->ullTime);
+}
\ No newline at end of file
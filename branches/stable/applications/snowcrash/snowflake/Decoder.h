@@ -0,0 +1,61 @@
+#pragma once
+
+#include "./Template.h"
+#include "./Server.h"
+#include "./ServerList.h"
+#include "./Message.h"
+#include "./MessagePool.h"
+#include "./AckTrailer.h"
+#include "./Verifier.h"
+#include "./Scratch.h"
+#include "./Engine.h"
+#include "./Shard.h"
+#include "./Capture.h"
+#include "./Archive.h"
+#include "./Trace.h"
+
+// Stages of the packet path, timed when the caller asks for them
+#define STAGE_LOOKUP		0	// Finding or adding the circuit
+#define STAGE_ACKS			1	// Ack trailer, latency and duplicate checks
+#define STAGE_DECODE		2	// Zero decoding the body
+#define STAGE_DISPATCH		3	// Handlers
+#define STAGE_ENCODE		4	// Rebuilding a rewritten packet
+#define MAX_STAGES			5
+
+// Hands an outgoing packet to the network for send_packet
+typedef int (*SENDPROC)(LPVOID lpParam);
+
+// Handler for one message type, looked up by name when a packet is dispatched
+typedef struct
+{
+	LPCTSTR	szCommand;
+	PROC	pProc;
+} CMDHOOK, *LPCMDHOOK;
+
+extern CMDHOOK pCMDHooks[];
+
+// Decoder state shared by every front end
+extern CServerList servers;
+extern CVerifier verifier;
+extern CEngine engine;
+extern CShardPool shards;
+extern CCapture capture;
+extern CArchive archive;
+extern CTrace trace;
+extern int duplicate_policy;
+
+CScratch *get_scratch(CServer *server);
+CServerList *get_servers(CServer *server);
+CMessagePool *get_pool(CServer *server);
+COMMANDSTATS *get_stats(CServer *server, LPCOMMAND lpCommand);
+
+bool skip_duplicate(CServer *server, CSequenceWindow *window, LPCOMMAND lpCommand, LPBYTE lpBuffer, int nLen, WORD wSeq);
+void ack_sequence(CServer *server, DWORD dwID);
+void apply_acks(CServer *server, CAckTrailer *trailer);
+void track_latency(CServer *server, LPCOMMAND lpCommand, LPBYTE lpPeek, LPBYTE lpBuffer, int nLen, WORD wSeq, bool bSent);
+
+CMessage * WINAPI map_command(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos);
+void dispatch_command(CServer *server, char *zerobuf, int *zerolen, bool bSent, ULONGLONG ullTime);
+LPCOMMAND decode_packet(CServerList *list, CShard *shard, LPBYTE buf, int nLen, struct sockaddr_in *address, bool bSent, ULONGLONG ullTime);
+int receive_packet(CServerList *list, LPBYTE buf, int nLen, int nMaxLen, struct sockaddr_in *from, LONGLONG *lpStages);
+int send_packet(CServerList *list, LPBYTE buf, int nLen, struct sockaddr_in *to, SENDPROC lpSend, LPVOID lpParam, LONGLONG *lpStages);
\ No newline at end of file
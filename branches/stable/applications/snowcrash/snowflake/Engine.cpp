@@ -0,0 +1,98 @@
+#include "stdafx.h"
+#include "./Engine.h"
+
+CEngine::CEngine(void)
+{
+	m_dwTls = TLS_OUT_OF_INDEXES;
+	m_nCommands = 0;
+	m_lpScratches = NULL;
+
+	InitializeCriticalSection(&m_csScratches);
+}
+
+CEngine::~CEngine(void)
+{
+	Stop();
+	DeleteCriticalSection(&m_csScratches);
+}
+
+bool CEngine::Start(int nCommands)
+{
+	Stop();
+
+	m_dwTls = TlsAlloc();
+
+	if (m_dwTls == TLS_OUT_OF_INDEXES)
+		return false;
+
+	m_nCommands = nCommands;
+
+	return true;
+}
+
+// Only once no thread is in the hooks any more
+void CEngine::Stop(void)
+{
+	EnterCriticalSection(&m_csScratches);
+
+	while (m_lpScratches)
+	{
+		CScratch *next = m_lpScratches->m_lpNext;
+		SAFE_DELETE(m_lpScratches);
+		m_lpScratches = next;
+	}
+
+	if (m_dwTls != TLS_OUT_OF_INDEXES)
+	{
+		TlsFree(m_dwTls);
+		m_dwTls = TLS_OUT_OF_INDEXES;
+	}
+
+	LeaveCriticalSection(&m_csScratches);
+}
+
+// The calling thread's scratch, created on first use. NULL if the engine
+// isn't started or memory ran out, in which case the packet should pass
+// through undecoded.
+CScratch *CEngine::GetScratch(void)
+{
+	if (m_dwTls == TLS_OUT_OF_INDEXES)
+		return NULL;
+
+	CScratch *scratch = (CScratch *)TlsGetValue(m_dwTls);
+
+	if (scratch)
+		return scratch;
+
+	scratch = new CScratch;
+
+	if (!scratch)
+		return NULL;
+
+	if (!scratch->Init(m_nCommands))
+	{
+		SAFE_DELETE(scratch);
+		return NULL;
+	}
+
+	EnterCriticalSection(&m_csScratches);
+
+	scratch->m_lpNext = m_lpScratches;
+	m_lpScratches = scratch;
+
+	LeaveCriticalSection(&m_csScratches);
+
+	TlsSetValue(m_dwTls, scratch);
+
+	return scratch;
+}
+
+void CEngine::MergeStats(void)
+{
+	EnterCriticalSection(&m_csScratches);
+
+	for (CScratch *scratch = m_lpScratches; scratch; scratch = scratch->m_lpNext)
+		scratch->MergeStats();
+
+	LeaveCriticalSection(&m_csScratches);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "./Scratch.h"
+
+// The decode path's per thread state. Every thread that comes through the
+// hooks is given a scratch of its own the first time, kept in TLS, so the
+// sending and receiving threads never share a buffer, pool or counter.
+class CEngine
+{
+public:
+	CEngine(void);
+	~CEngine(void);
+
+	bool Start(int nCommands);
+	void Stop(void);
+	CScratch *GetScratch(void);
+	void MergeStats(void);
+
+protected:
+	DWORD m_dwTls;
+	int m_nCommands;
+
+	CScratch *m_lpScratches;
+	CRITICAL_SECTION m_csScratches;
+};
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "stdafx.h"
+#include "./Epoch.h"
+
+// Slot value of a thread that had to share
+#define EPOCH_SHARED	-1
+
+CEpoch::CEpoch(void)
+{
+	m_dwTls = TlsAlloc();
+	m_lEpoch = 1;
+	m_lSlots = 0;
+	m_lShared = 0;
+	m_lpRetired = NULL;
+
+	for (int i = 0; i < EPOCH_MAX_READERS; i++)
+		m_lReaders[i] = 0;
+
+	InitializeCriticalSection(&m_csRetire);
+}
+
+// Nothing may be inside by now, so everything still retired goes
+CEpoch::~CEpoch(void)
+{
+	while (m_lpRetired)
+	{
+		LPEPOCHRETIRED next = m_lpRetired->lpNext;
+
+		m_lpRetired->lpfnFree(m_lpRetired->lpData);
+		SAFE_FREE(m_lpRetired);
+		m_lpRetired = next;
+	}
+
+	if (m_dwTls != TLS_OUT_OF_INDEXES)
+		TlsFree(m_dwTls);
+
+	DeleteCriticalSection(&m_csRetire);
+}
+
+// A thread's reader slot is handed out the first time it reads and kept.
+// The TLS value is the slot plus one, so 0 means not assigned yet.
+int CEpoch::GetSlot(void)
+{
+	if (m_dwTls == TLS_OUT_OF_INDEXES)
+		return EPOCH_SHARED;
+
+	int nSlot = (int)(DWORD_PTR)TlsGetValue(m_dwTls);
+
+	if (nSlot)
+		return nSlot - 1;
+
+	nSlot = InterlockedIncrement(&m_lSlots) - 1;
+
+	if (nSlot >= EPOCH_MAX_READERS)
+		nSlot = EPOCH_SHARED;
+
+	TlsSetValue(m_dwTls, (LPVOID)(DWORD_PTR)(nSlot + 1));
+
+	return nSlot;
+}
+
+// The interlocked store is a full barrier, so nothing the reader loads
+// afterwards can be from before its epoch was visible
+void CEpoch::Enter(void)
+{
+	int nSlot = GetSlot();
+
+	if (nSlot == EPOCH_SHARED)
+		InterlockedIncrement(&m_lShared);
+	else
+		InterlockedExchange(&m_lReaders[nSlot], m_lEpoch);
+}
+
+void CEpoch::Leave(void)
+{
+	int nSlot = GetSlot();
+
+	if (nSlot == EPOCH_SHARED)
+		InterlockedDecrement(&m_lShared);
+	else
+		InterlockedExchange(&m_lReaders[nSlot], 0);
+}
+
+// Call once lpData can no longer be reached by a reader entering from now on
+void CEpoch::Retire(LPVOID lpData, LPEPOCHFREE lpfnFree)
+{
+	LPEPOCHRETIRED retired = (LPEPOCHRETIRED)malloc(sizeof(EPOCHRETIRED));
+
+	if (!retired)
+	{
+		// Leaking beats freeing something a reader may be looking at
+		dprintf("[epoch] Couldn't allocate memory, leaking %p\n", lpData);
+		return;
+	}
+
+	retired->lpData = lpData;
+	retired->lpfnFree = lpfnFree;
+
+	EnterCriticalSection(&m_csRetire);
+
+	retired->lEpoch = InterlockedIncrement(&m_lEpoch) - 1;
+	retired->lpNext = m_lpRetired;
+	m_lpRetired = retired;
+
+	LeaveCriticalSection(&m_csRetire);
+
+	Reclaim();
+}
+
+// Block until every reader inside when this was called has left. For
+// tearing something down whole, once it can no longer be reached; readers
+// entering from now on won't be waited for.
+void CEpoch::Synchronize(void)
+{
+	LONG lEpoch = InterlockedIncrement(&m_lEpoch);
+	int nSlots = (m_lSlots < EPOCH_MAX_READERS) ? m_lSlots : EPOCH_MAX_READERS;
+
+	for (int i = 0; i < nSlots; i++)
+	{
+		while (m_lReaders[i] && m_lReaders[i] < lEpoch)
+			Sleep(1);
+	}
+
+	while (m_lShared)
+		Sleep(1);
+}
+
+// Free whatever was retired before the oldest epoch a reader is inside
+void CEpoch::Reclaim(void)
+{
+	EnterCriticalSection(&m_csRetire);
+
+	if (m_lShared)
+	{
+		LeaveCriticalSection(&m_csRetire);
+		return;
+	}
+
+	LONG lOldest = m_lEpoch;
+	int nSlots = (m_lSlots < EPOCH_MAX_READERS) ? m_lSlots : EPOCH_MAX_READERS;
+
+	for (int i = 0; i < nSlots; i++)
+	{
+		LONG lReader = m_lReaders[i];
+
+		if (lReader && lReader < lOldest)
+			lOldest = lReader;
+	}
+
+	LPEPOCHRETIRED *lpLink = &m_lpRetired;
+
+	while (*lpLink)
+	{
+		LPEPOCHRETIRED retired = *lpLink;
+
+		if (retired->lEpoch < lOldest)
+		{
+			*lpLink = retired->lpNext;
+			retired->lpfnFree(retired->lpData);
+			SAFE_FREE(retired);
+		}
+		else
+			lpLink = &retired->lpNext;
+	}
+
+	LeaveCriticalSection(&m_csRetire);
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+// Reader threads that get a slot of their own. Any beyond that share one
+// counter, which only holds reclamation back while they are inside.
+#define EPOCH_MAX_READERS	64
+
+typedef void (*LPEPOCHFREE)(LPVOID lpData);
+
+// Something unlinked by a writer, waiting for readers that may still see it
+typedef struct EPOCHRETIRED
+{
+	LPVOID lpData;
+	LPEPOCHFREE lpfnFree;
+	LONG lEpoch;
+	struct EPOCHRETIRED *lpNext;
+} EPOCHRETIRED, *LPEPOCHRETIRED;
+
+// Epoch based reclamation for structures that are read without locks.
+// Readers publish the epoch they entered in; a writer unlinks an object,
+// retires it under the current epoch and moves the epoch on. The object is
+// freed once every reader inside was seen to have entered after that.
+// Read sections don't nest.
+class CEpoch
+{
+public:
+	CEpoch(void);
+	~CEpoch(void);
+
+	void Enter(void);
+	void Leave(void);
+	void Retire(LPVOID lpData, LPEPOCHFREE lpfnFree);
+	void Reclaim(void);
+	void Synchronize(void);
+
+protected:
+	int GetSlot(void);
+
+	DWORD m_dwTls;
+	volatile LONG m_lEpoch;
+	volatile LONG m_lReaders[EPOCH_MAX_READERS];
+	volatile LONG m_lSlots;
+	volatile LONG m_lShared;
+
+	LPEPOCHRETIRED m_lpRetired;
+	CRITICAL_SECTION m_csRetire;
+};
\ No newline at end of file
@@ -0,0 +1,508 @@
+#include "stdafx.h"
+#include "./Generator.h"
+#include "./PacketBuilder.h"
+#include "./Protocol.h"
+#include "./Var.h"
+#include "./keywords.h"
+
+// A viewer's session in a busy region, by packets of each type. Object
+// updates and the viewer's own AgentUpdate stream make up most of it.
+static struct
+{
+	char *lpszCmd;
+	DWORD dwWeight;
+} observed_mix[] =
+{
+	{ "ImprovedTerseObjectUpdate",	300 },
+	{ "AgentUpdate",				200 },
+	{ "PacketAck",					120 },
+	{ "ObjectUpdateCompressed",		60 },
+	{ "ObjectUpdate",				40 },
+	{ "LayerData",					40 },
+	{ "ObjectUpdateCached",			30 },
+	{ "CoarseLocationUpdate",		30 },
+	{ "AvatarAnimation",			30 },
+	{ "ViewerEffect",				30 },
+	{ "ImagePacket",				20 },
+	{ "ImageData",					20 },
+	{ "RequestImage",				15 },
+	{ "KillObject",					15 },
+	{ "AttachedSound",				10 },
+	{ "SoundTrigger",				10 },
+	{ "SimStats",					10 },
+	{ "SimulatorViewerTimeMessage",	10 },
+	{ "StartPingCheck",				10 },
+	{ "CompletePingCheck",			10 },
+	{ "RequestMultipleObjects",		5 },
+	{ "AgentAnimation",				5 },
+	{ "ChatFromSimulator",			5 },
+	{ "TransferPacket",				5 },
+	{ "AgentThrottle",				1 },
+	{ NULL,							0 }
+};
+
+static int clamp(int n, int nLow, int nHigh)
+{
+	return (n < nLow) ? nLow : (n > nHigh) ? nHigh : n;
+}
+
+CGenerator::CGenerator(void)
+{
+	m_options.nMinItems = 1;
+	m_options.nMaxItems = 8;
+	m_options.nMaxVarLen = 64;
+	m_options.nZeros = 30;
+	m_options.nZerocoded = 100;
+	m_options.nReliable = 20;
+	m_options.nResent = 5;
+	m_options.nAcks = 10;
+	m_options.nMaxAcks = 8;
+	m_options.nSent = 25;
+	m_options.nCircuits = 4;
+	m_options.nMaxLen = GENERATOR_PACKET_LEN;
+
+	m_lpMix = NULL;
+	m_nMix = 0;
+	m_nMaxMix = 0;
+
+	m_lpSequences = NULL;
+	m_lpOpened = NULL;
+	m_nCircuits = 0;
+
+	m_lpCounts = NULL;
+	m_nMaxCounts = 0;
+	m_lpLens = NULL;
+	m_nMaxLens = 0;
+
+	m_lpUseCircuitCode = NULL;
+
+	Seed(1);
+}
+
+CGenerator::~CGenerator(void)
+{
+	Free();
+}
+
+void CGenerator::Free(void)
+{
+	SAFE_FREE(m_lpMix);
+	SAFE_FREE(m_lpSequences);
+	SAFE_FREE(m_lpOpened);
+	SAFE_FREE(m_lpCounts);
+	SAFE_FREE(m_lpLens);
+
+	m_nMix = m_nMaxMix = 0;
+	m_nCircuits = 0;
+	m_nMaxCounts = 0;
+	m_nMaxLens = 0;
+}
+
+void CGenerator::Seed(ULONGLONG ullSeed)
+{
+	// Xorshift never leaves a zero state
+	m_ullState = ullSeed ? ullSeed : 0x9e3779b97f4a7c15ULL;
+}
+
+// Add a message type to the mix. Options must be set first, as a type
+// whose smallest packet is longer than m_options.nMaxLen is left out.
+bool CGenerator::AddMix(LPCOMMAND lpCommand, DWORD dwWeight)
+{
+	if (!lpCommand || !dwWeight)
+		return false;
+
+	if (!m_lpUseCircuitCode)
+		m_lpUseCircuitCode = find_command("UseCircuitCode");
+
+	int nSize = Shape(lpCommand, 31, 0);
+
+	if (nSize < 0 || nSize > m_options.nMaxLen)
+		return false;
+
+	if (!Grow((void **)&m_lpMix, m_nMaxMix, m_nMix + 1, sizeof(GENERATORMIX)))
+		return false;
+
+	GENERATORMIX *lpMix = &m_lpMix[m_nMix];
+
+	lpMix->lpCommand = lpCommand;
+	lpMix->dwWeight = dwWeight;
+	lpMix->dwTotal = (m_nMix ? m_lpMix[m_nMix - 1].dwTotal : 0) + dwWeight;
+
+	m_nMix++;
+
+	return true;
+}
+
+// Add a comma separated mix: "observed", "uniform" for every message type
+// in the template, or message names each with an optional ":weight".
+// Fails on a name the template doesn't have.
+bool CGenerator::AddMix(char *lpszMix)
+{
+	char szItem[256];
+
+	while (*lpszMix)
+	{
+		char *lpszEnd = strchr(lpszMix, ',');
+		int nLen = lpszEnd ? (int)(lpszEnd - lpszMix) : (int)strlen(lpszMix);
+
+		if (nLen >= (int)sizeof(szItem))
+			return false;
+
+		memcpy(szItem, lpszMix, nLen);
+		szItem[nLen] = '\0';
+		lpszMix += lpszEnd ? nLen + 1 : nLen;
+
+		if (!nLen)
+			continue;
+
+		if (!stricmp(szItem, "observed"))
+		{
+			for (int i = 0; observed_mix[i].lpszCmd; i++)
+				AddMix(find_command(observed_mix[i].lpszCmd), observed_mix[i].dwWeight);
+		}
+		else if (!stricmp(szItem, "uniform"))
+		{
+			for (int i = 0; i < MAX_COMMANDS_HIGH; i++)
+			{
+				if (cmds_high[i].lpszCmd)
+					AddMix(&cmds_high[i], 1);
+			}
+
+			for (int i = 0; i < MAX_COMMANDS_MEDIUM; i++)
+			{
+				if (cmds_med[i].lpszCmd)
+					AddMix(&cmds_med[i], 1);
+			}
+
+			for (int i = 0; i < MAX_COMMANDS_LOW; i++)
+			{
+				if (cmds_low[i].lpszCmd)
+					AddMix(&cmds_low[i], 1);
+			}
+		}
+		else
+		{
+			char *lpszWeight = strchr(szItem, ':');
+			DWORD dwWeight = 1;
+
+			if (lpszWeight)
+			{
+				*lpszWeight++ = '\0';
+				dwWeight = (DWORD)atoi(lpszWeight);
+			}
+
+			LPCOMMAND lpCommand = find_command(szItem);
+
+			if (!lpCommand)
+				return false;
+
+			AddMix(lpCommand, dwWeight);
+		}
+	}
+
+	return true;
+}
+
+int CGenerator::CountMix(void)
+{
+	return m_nMix;
+}
+
+// Generate the next packet into lpBuffer, returning its length or -1 when
+// the mix is empty or nothing fits. lpPlain, if given, gets the same packet
+// without zero coding and must hold m_options.nMaxLen bytes.
+int CGenerator::Next(LPBYTE lpBuffer, int nMaxLen, LPGENERATEDPACKET lpPacket, LPBYTE lpPlain)
+{
+	if (!m_nMix || m_options.nCircuits <= 0)
+		return -1;
+
+	if (m_nCircuits != m_options.nCircuits)
+	{
+		SAFE_FREE(m_lpSequences);
+		SAFE_FREE(m_lpOpened);
+
+		m_lpSequences = (WORD *)malloc(m_options.nCircuits * 2 * sizeof(WORD));
+		m_lpOpened = (bool *)calloc(m_options.nCircuits, sizeof(bool));
+		m_nCircuits = 0;
+
+		if (!m_lpSequences || !m_lpOpened)
+			return -1;
+
+		for (int i = 0; i < m_options.nCircuits * 2; i++)
+			m_lpSequences[i] = 1;
+
+		m_nCircuits = m_options.nCircuits;
+	}
+
+	int nCircuit = (int)Random((DWORD)m_nCircuits);
+	LPCOMMAND lpCommand;
+	bool bSent;
+
+	// Each circuit opens the way a viewer's does, so tools that look for
+	// the viewer by its UseCircuitCode find it
+	if (!m_lpOpened[nCircuit] && m_lpUseCircuitCode)
+	{
+		lpCommand = m_lpUseCircuitCode;
+		bSent = true;
+		m_lpOpened[nCircuit] = true;
+	}
+	else
+	{
+		lpCommand = Pick();
+		bSent = Random(100) < (DWORD)m_options.nSent;
+	}
+
+	WORD *lpSequence = &m_lpSequences[nCircuit * 2 + (bSent ? 1 : 0)];
+	WORD wOther = m_lpSequences[nCircuit * 2 + (bSent ? 0 : 1)];
+	WORD wSequence = *lpSequence;
+	BYTE cFlags = 0;
+
+	if (Random(100) < (DWORD)m_options.nReliable)
+	{
+		cFlags |= MSG_RELIABLE;
+
+		// A resend repeats an earlier sequence number rather than taking one
+		if (wSequence > 1 && Random(100) < (DWORD)m_options.nResent)
+		{
+			cFlags |= MSG_RESENT;
+			wSequence -= 1 + (WORD)Random(clamp(wSequence - 1, 0, GENERATOR_RESEND_SPAN));
+		}
+	}
+
+	if (!(cFlags & MSG_RESENT))
+		(*lpSequence)++;
+
+	if (lpCommand->bZerocoded && Random(100) < (DWORD)m_options.nZerocoded)
+		cFlags |= MSG_ZEROCODED;
+
+	// Acks are for what came the other way
+	int nAcks = 0;
+
+	if (wOther > 1 && m_options.nMaxAcks > 0 && Random(100) < (DWORD)m_options.nAcks)
+		nAcks = 1 + (int)Random(clamp(m_options.nMaxAcks, 1, GENERATOR_MAX_ACKS));
+
+	// Draw the shape, halving the counts and lengths until it fits
+	int nShift = 0;
+	int nSize;
+
+	while ((nSize = Shape(lpCommand, nShift, nAcks)) > m_options.nMaxLen && nShift < 31)
+		nShift++;
+
+	if (nSize > m_options.nMaxLen && nAcks)
+		nSize = Shape(lpCommand, nShift, nAcks = 0);
+
+	if (nSize < 0 || nSize > m_options.nMaxLen)
+		return -1;
+
+	CPacketBuilder builder;
+	CPacketBuilder plain;
+
+	if (!builder.Begin(lpBuffer, nMaxLen, cFlags, wSequence) || !builder.SetCommand(lpCommand))
+		return -1;
+
+	if (lpPlain && (!plain.Begin(lpPlain, m_options.nMaxLen, cFlags & ~MSG_ZEROCODED, wSequence) || !plain.SetCommand(lpCommand)))
+		return -1;
+
+	int nCount = 0;
+	int nLen = 0;
+
+	for (LPCOMMANDSTRUCT lpStruct = lpCommand->structs; lpStruct; lpStruct = lpStruct->lpNext)
+	{
+		BYTE cItems = 1;
+
+		if (lpStruct->nType == LLTYPE_VARIABLE)
+			cItems = m_lpCounts[nCount++];
+		else if (lpStruct->nType == LLTYPE_MULTIPLE)
+			cItems = lpStruct->cItems;
+
+		builder.AddBlock(cItems);
+
+		if (lpPlain)
+			plain.AddBlock(cItems);
+
+		for (BYTE c = 0; c < cItems; c++)
+		{
+			for (LPCOMMANDVAR lpVar = lpStruct->vars; lpVar; lpVar = lpVar->lpNext)
+			{
+				int nFieldLen;
+
+				if (lpVar->nType == LLTYPE_VARIABLE)
+					nFieldLen = m_lpLens[nLen++];
+				else
+					nFieldLen = CVar::GetWireSize(lpVar->nType, lpVar->nTypeLen, NULL);
+
+				Fill(m_bField, nFieldLen);
+				builder.AddVar(m_bField, nFieldLen);
+
+				if (lpPlain)
+					plain.AddVar(m_bField, nFieldLen);
+			}
+		}
+	}
+
+	for (int i = 0; i < nAcks; i++)
+	{
+		DWORD dwID = (DWORD)(WORD)(wOther - 1 - (WORD)Random(clamp(wOther - 1, 0, GENERATOR_RESEND_SPAN)));
+
+		lpPacket->dwAcks[i] = dwID;
+		builder.AddAck(dwID);
+
+		if (lpPlain)
+			plain.AddAck(dwID);
+	}
+
+	PACKETSEGMENT segments[PACKET_SEGMENTS];
+	int nPacketLen = builder.End();
+
+	if (nPacketLen < 0 || (lpPlain && plain.End(segments) < 0))
+		return -1;
+
+	lpPacket->lpCommand = lpCommand;
+	lpPacket->nCircuit = nCircuit;
+	lpPacket->bSent = bSent;
+	lpPacket->wSequence = wSequence;
+	lpPacket->nBodyLen = lpPlain ? segments[PACKET_SEGMENT_HEADER].nLen + segments[PACKET_SEGMENT_BODY].nLen : 0;
+	lpPacket->cAcks = (BYTE)nAcks;
+
+	ZeroMemory(&lpPacket->address, sizeof(lpPacket->address));
+	lpPacket->address.sin_family = AF_INET;
+	lpPacket->address.sin_addr.s_addr = htonl(0x0a010001 + nCircuit);
+	lpPacket->address.sin_port = htons(13000);
+
+	return nPacketLen;
+}
+
+// Xorshift64*, good enough for traffic and the same on every platform
+ULONGLONG CGenerator::Random(void)
+{
+	m_ullState ^= m_ullState >> 12;
+	m_ullState ^= m_ullState << 25;
+	m_ullState ^= m_ullState >> 27;
+
+	return m_ullState * 0x2545f4914f6cdd1dULL;
+}
+
+// Uniform in [0, dwRange)
+DWORD CGenerator::Random(DWORD dwRange)
+{
+	return (DWORD)(((Random() >> 32) * dwRange) >> 32);
+}
+
+LPCOMMAND CGenerator::Pick(void)
+{
+	DWORD dwPick = Random(m_lpMix[m_nMix - 1].dwTotal);
+	int nLow = 0;
+	int nHigh = m_nMix - 1;
+
+	while (nLow < nHigh)
+	{
+		int nMid = (nLow + nHigh) / 2;
+
+		if (m_lpMix[nMid].dwTotal > dwPick)
+			nHigh = nMid;
+		else
+			nLow = nMid + 1;
+	}
+
+	return m_lpMix[nLow].lpCommand;
+}
+
+// Draw the item counts of a packet's Variable blocks and the lengths of
+// its Variable fields, both shifted down by nShift, and return the packet's
+// size before zero coding
+int CGenerator::Shape(LPCOMMAND lpCommand, int nShift, int nAcks)
+{
+	int nCounts = 0;
+	int nLens = 0;
+
+	for (LPCOMMANDSTRUCT lpStruct = lpCommand->structs; lpStruct; lpStruct = lpStruct->lpNext)
+	{
+		int nItems = 1;
+		int nVars = 0;
+
+		if (lpStruct->nType == LLTYPE_VARIABLE)
+		{
+			int nMin = clamp(m_options.nMinItems, 0, 0xff) >> nShift;
+			int nMax = clamp(m_options.nMaxItems, 0, 0xff) >> nShift;
+
+			if (nMax < nMin)
+				nMax = nMin;
+
+			if (!Grow((void **)&m_lpCounts, m_nMaxCounts, nCounts + 1, sizeof(BYTE)))
+				return -1;
+
+			nItems = nMin + (int)Random((DWORD)(nMax - nMin + 1));
+			m_lpCounts[nCounts++] = (BYTE)nItems;
+		}
+		else if (lpStruct->nType == LLTYPE_MULTIPLE)
+		{
+			nItems = lpStruct->cItems;
+		}
+
+		for (LPCOMMANDVAR lpVar = lpStruct->vars; lpVar; lpVar = lpVar->lpNext)
+		{
+			if (lpVar->nType == LLTYPE_VARIABLE)
+				nVars++;
+		}
+
+		if (!nVars || !nItems)
+			continue;
+
+		if (!Grow((void **)&m_lpLens, m_nMaxLens, nLens + nItems * nVars, sizeof(int)))
+			return -1;
+
+		for (int i = 0; i < nItems; i++)
+		{
+			for (LPCOMMANDVAR lpVar = lpStruct->vars; lpVar; lpVar = lpVar->lpNext)
+			{
+				if (lpVar->nType != LLTYPE_VARIABLE)
+					continue;
+
+				int nMax = clamp(m_options.nMaxVarLen, 0, (lpVar->nTypeLen == 1) ? 0xff : 0xffff) >> nShift;
+
+				m_lpLens[nLens++] = (int)Random((DWORD)nMax + 1);
+			}
+		}
+	}
+
+	return CPacketBuilder::GetSize(lpCommand, m_lpCounts, m_lpLens, nAcks);
+}
+
+// Random field bytes, m_options.nZeros percent of them zero
+void CGenerator::Fill(LPBYTE lpData, int nLen)
+{
+	DWORD dwZeros = (DWORD)clamp(m_options.nZeros, 0, 100) * 256 / 100;
+
+	for (int i = 0; i < nLen; i += 4)
+	{
+		ULONGLONG ullBits = Random();
+
+		for (int j = 0; j < 4 && i + j < nLen; j++, ullBits >>= 16)
+		{
+			BYTE cValue = (BYTE)ullBits;
+
+			lpData[i + j] = ((DWORD)(BYTE)(ullBits >> 8) < dwZeros) ? 0 : (cValue ? cValue : 1);
+		}
+	}
+}
+
+bool CGenerator::Grow(void **lpArray, int &nMax, int nNeed, size_t stSize)
+{
+	if (nNeed <= nMax)
+		return true;
+
+	int nNewMax = (nMax > 0) ? nMax : 16;
+
+	while (nNewMax < nNeed)
+		nNewMax *= 2;
+
+	void *lpNew = realloc(*lpArray, nNewMax * stSize);
+
+	if (!lpNew)
+		return false;
+
+	*lpArray = lpNew;
+	nMax = nNewMax;
+
+	return true;
+}
\ No newline at end of file
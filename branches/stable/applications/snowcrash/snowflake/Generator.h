@@ -0,0 +1,101 @@
+#pragma once
+
+#include "./Template.h"
+
+// Most acks one packet can append, their count being a byte
+#define GENERATOR_MAX_ACKS		255
+
+// Longest packet generated unless asked otherwise, decoded, about the
+// largest a simulator sends
+#define GENERATOR_PACKET_LEN	1400
+
+// Sequence numbers a resent packet may reach back over
+#define GENERATOR_RESEND_SPAN	64
+
+// Shape of the generated traffic. Shares are percentages.
+typedef struct
+{
+	int nMinItems;			// Items in each Variable block
+	int nMaxItems;
+	int nMaxVarLen;			// Longest Variable field
+	int nZeros;				// Share of field bytes that are zero
+	int nZerocoded;			// Share of zerocoded message types sent zerocoded
+	int nReliable;			// Share flagged MSG_RELIABLE
+	int nResent;			// Share of reliable packets flagged MSG_RESENT
+	int nAcks;				// Share carrying appended acks
+	int nMaxAcks;
+	int nSent;				// Share sent by the viewer, otherwise received
+	int nCircuits;			// Simulators the traffic is spread over
+	int nMaxLen;			// Longest packet, decoded
+} GENERATOROPTIONS, *LPGENERATOROPTIONS;
+
+// What went into a generated packet, for checking it decodes back the same
+typedef struct
+{
+	LPCOMMAND lpCommand;
+	int nCircuit;
+	struct sockaddr_in address;		// The circuit's simulator
+	bool bSent;
+	WORD wSequence;
+	int nBodyLen;					// Without the ack trailer
+	BYTE cAcks;
+	DWORD dwAcks[GENERATOR_MAX_ACKS];
+} GENERATEDPACKET, *LPGENERATEDPACKET;
+
+// One message type of a mix and its weight
+typedef struct
+{
+	LPCOMMAND lpCommand;
+	DWORD dwWeight;
+	DWORD dwTotal;		// Running total of the weights up to this one
+} GENERATORMIX;
+
+// Synthesizes packets from the parsed template, in any mix of message
+// types, and of any shape within its options. Every packet is one the
+// template accepts, so whatever the decoder makes of it is checkable
+// against what was generated. The same seed gives the same traffic.
+class CGenerator
+{
+public:
+	CGenerator(void);
+	~CGenerator(void);
+
+	GENERATOROPTIONS m_options;
+
+	bool AddMix(LPCOMMAND lpCommand, DWORD dwWeight);
+	bool AddMix(char *lpszMix);
+	int CountMix(void);
+	void Free(void);
+	void Seed(ULONGLONG ullSeed);
+	int Next(LPBYTE lpBuffer, int nMaxLen, LPGENERATEDPACKET lpPacket, LPBYTE lpPlain = NULL);
+	ULONGLONG Random(void);
+	DWORD Random(DWORD dwRange);
+
+protected:
+	LPCOMMAND Pick(void);
+	int Shape(LPCOMMAND lpCommand, int nShift, int nAcks);
+	void Fill(LPBYTE lpData, int nLen);
+	bool Grow(void **lpArray, int &nMax, int nNeed, size_t stSize);
+
+	ULONGLONG m_ullState;
+
+	GENERATORMIX *m_lpMix;
+	int m_nMix;
+	int m_nMaxMix;
+
+	LPCOMMAND m_lpUseCircuitCode;
+
+	// Per circuit: the next sequence number each way, and whether it has
+	// been opened with UseCircuitCode yet
+	WORD *m_lpSequences;
+	bool *m_lpOpened;
+	int m_nCircuits;
+
+	// The shape of the packet being generated, in template order
+	LPBYTE m_lpCounts;
+	int m_nMaxCounts;
+	int *m_lpLens;
+	int m_nMaxLens;
+
+	BYTE m_bField[65536];
+};
\ No newline at end of file
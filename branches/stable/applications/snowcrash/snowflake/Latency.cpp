@@ -0,0 +1,202 @@
+#include "stdafx.h"
+#include "./Latency.h"
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+CLatency::CLatency(void)
+{
+	Reset();
+}
+
+CLatency::~CLatency(void)
+{
+}
+
+void CLatency::Reset(void)
+{
+	ZeroMemory(&m_ping, sizeof(m_ping));
+	ZeroMemory(&m_ack, sizeof(m_ack));
+	ZeroMemory((LPVOID)m_lPings, sizeof(m_lPings));
+	ZeroMemory((LPVOID)m_lReliable, sizeof(m_lReliable));
+
+	m_dwReliable = 0;
+	m_dwResent = 0;
+	m_dwLoss = 0;
+}
+
+// Microsecond clock; only differences are used, so wrapping is harmless
+DWORD CLatency::GetTime(void)
+{
+	static LONGLONG llFrequency = 0;
+	LARGE_INTEGER liCounter;
+
+	if (!llFrequency)
+	{
+		LARGE_INTEGER liFrequency;
+
+		if (!QueryPerformanceFrequency(&liFrequency) || !liFrequency.QuadPart)
+			return GetTickCount() * 1000;
+
+		llFrequency = liFrequency.QuadPart;
+	}
+
+	QueryPerformanceCounter(&liCounter);
+
+	return (DWORD)(liCounter.QuadPart * 1000000 / llFrequency);
+}
+
+// Wall clock microseconds since the epoch, as pcap timestamps are
+ULONGLONG CLatency::GetWallTime(void)
+{
+#ifdef _WIN32
+	FILETIME ft;
+
+	GetSystemTimeAsFileTime(&ft);
+
+	return ((((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime) - (ULONGLONG)11644473600 * 10000000) / 10;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (ULONGLONG)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+// Restamp a slot for wID. It is empty while the time changes, so nothing
+// can claim it with the wrong one.
+void CLatency::Publish(volatile LONG *lpSlot, volatile DWORD *lpSent, WORD wID)
+{
+	InterlockedExchange(lpSlot, 0);
+	*lpSent = GetTime();
+	InterlockedExchange(lpSlot, LATENCY_SLOT(wID));
+}
+
+// Take a pending slot for wID, leaving it empty. False if it isn't pending,
+// belongs to another ID, or the other thread got there first.
+bool CLatency::Claim(volatile LONG *lpSlot, volatile DWORD *lpSent, WORD wID, LONG &lSlot, DWORD &dwSent)
+{
+	lSlot = InterlockedCompareExchange(lpSlot, 0, 0);
+
+	while ((lSlot & LATENCY_PENDING) && LATENCY_ID(lSlot) == wID)
+	{
+		dwSent = *lpSent;
+
+		LONG lSeen = InterlockedCompareExchange(lpSlot, 0, lSlot);
+
+		if (lSeen == lSlot)
+			return true;
+
+		lSlot = lSeen;
+	}
+
+	return false;
+}
+
+void CLatency::PingStarted(BYTE cPingID)
+{
+	Publish(&m_lPings[cPingID], &m_dwPingSent[cPingID], cPingID);
+}
+
+void CLatency::PingCompleted(BYTE cPingID)
+{
+	LONG lSlot;
+	DWORD dwSent;
+
+	if (Claim(&m_lPings[cPingID], &m_dwPingSent[cPingID], cPingID, lSlot, dwSent))
+		AddSample(&m_ping, GetTime() - dwSent);
+}
+
+// A resent packet's ack can't be told apart from the original's, so it
+// gives no sample but does count towards loss
+void CLatency::ReliableSent(WORD wSequence, bool bResent)
+{
+	int nSlot = wSequence % LATENCY_WINDOW;
+
+	m_dwReliable++;
+
+	if (bResent)
+	{
+		LONG lOld = InterlockedCompareExchange(&m_lReliable[nSlot], 0, 0);
+		LONG lSeen;
+
+		m_dwResent++;
+
+		// Marked only while the original is still waiting for its ack
+		while ((lOld & LATENCY_PENDING) && LATENCY_ID(lOld) == wSequence && !(lOld & LATENCY_RESENT) &&
+			(lSeen = InterlockedCompareExchange(&m_lReliable[nSlot], lOld | LATENCY_RESENT, lOld)) != lOld)
+			lOld = lSeen;
+	}
+	else
+		Publish(&m_lReliable[nSlot], &m_dwReliableSent[nSlot], wSequence);
+
+	m_dwLoss = m_dwLoss - (m_dwLoss >> 4) + (bResent ? (65536 >> 4) : 0);
+}
+
+void CLatency::Acked(DWORD dwID)
+{
+	int nSlot = (WORD)dwID % LATENCY_WINDOW;
+	LONG lSlot;
+	DWORD dwSent;
+
+	if (Claim(&m_lReliable[nSlot], &m_dwReliableSent[nSlot], (WORD)dwID, lSlot, dwSent) && !(lSlot & LATENCY_RESENT))
+		AddSample(&m_ack, GetTime() - dwSent);
+}
+
+// Smoothing as in RFC 2988: srtt += (sample - srtt) / 8 and
+// rttvar += (|srtt - sample| - rttvar) / 4
+void CLatency::AddSample(LATENCYSTATS *stats, DWORD dwSample)
+{
+	if (!stats->dwSamples)
+	{
+		stats->dwSmoothed = dwSample;
+		stats->dwJitter = dwSample / 2;
+		stats->dwMin = dwSample;
+		stats->dwMax = dwSample;
+	}
+	else
+	{
+		long lDelta = (long)dwSample - (long)stats->dwSmoothed;
+		long lDeviation = (lDelta < 0) ? -lDelta : lDelta;
+
+		stats->dwJitter = (DWORD)((long)stats->dwJitter + (lDeviation - (long)stats->dwJitter) / 4);
+		stats->dwSmoothed = (DWORD)((long)stats->dwSmoothed + lDelta / 8);
+
+		if (dwSample < stats->dwMin)
+			stats->dwMin = dwSample;
+
+		if (dwSample > stats->dwMax)
+			stats->dwMax = dwSample;
+	}
+
+	int nBucket = 0;
+
+	for (DWORD dwMs = dwSample / 1000; dwMs && nBucket < LATENCY_BUCKETS - 1; dwMs >>= 1)
+		nBucket++;
+
+	stats->dwHistogram[nBucket]++;
+	stats->dwSamples++;
+}
+
+static void report_stats(FILE *fp, char *lpszName, char *lpszKind, LATENCYSTATS *stats)
+{
+	fprintf(fp, "%s\t%s\t%u\t%u\t%u\t%u\t%u", lpszName, lpszKind, stats->dwSamples,
+		stats->dwSmoothed, stats->dwJitter, stats->dwSamples ? stats->dwMin : 0, stats->dwMax);
+
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+		fprintf(fp, "\t%u", stats->dwHistogram[i]);
+
+	fprintf(fp, "\n");
+}
+
+// Tab separated, one line per kind of sample. Times are in microseconds and
+// loss in parts per thousand.
+void CLatency::Report(FILE *fp, char *lpszName)
+{
+	report_stats(fp, lpszName, "Ping", &m_ping);
+	report_stats(fp, lpszName, "Ack", &m_ack);
+
+	fprintf(fp, "%s\tLoss\t%u\t%u\t%u\n", lpszName, m_dwReliable, m_dwResent, (m_dwLoss * 1000) >> 16);
+}
\ No newline at end of file
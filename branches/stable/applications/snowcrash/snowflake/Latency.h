@@ -0,0 +1,74 @@
+#pragma once
+
+// Latency buckets are powers of two in milliseconds: bucket 0 holds samples
+// under 1ms, bucket n samples from 2^(n-1) up to 2^n ms, the last one the rest
+#define LATENCY_BUCKETS		16
+
+// Reliable packets awaiting an ack, indexed by sequence modulo the window
+#define LATENCY_WINDOW		1024
+
+// Smoothed round trip estimate over one kind of sample, in microseconds
+typedef struct
+{
+	DWORD dwSamples;
+	DWORD dwSmoothed;		// EWMA, gain 1/8
+	DWORD dwJitter;			// EWMA of the deviation from dwSmoothed, gain 1/4
+	DWORD dwMin;
+	DWORD dwMax;
+	DWORD dwHistogram[LATENCY_BUCKETS];
+} LATENCYSTATS;
+
+// A clock started on the sending thread and stopped on the receiving one,
+// without either taking a lock. Each slot is one word, the sequence number
+// or ping ID in the low 16 bits and the flags above, with the send time
+// kept beside it. The sender empties the slot before restamping the time
+// and publishes it after; the receiver reads the time between reading the
+// slot and claiming it by swapping it for zero, so a claim that succeeds
+// saw the time that went with it, and a sample is only ever taken once.
+#define LATENCY_PENDING		0x00010000
+#define LATENCY_RESENT		0x00020000
+
+#define LATENCY_SLOT(id)	(LATENCY_PENDING | (WORD)(id))
+#define LATENCY_ID(slot)	((WORD)(slot))
+
+// Always-on latency bookkeeping for one circuit: StartPingCheck to
+// CompletePingCheck round trips, and the delay from sending a reliable
+// packet to seeing it acked. Everything is inline, so recording a sample
+// never allocates, and nothing is locked. The send counters are only
+// written on the sending thread and the samples only on the receiving
+// one; the pending slots in between are swapped whole.
+class CLatency
+{
+public:
+	CLatency(void);
+	~CLatency(void);
+
+	LATENCYSTATS m_ping;
+	LATENCYSTATS m_ack;
+
+	DWORD m_dwReliable;
+	DWORD m_dwResent;
+	DWORD m_dwLoss;			// EWMA share of reliable sends that were resends, out of 65536
+
+	void Reset(void);
+	void PingStarted(BYTE cPingID);
+	void PingCompleted(BYTE cPingID);
+	void ReliableSent(WORD wSequence, bool bResent);
+	void Acked(DWORD dwID);
+	void Report(FILE *fp, char *lpszName);
+
+	static DWORD GetTime(void);
+	static ULONGLONG GetWallTime(void);
+
+protected:
+	void AddSample(LATENCYSTATS *stats, DWORD dwSample);
+
+	void Publish(volatile LONG *lpSlot, volatile DWORD *lpSent, WORD wID);
+	bool Claim(volatile LONG *lpSlot, volatile DWORD *lpSent, WORD wID, LONG &lSlot, DWORD &dwSent);
+
+	volatile LONG m_lPings[256];
+	volatile DWORD m_dwPingSent[256];
+
+	volatile LONG m_lReliable[LATENCY_WINDOW];
+	volatile DWORD m_dwReliableSent[LATENCY_WINDOW];
+};
\ No newline at end of file
@@ -0,0 +1,383 @@
+#include "stdafx.h"
+#include "./Log.h"
+
+CLog logger;
+
+CLogRing::CLogRing(void)
+{
+	m_lpData = NULL;
+	m_dwLen = 0;
+	m_lHead = 0;
+	m_lTail = 0;
+	m_lDropped = 0;
+	m_lReported = 0;
+	m_lpNext = NULL;
+}
+
+CLogRing::~CLogRing(void)
+{
+	SAFE_FREE(m_lpData);
+}
+
+CLog::CLog(void)
+{
+	m_nPolicy = LOG_DROP;
+	m_dwWritten = 0;
+
+	m_fp = NULL;
+	m_bText = true;
+	m_dwTls = TLS_OUT_OF_INDEXES;
+	m_dwRingLen = 0;
+	m_lpRings = NULL;
+
+	m_lpBatch = NULL;
+	m_nBatch = 0;
+
+	m_hWake = NULL;
+	m_hThread = NULL;
+	m_bStop = false;
+
+	InitializeCriticalSection(&m_csRings);
+}
+
+CLog::~CLog(void)
+{
+	Stop();
+	DeleteCriticalSection(&m_csRings);
+}
+
+// fp may be NULL to log to the console only
+bool CLog::Start(FILE *fp, int nPolicy, DWORD dwRingLen, bool bText)
+{
+	Stop();
+
+	// Whole lines must always fit, and offsets wrap with a mask
+	m_dwRingLen = LOG_LINE_LEN;
+
+	while (m_dwRingLen < dwRingLen)
+		m_dwRingLen *= 2;
+
+	m_fp = fp;
+	m_bText = bText;
+	m_nPolicy = nPolicy;
+	m_dwWritten = 0;
+	m_nBatch = 0;
+	m_bStop = false;
+
+	m_lpBatch = (LPBYTE)malloc(LOG_BATCH_LEN);
+	m_dwTls = TlsAlloc();
+
+	if (!m_lpBatch || m_dwTls == TLS_OUT_OF_INDEXES)
+	{
+		Stop();
+		return false;
+	}
+
+	m_hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	if (!m_hWake)
+	{
+		Stop();
+		return false;
+	}
+
+	m_hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+
+	if (!m_hThread)
+	{
+		Stop();
+		return false;
+	}
+
+	return true;
+}
+
+// Only once no thread is in the hooks any more. Whatever is queued is
+// flushed before the rings go.
+void CLog::Stop(void)
+{
+	if (m_hThread)
+	{
+		m_bStop = true;
+		SetEvent(m_hWake);
+		WaitForSingleObject(m_hThread, INFINITE);
+		CloseHandle(m_hThread);
+		m_hThread = NULL;
+	}
+
+	if (m_hWake)
+	{
+		CloseHandle(m_hWake);
+		m_hWake = NULL;
+	}
+
+	EnterCriticalSection(&m_csRings);
+
+	while (m_lpRings)
+	{
+		CLogRing *next = m_lpRings->m_lpNext;
+		SAFE_DELETE(m_lpRings);
+		m_lpRings = next;
+	}
+
+	if (m_dwTls != TLS_OUT_OF_INDEXES)
+	{
+		TlsFree(m_dwTls);
+		m_dwTls = TLS_OUT_OF_INDEXES;
+	}
+
+	LeaveCriticalSection(&m_csRings);
+
+	SAFE_FREE(m_lpBatch);
+	m_fp = NULL;
+}
+
+// Copy a formatted line into the calling thread's ring. False if the log
+// isn't running, in which case the caller should write the line itself.
+bool CLog::Write(LPCTSTR lpszLine, int nLen)
+{
+	return Write((LPBYTE)lpszLine, nLen, NULL, 0);
+}
+
+// Copy a record, in up to two parts, into the calling thread's ring as one
+// unit. The flusher only ever sees whole records.
+bool CLog::Write(LPBYTE lpHead, int nHead, LPBYTE lpData, int nLen)
+{
+	if (!m_hThread)
+		return false;
+
+	CLogRing *ring = GetRing();
+
+	if (!ring)
+		return false;
+
+	int nTotal = nHead + nLen;
+
+	if (nTotal <= 0)
+		return true;
+
+	if ((DWORD)nTotal > ring->m_dwLen)
+	{
+		ring->m_lDropped++;
+		return true;
+	}
+
+	DWORD dwHead = (DWORD)ring->m_lHead;
+
+	while (dwHead - (DWORD)ring->m_lTail > ring->m_dwLen - nTotal)
+	{
+		if (m_nPolicy != LOG_BLOCK)
+		{
+			ring->m_lDropped++;
+			return true;
+		}
+
+		SetEvent(m_hWake);
+		Sleep(0);
+	}
+
+	DWORD dwUsed = dwHead - (DWORD)ring->m_lTail;
+
+	Copy(ring, dwHead, lpHead, nHead);
+	Copy(ring, dwHead + nHead, lpData, nLen);
+
+	InterlockedExchangeAdd(&ring->m_lHead, nTotal);
+
+	// The flusher comes round on its own; only hurry it once the ring
+	// passes half full
+	if (dwUsed < ring->m_dwLen / 2 && dwUsed + nTotal >= ring->m_dwLen / 2)
+		SetEvent(m_hWake);
+
+	return true;
+}
+
+bool CLog::IsRunning(void)
+{
+	return m_hThread != NULL;
+}
+
+// Records lost to full rings, over all threads
+DWORD CLog::GetDropped(void)
+{
+	DWORD dwDropped = 0;
+
+	EnterCriticalSection(&m_csRings);
+
+	for (CLogRing *ring = m_lpRings; ring; ring = ring->m_lpNext)
+		dwDropped += ring->m_lDropped;
+
+	LeaveCriticalSection(&m_csRings);
+
+	return dwDropped;
+}
+
+// Copy into a ring at a byte position, wrapping at the end
+void CLog::Copy(CLogRing *ring, DWORD dwPos, LPBYTE lpData, int nLen)
+{
+	DWORD dwOffset = dwPos & (ring->m_dwLen - 1);
+	DWORD dwFirst = ring->m_dwLen - dwOffset;
+
+	if (nLen <= 0)
+		return;
+
+	if (dwFirst > (DWORD)nLen)
+		dwFirst = nLen;
+
+	memcpy(&ring->m_lpData[dwOffset], lpData, dwFirst);
+	memcpy(ring->m_lpData, lpData + dwFirst, nLen - dwFirst);
+}
+
+// The calling thread's ring, created on first use
+CLogRing *CLog::GetRing(void)
+{
+	CLogRing *ring = (CLogRing *)TlsGetValue(m_dwTls);
+
+	if (ring)
+		return ring;
+
+	ring = new CLogRing;
+
+	if (!ring)
+		return NULL;
+
+	ring->m_lpData = (LPBYTE)malloc(m_dwRingLen);
+
+	if (!ring->m_lpData)
+	{
+		SAFE_DELETE(ring);
+		return NULL;
+	}
+
+	ring->m_dwLen = m_dwRingLen;
+
+	EnterCriticalSection(&m_csRings);
+
+	ring->m_lpNext = m_lpRings;
+	m_lpRings = ring;
+
+	LeaveCriticalSection(&m_csRings);
+
+	TlsSetValue(m_dwTls, ring);
+
+	return ring;
+}
+
+DWORD WINAPI CLog::ThreadProc(LPVOID lpParam)
+{
+	((CLog *)lpParam)->Run();
+
+	return 0;
+}
+
+void CLog::Run(void)
+{
+	for (;;)
+	{
+		// Read before draining, so lines written up to Stop() still go out
+		bool bStop = m_bStop;
+
+		if (Drain() > 0)
+		{
+			Output(m_lpBatch, m_nBatch);
+			m_nBatch = 0;
+
+			if (m_fp)
+				fflush(m_fp);
+		}
+
+		if (bStop)
+			break;
+
+		WaitForSingleObject(m_hWake, LOG_FLUSH_MS);
+	}
+}
+
+// Move everything queued into the batch a ring at a time, writing the batch
+// out whenever it fills. Rings only hold whole lines, so lines of different
+// threads never interleave. Returns the bytes moved.
+int CLog::Drain(void)
+{
+	int nDrained = 0;
+
+	// Rings are only ever added at the head, and only freed once we're gone
+	EnterCriticalSection(&m_csRings);
+	CLogRing *lpRings = m_lpRings;
+	LeaveCriticalSection(&m_csRings);
+
+	for (CLogRing *ring = lpRings; ring; ring = ring->m_lpNext)
+	{
+		DWORD dwTail = (DWORD)ring->m_lTail;
+		DWORD dwHead = (DWORD)ring->m_lHead;
+
+		MemoryBarrier();
+
+		while (dwTail != dwHead)
+		{
+			DWORD dwOffset = dwTail & (ring->m_dwLen - 1);
+			DWORD dwLen = dwHead - dwTail;
+
+			if (dwLen > ring->m_dwLen - dwOffset)
+				dwLen = ring->m_dwLen - dwOffset;
+
+			if (dwLen > (DWORD)(LOG_BATCH_LEN - m_nBatch))
+				dwLen = LOG_BATCH_LEN - m_nBatch;
+
+			memcpy(&m_lpBatch[m_nBatch], &ring->m_lpData[dwOffset], dwLen);
+			m_nBatch += dwLen;
+			dwTail += dwLen;
+			nDrained += dwLen;
+
+			InterlockedExchangeAdd(&ring->m_lTail, (LONG)dwLen);
+
+			if (m_nBatch == LOG_BATCH_LEN)
+			{
+				Output(m_lpBatch, m_nBatch);
+				m_nBatch = 0;
+			}
+		}
+
+		LONG lDropped = ring->m_lDropped;
+
+		if (m_bText && lDropped != ring->m_lReported)
+		{
+			char szLine[64];
+			int nLen = _snprintf(szLine, sizeof(szLine), "[log] %d lines dropped\n", (int)(lDropped - ring->m_lReported));
+
+			ring->m_lReported = lDropped;
+
+			if (m_nBatch + nLen > LOG_BATCH_LEN)
+			{
+				Output(m_lpBatch, m_nBatch);
+				m_nBatch = 0;
+			}
+
+			memcpy(&m_lpBatch[m_nBatch], szLine, nLen);
+			m_nBatch += nLen;
+			nDrained += nLen;
+		}
+	}
+
+	return nDrained;
+}
+
+void CLog::Output(LPBYTE lpData, int nLen)
+{
+	if (nLen <= 0)
+		return;
+
+	if (m_bText)
+	{
+#ifdef _WIN32
+		DWORD dwWrote;
+
+		WriteConsole(GetStdHandle(STD_OUTPUT_HANDLE), lpData, nLen, &dwWrote, NULL);
+#else
+		fwrite(lpData, 1, nLen, stdout);
+#endif
+	}
+
+	if (m_fp)
+		fwrite(lpData, 1, nLen, m_fp);
+
+	m_dwWritten += nLen;
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#define LOG_RING_LEN		(256 * 1024)	// Bytes per thread, a power of two
+#define LOG_LINE_LEN		8192
+#define LOG_BATCH_LEN		(64 * 1024)
+#define LOG_FLUSH_MS		50
+
+// What a thread does when its ring is full
+#define LOG_DROP			0			// Lose the line and count it
+#define LOG_BLOCK			1			// Wait for the flusher to make room
+
+// One thread's lines on their way to the flusher. Only the owning thread
+// advances the head and only the flusher advances the tail, so neither
+// side ever takes a lock.
+class CLogRing
+{
+public:
+	CLogRing(void);
+	~CLogRing(void);
+
+	LPBYTE m_lpData;
+	DWORD m_dwLen;
+	volatile LONG m_lHead;		// Bytes written so far
+	volatile LONG m_lTail;		// Bytes flushed so far
+	volatile LONG m_lDropped;	// Lines lost to a full ring
+	LONG m_lReported;			// Dropped lines the flusher has owned up to
+
+	CLogRing *m_lpNext;
+};
+
+// Moves dprintf output off the hooked threads. Each thread copies its line
+// into its own ring; a flusher thread drains every ring in batches and does
+// the console and file writes, with one fflush per pass. Lines of one
+// thread stay in order, lines of different threads may not. A log started
+// without bText carries binary records to its file instead, and counts
+// what it drops rather than saying so in the stream.
+class CLog
+{
+public:
+	CLog(void);
+	~CLog(void);
+
+	bool Start(FILE *fp, int nPolicy, DWORD dwRingLen = LOG_RING_LEN, bool bText = true);
+	void Stop(void);
+	bool Write(LPCTSTR lpszLine, int nLen);
+	bool Write(LPBYTE lpHead, int nHead, LPBYTE lpData, int nLen);
+	bool IsRunning(void);
+	DWORD GetDropped(void);
+
+	int m_nPolicy;
+	DWORD m_dwWritten;			// Bytes flushed, over all threads
+
+protected:
+	static DWORD WINAPI ThreadProc(LPVOID lpParam);
+	void Run(void);
+	CLogRing *GetRing(void);
+	void Copy(CLogRing *ring, DWORD dwPos, LPBYTE lpData, int nLen);
+	int Drain(void);
+	void Output(LPBYTE lpData, int nLen);
+
+	FILE *m_fp;
+	bool m_bText;
+	DWORD m_dwTls;
+	DWORD m_dwRingLen;
+	CLogRing *m_lpRings;
+	CRITICAL_SECTION m_csRings;
+
+	LPBYTE m_lpBatch;
+	int m_nBatch;
+
+	HANDLE m_hWake;
+	HANDLE m_hThread;
+	volatile bool m_bStop;
+};
+
+extern CLog logger;
\ No newline at end of file
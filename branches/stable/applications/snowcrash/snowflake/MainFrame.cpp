@@ -1,5 +1,5 @@
-#include "StdAfx.h"
-#include ".\MainFrame.h"
+#include "stdafx.h"
+#include "./MainFrame.h"
 
 CMainFrame::CMainFrame()
 {
@@ -0,0 +1,114 @@
+#include "stdafx.h"
+#include "./MappedFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+CMappedFile::CMappedFile(void)
+{
+	m_lpData = NULL;
+	m_stLen = 0;
+
+#ifdef _WIN32
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+#else
+	m_nFile = -1;
+#endif
+}
+
+CMappedFile::~CMappedFile(void)
+{
+	Close();
+}
+
+// An empty file opens fine, with nothing mapped
+bool CMappedFile::Open(const char *lpszPath)
+{
+	Close();
+
+#ifdef _WIN32
+	LARGE_INTEGER liSize;
+
+	m_hFile = CreateFile(lpszPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if (m_hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_hFile, &liSize))
+	{
+		Close();
+		return false;
+	}
+
+	m_stLen = (size_t)liSize.QuadPart;
+
+	if (!m_stLen)
+		return true;
+
+	m_hMapping = CreateFileMapping(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	if (m_hMapping)
+		m_lpData = (LPBYTE)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	struct stat st;
+
+	m_nFile = open(lpszPath, O_RDONLY);
+
+	if (m_nFile < 0 || fstat(m_nFile, &st))
+	{
+		Close();
+		return false;
+	}
+
+	m_stLen = (size_t)st.st_size;
+
+	if (!m_stLen)
+		return true;
+
+	void *lpData = mmap(NULL, m_stLen, PROT_READ, MAP_PRIVATE, m_nFile, 0);
+
+	if (lpData != MAP_FAILED)
+	{
+		m_lpData = (LPBYTE)lpData;
+		madvise(lpData, m_stLen, MADV_SEQUENTIAL);
+	}
+#endif
+
+	if (!m_lpData)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void CMappedFile::Close(void)
+{
+#ifdef _WIN32
+	if (m_lpData)
+		UnmapViewOfFile(m_lpData);
+
+	if (m_hMapping)
+		CloseHandle(m_hMapping);
+
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+#else
+	if (m_lpData)
+		munmap(m_lpData, m_stLen);
+
+	if (m_nFile >= 0)
+		close(m_nFile);
+
+	m_nFile = -1;
+#endif
+
+	m_lpData = NULL;
+	m_stLen = 0;
+}
\ No newline at end of file
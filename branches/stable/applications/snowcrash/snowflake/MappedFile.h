@@ -0,0 +1,24 @@
+#pragma once
+
+// A whole file mapped read only, for scanning captures without copying
+// them into memory first
+class CMappedFile
+{
+public:
+	CMappedFile(void);
+	~CMappedFile(void);
+
+	bool Open(const char *lpszPath);
+	void Close(void);
+
+	LPBYTE m_lpData;
+	size_t m_stLen;
+
+protected:
+#ifdef _WIN32
+	HANDLE m_hFile;
+	HANDLE m_hMapping;
+#else
+	int m_nFile;
+#endif
+};
\ No newline at end of file
@@ -1,115 +1,178 @@
-#include "StdAfx.h"
-#include ".\Message.h"
+#include "stdafx.h"
+#include "./Message.h"
 
 CMessage::CMessage(void)
 {
 	m_lpBlocks = NULL;
+	m_nBlocks = 0;
+	m_nMaxBlocks = 0;
+
+	m_lpItems = NULL;
+	m_nItems = 0;
+	m_nMaxItems = 0;
+
+	m_lpVars = NULL;
+	m_nVars = 0;
+	m_nMaxVars = 0;
+
+	m_lpData = NULL;
+	m_nLen = 0;
+	m_nMaxLen = 0;
+
 	m_lpszCommand = NULL;
 }
 
 CMessage::~CMessage(void)
 {
 	FreeBlocks();
-	SAFE_FREE(m_lpszCommand);
 }
 
 void CMessage::FreeBlocks(void)
 {
-	CBlockList *blocks = m_lpBlocks;
+	SAFE_DELETE_ARRAY(m_lpBlocks);
+	SAFE_DELETE_ARRAY(m_lpItems);
+	SAFE_DELETE_ARRAY(m_lpVars);
+	SAFE_FREE(m_lpData);
+
+	m_nBlocks = m_nMaxBlocks = 0;
+	m_nItems = m_nMaxItems = 0;
+	m_nVars = m_nMaxVars = 0;
+	m_nLen = m_nMaxLen = 0;
+}
+
+// Size the layout for a whole message up front, growing the arrays only
+// when the existing capacity is too small
+bool CMessage::Reserve(int nBlocks, int nItems, int nVars, int nLen)
+{
+	Reset();
 
-	while (blocks)
+	if (nBlocks > m_nMaxBlocks)
 	{
-		if (blocks->m_lpNext)
-		{
-			blocks = blocks->m_lpNext;
+		SAFE_DELETE_ARRAY(m_lpBlocks);
+		m_nMaxBlocks = 0;
+		m_lpBlocks = new CBlockList[nBlocks];
 
-			if (blocks->m_lpPrev)
-				SAFE_DELETE(blocks->m_lpPrev);
-		}
-		else
-			SAFE_DELETE(blocks);
+		if (!m_lpBlocks) return false;
+
+		m_nMaxBlocks = nBlocks;
 	}
 
-	m_lpBlocks = NULL;
-}
+	if (nItems > m_nMaxItems)
+	{
+		SAFE_DELETE_ARRAY(m_lpItems);
+		m_nMaxItems = 0;
+		m_lpItems = new CBlock[nItems];
 
-bool CMessage::AddBlock(char *lpszBlock, int nType, CBlock *lpBlock)
-{
-	CBlockList *blocks = FindBlock(lpszBlock);
+		if (!m_lpItems) return false;
 
-	if (blocks)
+		m_nMaxItems = nItems;
+	}
+
+	if (nVars > m_nMaxVars)
 	{
-		return blocks->AddBlock(lpBlock);
+		SAFE_DELETE_ARRAY(m_lpVars);
+		m_nMaxVars = 0;
+		m_lpVars = new CVar[nVars];
+
+		if (!m_lpVars) return false;
+
+		m_nMaxVars = nVars;
 	}
-	else
+
+	if (nLen > m_nMaxLen)
 	{
-		if (m_lpBlocks)
-		{
-			blocks = m_lpBlocks;
+		SAFE_FREE(m_lpData);
+		m_nMaxLen = 0;
+		m_lpData = (LPBYTE)malloc(nLen);
 
-			while (blocks->m_lpNext)
-				blocks = blocks->m_lpNext;
+		if (!m_lpData) return false;
 
-			blocks->m_lpNext = new CBlockList;
+		m_nMaxLen = nLen;
+	}
 
-			if (!blocks->m_lpNext) return false;
+	return true;
+}
 
-			blocks->m_lpNext->m_lpNext = NULL;
-			blocks->m_lpNext->m_lpPrev = blocks;
-			blocks->m_lpNext->SetBlock(lpszBlock);
-			blocks->m_lpNext->SetType(nType);
-			blocks->m_lpNext->AddBlock(lpBlock);
+// Empty the message but keep its capacity
+void CMessage::Reset(void)
+{
+	m_nBlocks = 0;
+	m_nItems = 0;
+	m_nVars = 0;
+	m_nLen = 0;
+	m_lpszCommand = NULL;
+}
 
-			return true;
-		}
-		else
-		{
-			blocks = new CBlockList;
+LPBYTE CMessage::SetData(LPBYTE lpData, int nLen)
+{
+	if (nLen > m_nMaxLen)
+		return NULL;
 
-			if (!blocks) return false;
+	memcpy(m_lpData, lpData, nLen);
+	m_nLen = nLen;
 
-			m_lpBlocks = blocks;
-			m_lpBlocks->m_lpNext = NULL;
-			m_lpBlocks->m_lpPrev = NULL;
-			m_lpBlocks->SetBlock(lpszBlock);
-			m_lpBlocks->SetType(nType);
-			m_lpBlocks->AddBlock(lpBlock);
+	return m_lpData;
+}
 
-			return true;
-		}
+CBlockList *CMessage::AddBlockList(char *lpszBlock, int nType)
+{
+	if (m_nBlocks >= m_nMaxBlocks)
+		return NULL;
 
-		return false;
-	}
+	CBlockList *blocks = &m_lpBlocks[m_nBlocks++];
+
+	blocks->SetBlock(lpszBlock);
+	blocks->SetType(nType);
+	blocks->m_lpBlocks = &m_lpItems[m_nItems];
+	blocks->cItems = 0;
+
+	return blocks;
+}
+
+// Blocks are appended in template order, so the new instance always
+// belongs to the last block list
+CBlock *CMessage::AddBlock(CBlockList *lpBlocks)
+{
+	if (m_nItems >= m_nMaxItems || !lpBlocks)
+		return NULL;
+
+	CBlock *block = &m_lpItems[m_nItems++];
+
+	block->m_lpVars = &m_lpVars[m_nVars];
+	block->cItems = 0;
+	lpBlocks->cItems++;
+
+	return block;
+}
+
+CVar *CMessage::AddVar(CBlock *lpBlock)
+{
+	if (m_nVars >= m_nMaxVars || !lpBlock)
+		return NULL;
+
+	CVar *var = &m_lpVars[m_nVars++];
+
+	lpBlock->cItems++;
+
+	return var;
 }
 
 CBlock *CMessage::GetBlock(char *lpszBlock, int nIndex)
 {
-	CBlockList *blocks = m_lpBlocks;
+	CBlockList *blocks = FindBlock(lpszBlock);
 
-	while (blocks)
-	{
-		if (blocks->m_lpszBlock && !stricmp(lpszBlock, blocks->m_lpszBlock))
-		{
-			CBlock *block = blocks->GetBlock(nIndex);
-			return block;
-		}
-		
-		blocks = blocks->m_lpNext;
-	}
+	if (blocks)
+		return blocks->GetBlock(nIndex);
 
 	return NULL;
 }
 
 CBlockList *CMessage::FindBlock(char *lpszBlock)
 {
-	CBlockList *blocks = m_lpBlocks;
-
-	while (blocks)
+	for (int i = 0; i < m_nBlocks; i++)
 	{
-		if (blocks->m_lpszBlock && !stricmp(lpszBlock, blocks->m_lpszBlock))
-			return blocks;
-		
-		blocks = blocks->m_lpNext;
+		if (m_lpBlocks[i].m_lpszBlock && !stricmp(lpszBlock, m_lpBlocks[i].m_lpszBlock))
+			return &m_lpBlocks[i];
 	}
 
 	return NULL;
@@ -165,24 +228,30 @@ bool CMessage::GetBool(char *lpszBlock, int nIndex, char *lpszVar, bool &lpbBool
 	return false;
 }
 
-void CMessage::SetCommand(char *lpszCommand)
+// Copy a fixed size field out as it is on the wire. Fails if the field
+// isn't exactly nLen bytes.
+bool CMessage::GetData(char *lpszBlock, int nIndex, char *lpszVar, LPVOID lpData, int nLen)
 {
-	if (lpszCommand)
+	CBlock *block = GetBlock(lpszBlock, nIndex);
+
+	if (block)
 	{
-		size_t stLen = strlen(lpszCommand);
+		CVar *var = block->FindVar(lpszVar);
 
-		if (stLen > 0)
+		if (var && var->m_nLen == nLen)
 		{
-			SAFE_FREE(m_lpszCommand);
-			m_lpszCommand = (char *)malloc(stLen + 1);
-
-			if (m_lpszCommand)
-			{
-				strncpy(m_lpszCommand, lpszCommand, stLen);
-				m_lpszCommand[stLen] = '\0';
-			}
+			memcpy(lpData, var->m_lpData, nLen);
+
+			return true;
 		}
-	}			
+	}
+
+	return false;
+}
+
+void CMessage::SetCommand(char *lpszCommand)
+{
+	m_lpszCommand = lpszCommand;
 }
 
 void CMessage::Dump(void)
@@ -190,28 +259,20 @@ void CMessage::Dump(void)
 	if (m_lpszCommand)
 		dprintf("----- %s -----\n", m_lpszCommand);
 
-	CBlockList *blocks = m_lpBlocks;
-
-	while (blocks)
-	{
-		blocks->Dump();
-		blocks = blocks->m_lpNext;
-	}
+	for (int i = 0; i < m_nBlocks; i++)
+		m_lpBlocks[i].Dump();
 }
 
 int CMessage::Pack(LPBYTE lpData)
 {
 	int nTotalWrote = 0;
-	int nWrote = 0;
 	LPBYTE lpPtr = lpData;
-	CBlockList *blocks = m_lpBlocks;
 
-	while (blocks)
+	for (int i = 0; i < m_nBlocks; i++)
 	{
-		nWrote = blocks->Pack(lpPtr);
+		int nWrote = m_lpBlocks[i].Pack(lpPtr);
 		lpPtr += nWrote;
 		nTotalWrote += nWrote;
-		blocks = blocks->m_lpNext;
 	}
 
 	return nTotalWrote;
@@ -1,6 +1,6 @@
 #pragma once
 
-#include ".\BlockList.h"
+#include "./BlockList.h"
 
 class CMessage
 {
@@ -8,11 +8,36 @@ public:
 	CMessage(void);
 	~CMessage(void);
 
-	CBlockList	*m_lpBlocks;
+	// One entry per template block, in template order
+	CBlockList *m_lpBlocks;
+	int m_nBlocks;
+	int m_nMaxBlocks;
+
+	// Every block instance of the message, contiguous
+	CBlock *m_lpItems;
+	int m_nItems;
+	int m_nMaxItems;
+
+	// Every field of every block instance, contiguous
+	CVar *m_lpVars;
+	int m_nVars;
+	int m_nMaxVars;
+
+	// Copy of the message body the fields point into
+	LPBYTE m_lpData;
+	int m_nLen;
+	int m_nMaxLen;
+
+	// Points into the message template, not owned
 	char *m_lpszCommand;
-	
+
 	void FreeBlocks(void);
-	bool AddBlock(char *lpszBlock, int nType, CBlock *lpBlock);
+	bool Reserve(int nBlocks, int nItems, int nVars, int nLen);
+	void Reset(void);
+	LPBYTE SetData(LPBYTE lpData, int nLen);
+	CBlockList *AddBlockList(char *lpszBlock, int nType);
+	CBlock *AddBlock(CBlockList *lpBlocks);
+	CVar *AddVar(CBlock *lpBlock);
 	CBlockList *FindBlock(char *lpszBlock);
 	CBlock *GetBlock(char *lpszBlock, int nIndex);
 	int CountBlock(char *lpszBlock);
@@ -21,5 +46,5 @@ public:
 	int Pack(LPBYTE lpData);
 	bool GetString(char *lpszBlock, int nIndex, char *lpszVar, char &lpszStr);
 	bool GetBool(char *lpszBlock, int nIndex, char *lpszVar, bool &lpbBool);
+	bool GetData(char *lpszBlock, int nIndex, char *lpszVar, LPVOID lpData, int nLen);
 };
-
@@ -0,0 +1,75 @@
+#include "stdafx.h"
+#include "./MessagePool.h"
+
+CMessagePool::CMessagePool(void)
+{
+	m_lpMessages = NULL;
+	m_lpCounts = NULL;
+	m_nCommands = 0;
+}
+
+CMessagePool::~CMessagePool(void)
+{
+	Free();
+}
+
+// Size the pool for every command in the parsed template
+bool CMessagePool::Init(int nCommands)
+{
+	Free();
+
+	m_lpMessages = (CMessage **)calloc(nCommands * MESSAGEPOOL_DEPTH, sizeof(CMessage *));
+	m_lpCounts = (BYTE *)calloc(nCommands, sizeof(BYTE));
+
+	if (!m_lpMessages || !m_lpCounts)
+	{
+		Free();
+		return false;
+	}
+
+	m_nCommands = nCommands;
+
+	return true;
+}
+
+void CMessagePool::Free(void)
+{
+	if (m_lpMessages && m_lpCounts)
+	{
+		for (int i = 0; i < m_nCommands; i++)
+		{
+			for (int j = 0; j < m_lpCounts[i]; j++)
+				SAFE_DELETE(m_lpMessages[i * MESSAGEPOOL_DEPTH + j]);
+		}
+	}
+
+	SAFE_FREE(m_lpMessages);
+	SAFE_FREE(m_lpCounts);
+	m_nCommands = 0;
+}
+
+CMessage *CMessagePool::Alloc(LPCOMMAND lpCommand)
+{
+	int nIndex = lpCommand->nIndex;
+
+	if (nIndex < m_nCommands && m_lpCounts[nIndex] > 0)
+		return m_lpMessages[nIndex * MESSAGEPOOL_DEPTH + --m_lpCounts[nIndex]];
+
+	return new CMessage;
+}
+
+void CMessagePool::Release(LPCOMMAND lpCommand, CMessage *msg)
+{
+	if (!msg)
+		return;
+
+	int nIndex = lpCommand->nIndex;
+
+	if (nIndex < m_nCommands && m_lpCounts[nIndex] < MESSAGEPOOL_DEPTH)
+	{
+		msg->Reset();
+		m_lpMessages[nIndex * MESSAGEPOOL_DEPTH + m_lpCounts[nIndex]++] = msg;
+	}
+	else
+		delete msg;
+}
\ No newline at end of file
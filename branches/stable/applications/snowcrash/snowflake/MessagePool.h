@@ -0,0 +1,26 @@
+#pragma once
+
+#include "./Template.h"
+#include "./Message.h"
+
+// Decoded messages kept per message type for reuse
+#define MESSAGEPOOL_DEPTH	4
+
+// Recycles decoded messages per message type. A released message keeps its
+// block, field and body capacity, so once every type has been seen at its
+// largest shape decoding allocates nothing.
+class CMessagePool
+{
+public:
+	CMessagePool(void);
+	~CMessagePool(void);
+
+	CMessage **m_lpMessages;
+	BYTE *m_lpCounts;
+	int m_nCommands;
+
+	bool Init(int nCommands);
+	void Free(void);
+	CMessage *Alloc(LPCOMMAND lpCommand);
+	void Release(LPCOMMAND lpCommand, CMessage *msg);
+};
@@ -0,0 +1,444 @@
+#include "stdafx.h"
+#include "./PacketBuilder.h"
+#include "./keywords.h"
+
+// Length of the message ID that follows the packet header
+static int get_id_len(LPCOMMAND lpCommand)
+{
+	if (lpCommand->wFrequency == MSG_FREQ_HIGH)
+		return 1;
+	else if (lpCommand->wFrequency == MSG_FREQ_MED)
+		return 2;
+
+	return 4;
+}
+
+CPacketBuilder::CPacketBuilder(void)
+{
+	m_lpBuffer = NULL;
+	m_nMaxLen = 0;
+	m_nLen = 0;
+	m_nBodyEnd = 0;
+	m_bZerocoded = false;
+	m_cZeros = 0;
+	m_cAcks = 0;
+	m_bFailed = false;
+
+	m_lpCommand = NULL;
+	m_lpStruct = NULL;
+	m_lpVar = NULL;
+	m_cItems = 0;
+}
+
+CPacketBuilder::~CPacketBuilder(void)
+{
+}
+
+// Exact unencoded size of a packet, given one count per Variable template
+// block and one length per Variable field, both in template order. Zero
+// coding can shrink the body or grow it by up to half its length.
+int CPacketBuilder::GetSize(LPCOMMAND lpCommand, LPBYTE lpCounts, int *lpLens, int nAcks)
+{
+	int nSize = MSG_HEADER_LEN + get_id_len(lpCommand);
+	LPCOMMANDSTRUCT lpStruct = lpCommand->structs;
+
+	while (lpStruct)
+	{
+		BYTE cItems = 1;
+
+		if (lpStruct->nType == LLTYPE_VARIABLE)
+		{
+			cItems = *lpCounts++;
+			nSize += sizeof(cItems);
+		}
+		else if (lpStruct->nType == LLTYPE_MULTIPLE)
+		{
+			cItems = lpStruct->cItems;
+		}
+
+		for (BYTE c = 0; c < cItems; c++)
+		{
+			LPCOMMANDVAR lpVar = lpStruct->vars;
+
+			while (lpVar)
+			{
+				if (lpVar->nType == LLTYPE_VARIABLE)
+					nSize += lpVar->nTypeLen + *lpLens++;
+				else
+					nSize += CVar::GetWireSize(lpVar->nType, lpVar->nTypeLen, NULL);
+
+				lpVar = lpVar->lpNext;
+			}
+		}
+
+		lpStruct = lpStruct->lpNext;
+	}
+
+	if (nAcks > 0)
+		nSize += nAcks * sizeof(DWORD) + sizeof(BYTE);
+
+	return nSize;
+}
+
+// Exact unencoded size of a decoded message once serialized
+int CPacketBuilder::GetSize(LPCOMMAND lpCommand, CMessage *msg, int nAcks)
+{
+	int nSize = MSG_HEADER_LEN + get_id_len(lpCommand);
+
+	for (int i = 0; i < msg->m_nBlocks; i++)
+	{
+		if (msg->m_lpBlocks[i].m_nType == LLTYPE_VARIABLE)
+			nSize += sizeof(BYTE);
+	}
+
+	for (int i = 0; i < msg->m_nVars; i++)
+	{
+		CVar *var = &msg->m_lpVars[i];
+
+		if (var->m_nType == LLTYPE_VARIABLE)
+			nSize += var->m_nTypeLen + var->m_nLen;
+		else
+			nSize += var->m_nLen;
+	}
+
+	if (nAcks > 0)
+		nSize += nAcks * sizeof(DWORD) + sizeof(BYTE);
+
+	return nSize;
+}
+
+bool CPacketBuilder::Begin(LPBYTE lpBuffer, int nMaxLen, BYTE cFlags, WORD wSequence)
+{
+	BYTE bHeader[MSG_HEADER_LEN];
+
+	wSequence = htons(wSequence);
+
+	bHeader[0] = cFlags;
+	bHeader[1] = 0;
+	memcpy(&bHeader[2], &wSequence, sizeof(wSequence));
+
+	return Begin(lpBuffer, nMaxLen, bHeader);
+}
+
+// Start a packet with a copy of an existing wire header
+bool CPacketBuilder::Begin(LPBYTE lpBuffer, int nMaxLen, LPBYTE lpHeader)
+{
+	m_lpBuffer = lpBuffer;
+	m_nMaxLen = nMaxLen;
+	m_nLen = 0;
+	m_nBodyEnd = 0;
+	m_bZerocoded = (lpHeader[0] & MSG_ZEROCODED) ? true : false;
+	m_cZeros = 0;
+	m_cAcks = 0;
+	m_bFailed = false;
+
+	m_lpCommand = NULL;
+	m_lpStruct = NULL;
+	m_lpVar = NULL;
+	m_cItems = 0;
+
+	return WriteRaw(lpHeader, MSG_HEADER_LEN);
+}
+
+bool CPacketBuilder::SetCommand(LPCOMMAND lpCommand)
+{
+	BYTE bID[4];
+	int nLen = get_id_len(lpCommand);
+
+	if (m_lpCommand || m_nLen != MSG_HEADER_LEN)
+	{
+		m_bFailed = true;
+		return false;
+	}
+
+	if (nLen == 1)
+	{
+		bID[0] = (BYTE)lpCommand->wID;
+	}
+	else if (nLen == 2)
+	{
+		bID[0] = 0xff;
+		bID[1] = (BYTE)lpCommand->wID;
+	}
+	else
+	{
+		bID[0] = 0xff;
+		bID[1] = 0xff;
+		bID[2] = (BYTE)(lpCommand->wID >> 8);
+		bID[3] = (BYTE)lpCommand->wID;
+	}
+
+	m_lpCommand = lpCommand;
+
+	return Write(bID, nLen);
+}
+
+// Move on to the next template block. Single blocks take one item, Multiple
+// blocks their template count and Variable blocks write their count byte.
+bool CPacketBuilder::AddBlock(BYTE cItems)
+{
+	LPCOMMANDSTRUCT lpStruct = NULL;
+
+	if (m_lpCommand && !m_cItems)
+		lpStruct = (m_lpStruct) ? m_lpStruct->lpNext : m_lpCommand->structs;
+
+	if (!lpStruct)
+	{
+		m_bFailed = true;
+		return false;
+	}
+
+	if (lpStruct->nType == LLTYPE_VARIABLE)
+	{
+		if (!Write(&cItems, sizeof(cItems)))
+			return false;
+	}
+	else if ((lpStruct->nType == LLTYPE_MULTIPLE && cItems != lpStruct->cItems) ||
+		(lpStruct->nType != LLTYPE_MULTIPLE && cItems != 1))
+	{
+		m_bFailed = true;
+		return false;
+	}
+
+	m_lpStruct = lpStruct;
+	m_lpVar = lpStruct->vars;
+	m_cItems = (m_lpVar) ? cItems : 0;
+
+	return true;
+}
+
+// Write the next field of the current block item in template order
+bool CPacketBuilder::AddVar(LPBYTE lpData, int nLen)
+{
+	if (!m_lpVar || m_cItems == 0)
+	{
+		m_bFailed = true;
+		return false;
+	}
+
+	if (m_lpVar->nType == LLTYPE_VARIABLE)
+	{
+		if (m_lpVar->nTypeLen == 1 && nLen <= 0xff)
+		{
+			BYTE cDataLen = (BYTE)nLen;
+
+			if (!Write(&cDataLen, sizeof(cDataLen)))
+				return false;
+		}
+		else if (m_lpVar->nTypeLen == 2 && nLen <= 0xffff)
+		{
+			WORD cDataLen = (WORD)nLen;
+
+			if (!Write((LPBYTE)&cDataLen, sizeof(cDataLen)))
+				return false;
+		}
+		else
+		{
+			m_bFailed = true;
+			return false;
+		}
+	}
+	else if (nLen != CVar::GetWireSize(m_lpVar->nType, m_lpVar->nTypeLen, NULL))
+	{
+		m_bFailed = true;
+		return false;
+	}
+
+	if (!Write(lpData, nLen))
+		return false;
+
+	return NextVar();
+}
+
+// Serialize a decoded message straight from its flat field arrays
+bool CPacketBuilder::AddMessage(CMessage *msg)
+{
+	for (int i = 0; i < msg->m_nBlocks; i++)
+	{
+		CBlockList *blocks = &msg->m_lpBlocks[i];
+
+		if (!AddBlock(blocks->cItems))
+			return false;
+
+		for (int j = 0; j < blocks->cItems; j++)
+		{
+			CBlock *block = &blocks->m_lpBlocks[j];
+
+			for (int k = 0; k < block->cItems; k++)
+			{
+				if (!AddVar(block->m_lpVars[k].m_lpData, block->m_lpVars[k].m_nLen))
+					return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// Append already serialized body bytes, message ID included, bypassing the
+// template. Used to re-encode a decoded buffer that was not modified.
+bool CPacketBuilder::AddBody(LPBYTE lpData, int nLen)
+{
+	if (m_lpCommand)
+	{
+		m_bFailed = true;
+		return false;
+	}
+
+	return Write(lpData, nLen);
+}
+
+bool CPacketBuilder::AddAck(DWORD dwID)
+{
+	if (m_cAcks == 0xff || !FlushZeros())
+	{
+		m_bFailed = true;
+		return false;
+	}
+
+	if (!m_cAcks)
+		m_nBodyEnd = m_nLen;
+
+	dwID = htonl(dwID);
+
+	if (!WriteRaw((LPBYTE)&dwID, sizeof(dwID)))
+		return false;
+
+	m_cAcks++;
+
+	return true;
+}
+
+// Append acks that are already in wire order, such as a received trailer
+bool CPacketBuilder::AddAcks(LPBYTE lpAcks, BYTE cAcks)
+{
+	if ((int)m_cAcks + cAcks > 0xff || !FlushZeros())
+	{
+		m_bFailed = true;
+		return false;
+	}
+
+	if (!m_cAcks)
+		m_nBodyEnd = m_nLen;
+
+	if (!WriteRaw(lpAcks, cAcks * sizeof(DWORD)))
+		return false;
+
+	m_cAcks += cAcks;
+
+	return true;
+}
+
+// Finish the packet, returning its length or -1 if it did not fit, did not
+// follow the template or was left incomplete
+int CPacketBuilder::End(LPPACKETSEGMENT lpSegments)
+{
+	if (!FlushZeros())
+		return -1;
+
+	if (m_lpCommand && (m_cItems || (m_lpStruct ? m_lpStruct->lpNext : m_lpCommand->structs)))
+		m_bFailed = true;
+
+	if (m_bFailed)
+		return -1;
+
+	if (m_cAcks)
+	{
+		if (!WriteRaw(&m_cAcks, sizeof(m_cAcks)))
+			return -1;
+
+		m_lpBuffer[0] |= MSG_APPENDED_ACKS;
+	}
+	else
+	{
+		m_nBodyEnd = m_nLen;
+		m_lpBuffer[0] &= ~MSG_APPENDED_ACKS;
+	}
+
+	if (lpSegments)
+	{
+		lpSegments[PACKET_SEGMENT_HEADER].lpData = m_lpBuffer;
+		lpSegments[PACKET_SEGMENT_HEADER].nLen = MSG_HEADER_LEN;
+		lpSegments[PACKET_SEGMENT_BODY].lpData = &m_lpBuffer[MSG_HEADER_LEN];
+		lpSegments[PACKET_SEGMENT_BODY].nLen = m_nBodyEnd - MSG_HEADER_LEN;
+		lpSegments[PACKET_SEGMENT_ACKS].lpData = &m_lpBuffer[m_nBodyEnd];
+		lpSegments[PACKET_SEGMENT_ACKS].nLen = m_nLen - m_nBodyEnd;
+	}
+
+	return m_nLen;
+}
+
+// Write body bytes, run length encoding zeros when zero coding is on
+bool CPacketBuilder::Write(LPBYTE lpData, int nLen)
+{
+	if (m_cAcks)
+	{
+		m_bFailed = true;
+		return false;
+	}
+
+	if (!m_bZerocoded)
+		return WriteRaw(lpData, nLen);
+
+	for (int i = 0; i < nLen; i++)
+	{
+		if (lpData[i] == 0x00)
+		{
+			if (++m_cZeros == 0xff && !FlushZeros())
+				return false;
+		}
+		else
+		{
+			if (m_cZeros && !FlushZeros())
+				return false;
+
+			if (m_nLen >= m_nMaxLen)
+			{
+				m_bFailed = true;
+				return false;
+			}
+
+			m_lpBuffer[m_nLen++] = lpData[i];
+		}
+	}
+
+	return true;
+}
+
+bool CPacketBuilder::WriteRaw(LPBYTE lpData, int nLen)
+{
+	if (m_bFailed || m_nLen + nLen > m_nMaxLen)
+	{
+		m_bFailed = true;
+		return false;
+	}
+
+	memcpy(&m_lpBuffer[m_nLen], lpData, nLen);
+	m_nLen += nLen;
+
+	return true;
+}
+
+bool CPacketBuilder::FlushZeros(void)
+{
+	if (m_cZeros)
+	{
+		BYTE bRun[2] = { 0x00, m_cZeros };
+
+		m_cZeros = 0;
+
+		return WriteRaw(bRun, sizeof(bRun));
+	}
+
+	return !m_bFailed;
+}
+
+bool CPacketBuilder::NextVar(void)
+{
+	m_lpVar = m_lpVar->lpNext;
+
+	if (!m_lpVar && --m_cItems > 0)
+		m_lpVar = m_lpStruct->vars;
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "./Template.h"
+#include "./Message.h"
+
+#define PACKET_SEGMENT_HEADER	0
+#define PACKET_SEGMENT_BODY		1
+#define PACKET_SEGMENT_ACKS		2
+#define PACKET_SEGMENTS			3
+
+// Scatter/gather view of a finished packet, laid out like a WSABUF
+typedef struct
+{
+	int nLen;
+	LPBYTE lpData;
+} PACKETSEGMENT, *LPPACKETSEGMENT;
+
+// Writes a message straight into a caller supplied wire buffer, following
+// the template block by block and field by field. When the header carries
+// MSG_ZEROCODED the body is zero coded as it is written.
+class CPacketBuilder
+{
+public:
+	CPacketBuilder(void);
+	~CPacketBuilder(void);
+
+	static int GetSize(LPCOMMAND lpCommand, LPBYTE lpCounts, int *lpLens, int nAcks);
+	static int GetSize(LPCOMMAND lpCommand, CMessage *msg, int nAcks);
+
+	bool Begin(LPBYTE lpBuffer, int nMaxLen, BYTE cFlags, WORD wSequence);
+	bool Begin(LPBYTE lpBuffer, int nMaxLen, LPBYTE lpHeader);
+	bool SetCommand(LPCOMMAND lpCommand);
+	bool AddBlock(BYTE cItems = 1);
+	bool AddVar(LPBYTE lpData, int nLen);
+	bool AddMessage(CMessage *msg);
+	bool AddBody(LPBYTE lpData, int nLen);
+	bool AddAck(DWORD dwID);
+	bool AddAcks(LPBYTE lpAcks, BYTE cAcks);
+	int End(LPPACKETSEGMENT lpSegments = NULL);
+
+protected:
+	bool Write(LPBYTE lpData, int nLen);
+	bool WriteRaw(LPBYTE lpData, int nLen);
+	bool FlushZeros(void);
+	bool NextVar(void);
+
+	LPBYTE m_lpBuffer;
+	int m_nMaxLen;
+	int m_nLen;
+	int m_nBodyEnd;
+	bool m_bZerocoded;
+	BYTE m_cZeros;
+	BYTE m_cAcks;
+	bool m_bFailed;
+
+	LPCOMMAND m_lpCommand;
+	LPCOMMANDSTRUCT m_lpStruct;
+	LPCOMMANDVAR m_lpVar;
+	BYTE m_cItems;
+};
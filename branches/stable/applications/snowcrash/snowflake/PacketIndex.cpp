@@ -0,0 +1,298 @@
+#include "stdafx.h"
+#include "./PacketIndex.h"
+#include "./Var.h"
+#include "./keywords.h"
+
+// Grow an array to hold at least nNeed entries, keeping its contents
+static bool grow_array(void **lpArray, int &nMax, int nNeed, size_t stSize)
+{
+	if (nNeed <= nMax)
+		return true;
+
+	int nNewMax = (nMax > 0) ? nMax : 16;
+
+	while (nNewMax < nNeed)
+		nNewMax *= 2;
+
+	void *lpNew = realloc(*lpArray, nNewMax * stSize);
+
+	if (!lpNew)
+		return false;
+
+	*lpArray = lpNew;
+	nMax = nNewMax;
+
+	return true;
+}
+
+CPacketIndex::CPacketIndex(void)
+{
+	m_lpCommand = NULL;
+	m_lpData = NULL;
+	m_nLen = 0;
+	m_nMaxLen = 0;
+
+	m_lpBlocks = NULL;
+	m_nBlocks = 0;
+	m_nMaxBlocks = 0;
+
+	m_lpVars = NULL;
+	m_nVars = 0;
+	m_nMaxVars = 0;
+
+	m_lpOffsets = NULL;
+	m_nFields = 0;
+	m_nMaxFields = 0;
+}
+
+CPacketIndex::~CPacketIndex(void)
+{
+	Free();
+}
+
+void CPacketIndex::Free(void)
+{
+	SAFE_FREE(m_lpBlocks);
+	SAFE_FREE(m_lpVars);
+	SAFE_FREE(m_lpOffsets);
+
+	m_nBlocks = m_nMaxBlocks = 0;
+	m_nVars = m_nMaxVars = 0;
+	m_nFields = m_nMaxFields = 0;
+}
+
+// Index a decoded packet. lpData is the whole decoded buffer, nPos the
+// offset of the first block and nMaxLen how far the buffer may grow when a
+// Variable field is lengthened. Capacity is kept between packets.
+bool CPacketIndex::Build(LPCOMMAND lpCommand, LPBYTE lpData, int nLen, int nPos, int nMaxLen)
+{
+	int nBlocks = 0;
+	int nVars = 0;
+	LPCOMMANDSTRUCT lpStruct = lpCommand->structs;
+
+	while (lpStruct)
+	{
+		for (LPCOMMANDVAR lpVar = lpStruct->vars; lpVar; lpVar = lpVar->lpNext)
+			nVars++;
+
+		nBlocks++;
+		lpStruct = lpStruct->lpNext;
+	}
+
+	if (!grow_array((void **)&m_lpBlocks, m_nMaxBlocks, nBlocks, sizeof(PACKETBLOCK)) ||
+		!grow_array((void **)&m_lpVars, m_nMaxVars, nVars, sizeof(LPCOMMANDVAR)))
+		return false;
+
+	m_lpCommand = lpCommand;
+	m_lpData = lpData;
+	m_nLen = nLen;
+	m_nMaxLen = nMaxLen;
+	m_nBlocks = 0;
+	m_nVars = 0;
+	m_nFields = 0;
+
+	lpStruct = lpCommand->structs;
+
+	while (lpStruct)
+	{
+		LPPACKETBLOCK block = &m_lpBlocks[m_nBlocks++];
+		BYTE cItems = 1;
+
+		block->lpStruct = lpStruct;
+		block->nCountOffset = -1;
+		block->nFirstVar = m_nVars;
+		block->nVars = 0;
+
+		for (LPCOMMANDVAR lpVar = lpStruct->vars; lpVar; lpVar = lpVar->lpNext)
+		{
+			m_lpVars[m_nVars++] = lpVar;
+			block->nVars++;
+		}
+
+		if (lpStruct->nType == LLTYPE_VARIABLE)
+		{
+			if (nPos + (int)sizeof(cItems) > nLen)
+				return false;
+
+			block->nCountOffset = nPos;
+			memcpy(&cItems, &lpData[nPos], sizeof(cItems));
+			nPos += sizeof(cItems);
+		}
+		else if (lpStruct->nType == LLTYPE_MULTIPLE)
+		{
+			cItems = lpStruct->cItems;
+		}
+
+		block->cItems = cItems;
+		block->nFirstField = m_nFields;
+
+		if (!grow_array((void **)&m_lpOffsets, m_nMaxFields, m_nFields + cItems * block->nVars, sizeof(int)))
+			return false;
+
+		for (BYTE c = 0; c < cItems; c++)
+		{
+			for (int v = 0; v < block->nVars; v++)
+			{
+				LPCOMMANDVAR lpVar = m_lpVars[block->nFirstVar + v];
+
+				if (lpVar->nType == LLTYPE_VARIABLE && nPos + lpVar->nTypeLen > nLen)
+					return false;
+
+				m_lpOffsets[m_nFields++] = nPos;
+				nPos += CVar::GetWireSize(lpVar->nType, lpVar->nTypeLen, &lpData[nPos]);
+
+				if (nPos > nLen)
+					return false;
+			}
+		}
+
+		lpStruct = lpStruct->lpNext;
+	}
+
+	return true;
+}
+
+// Resolve names to indices once, so later lookups and patches are O(1)
+int CPacketIndex::FindBlock(char *lpszBlock)
+{
+	for (int i = 0; i < m_nBlocks; i++)
+	{
+		if (m_lpBlocks[i].lpStruct->lpszStruct && !stricmp(lpszBlock, m_lpBlocks[i].lpStruct->lpszStruct))
+			return i;
+	}
+
+	return -1;
+}
+
+int CPacketIndex::FindVar(int nBlock, char *lpszVar)
+{
+	if (nBlock < 0 || nBlock >= m_nBlocks)
+		return -1;
+
+	for (int i = 0; i < m_lpBlocks[nBlock].nVars; i++)
+	{
+		LPCOMMANDVAR lpVar = m_lpVars[m_lpBlocks[nBlock].nFirstVar + i];
+
+		if (lpVar->lpszVar && !stricmp(lpszVar, lpVar->lpszVar))
+			return i;
+	}
+
+	return -1;
+}
+
+int CPacketIndex::CountBlock(int nBlock)
+{
+	if (nBlock < 0 || nBlock >= m_nBlocks)
+		return 0;
+
+	return m_lpBlocks[nBlock].cItems;
+}
+
+int CPacketIndex::GetField(int nBlock, int nItem, int nVar)
+{
+	if (nBlock < 0 || nBlock >= m_nBlocks)
+		return -1;
+
+	LPPACKETBLOCK block = &m_lpBlocks[nBlock];
+
+	if (nItem < 0 || nItem >= block->cItems || nVar < 0 || nVar >= block->nVars)
+		return -1;
+
+	return block->nFirstField + nItem * block->nVars + nVar;
+}
+
+// Pointer to a field's bytes in the buffer, past any length prefix
+LPBYTE CPacketIndex::GetVar(int nBlock, int nItem, int nVar, int &nLen)
+{
+	int nField = GetField(nBlock, nItem, nVar);
+
+	nLen = 0;
+
+	if (nField < 0)
+		return NULL;
+
+	LPCOMMANDVAR lpVar = m_lpVars[m_lpBlocks[nBlock].nFirstVar + nVar];
+	LPBYTE lpData = &m_lpData[m_lpOffsets[nField]];
+
+	nLen = CVar::GetWireSize(lpVar->nType, lpVar->nTypeLen, lpData);
+
+	if (lpVar->nType == LLTYPE_VARIABLE)
+	{
+		lpData += lpVar->nTypeLen;
+		nLen -= lpVar->nTypeLen;
+	}
+
+	return lpData;
+}
+
+// Overwrite a field in place. Fixed size fields must keep their size; a
+// Variable field of a different length is spliced in and the offsets of
+// everything after it are moved along.
+bool CPacketIndex::Patch(int nBlock, int nItem, int nVar, LPBYTE lpData, int nLen)
+{
+	int nField = GetField(nBlock, nItem, nVar);
+
+	if (nField < 0)
+		return false;
+
+	LPCOMMANDVAR lpVar = m_lpVars[m_lpBlocks[nBlock].nFirstVar + nVar];
+	int nOffset = m_lpOffsets[nField];
+
+	if (lpVar->nType != LLTYPE_VARIABLE)
+	{
+		if (nLen != CVar::GetWireSize(lpVar->nType, lpVar->nTypeLen, NULL))
+			return false;
+
+		memcpy(&m_lpData[nOffset], lpData, nLen);
+
+		return true;
+	}
+
+	int nOldLen = CVar::GetWireSize(lpVar->nType, lpVar->nTypeLen, &m_lpData[nOffset]) - lpVar->nTypeLen;
+
+	if (lpVar->nTypeLen == 1 && nLen <= 0xff)
+	{
+		if (nLen != nOldLen && !Splice(nField, nOffset, 1 + nOldLen, 1 + nLen))
+			return false;
+
+		BYTE cDataLen = (BYTE)nLen;
+		memcpy(&m_lpData[nOffset], &cDataLen, sizeof(cDataLen));
+	}
+	else if (lpVar->nTypeLen == 2 && nLen <= 0xffff)
+	{
+		if (nLen != nOldLen && !Splice(nField, nOffset, 2 + nOldLen, 2 + nLen))
+			return false;
+
+		WORD cDataLen = (WORD)nLen;
+		memcpy(&m_lpData[nOffset], &cDataLen, sizeof(cDataLen));
+	}
+	else
+		return false;
+
+	memcpy(&m_lpData[nOffset + lpVar->nTypeLen], lpData, nLen);
+
+	return true;
+}
+
+bool CPacketIndex::Splice(int nField, int nOffset, int nOldLen, int nNewLen)
+{
+	int nDelta = nNewLen - nOldLen;
+	int nTail = nOffset + nOldLen;
+
+	if (m_nLen + nDelta > m_nMaxLen)
+		return false;
+
+	memmove(&m_lpData[nTail + nDelta], &m_lpData[nTail], m_nLen - nTail);
+	m_nLen += nDelta;
+
+	for (int i = nField + 1; i < m_nFields; i++)
+		m_lpOffsets[i] += nDelta;
+
+	for (int i = 0; i < m_nBlocks; i++)
+	{
+		if (m_lpBlocks[i].nCountOffset > nOffset)
+			m_lpBlocks[i].nCountOffset += nDelta;
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "./Template.h"
+
+// One template block of an indexed packet
+typedef struct
+{
+	LPCOMMANDSTRUCT lpStruct;
+	int nCountOffset;	// Offset of the Variable count byte, -1 otherwise
+	int nFirstField;	// Index of the block's first field in the offset table
+	int nFirstVar;		// Index of the block's first template field
+	int nVars;			// Template fields per item
+	BYTE cItems;
+} PACKETBLOCK, *LPPACKETBLOCK;
+
+// Offset table over a decoded packet buffer. Fields can be read or
+// overwritten in place without building a CMessage; only a Variable field
+// that changes length needs the rest of the packet spliced along.
+class CPacketIndex
+{
+public:
+	CPacketIndex(void);
+	~CPacketIndex(void);
+
+	LPCOMMAND m_lpCommand;
+	LPBYTE m_lpData;
+	int m_nLen;
+	int m_nMaxLen;
+
+	LPPACKETBLOCK m_lpBlocks;
+	int m_nBlocks;
+	int m_nMaxBlocks;
+
+	// Template fields of every block, flattened
+	LPCOMMANDVAR *m_lpVars;
+	int m_nVars;
+	int m_nMaxVars;
+
+	// Offset of every field in the buffer, in wire order
+	int *m_lpOffsets;
+	int m_nFields;
+	int m_nMaxFields;
+
+	void Free(void);
+	bool Build(LPCOMMAND lpCommand, LPBYTE lpData, int nLen, int nPos, int nMaxLen);
+	int FindBlock(char *lpszBlock);
+	int FindVar(int nBlock, char *lpszVar);
+	int CountBlock(int nBlock);
+	LPBYTE GetVar(int nBlock, int nItem, int nVar, int &nLen);
+	bool Patch(int nBlock, int nItem, int nVar, LPBYTE lpData, int nLen);
+
+protected:
+	int GetField(int nBlock, int nItem, int nVar);
+	bool Splice(int nField, int nOffset, int nOldLen, int nNewLen);
+};
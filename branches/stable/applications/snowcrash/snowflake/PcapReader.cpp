@@ -0,0 +1,409 @@
+#include "stdafx.h"
+#include "./PcapReader.h"
+
+#define ETHERTYPE_IPV4		0x0800
+#define ETHERTYPE_VLAN		0x8100
+#define ETHERTYPE_QINQ		0x88a8
+
+#define IP_PROTO_UDP		17
+#define FAMILY_INET			2
+
+// Protocol headers are big endian whatever the file is
+static WORD read_be16(LPBYTE lpData)
+{
+	return (WORD)((lpData[0] << 8) | lpData[1]);
+}
+
+static DWORD read_raw32(LPBYTE lpData)
+{
+	DWORD dwValue;
+	memcpy(&dwValue, lpData, sizeof(dwValue));
+
+	return dwValue;
+}
+
+static DWORD swap32(DWORD dwValue)
+{
+	return (dwValue >> 24) | ((dwValue >> 8) & 0xff00) | ((dwValue << 8) & 0xff0000) | (dwValue << 24);
+}
+
+// Timestamp in some number of units per second, to microseconds
+static ULONGLONG to_microseconds(ULONGLONG ullTime, ULONGLONG ullUnits)
+{
+	if (ullUnits == 1000000 || !ullUnits)
+		return ullTime;
+
+	return (ullTime / ullUnits) * 1000000 + (ullTime % ullUnits) * 1000000 / ullUnits;
+}
+
+CPcapReader::CPcapReader(void)
+{
+	m_stPos = 0;
+	m_stStart = 0;
+	m_bNG = false;
+	m_bSwapped = false;
+	m_bNano = false;
+	m_nLinkType = PCAP_LINK_ETHERNET;
+	m_ullTime = 0;
+	m_nInterfaces = 0;
+	m_dwFrames = 0;
+	m_dwSkipped = 0;
+	m_bTruncated = false;
+}
+
+CPcapReader::~CPcapReader(void)
+{
+	Close();
+}
+
+// Tell pcap from pcapng, and the byte order they were written in, by the
+// first word of the file
+bool CPcapReader::Open(const char *lpszPath)
+{
+	Close();
+
+	if (!m_file.Open(lpszPath) || m_file.m_stLen < 12)
+	{
+		Close();
+		return false;
+	}
+
+	DWORD dwMagic = read_raw32(m_file.m_lpData);
+
+	if (dwMagic == PCAPNG_BLOCK_SHB)
+	{
+		m_bNG = true;
+		m_stStart = 0;
+	}
+	else
+	{
+		m_bSwapped = (dwMagic == swap32(PCAP_MAGIC) || dwMagic == swap32(PCAP_MAGIC_NANO));
+		dwMagic = Read32(m_file.m_lpData);
+
+		if ((dwMagic != PCAP_MAGIC && dwMagic != PCAP_MAGIC_NANO) || m_file.m_stLen < 24)
+		{
+			Close();
+			return false;
+		}
+
+		m_bNano = (dwMagic == PCAP_MAGIC_NANO);
+		m_nLinkType = (int)(Read32(&m_file.m_lpData[20]) & 0xffff);
+		m_stStart = 24;
+	}
+
+	Rewind();
+
+	return true;
+}
+
+void CPcapReader::Close(void)
+{
+	m_file.Close();
+	m_stPos = 0;
+	m_stStart = 0;
+	m_bNG = false;
+	m_bSwapped = false;
+	m_bNano = false;
+	m_nInterfaces = 0;
+}
+
+void CPcapReader::Rewind(void)
+{
+	m_stPos = m_stStart;
+	m_ullTime = 0;
+	m_nInterfaces = 0;
+	m_dwFrames = 0;
+	m_dwSkipped = 0;
+	m_bTruncated = false;
+}
+
+// Fill up to nMax packets, returning how many. Fewer than nMax means the
+// end of the capture was reached.
+int CPcapReader::Read(LPPCAPPACKET lpPackets, int nMax)
+{
+	int nPackets = 0;
+	LPBYTE lpFrame;
+	int nLen;
+	int nLinkType;
+	ULONGLONG ullTime;
+
+	while (nPackets < nMax)
+	{
+		if (m_bNG ? !NextBlock(&lpFrame, &nLen, &nLinkType, &ullTime) : !NextFrame(&lpFrame, &nLen, &nLinkType, &ullTime))
+			break;
+
+		m_dwFrames++;
+
+		if (!ParseFrame(lpFrame, nLen, nLinkType, &lpPackets[nPackets]))
+		{
+			m_dwSkipped++;
+			continue;
+		}
+
+		lpPackets[nPackets++].ullTime = ullTime;
+	}
+
+	return nPackets;
+}
+
+// Classic pcap: a 16 byte record header, then the captured bytes
+bool CPcapReader::NextFrame(LPBYTE *lpFrame, int *nLen, int *nLinkType, ULONGLONG *ullTime)
+{
+	size_t stLeft = m_file.m_stLen - m_stPos;
+
+	if (stLeft < 16)
+	{
+		m_bTruncated = (stLeft != 0);
+		return false;
+	}
+
+	LPBYTE lpRecord = &m_file.m_lpData[m_stPos];
+	DWORD dwCaptured = Read32(&lpRecord[8]);
+
+	if (dwCaptured > stLeft - 16)
+	{
+		m_bTruncated = true;
+		return false;
+	}
+
+	ULONGLONG ullFraction = Read32(&lpRecord[4]);
+
+	*ullTime = (ULONGLONG)Read32(lpRecord) * 1000000 + (m_bNano ? ullFraction / 1000 : ullFraction);
+	*lpFrame = &lpRecord[16];
+	*nLen = (int)dwCaptured;
+	*nLinkType = m_nLinkType;
+
+	m_stPos += 16 + dwCaptured;
+
+	return true;
+}
+
+// pcapng: walk blocks until a packet turns up, picking up the section byte
+// order and the interfaces along the way
+bool CPcapReader::NextBlock(LPBYTE *lpFrame, int *nLen, int *nLinkType, ULONGLONG *ullTime)
+{
+	for (;;)
+	{
+		size_t stLeft = m_file.m_stLen - m_stPos;
+
+		if (stLeft < 12)
+		{
+			m_bTruncated = (stLeft != 0);
+			return false;
+		}
+
+		LPBYTE lpBlock = &m_file.m_lpData[m_stPos];
+		DWORD dwType = Read32(lpBlock);
+
+		// The section header says which byte order the rest of it is in
+		if (dwType == PCAPNG_BLOCK_SHB)
+		{
+			m_bSwapped = (read_raw32(&lpBlock[8]) == swap32(PCAPNG_BYTE_ORDER));
+			m_nInterfaces = 0;
+		}
+
+		DWORD dwBlockLen = Read32(&lpBlock[4]);
+
+		if (dwBlockLen < 12 || (dwBlockLen & 3) || dwBlockLen > stLeft)
+		{
+			m_bTruncated = true;
+			return false;
+		}
+
+		m_stPos += dwBlockLen;
+
+		if (dwType == PCAPNG_BLOCK_IDB && dwBlockLen >= 20)
+		{
+			if (m_nInterfaces >= PCAP_MAX_INTERFACES)
+				continue;
+
+			PCAPINTERFACE *lpInterface = &m_interfaces[m_nInterfaces++];
+
+			lpInterface->nLinkType = Read16(&lpBlock[8]);
+			lpInterface->ullUnits = 1000000;
+
+			// Options run to the trailing length, each padded to 4 bytes
+			for (DWORD dwOpt = 16; dwOpt + 4 <= dwBlockLen - 4; )
+			{
+				WORD wCode = Read16(&lpBlock[dwOpt]);
+				WORD wLen = Read16(&lpBlock[dwOpt + 2]);
+
+				if (!wCode || dwOpt + 4 + wLen > dwBlockLen - 4)
+					break;
+
+				// if_tsresol: a power of ten, or of two with the top bit set
+				if (wCode == 9 && wLen >= 1)
+				{
+					BYTE cResolution = lpBlock[dwOpt + 4];
+					ULONGLONG ullUnits = 1;
+
+					if (cResolution & 0x80)
+						ullUnits <<= (cResolution & 0x7f) < 63 ? (cResolution & 0x7f) : 63;
+					else
+					{
+						for (BYTE c = 0; c < cResolution && c < 19; c++)
+							ullUnits *= 10;
+					}
+
+					lpInterface->ullUnits = ullUnits;
+				}
+
+				dwOpt += 4 + ((wLen + 3) & ~3);
+			}
+		}
+		else if (dwType == PCAPNG_BLOCK_EPB && dwBlockLen >= 32)
+		{
+			DWORD dwInterface = Read32(&lpBlock[8]);
+			DWORD dwCaptured = Read32(&lpBlock[20]);
+
+			if (dwInterface >= (DWORD)m_nInterfaces || dwCaptured > dwBlockLen - 32)
+				continue;
+
+			ULONGLONG ullStamp = ((ULONGLONG)Read32(&lpBlock[12]) << 32) | Read32(&lpBlock[16]);
+
+			m_ullTime = to_microseconds(ullStamp, m_interfaces[dwInterface].ullUnits);
+
+			*ullTime = m_ullTime;
+			*lpFrame = &lpBlock[28];
+			*nLen = (int)dwCaptured;
+			*nLinkType = m_interfaces[dwInterface].nLinkType;
+
+			return true;
+		}
+		else if (dwType == PCAPNG_BLOCK_SPB && dwBlockLen >= 16 && m_nInterfaces)
+		{
+			// No timestamp, so it keeps its place after the packet before it,
+			// and only the original length to go by
+			DWORD dwCaptured = Read32(&lpBlock[8]);
+
+			if (dwCaptured > dwBlockLen - 16)
+				dwCaptured = dwBlockLen - 16;
+
+			*ullTime = m_ullTime;
+			*lpFrame = &lpBlock[12];
+			*nLen = (int)dwCaptured;
+			*nLinkType = m_interfaces[0].nLinkType;
+
+			return true;
+		}
+	}
+}
+
+// Strip the link layer, IPv4 and UDP headers off a frame
+bool CPcapReader::ParseFrame(LPBYTE lpFrame, int nLen, int nLinkType, LPPCAPPACKET lpPacket)
+{
+	WORD wProto = 0;
+	int nPos = 0;
+
+	switch (nLinkType)
+	{
+		case PCAP_LINK_ETHERNET:
+			if (nLen < 14)
+				return false;
+
+			wProto = read_be16(&lpFrame[12]);
+			nPos = 14;
+
+			while (wProto == ETHERTYPE_VLAN || wProto == ETHERTYPE_QINQ)
+			{
+				if (nPos + 4 > nLen)
+					return false;
+
+				wProto = read_be16(&lpFrame[nPos + 2]);
+				nPos += 4;
+			}
+			break;
+
+		case PCAP_LINK_SLL:
+			if (nLen < 16)
+				return false;
+
+			wProto = read_be16(&lpFrame[14]);
+			nPos = 16;
+			break;
+
+		case PCAP_LINK_SLL2:
+			if (nLen < 20)
+				return false;
+
+			wProto = read_be16(lpFrame);
+			nPos = 20;
+			break;
+
+		case PCAP_LINK_NULL:
+			if (nLen < 4)
+				return false;
+
+			wProto = (Read32(lpFrame) == FAMILY_INET) ? ETHERTYPE_IPV4 : 0;
+			nPos = 4;
+			break;
+
+		case PCAP_LINK_LOOP:
+			if (nLen < 4)
+				return false;
+
+			wProto = (read_be16(&lpFrame[2]) == FAMILY_INET && !read_be16(lpFrame)) ? ETHERTYPE_IPV4 : 0;
+			nPos = 4;
+			break;
+
+		case PCAP_LINK_RAW:
+		case PCAP_LINK_IPV4:
+			wProto = ETHERTYPE_IPV4;
+			break;
+
+		default:
+			return false;
+	}
+
+	if (wProto != ETHERTYPE_IPV4 || nLen - nPos < 20)
+		return false;
+
+	LPBYTE lpIP = &lpFrame[nPos];
+	int nHeaderLen = (lpIP[0] & 0x0f) * 4;
+	int nTotalLen = read_be16(&lpIP[2]);
+
+	// Anything cut short by the snap length is of no use to the decoder
+	if ((lpIP[0] >> 4) != 4 || nHeaderLen < 20 || nTotalLen < nHeaderLen + 8 || nTotalLen > nLen - nPos)
+		return false;
+
+	// Fragments would need reassembling first
+	if (lpIP[9] != IP_PROTO_UDP || (read_be16(&lpIP[6]) & 0x3fff))
+		return false;
+
+	LPBYTE lpUDP = &lpIP[nHeaderLen];
+	int nUDPLen = read_be16(&lpUDP[4]);
+
+	if (nUDPLen < 8 || nUDPLen > nTotalLen - nHeaderLen)
+		return false;
+
+	ZeroMemory(&lpPacket->source, sizeof(lpPacket->source));
+	lpPacket->source.sin_family = AF_INET;
+	memcpy(&lpPacket->source.sin_addr, &lpIP[12], 4);
+	memcpy(&lpPacket->source.sin_port, &lpUDP[0], 2);
+
+	ZeroMemory(&lpPacket->dest, sizeof(lpPacket->dest));
+	lpPacket->dest.sin_family = AF_INET;
+	memcpy(&lpPacket->dest.sin_addr, &lpIP[16], 4);
+	memcpy(&lpPacket->dest.sin_port, &lpUDP[2], 2);
+
+	lpPacket->lpData = &lpUDP[8];
+	lpPacket->nLen = nUDPLen - 8;
+
+	return true;
+}
+
+// Record fields in the byte order the file was written in
+WORD CPcapReader::Read16(LPBYTE lpData)
+{
+	WORD wValue;
+	memcpy(&wValue, lpData, sizeof(wValue));
+
+	return m_bSwapped ? (WORD)((wValue >> 8) | (wValue << 8)) : wValue;
+}
+
+DWORD CPcapReader::Read32(LPBYTE lpData)
+{
+	DWORD dwValue = read_raw32(lpData);
+
+	return m_bSwapped ? swap32(dwValue) : dwValue;
+}
\ No newline at end of file
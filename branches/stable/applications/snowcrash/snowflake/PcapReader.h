@@ -0,0 +1,79 @@
+#pragma once
+
+#include "./MappedFile.h"
+
+#define PCAP_MAGIC				0xa1b2c3d4	// Microsecond timestamps
+#define PCAP_MAGIC_NANO			0xa1b23c4d	// Nanosecond timestamps
+#define PCAPNG_BLOCK_SHB		0x0a0d0d0a	// Section header
+#define PCAPNG_BLOCK_IDB		0x00000001	// Interface description
+#define PCAPNG_BLOCK_SPB		0x00000003	// Simple packet
+#define PCAPNG_BLOCK_EPB		0x00000006	// Enhanced packet
+#define PCAPNG_BYTE_ORDER		0x1a2b3c4d
+
+// Link layers a frame can start with
+#define PCAP_LINK_NULL			0			// BSD loopback, host order family
+#define PCAP_LINK_ETHERNET		1
+#define PCAP_LINK_RAW			101			// Bare IP
+#define PCAP_LINK_LOOP			108			// OpenBSD loopback, network order family
+#define PCAP_LINK_SLL			113			// Linux cooked
+#define PCAP_LINK_IPV4			228
+#define PCAP_LINK_SLL2			276
+
+#define PCAP_MAX_INTERFACES		16
+
+// One UDP datagram out of a capture. The payload is read where it lies in
+// the mapped file, so it is only good while the reader is open.
+typedef struct
+{
+	ULONGLONG ullTime;				// Microseconds since the epoch
+	struct sockaddr_in source;
+	struct sockaddr_in dest;
+	LPBYTE lpData;
+	int nLen;
+} PCAPPACKET, *LPPCAPPACKET;
+
+// A pcapng interface: its link layer and timestamp units per second
+typedef struct
+{
+	int nLinkType;
+	ULONGLONG ullUnits;
+} PCAPINTERFACE;
+
+// Pulls the IPv4 UDP payloads out of a pcap or pcapng file without
+// libpcap. Anything else on the wire, IP fragments included, is counted
+// and skipped.
+class CPcapReader
+{
+public:
+	CPcapReader(void);
+	~CPcapReader(void);
+
+	bool Open(const char *lpszPath);
+	void Close(void);
+	void Rewind(void);
+	int Read(LPPCAPPACKET lpPackets, int nMax);
+
+	DWORD m_dwFrames;				// Frames read so far
+	DWORD m_dwSkipped;				// Frames that were not IPv4 UDP
+	bool m_bTruncated;				// Stopped at a record cut short
+
+protected:
+	bool NextFrame(LPBYTE *lpFrame, int *nLen, int *nLinkType, ULONGLONG *ullTime);
+	bool NextBlock(LPBYTE *lpFrame, int *nLen, int *nLinkType, ULONGLONG *ullTime);
+	bool ParseFrame(LPBYTE lpFrame, int nLen, int nLinkType, LPPCAPPACKET lpPacket);
+	WORD Read16(LPBYTE lpData);
+	DWORD Read32(LPBYTE lpData);
+
+	CMappedFile m_file;
+	size_t m_stPos;
+	size_t m_stStart;				// First record, past the file header
+
+	bool m_bNG;
+	bool m_bSwapped;				// File was written on the other endianness
+	bool m_bNano;
+	int m_nLinkType;
+	ULONGLONG m_ullTime;			// Last timestamp read, for blocks without one
+
+	PCAPINTERFACE m_interfaces[PCAP_MAX_INTERFACES];
+	int m_nInterfaces;
+};
\ No newline at end of file
@@ -0,0 +1,297 @@
+#include "stdafx.h"
+
+#ifndef _WIN32
+
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HANDLE_THREAD	1
+#define HANDLE_EVENT	2
+
+// What a HANDLE points at. A thread keeps its start routine until it runs;
+// an event is a flag guarded by a mutex and condition variable.
+typedef struct
+{
+	int nType;
+
+	pthread_t thread;
+	bool bJoined;
+	LPTHREAD_START_ROUTINE lpStartAddress;
+	LPVOID lpParam;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool bSignaled;
+	bool bManualReset;
+} PLATFORMHANDLE, *LPPLATFORMHANDLE;
+
+void InitializeCriticalSection(CRITICAL_SECTION *lpCriticalSection)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&lpCriticalSection->mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+void DeleteCriticalSection(CRITICAL_SECTION *lpCriticalSection)
+{
+	pthread_mutex_destroy(&lpCriticalSection->mutex);
+}
+
+void EnterCriticalSection(CRITICAL_SECTION *lpCriticalSection)
+{
+	pthread_mutex_lock(&lpCriticalSection->mutex);
+}
+
+void LeaveCriticalSection(CRITICAL_SECTION *lpCriticalSection)
+{
+	pthread_mutex_unlock(&lpCriticalSection->mutex);
+}
+
+static void *thread_start(void *lpParam)
+{
+	LPPLATFORMHANDLE handle = (LPPLATFORMHANDLE)lpParam;
+
+	handle->lpStartAddress(handle->lpParam);
+
+	return NULL;
+}
+
+HANDLE CreateThread(LPVOID lpAttributes, size_t stStackSize, LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParam, DWORD dwFlags, LPDWORD lpThreadId)
+{
+	LPPLATFORMHANDLE handle = (LPPLATFORMHANDLE)malloc(sizeof(PLATFORMHANDLE));
+
+	if (!handle)
+		return NULL;
+
+	ZeroMemory(handle, sizeof(PLATFORMHANDLE));
+	handle->nType = HANDLE_THREAD;
+	handle->lpStartAddress = lpStartAddress;
+	handle->lpParam = lpParam;
+
+	if (pthread_create(&handle->thread, NULL, thread_start, handle))
+	{
+		free(handle);
+		return NULL;
+	}
+
+	if (lpThreadId)
+		*lpThreadId = 0;
+
+	return handle;
+}
+
+HANDLE CreateEvent(LPVOID lpAttributes, BOOL bManualReset, BOOL bInitialState, LPCTSTR lpszName)
+{
+	LPPLATFORMHANDLE handle = (LPPLATFORMHANDLE)malloc(sizeof(PLATFORMHANDLE));
+
+	if (!handle)
+		return NULL;
+
+	ZeroMemory(handle, sizeof(PLATFORMHANDLE));
+	handle->nType = HANDLE_EVENT;
+	handle->bManualReset = bManualReset != FALSE;
+	handle->bSignaled = bInitialState != FALSE;
+
+	pthread_mutex_init(&handle->mutex, NULL);
+	pthread_cond_init(&handle->cond, NULL);
+
+	return handle;
+}
+
+BOOL SetEvent(HANDLE hEvent)
+{
+	LPPLATFORMHANDLE handle = (LPPLATFORMHANDLE)hEvent;
+
+	if (!handle || handle->nType != HANDLE_EVENT)
+		return FALSE;
+
+	pthread_mutex_lock(&handle->mutex);
+	handle->bSignaled = true;
+	pthread_cond_broadcast(&handle->cond);
+	pthread_mutex_unlock(&handle->mutex);
+
+	return TRUE;
+}
+
+BOOL ResetEvent(HANDLE hEvent)
+{
+	LPPLATFORMHANDLE handle = (LPPLATFORMHANDLE)hEvent;
+
+	if (!handle || handle->nType != HANDLE_EVENT)
+		return FALSE;
+
+	pthread_mutex_lock(&handle->mutex);
+	handle->bSignaled = false;
+	pthread_mutex_unlock(&handle->mutex);
+
+	return TRUE;
+}
+
+// A thread can only be waited on until it exits; events wait with a timeout
+// against the realtime clock, like pthread_cond_timedwait wants
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds)
+{
+	LPPLATFORMHANDLE handle = (LPPLATFORMHANDLE)hHandle;
+
+	if (!handle)
+		return WAIT_OBJECT_0;
+
+	if (handle->nType == HANDLE_THREAD)
+	{
+		if (!handle->bJoined)
+		{
+			pthread_join(handle->thread, NULL);
+			handle->bJoined = true;
+		}
+
+		return WAIT_OBJECT_0;
+	}
+
+	struct timespec ts;
+	int nRes = 0;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	if (dwMilliseconds != INFINITE)
+	{
+		ts.tv_sec += dwMilliseconds / 1000;
+		ts.tv_nsec += (long)(dwMilliseconds % 1000) * 1000000;
+
+		if (ts.tv_nsec >= 1000000000)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_mutex_lock(&handle->mutex);
+
+	while (!handle->bSignaled && nRes != ETIMEDOUT)
+	{
+		if (dwMilliseconds == INFINITE)
+			nRes = pthread_cond_wait(&handle->cond, &handle->mutex);
+		else
+			nRes = pthread_cond_timedwait(&handle->cond, &handle->mutex, &ts);
+	}
+
+	bool bSignaled = handle->bSignaled;
+
+	if (bSignaled && !handle->bManualReset)
+		handle->bSignaled = false;
+
+	pthread_mutex_unlock(&handle->mutex);
+
+	return bSignaled ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+}
+
+// Windows lets a running thread's handle be closed; here it is detached
+BOOL CloseHandle(HANDLE hHandle)
+{
+	LPPLATFORMHANDLE handle = (LPPLATFORMHANDLE)hHandle;
+
+	if (!handle)
+		return FALSE;
+
+	if (handle->nType == HANDLE_THREAD && !handle->bJoined)
+		pthread_detach(handle->thread);
+	else if (handle->nType == HANDLE_EVENT)
+	{
+		pthread_cond_destroy(&handle->cond);
+		pthread_mutex_destroy(&handle->mutex);
+	}
+
+	free(handle);
+
+	return TRUE;
+}
+
+DWORD TlsAlloc(void)
+{
+	pthread_key_t key;
+
+	if (pthread_key_create(&key, NULL))
+		return TLS_OUT_OF_INDEXES;
+
+	return (DWORD)key;
+}
+
+BOOL TlsFree(DWORD dwTlsIndex)
+{
+	return pthread_key_delete((pthread_key_t)dwTlsIndex) == 0;
+}
+
+LPVOID TlsGetValue(DWORD dwTlsIndex)
+{
+	return pthread_getspecific((pthread_key_t)dwTlsIndex);
+}
+
+BOOL TlsSetValue(DWORD dwTlsIndex, LPVOID lpValue)
+{
+	return pthread_setspecific((pthread_key_t)dwTlsIndex, lpValue) == 0;
+}
+
+// Sleep(0) gives up the rest of the time slice
+void Sleep(DWORD dwMilliseconds)
+{
+	if (!dwMilliseconds)
+	{
+		sched_yield();
+		return;
+	}
+
+	struct timespec ts;
+
+	ts.tv_sec = dwMilliseconds / 1000;
+	ts.tv_nsec = (long)(dwMilliseconds % 1000) * 1000000;
+
+	while (nanosleep(&ts, &ts) && errno == EINTR)
+		;
+}
+
+DWORD GetTickCount(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (DWORD)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+DWORD GetCurrentThreadId(void)
+{
+	return (DWORD)(DWORD_PTR)pthread_self();
+}
+
+// Nanoseconds off the monotonic clock
+BOOL QueryPerformanceCounter(LARGE_INTEGER *lpCount)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return FALSE;
+
+	lpCount->QuadPart = (LONGLONG)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+	return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *lpFrequency)
+{
+	lpFrequency->QuadPart = 1000000000;
+
+	return TRUE;
+}
+
+void GetSystemInfo(LPSYSTEM_INFO lpSystemInfo)
+{
+	long lProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+
+	lpSystemInfo->dwNumberOfProcessors = (lProcessors > 0) ? (DWORD)lProcessors : 1;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,183 @@
+#pragma once
+
+// printf size prefix for 64 bit integers
+#ifdef _WIN32
+#define PRINTF_INT64			"I64"
+#else
+#define PRINTF_INT64			"ll"
+#endif
+
+// The protocol core is written against the Win32 names it was born with.
+// On Windows those come from windows.h; anywhere else they are defined here
+// over fixed width types and pthreads, so the core builds as a plain static
+// library. Only what the core actually uses is provided.
+#ifndef _WIN32
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+typedef uint8_t				BYTE;
+typedef uint16_t			WORD;
+typedef uint32_t			DWORD;
+typedef int16_t				SHORT;
+typedef int32_t				LONG;
+typedef uint32_t			ULONG;
+typedef long long			LONGLONG;	// 64 bits everywhere, and what %lld wants
+typedef unsigned long long	ULONGLONG;
+typedef uint32_t			UINT;
+typedef int32_t				BOOL;
+typedef float				FLOAT;
+typedef uintptr_t			DWORD_PTR;
+typedef intptr_t			LONG_PTR;
+typedef char				TCHAR;
+
+typedef BYTE				*LPBYTE;
+typedef WORD				*LPWORD;
+typedef DWORD				*LPDWORD;
+typedef void				*LPVOID;
+typedef void				*PVOID;
+typedef void				*HANDLE;
+typedef char				*LPSTR;
+typedef const char			*LPCSTR;
+typedef TCHAR				*LPTSTR;
+typedef const TCHAR			*LPCTSTR;
+
+typedef int (*PROC)(void);
+
+typedef union
+{
+	struct
+	{
+		DWORD LowPart;
+		LONG HighPart;
+	};
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+#define WINAPI
+#define CALLBACK
+
+#define TRUE					1
+#define FALSE					0
+#define MAX_PATH				260
+#define INFINITE				0xFFFFFFFF
+#define WAIT_OBJECT_0			0
+#define WAIT_TIMEOUT			258
+#define TLS_OUT_OF_INDEXES		0xFFFFFFFF
+
+#define _T(x)					x
+#define _tcslen					strlen
+#define _tcscmp					strcmp
+#define _tcsicmp				strcasecmp
+#define _tcsdup					strdup
+#define _vsntprintf				vsnprintf
+#define stricmp					strcasecmp
+#define strnicmp				strncasecmp
+#define _snprintf				snprintf
+#define wsprintf				sprintf
+
+#define ZeroMemory(p, n)		memset((p), 0, (n))
+#define MemoryBarrier()			__sync_synchronize()
+
+inline TCHAR *_tcsupr(TCHAR *lpszStr)
+{
+	for (TCHAR *p = lpszStr; *p; p++)
+		*p = (TCHAR)toupper((unsigned char)*p);
+
+	return lpszStr;
+}
+
+// Recursive, like the Windows original
+typedef struct
+{
+	pthread_mutex_t mutex;
+} CRITICAL_SECTION;
+
+void InitializeCriticalSection(CRITICAL_SECTION *lpCriticalSection);
+void DeleteCriticalSection(CRITICAL_SECTION *lpCriticalSection);
+void EnterCriticalSection(CRITICAL_SECTION *lpCriticalSection);
+void LeaveCriticalSection(CRITICAL_SECTION *lpCriticalSection);
+
+// Full barriers, as on Windows
+inline LONG InterlockedIncrement(volatile LONG *lpAddend)
+{
+	return __sync_add_and_fetch(lpAddend, 1);
+}
+
+inline LONG InterlockedDecrement(volatile LONG *lpAddend)
+{
+	return __sync_sub_and_fetch(lpAddend, 1);
+}
+
+inline LONG InterlockedExchangeAdd(volatile LONG *lpAddend, LONG lValue)
+{
+	return __sync_fetch_and_add(lpAddend, lValue);
+}
+
+inline LONG InterlockedExchange(volatile LONG *lpTarget, LONG lValue)
+{
+	__sync_synchronize();
+	return __sync_lock_test_and_set(lpTarget, lValue);
+}
+
+inline LONG InterlockedCompareExchange(volatile LONG *lpDest, LONG lExchange, LONG lComparand)
+{
+	return __sync_val_compare_and_swap(lpDest, lComparand, lExchange);
+}
+
+inline PVOID InterlockedExchangePointer(PVOID volatile *lpTarget, PVOID lpValue)
+{
+	__sync_synchronize();
+	return __sync_lock_test_and_set(lpTarget, lpValue);
+}
+
+inline PVOID InterlockedCompareExchangePointer(PVOID volatile *lpDest, PVOID lpExchange, PVOID lpComparand)
+{
+	return __sync_val_compare_and_swap(lpDest, lpComparand, lpExchange);
+}
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID lpParam);
+
+// Threads and auto or manual reset events share one handle type
+HANDLE CreateThread(LPVOID lpAttributes, size_t stStackSize, LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParam, DWORD dwFlags, LPDWORD lpThreadId);
+HANDLE CreateEvent(LPVOID lpAttributes, BOOL bManualReset, BOOL bInitialState, LPCTSTR lpszName);
+BOOL SetEvent(HANDLE hEvent);
+BOOL ResetEvent(HANDLE hEvent);
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds);
+BOOL CloseHandle(HANDLE hHandle);
+
+DWORD TlsAlloc(void);
+BOOL TlsFree(DWORD dwTlsIndex);
+LPVOID TlsGetValue(DWORD dwTlsIndex);
+BOOL TlsSetValue(DWORD dwTlsIndex, LPVOID lpValue);
+
+void Sleep(DWORD dwMilliseconds);
+DWORD GetTickCount(void);
+DWORD GetCurrentThreadId(void);
+BOOL QueryPerformanceCounter(LARGE_INTEGER *lpCount);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *lpFrequency);
+
+// Only the processor count is filled in
+typedef struct
+{
+	DWORD dwNumberOfProcessors;
+} SYSTEM_INFO, *LPSYSTEM_INFO;
+
+void GetSystemInfo(LPSYSTEM_INFO lpSystemInfo);
+
+// Only ever a sanity check against a stale hook table
+inline BOOL IsBadCodePtr(PROC lpfn)
+{
+	return lpfn == NULL;
+}
+
+#endif
\ No newline at end of file
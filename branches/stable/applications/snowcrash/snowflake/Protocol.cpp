@@ -0,0 +1,885 @@
+#include "stdafx.h"
+#include "./Protocol.h"
+#include "./Var.h"
+#include "./keywords.h"
+
+COMMAND cmds_low[MAX_COMMANDS_LOW];
+COMMAND cmds_med[MAX_COMMANDS_MEDIUM];
+COMMAND cmds_high[MAX_COMMANDS_HIGH];
+int cmds_count = 0;
+
+// Commands the packet path watches for, looked up once the template is loaded
+LPCOMMAND start_ping_check = NULL;
+LPCOMMAND complete_ping_check = NULL;
+LPCOMMAND packet_ack = NULL;
+
+// Returns the decoded length, or -1 if it would not fit in destlen. A run
+// count cut off by the end of the body is taken literally.
+int ZeroDecode(char *src, int srclen, char *dest, int destlen)
+{
+	int zerolen = 0;
+
+	if (src[0] & MSG_ZEROCODED)
+	{
+		memcpy(dest, src, 4);
+		zerolen += 4;
+
+		for (int i = zerolen; i < srclen; i++)
+		{
+			if ((unsigned char)src[i] == 0x00 && i + 1 < srclen)
+			{
+				if (zerolen + (unsigned char)src[i+1] > destlen)
+					return -1;
+
+				for (unsigned char j = 0; j < (unsigned char)src[i+1]; j++)
+					dest[zerolen++] = 0x00;
+
+				i++;
+			}
+			else
+			{
+				if (zerolen >= destlen)
+					return -1;
+
+				dest[zerolen++] = src[i];
+			}
+		}
+	}
+	else
+	{
+		if (srclen > destlen)
+			return -1;
+
+		memcpy(dest, src, srclen);
+		zerolen = srclen;
+	}
+
+	return zerolen;
+}
+
+int ZeroEncode(char *src, int srclen, char *dest, int destlen)
+{
+	int zerolen = 0;
+	unsigned char zerocount = 0;
+
+	if (src[0] & MSG_ZEROCODED)
+	{
+		memcpy(dest, src, 4);
+		zerolen += 4;
+
+		for (int i = zerolen; i < srclen; i++)
+		{
+			if ((unsigned char)src[i] == 0x00)
+			{
+				zerocount++;
+
+				if (zerocount == 0)
+				{
+					dest[zerolen++] = 0x00;
+					dest[zerolen++] = 0xff;
+					zerocount++;
+				}
+			}
+			else
+			{
+				if (zerocount)
+				{
+					dest[zerolen++] = 0x00;
+					dest[zerolen++] = zerocount;
+					zerocount = 0;
+				}
+
+				dest[zerolen++] = src[i];
+			}
+		}
+
+		if (zerocount)
+		{
+			dest[zerolen++] = 0x00;
+			dest[zerolen++] = zerocount;
+		}
+	}
+	else
+	{
+		memcpy(dest, src, srclen);
+		zerolen = srclen;
+	}
+
+	return zerolen;
+}
+
+// Convert a "hex string" to an integer by Anders Molin
+int httoi(const TCHAR *value)
+{
+	struct HEXMAP
+	{
+		TCHAR c;
+		int value;
+	};
+
+	const int nHexMap = 16;
+	
+	HEXMAP hmLookup[nHexMap] =
+	{
+		{'0', 0}, {'1', 1},
+		{'2', 2}, {'3', 3},
+		{'4', 4}, {'5', 5},
+		{'6', 6}, {'7', 7},
+		{'8', 8}, {'9', 9},
+		{'A', 10}, {'B', 11},
+		{'C', 12}, {'D', 13},
+		{'E', 14}, {'F', 15}
+	};
+
+	TCHAR *mstr = _tcsupr(_tcsdup(value));
+	TCHAR *s = mstr;
+	int result = 0;
+	
+	if (*s == '0' && *(s + 1) == 'X')
+		s += 2;
+	
+	bool firsttime = true;
+	
+	while (*s != '\0')
+	{
+		bool found = false;
+
+		for (int i = 0; i < nHexMap; i++)
+		{
+			if (*s == hmLookup[i].c)
+			{
+				if (!firsttime)
+					result <<= 4;
+				
+				result |= hmLookup[i].value;
+				found = true;
+				break;
+			}
+		}
+		
+		if (!found)
+			break;
+		
+		s++;
+		firsttime = false;
+	}
+
+	free(mstr);
+	
+	return result;
+}
+
+// Trim beginning, ending, and excess embedded whitespace from a string
+char *trim(char *szStr)
+{
+	char *iBuf, *oBuf;
+
+	if (szStr)
+	{
+		for (iBuf = oBuf = szStr; *iBuf;)
+		{
+			while (*iBuf && (isspace(*iBuf)))
+				iBuf++;
+			
+			if (*iBuf && (oBuf != szStr))
+				*(oBuf++) = ' ';
+			
+			while (*iBuf && (!isspace(*iBuf)))
+				*(oBuf++) = *(iBuf++);
+		}
+		
+		*oBuf = '\0';
+	}
+
+	return(szStr);
+}
+
+int get_var_type(TCHAR *lptszType)
+{
+	int i = 0;
+
+	while (LLTYPES[i])
+	{
+		if (!_tcscmp(lptszType, LLTYPES[i]))
+		{
+			//printf("Type: %s\n", LLTYPES[i]);
+			return i;
+		}
+
+		i++;
+	}
+
+	return -1;
+}
+
+int get_keyword_pos(TCHAR *lptszKeyword)
+{
+	int i = 0;
+
+	while (LLKEYWORDS[i])
+	{
+		if (!_tcscmp(lptszKeyword, LLKEYWORDS[i]))
+		{
+			//printf("Keyword: %s\n", LLKEYWORDS[i]);
+			return i;
+		}
+
+		i++;
+	}
+
+	dprintf("Unhandled keyword: %s\n", lptszKeyword);
+	return -1;
+}
+
+// Get message template block deliminator positions
+bool get_block_markers(LPBYTE lpBuffer, DWORD &dwStart, DWORD &dwEnd, DWORD &dwChildren)
+{
+	DWORD dwStartBlock = 0;
+	DWORD dwEndBlock = 0;
+	DWORD dwDepth = 0;
+	
+	dwChildren = 0;
+
+	for (DWORD dwPos = dwStart; dwPos <= dwEnd; dwPos++)
+	{
+		if (lpBuffer[dwPos] == '{')
+		{
+			dwDepth++;
+
+			if (dwDepth == 1)
+				dwStartBlock = dwPos;
+			else if (dwDepth == 2 && !dwChildren)
+				dwChildren = dwPos;
+		}
+		
+		else if (lpBuffer[dwPos] == '}')
+		{
+			dwDepth--;
+
+			if (dwDepth == 0 && dwStartBlock)
+			{
+				dwEndBlock = dwPos;
+				dwStart = dwStartBlock;
+				dwEnd = dwEndBlock;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// Parse the variables message template block of a struct
+bool get_var_blocks(LPCOMMANDSTRUCT lpStruct, LPBYTE lpBuffer, DWORD dwStart, DWORD dwEnd)
+{
+	DWORD dwVarStart = dwStart;
+	DWORD dwVarEnd = dwEnd;
+	DWORD dwVarChildren = 0;
+
+	while (get_block_markers(lpBuffer, dwVarStart, dwVarEnd, dwVarChildren))
+	{
+		char szVarLine[256];
+		DWORD dwVarLen = (dwVarChildren ? dwVarChildren - 1 : dwVarEnd - 1) - dwVarStart;
+
+		memcpy(&szVarLine, &lpBuffer[dwVarStart+1], dwVarLen);
+		szVarLine[dwVarLen] = '\0';
+		trim(szVarLine);
+		
+		//printf("\t\t%s\n", szVarLine);
+
+		char *lpszVar = strtok(szVarLine, " ");
+		char *lpszType = strtok(NULL, " ");
+		char *lpszTypeLen = NULL;
+		int nKeywordPos = get_keyword_pos(lpszVar);
+		int nVarType = get_var_type(lpszType);
+
+		LPCOMMANDVAR lpVar = lpStruct->vars;
+
+		if (lpVar)
+		{
+			// Insert after an item
+			if (nKeywordPos > lpVar->nKeywordPos)
+			{
+				while (lpVar->lpNext && nKeywordPos > lpVar->lpNext->nKeywordPos)
+					lpVar = lpVar->lpNext;
+
+				LPCOMMANDVAR lpBelow = lpVar->lpNext;
+
+				lpVar->lpNext = (LPCOMMANDVAR)malloc(sizeof(COMMANDVAR));
+				
+				if (!lpVar->lpNext)
+					return false;
+
+				ZeroMemory(lpVar->lpNext, sizeof(COMMANDVAR));
+				lpVar->lpNext->lpPrev = lpVar;
+				lpVar->lpNext->lpNext = lpBelow;
+				lpVar = lpVar->lpNext;
+			}
+			// Insert before all items
+			else
+			{
+				lpVar->lpPrev = (LPCOMMANDVAR)malloc(sizeof(COMMANDVAR));
+				
+				if (!lpVar->lpPrev)
+					return false;
+
+				ZeroMemory(lpVar->lpPrev, sizeof(COMMANDVAR));
+
+				lpVar->lpPrev->lpNext = lpVar;
+				lpVar->lpPrev->lpPrev = NULL;
+				lpVar = lpVar->lpPrev;
+				lpStruct->vars = lpVar;
+			}
+		}
+		// No existing list, create a new list with our entry
+		else
+		{
+			lpVar = (LPCOMMANDVAR)malloc(sizeof(COMMANDVAR));
+			
+			if (!lpVar)
+				return false;
+
+			ZeroMemory(lpVar, sizeof(COMMANDVAR));
+			lpStruct->vars = lpVar;
+		}
+
+		lpVar->lpszVar = strdup(lpszVar);
+		lpVar->nType = nVarType;
+		lpVar->nKeywordPos = nKeywordPos;
+
+		if (nVarType == LLTYPE_VARIABLE || nVarType == LLTYPE_FIXED)
+		{
+			lpszTypeLen = strtok(NULL, " ");
+			lpVar->nTypeLen = atoi(lpszTypeLen);
+		}
+
+		dwVarStart = dwVarEnd + 1;
+		dwVarEnd = dwEnd;
+	}
+
+	return true;
+}
+
+// Parse the struct message template block of a command
+bool get_struct_blocks(LPCOMMAND lpCmd, LPBYTE lpBuffer, DWORD dwStart, DWORD dwEnd)
+{
+	DWORD dwStructStart = dwStart;
+	DWORD dwStructEnd = dwEnd;
+	DWORD dwStructChildren = 0;
+
+	while (get_block_markers(lpBuffer, dwStructStart, dwStructEnd, dwStructChildren))
+	{
+		char szStructLine[256];
+		DWORD dwStructLen = (dwStructChildren ? dwStructChildren - 1 : dwStructEnd - 1) - dwStructStart;
+
+		memcpy(&szStructLine, &lpBuffer[dwStructStart+1], dwStructLen);
+		szStructLine[dwStructLen] = '\0';
+		trim(szStructLine);
+		
+		//printf("\t%s\n", szStructLine);
+
+		char *lpszStruct = strtok(szStructLine, " ");
+		char *lpszType = strtok(NULL, " ");
+		int nKeywordPos = get_keyword_pos(lpszStruct);
+		int nVarType = get_var_type(lpszType);
+
+		LPCOMMANDSTRUCT lpStruct = lpCmd->structs;
+
+		if (lpStruct)
+		{
+			// Insert after an item
+			if (nKeywordPos > lpStruct->nKeywordPos)
+			{
+				while (lpStruct->lpNext && nKeywordPos > lpStruct->lpNext->nKeywordPos)
+					lpStruct = lpStruct->lpNext;
+
+				LPCOMMANDSTRUCT lpBelow = lpStruct->lpNext;
+
+				lpStruct->lpNext = (LPCOMMANDSTRUCT)malloc(sizeof(COMMANDSTRUCT));
+			
+				if (!lpStruct->lpNext)
+					return false;
+
+				ZeroMemory(lpStruct->lpNext, sizeof(COMMANDSTRUCT));
+				lpStruct->lpNext->lpPrev = lpStruct;
+				lpStruct->lpNext->lpNext = lpBelow;
+				lpStruct = lpStruct->lpNext;
+			}
+			// Insert before all items
+			else
+			{
+				lpStruct->lpPrev = (LPCOMMANDSTRUCT)malloc(sizeof(COMMANDSTRUCT));
+				
+				if (!lpStruct->lpPrev)
+					return false;
+
+				ZeroMemory(lpStruct->lpPrev, sizeof(COMMANDSTRUCT));
+
+				lpStruct->lpPrev->lpNext = lpStruct;
+				lpStruct->lpPrev->lpPrev = NULL;
+				lpStruct = lpStruct->lpPrev;
+				lpCmd->structs = lpStruct;
+			}
+		}
+		// No existing list, create a new list with our entry
+		else
+		{
+			lpCmd->structs = (LPCOMMANDSTRUCT)malloc(sizeof(COMMANDSTRUCT));
+			
+			if (!lpCmd->structs)
+				return false;
+
+			ZeroMemory(lpCmd->structs, sizeof(COMMANDSTRUCT));
+			lpStruct = lpCmd->structs;
+		}
+
+		lpStruct->lpszStruct = strdup(lpszStruct);
+		lpStruct->nKeywordPos = nKeywordPos;
+		lpStruct->nType = nVarType;
+
+		if (nVarType == LLTYPE_VARIABLE)
+		{
+			lpStruct->cItems = 1;
+		}
+		else if (nVarType == LLTYPE_MULTIPLE)
+		{
+			char *lpszTypeLen = strtok(NULL, " ");
+			lpStruct->cItems = atoi(lpszTypeLen);
+		}
+
+		get_var_blocks(lpStruct, lpBuffer, dwStructStart + 1, dwStructEnd - 1);
+
+		dwStructStart = dwStructEnd + 1;
+		dwStructEnd = dwEnd;
+	}
+
+	return true;
+}
+
+// Parse the command message template blocks
+bool get_command_blocks(LPBYTE lpBuffer, DWORD dwStart, DWORD dwEnd)
+{
+	DWORD dwCmdStart = dwStart;
+	DWORD dwCmdEnd = dwEnd;
+	DWORD dwCmdChildren = 0;
+	
+	while (get_block_markers(lpBuffer, dwCmdStart, dwCmdEnd, dwCmdChildren))
+	{
+		char szCmdLine[256];
+		DWORD dwCmdLen = (dwCmdChildren ? dwCmdChildren - 1 : dwCmdEnd - 1) - dwCmdStart;
+
+		memcpy(&szCmdLine, &lpBuffer[dwCmdStart+1], dwCmdLen);
+		szCmdLine[dwCmdLen] = '\0';
+		trim(szCmdLine);
+		
+		//printf("%s\n", szCmdLine);
+
+		char *lpszCmd = strtok(szCmdLine, " ");
+		char *lpszFreq = strtok(NULL, " ");
+		char *lpszFixed = NULL;
+		char *lpszTrust = NULL;
+		char *lpszCoding = NULL;
+		static DWORD dwLow = 1;
+		static DWORD dwMed = 1;
+		static DWORD dwHigh = 1;
+		COMMAND *lpCmd = NULL;
+
+		// Get the commands frequency
+		if (!strnicmp(lpszFreq, "Fixed", 6))
+		{
+			lpszFixed = strtok(NULL, " ");
+			DWORD dwFixed = (DWORD)httoi(lpszFixed) ^ 0xffff0000;
+			lpCmd = &cmds_low[dwFixed];
+			lpCmd->wFrequency = MSG_FREQ_LOW;
+			lpCmd->wID = (WORD)dwFixed;
+		}
+		else if (!strnicmp(lpszFreq, "Low", 4))
+		{
+			lpCmd = &cmds_low[dwLow];
+			lpCmd->wFrequency = MSG_FREQ_LOW;
+			lpCmd->wID = (WORD)dwLow++;
+		}
+		else if (!strnicmp(lpszFreq, "Medium", 7))
+		{
+			lpCmd = &cmds_med[dwMed];
+			lpCmd->wFrequency = MSG_FREQ_MED;
+			lpCmd->wID = (WORD)dwMed++;
+		}
+		else if (!strnicmp(lpszFreq, "High", 5))
+		{
+			lpCmd = &cmds_high[dwHigh];
+			lpCmd->wFrequency = MSG_FREQ_HIGH;
+			lpCmd->wID = (WORD)dwHigh++;
+		}
+
+		lpszTrust = strtok(NULL, " ");
+		lpszCoding = strtok(NULL, " ");
+		
+		lpCmd->lpszCmd = strdup(lpszCmd);
+		lpCmd->nIndex = cmds_count++;
+		
+		// Is the command zero encoded?
+		if (!strnicmp(lpszCoding, "Zerocoded", 10))
+		{
+			lpCmd->bZerocoded = true;
+		}
+
+		// Is the command trusted?
+		if (!strnicmp(lpszTrust, "Trusted", 8))
+		{
+			lpCmd->bTrusted = true;
+		}
+
+		get_struct_blocks(lpCmd, lpBuffer, dwCmdStart + 1, dwCmdEnd - 1);
+
+		//printf("----------------------\n");
+
+		dwCmdStart = dwCmdEnd + 1;
+		dwCmdEnd = dwEnd;
+	}
+
+	return true;
+}
+
+void dump_structs(LPCOMMANDSTRUCT lpStruct)
+{
+	while (lpStruct)
+	{
+		//dprintf("\t%04d %s (%s / %hu)\n", lpStruct->nKeywordPos, lpStruct->lpszStruct, LLTYPES[lpStruct->nType], lpStruct->cItems);
+
+		LPCOMMANDVAR lpVar = lpStruct->vars;
+
+		while (lpVar)
+		{
+			//dprintf("\t\t%04d %s (%s / %d)\n", lpVar->nKeywordPos, lpVar->lpszVar, LLTYPES[lpVar->nType], lpVar->nTypeLen);
+			lpVar = lpVar->lpNext;
+		}
+
+//		if (lpStruct->lpNext)
+//		{
+			lpStruct = lpStruct->lpNext;
+//			SAFE_FREE(lpStruct->lpPrev->lpszStruct);
+//			SAFE_FREE(lpStruct->lpPrev);
+//		}
+//		else
+//		{
+//			SAFE_FREE(lpStruct->lpszStruct);
+//			SAFE_FREE(lpStruct);
+//		}
+	}
+}
+
+LPCOMMAND find_command(char *lpszCmd)
+{
+	for (int i = 0; i < MAX_COMMANDS_HIGH; i++)
+	{
+		if (cmds_high[i].lpszCmd && !stricmp(cmds_high[i].lpszCmd, lpszCmd))
+			return &cmds_high[i];
+	}
+
+	for (int i = 0; i < MAX_COMMANDS_MEDIUM; i++)
+	{
+		if (cmds_med[i].lpszCmd && !stricmp(cmds_med[i].lpszCmd, lpszCmd))
+			return &cmds_med[i];
+	}
+
+	for (int i = 0; i < MAX_COMMANDS_LOW; i++)
+	{
+		if (cmds_low[i].lpszCmd && !stricmp(cmds_low[i].lpszCmd, lpszCmd))
+			return &cmds_low[i];
+	}
+
+	return NULL;
+}
+
+// A message type's number as it reads on the wire: one byte for high
+// frequency messages, 0xff then a byte for medium, 0xffff then a word for low
+DWORD command_number(LPCOMMAND lpCommand)
+{
+	if (lpCommand->wFrequency == MSG_FREQ_HIGH)
+		return lpCommand->wID;
+
+	if (lpCommand->wFrequency == MSG_FREQ_MED)
+		return 0xff00 | lpCommand->wID;
+
+	return 0xffff0000 | lpCommand->wID;
+}
+
+LPCOMMAND number_command(DWORD dwMessage)
+{
+	if (dwMessage < 0xff00)
+		return (dwMessage < MAX_COMMANDS_HIGH) ? &cmds_high[dwMessage] : NULL;
+
+	if (dwMessage < 0xffff0000)
+		return ((dwMessage & 0xff) < MAX_COMMANDS_MEDIUM) ? &cmds_med[dwMessage & 0xff] : NULL;
+
+	return ((dwMessage & 0xffff) < MAX_COMMANDS_LOW) ? &cmds_low[dwMessage & 0xffff] : NULL;
+}
+
+// Look up a packet's message type from the wire, zero decoding only the
+// first PEEK_LEN bytes of the body. Those are left in lpPeek when given.
+LPCOMMAND peek_command(LPBYTE lpBuffer, int nLen, LPBYTE lpPeek)
+{
+	BYTE bID[PEEK_LEN];
+	int nID = 0;
+
+	for (int i = MSG_HEADER_LEN; i < nLen && nID < sizeof(bID); i++)
+	{
+		if (lpBuffer[i] == 0x00 && (lpBuffer[0] & MSG_ZEROCODED) && i + 1 < nLen)
+		{
+			for (int z = 0; z < lpBuffer[i + 1] && nID < sizeof(bID); z++)
+				bID[nID++] = 0x00;
+
+			i++;
+		}
+		else
+			bID[nID++] = lpBuffer[i];
+	}
+
+	if (lpPeek)
+	{
+		ZeroMemory(lpPeek, PEEK_LEN);
+		memcpy(lpPeek, bID, nID);
+	}
+
+	if (nID >= 1 && bID[0] != 0xff)
+		return &cmds_high[bID[0]];
+
+	if (nID >= 2 && bID[1] != 0xff)
+		return &cmds_med[bID[1]];
+
+	if (nID >= 4)
+		return &cmds_low[(bID[2] << 8) | bID[3]];
+
+	return NULL;
+}
+
+// Walk a packet against its template without decoding it, counting the block
+// lists, block instances and fields a flat message layout needs. Returns the
+// end of the message body or -1 if the packet is shorter than the template
+int measure_command(LPCOMMAND lpCommand, char *zerobuf, int len, int pos, int &nBlocks, int &nItems, int &nVars)
+{
+	nBlocks = 0;
+	nItems = 0;
+	nVars = 0;
+
+	LPCOMMANDSTRUCT lpStruct = lpCommand->structs;
+
+	while (lpStruct)
+	{
+		BYTE cItems = 1;
+
+		if (lpStruct->nType == LLTYPE_VARIABLE)
+		{
+			if (pos + (int)sizeof(cItems) > len)
+				return -1;
+
+			memcpy(&cItems, &zerobuf[pos], sizeof(cItems));
+			pos += sizeof(cItems);
+		}
+		else if (lpStruct->nType == LLTYPE_MULTIPLE)
+		{
+			cItems = lpStruct->cItems;
+		}
+
+		nBlocks++;
+		nItems += cItems;
+
+		for (BYTE c = 0; c < cItems; c++)
+		{
+			LPCOMMANDVAR lpVar = lpStruct->vars;
+
+			while (lpVar)
+			{
+				if (lpVar->nType == LLTYPE_VARIABLE && pos + lpVar->nTypeLen > len)
+					return -1;
+
+				pos += CVar::GetWireSize(lpVar->nType, lpVar->nTypeLen, (LPBYTE)&zerobuf[pos]);
+				nVars++;
+
+				if (pos > len)
+					return -1;
+
+				lpVar = lpVar->lpNext;
+			}
+		}
+
+		lpStruct = lpStruct->lpNext;
+	}
+
+	return pos;
+}
+
+// Fill the command tables from a template with its comments stripped
+static void load_commands(LPBYTE lpTemplate, DWORD dwLen)
+{
+	ZeroMemory(&cmds_low, sizeof(cmds_low));
+	ZeroMemory(&cmds_med, sizeof(cmds_med));
+	ZeroMemory(&cmds_high, sizeof(cmds_high));
+	cmds_count = 0;
+
+	get_command_blocks(lpTemplate, 0, dwLen);
+
+	start_ping_check = find_command("StartPingCheck");
+	complete_ping_check = find_command("CompletePingCheck");
+	packet_ack = find_command("PacketAck");
+	
+	for (int i = 1; i < MAX_COMMANDS_LOW; i++)
+	{
+		if (cmds_low[i].lpszCmd)
+		{
+			//dprintf("LOW %05d - %s - %s - %s\n", i, cmds_low[i].lpszCmd, cmds_low[i].bTrusted ? "Trusted" : "Untrusted", cmds_low[i].bZerocoded ? "Zerocoded" : "Unencoded");
+			dump_structs(cmds_low[i].structs);
+			//SAFE_FREE(cmds_low[i].lpszCmd);
+		}
+	}
+
+	for (int i = 1; i < MAX_COMMANDS_MEDIUM; i++)
+	{
+		if (cmds_med[i].lpszCmd)
+		{
+			//dprintf("Medium %05d - %s\n", i, cmds_med[i].lpszCmd);
+			dump_structs(cmds_med[i].structs);
+			//SAFE_FREE(cmds_med[i].lpszCmd);
+		}
+	}
+
+	for (int i = 1; i < MAX_COMMANDS_HIGH; i++)
+	{
+		if (cmds_high[i].lpszCmd)
+		{
+			//dprintf("High %05d - %s\n", i, cmds_high[i].lpszCmd);
+			dump_structs(cmds_high[i].structs);
+			//SAFE_FREE(cmds_high[i].lpszCmd);
+		}
+	}
+}
+
+// Decrypt comm.dat into the message template and fill the command tables
+// from it. Returns -1 if either file could not be opened.
+int decomm(LPCTSTR lpszCommDat, LPCTSTR lpszTemplate)
+{
+	FILE *fpComm;
+	FILE *fpMsg;
+
+	fpComm = fopen(lpszCommDat, "rb");
+
+	if (!fpComm)
+	{
+		printf("Couldn't open %s for reading, aborting...\n", lpszCommDat);
+		return -1;
+	}
+
+	fpMsg = fopen(lpszTemplate, "wb");
+
+	if (!fpMsg)
+	{
+		printf("Couldn't open %s for writing, aborting...\n", lpszTemplate);
+		return -1;
+	}
+
+	printf("Decrypting %s to %s\n", lpszCommDat, lpszTemplate);
+	static unsigned char ucMagicKey = 0;
+	long lTemplateSize = 0;
+
+	fseek(fpComm, 0, SEEK_END);
+	lTemplateSize = ftell(fpComm);
+	fseek(fpComm, 0, SEEK_SET);
+
+	BYTE buffer[2048];
+	BYTE stripped[2048];
+	LPBYTE lpTemplate = (LPBYTE)malloc(lTemplateSize);
+	DWORD dwTemplateWrote = 0;
+
+	if (!lpTemplate)
+		return -1;
+
+	bool bComment = false;
+
+	while (!feof(fpComm))
+	{
+		size_t stRead = fread(&buffer, 1, sizeof(buffer), fpComm);
+		size_t stStripped = 0;
+
+		for (size_t stCount = 0; stCount < stRead; stCount++)
+		{
+			buffer[stCount] ^= ucMagicKey;
+
+			if (!bComment && buffer[stCount] != '/')
+				stripped[stStripped++] = buffer[stCount];
+
+			if (bComment && buffer[stCount] == '\n')
+				bComment = false;
+
+			if (!bComment && buffer[stCount] == '/')
+				bComment = true;
+
+			ucMagicKey += 43;
+		}
+
+		memcpy(lpTemplate + dwTemplateWrote, &stripped, stStripped);
+		dwTemplateWrote += (DWORD)stStripped;
+		
+		size_t stWrote = fwrite(&stripped, 1, stStripped, fpMsg);
+
+		printf(".");
+		fflush(stdout);
+	}
+
+	printf("\nDone.\n");
+
+	printf("template size: %ld\n", lTemplateSize);
+
+	fclose(fpComm);
+	fclose(fpMsg);
+
+	load_commands(lpTemplate, dwTemplateWrote);
+	free(lpTemplate);
+
+	return 0;
+}
+
+// Load a message template that is already decrypted, such as one decomm
+// wrote out. Returns -1 if it could not be read.
+int load_template(LPCTSTR lpszTemplate)
+{
+	FILE *fp = fopen(lpszTemplate, "rb");
+
+	if (!fp)
+		return -1;
+
+	fseek(fp, 0, SEEK_END);
+	long lSize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	LPBYTE lpTemplate = (LPBYTE)malloc(lSize > 0 ? lSize : 1);
+
+	if (!lpTemplate || (lSize > 0 && fread(lpTemplate, lSize, 1, fp) != 1))
+	{
+		SAFE_FREE(lpTemplate);
+		fclose(fp);
+		return -1;
+	}
+
+	fclose(fp);
+
+	DWORD dwLen = 0;
+	bool bComment = false;
+
+	for (long l = 0; l < lSize; l++)
+	{
+		if (!bComment && lpTemplate[l] != '/')
+			lpTemplate[dwLen++] = lpTemplate[l];
+
+		if (bComment && lpTemplate[l] == '\n')
+			bComment = false;
+
+		if (!bComment && lpTemplate[l] == '/')
+			bComment = true;
+	}
+
+	load_commands(lpTemplate, dwLen);
+	free(lpTemplate);
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "./Template.h"
+
+// Bytes of a packet body peek_command decodes to find the message type
+#define PEEK_LEN	8
+
+// Commands the packet path watches for, looked up once the template is loaded
+extern LPCOMMAND start_ping_check;
+extern LPCOMMAND complete_ping_check;
+extern LPCOMMAND packet_ack;
+
+int ZeroDecode(char *src, int srclen, char *dest, int destlen);
+int ZeroEncode(char *src, int srclen, char *dest, int destlen);
+
+int decomm(LPCTSTR lpszCommDat, LPCTSTR lpszTemplate);
+int load_template(LPCTSTR lpszTemplate);
+bool get_command_blocks(LPBYTE lpBuffer, DWORD dwStart, DWORD dwEnd);
+void dump_structs(LPCOMMANDSTRUCT lpStruct);
+
+LPCOMMAND find_command(char *lpszCmd);
+DWORD command_number(LPCOMMAND lpCommand);
+LPCOMMAND number_command(DWORD dwMessage);
+LPCOMMAND peek_command(LPBYTE lpBuffer, int nLen, LPBYTE lpPeek);
+int measure_command(LPCOMMAND lpCommand, char *zerobuf, int len, int pos, int &nBlocks, int &nItems, int &nVars);
\ No newline at end of file
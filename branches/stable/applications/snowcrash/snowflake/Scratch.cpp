@@ -0,0 +1,101 @@
+#include "stdafx.h"
+#include "./Scratch.h"
+
+CScratch::CScratch(void)
+{
+	m_lpStats = NULL;
+	m_lpNext = NULL;
+	m_bModified = false;
+	m_lpArena = NULL;
+	m_nUsed = 0;
+}
+
+CScratch::~CScratch(void)
+{
+	Free();
+}
+
+bool CScratch::Init(int nCommands)
+{
+	Free();
+
+	m_lpArena = (LPBYTE)malloc(SCRATCH_ARENA_LEN);
+	m_lpStats = (COMMANDSTATS *)calloc(nCommands > 0 ? nCommands : 1, sizeof(COMMANDSTATS));
+
+	if (!m_lpArena || !m_lpStats || !m_messages.Init(nCommands))
+	{
+		Free();
+		return false;
+	}
+
+	return true;
+}
+
+void CScratch::Free(void)
+{
+	m_messages.Free();
+
+	SAFE_FREE(m_lpArena);
+	SAFE_FREE(m_lpStats);
+	m_nUsed = 0;
+}
+
+// Bump allocation, kept 8 byte aligned. NULL once the arena is used up;
+// nothing is handed back until the next Reset.
+LPBYTE CScratch::Alloc(int nLen)
+{
+	int nAligned = (nLen + 7) & ~7;
+
+	if (!m_lpArena || nLen < 0 || nAligned > SCRATCH_ARENA_LEN - m_nUsed)
+		return NULL;
+
+	LPBYTE lpData = &m_lpArena[m_nUsed];
+	m_nUsed += nAligned;
+
+	return lpData;
+}
+
+void CScratch::Reset(void)
+{
+	m_nUsed = 0;
+	m_bModified = false;
+}
+
+static void merge_commands(LPCOMMAND lpCommands, int nCommands, COMMANDSTATS *lpStats)
+{
+	for (int i = 0; i < nCommands; i++)
+	{
+		if (!lpCommands[i].lpszCmd)
+			continue;
+
+		COMMANDSTATS *stats = &lpCommands[i].stats;
+		COMMANDSTATS *scratch = &lpStats[lpCommands[i].nIndex];
+
+		stats->dwDecoded += scratch->dwDecoded;
+		stats->dwVerified += scratch->dwVerified;
+		stats->dwResent += scratch->dwResent;
+		stats->dwDuplicates += scratch->dwDuplicates;
+
+		if (scratch->dwMismatched)
+		{
+			stats->dwMismatched += scratch->dwMismatched;
+			stats->nMismatchOffset = scratch->nMismatchOffset;
+			stats->nMismatchLen = scratch->nMismatchLen;
+			stats->nMismatchPacked = scratch->nMismatchPacked;
+		}
+
+		ZeroMemory(scratch, sizeof(COMMANDSTATS));
+	}
+}
+
+// Fold the counters into the message types' own. The owning thread must be
+// idle.
+void CScratch::MergeStats(void)
+{
+	if (!m_lpStats)
+		return;
+
+	merge_commands(cmds_high, MAX_COMMANDS_HIGH, m_lpStats);
+	merge_commands(cmds_med, MAX_COMMANDS_MEDIUM, m_lpStats);
+	merge_commands(cmds_low, MAX_COMMANDS_LOW, m_lpStats);
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "./Template.h"
+#include "./MessagePool.h"
+
+// Arena each decoding thread allocates from, reset for every packet. It
+// holds a decode buffer plus a packet's appended acks with room to spare,
+// the acks only being copied out when a rewritten body could overrun them.
+#define SCRATCH_ARENA_LEN	65536
+
+// Decode buffer for one packet
+#define SCRATCH_PACKET_LEN	8192
+
+// Everything one thread needs to decode packets without touching another
+// thread's state: a bump allocated arena, a message pool, and its own copy
+// of the per message type counters, folded back in once it is idle.
+class CScratch
+{
+public:
+	CScratch(void);
+	~CScratch(void);
+
+	CMessagePool m_messages;
+	COMMANDSTATS *m_lpStats;	// Indexed by COMMAND::nIndex
+	CScratch *m_lpNext;
+	bool m_bModified;			// Set by a handler that rewrote the decoded packet
+
+	bool Init(int nCommands);
+	void Free(void);
+	LPBYTE Alloc(int nLen);
+	void Reset(void);
+	void MergeStats(void);
+
+protected:
+	LPBYTE m_lpArena;
+	int m_nUsed;
+};
\ No newline at end of file
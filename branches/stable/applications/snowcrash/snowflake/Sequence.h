@@ -13,7 +13,8 @@ public:
 	WORD m_wKey;
 	WORD m_wValue;
 	WORD m_wState;
+	bool m_bUsed;
 
-	CSequence *m_lpPrev;
+	// Free list link of overflow entries
 	CSequence *m_lpNext;
-};
+};
\ No newline at end of file
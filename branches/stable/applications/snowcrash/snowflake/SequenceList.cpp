@@ -1,161 +1,397 @@
-#include "StdAfx.h"
-#include ".\SequenceList.h"
+#include "stdafx.h"
+#include "./SequenceList.h"
+
+// Fibonacci hash of a sequence number into the overflow tables. The low
+// bits of the product only depend on the low bits of the key, so it's the
+// top 9 that index the 512 entries.
+static int hash_sequence(WORD wKey)
+{
+	return (int)((WORD)(wKey * 40503) >> 7);
+}
+
+// Index of the lowest set bit of a non zero word, halving the search each
+// step so it takes five tests on any compiler
+static int lowest_bit(DWORD dwBits)
+{
+	int nBit = 0;
+
+	if (!(dwBits & 0xffff))
+	{
+		dwBits >>= 16;
+		nBit += 16;
+	}
+
+	if (!(dwBits & 0xff))
+	{
+		dwBits >>= 8;
+		nBit += 8;
+	}
+
+	if (!(dwBits & 0xf))
+	{
+		dwBits >>= 4;
+		nBit += 4;
+	}
+
+	if (!(dwBits & 0x3))
+	{
+		dwBits >>= 2;
+		nBit += 2;
+	}
+
+	if (!(dwBits & 0x1))
+		nBit++;
+
+	return nBit;
+}
 
 CSequenceList::CSequenceList(void)
 {
-	m_lpSequences = NULL;
+	FreeSequences();
 }
 
 CSequenceList::~CSequenceList(void)
 {
-	FreeSequences();
 }
 
+// Every entry lives inside the list itself, so freeing only clears slots
 void CSequenceList::FreeSequences(void)
 {
-	CSequence *sequence = m_lpSequences;
+	for (int i = 0; i < SEQUENCE_WINDOW; i++)
+	{
+		m_sequences[i].m_bUsed = false;
+		m_lpValues[i] = NULL;
+	}
+
+	m_lpOverflowFree = NULL;
 
-	while (sequence)
+	for (int i = SEQUENCE_OVERFLOW - 1; i >= 0; i--)
 	{
-		if (sequence->m_lpNext)
-		{
-			sequence = sequence->m_lpNext;
+		m_overflow[i].m_bUsed = false;
+		m_overflow[i].m_lpNext = m_lpOverflowFree;
+		m_lpOverflowFree = &m_overflow[i];
+	}
 
-			if (sequence->m_lpPrev)
-				SAFE_DELETE(sequence->m_lpPrev);
-		}
-		else
-			SAFE_DELETE(sequence);
+	for (int i = 0; i < SEQUENCE_OVERFLOW_HASH; i++)
+	{
+		m_lpOverflowKeys[i] = NULL;
+		m_lpOverflowValues[i] = NULL;
+	}
+
+	for (int i = 0; i < SEQUENCE_BITMAP; i++)
+	{
+		m_dwAcked[i] = 0;
+		m_dwUnacked[i] = 0;
 	}
 
-	m_lpSequences = NULL;
+	m_nOverflowValues = 0;
+	m_nSequences = 0;
+	m_nAcked = 0;
 }
 
-bool CSequenceList::AddSequence(CSequence *lpSequence)
+// Take the ring slot of wKey, or an overflow entry when an older sequence
+// still holds it. Returns NULL if the key is already present or the
+// overflow pool is exhausted.
+CSequence *CSequenceList::AddSequence(WORD wKey, WORD wValue)
 {
-	CSequence *sequence = NULL;
+	if (FindSequenceByKey(wKey))
+		return NULL;
+
+	CSequence *sequence = &m_sequences[wKey % SEQUENCE_WINDOW];
+	bool bValueFree = !m_lpValues[wValue % SEQUENCE_WINDOW];
 
-	if (m_lpSequences)
+	if (!bValueFree && m_nOverflowValues >= SEQUENCE_OVERFLOW)
+		return NULL;
+
+	if (sequence->m_bUsed)
 	{
-		sequence = m_lpSequences;
+		if (!m_lpOverflowFree)
+			return NULL;
 
-		while (sequence->m_lpNext)
-			sequence = sequence->m_lpNext;
+		sequence = m_lpOverflowFree;
+		m_lpOverflowFree = sequence->m_lpNext;
+		sequence->m_lpNext = NULL;
+		sequence->m_wKey = wKey;
 
-		sequence->m_lpNext = lpSequence;
+		HashInsert(m_lpOverflowKeys, sequence, false);
+	}
 
-		if (!sequence->m_lpNext) return false;
+	sequence->m_wKey = wKey;
+	sequence->m_wValue = wValue;
+	sequence->m_wState = SEQ_STATE_UNACKED;
+	sequence->m_bUsed = true;
 
-		sequence->m_lpNext->m_lpNext = NULL;
-		sequence->m_lpNext->m_lpPrev = sequence;
+	int nSlot = GetSlot(sequence);
+	m_dwUnacked[nSlot / 32] |= 1UL << (nSlot % 32);
 
-		return true;
-	}
+	if (bValueFree)
+		m_lpValues[wValue % SEQUENCE_WINDOW] = sequence;
 	else
 	{
-		sequence = lpSequence;
+		HashInsert(m_lpOverflowValues, sequence, true);
+		m_nOverflowValues++;
+	}
 
-		if (!sequence) return false;
+	m_nSequences++;
 
-		m_lpSequences = sequence;
-		m_lpSequences->m_lpNext = NULL;
-		m_lpSequences->m_lpPrev = NULL;
+	return sequence;
+}
 
-		return true;
-	}
+void CSequenceList::RemoveSequence(CSequence *lpSequence)
+{
+	if (!lpSequence || !lpSequence->m_bUsed)
+		return;
+
+	int nSlot = GetSlot(lpSequence);
+	DWORD dwBit = 1UL << (nSlot % 32);
+
+	if (m_dwAcked[nSlot / 32] & dwBit)
+		m_nAcked--;
+
+	m_dwAcked[nSlot / 32] &= ~dwBit;
+	m_dwUnacked[nSlot / 32] &= ~dwBit;
 
-	return false;
+	Release(lpSequence);
 }
 
-void CSequenceList::RemoveSequence(CSequence *lpSequence)
+// Give a slot back without touching the bitmaps
+void CSequenceList::Release(CSequence *lpSequence)
 {
-	if (lpSequence->m_lpNext)
+	if (m_lpValues[lpSequence->m_wValue % SEQUENCE_WINDOW] == lpSequence)
+		m_lpValues[lpSequence->m_wValue % SEQUENCE_WINDOW] = NULL;
+	else
 	{
-		if (lpSequence->m_lpPrev)
-		{
-			lpSequence->m_lpPrev->m_lpNext = lpSequence->m_lpNext;
-			lpSequence->m_lpNext->m_lpPrev = lpSequence->m_lpPrev;
-		}
-		else
-		{
-			lpSequence->m_lpNext->m_lpPrev = NULL;
-			m_lpSequences = lpSequence->m_lpNext;
-		}
+		HashRemove(m_lpOverflowValues, lpSequence, true);
+		m_nOverflowValues--;
 	}
-	else
+
+	if (lpSequence >= m_overflow && lpSequence < &m_overflow[SEQUENCE_OVERFLOW])
 	{
-		if (lpSequence->m_lpPrev)
-		{
-			lpSequence->m_lpPrev->m_lpNext = NULL;
-		}
-		else
-		{
-			m_lpSequences = NULL;
-		}
+		HashRemove(m_lpOverflowKeys, lpSequence, false);
+
+		lpSequence->m_lpNext = m_lpOverflowFree;
+		m_lpOverflowFree = lpSequence;
 	}
 
-	SAFE_DELETE(lpSequence);
+	lpSequence->m_bUsed = false;
+	m_nSequences--;
 }
 
 CSequence *CSequenceList::FindSequenceByKey(WORD wKey)
 {
-	CSequence *sequence = m_lpSequences;
+	CSequence *sequence = &m_sequences[wKey % SEQUENCE_WINDOW];
 
-	while (sequence)
-	{
-		if (sequence->m_wKey == wKey)
-			return sequence;
-		sequence = sequence->m_lpNext;
-	}
+	if (sequence->m_bUsed && sequence->m_wKey == wKey)
+		return sequence;
 
-	return NULL;
+	return HashFind(m_lpOverflowKeys, wKey, false);
 }
 
 CSequence *CSequenceList::FindSequenceByValue(WORD wValue)
 {
-	CSequence *sequence = m_lpSequences;
+	CSequence *sequence = m_lpValues[wValue % SEQUENCE_WINDOW];
 
-	while (sequence)
-	{
-		if (sequence->m_wValue == wValue)
-			return sequence;
-		sequence = sequence->m_lpNext;
-	}
+	if (sequence && sequence->m_wValue == wValue)
+		return sequence;
 
-	return NULL;
+	return HashFind(m_lpOverflowValues, wValue, true);
+}
+
+int CSequenceList::CountSequences(void)
+{
+	return m_nSequences;
 }
 
 void CSequenceList::WalkSequences(void)
 {
-	CSequence *sequence = m_lpSequences;
+	for (int i = 0; i < SEQUENCE_WINDOW; i++)
+	{
+		if (m_sequences[i].m_bUsed)
+			dprintf("SEQ WALK: %hu ==> %hu\n", m_sequences[i].m_wKey, m_sequences[i].m_wValue);
+	}
 
-	while (sequence)
+	for (int i = 0; i < SEQUENCE_OVERFLOW; i++)
 	{
-		dprintf("SEQ WALK: %hu ==> %hu\n", sequence->m_wKey, sequence->m_wValue);
-		sequence = sequence->m_lpNext;
+		if (m_overflow[i].m_bUsed)
+			dprintf("SEQ WALK: %hu ==> %hu (overflow)\n", m_overflow[i].m_wKey, m_overflow[i].m_wValue);
 	}
 }
 
-BYTE CSequenceList::WriteAckedSequences(char *buf)
+// Move a sequence between states, keeping the bitmaps in step
+void CSequenceList::SetState(CSequence *lpSequence, WORD wState)
+{
+	if (!lpSequence || !lpSequence->m_bUsed)
+		return;
+
+	int nSlot = GetSlot(lpSequence);
+	DWORD dwBit = 1UL << (nSlot % 32);
+
+	if (lpSequence->m_wState == SEQ_STATE_ACKED)
+		m_nAcked--;
+
+	if (wState == SEQ_STATE_ACKED)
+		m_nAcked++;
+
+	m_dwAcked[nSlot / 32] &= ~dwBit;
+	m_dwUnacked[nSlot / 32] &= ~dwBit;
+
+	if (wState == SEQ_STATE_ACKED)
+		m_dwAcked[nSlot / 32] |= dwBit;
+	else if (wState == SEQ_STATE_UNACKED)
+		m_dwUnacked[nSlot / 32] |= dwBit;
+
+	lpSequence->m_wState = wState;
+}
+
+int CSequenceList::CountAcked(void)
+{
+	return m_nAcked;
+}
+
+// Collect up to cMax acked sequence numbers a bitmap word at a time, skipping
+// empty words outright, then drop them. Each word's collected bits are
+// cleared with a single mask.
+BYTE CSequenceList::WriteAckedSequences(LPDWORD lpIDs, BYTE cMax)
 {
-	CSequence *sequence = m_lpSequences;
 	BYTE cAcked = 0;
 
-	while (sequence)
+	for (int i = 0; i < SEQUENCE_BITMAP && cAcked < cMax && m_nAcked; i++)
 	{
-		if (sequence->m_wState == SEQ_STATE_ACKED)
+		DWORD dwBits = m_dwAcked[i];
+		DWORD dwTaken = 0;
+
+		while (dwBits && cAcked < cMax)
 		{
-			DWORD dwID = (DWORD)sequence->m_wKey;
-			dprintf("WROTE ACKED SEQ: %lu\n", dwID);
-			memcpy(&buf[cAcked * sizeof(dwID)], &dwID, sizeof(dwID));
-			cAcked++;
-			CSequence *remove = sequence;
-			sequence = sequence->m_lpNext;
-			RemoveSequence(remove);
+			int nBit = lowest_bit(dwBits);
+			CSequence *sequence = GetSequence(i * 32 + nBit);
+
+			lpIDs[cAcked++] = (DWORD)sequence->m_wKey;
+			dwTaken |= 1UL << nBit;
+			dwBits &= dwBits - 1;
+
+			Release(sequence);
 		}
-		else
-			sequence = sequence->m_lpNext;
+
+		m_dwAcked[i] &= ~dwTaken;
 	}
 
+	m_nAcked -= cAcked;
+
 	return cAcked;
+}
+
+// Emit pending acks as a packet's appended ack trailer
+BYTE CSequenceList::AppendAcks(CPacketBuilder *builder)
+{
+	DWORD dwIDs[SEQUENCE_MAX_ACKS];
+	BYTE cAcks = WriteAckedSequences(dwIDs);
+
+	for (BYTE c = 0; c < cAcks; c++)
+	{
+		if (!builder->AddAck(dwIDs[c]))
+			return c;
+	}
+
+	return cAcks;
+}
+
+// Emit pending acks as a standalone PacketAck, returning its length, 0 when
+// nothing is pending or -1 if it did not fit
+int CSequenceList::WritePacketAck(LPCOMMAND lpPacketAck, LPBYTE lpBuffer, int nMaxLen, WORD wSequence)
+{
+	DWORD dwIDs[SEQUENCE_MAX_ACKS];
+	CPacketBuilder builder;
+
+	if (!m_nAcked)
+		return 0;
+
+	if (!builder.Begin(lpBuffer, nMaxLen, 0, wSequence) || !builder.SetCommand(lpPacketAck))
+		return -1;
+
+	BYTE cAcks = WriteAckedSequences(dwIDs);
+
+	builder.AddBlock(cAcks);
+
+	for (BYTE c = 0; c < cAcks; c++)
+		builder.AddVar((LPBYTE)&dwIDs[c], sizeof(DWORD));
+
+	return builder.End();
+}
+
+// Linear probing over the overflow entries, keyed by either the original
+// sequence or its rewritten value
+void CSequenceList::HashInsert(CSequence **lpTable, CSequence *lpSequence, bool bValue)
+{
+	int i = hash_sequence(bValue ? lpSequence->m_wValue : lpSequence->m_wKey);
+
+	while (lpTable[i])
+		i = (i + 1) % SEQUENCE_OVERFLOW_HASH;
+
+	lpTable[i] = lpSequence;
+}
+
+CSequence *CSequenceList::HashFind(CSequence **lpTable, WORD wKey, bool bValue)
+{
+	int i = hash_sequence(wKey);
+
+	while (lpTable[i])
+	{
+		if ((bValue ? lpTable[i]->m_wValue : lpTable[i]->m_wKey) == wKey)
+			return lpTable[i];
+
+		i = (i + 1) % SEQUENCE_OVERFLOW_HASH;
+	}
+
+	return NULL;
+}
+
+// Remove without tombstones by shifting later entries of the same probe
+// run back into the hole
+void CSequenceList::HashRemove(CSequence **lpTable, CSequence *lpSequence, bool bValue)
+{
+	int i = hash_sequence(bValue ? lpSequence->m_wValue : lpSequence->m_wKey);
+
+	while (lpTable[i] && lpTable[i] != lpSequence)
+		i = (i + 1) % SEQUENCE_OVERFLOW_HASH;
+
+	if (!lpTable[i])
+		return;
+
+	int j = i;
+
+	for (;;)
+	{
+		j = (j + 1) % SEQUENCE_OVERFLOW_HASH;
+
+		if (!lpTable[j])
+			break;
+
+		int k = hash_sequence(bValue ? lpTable[j]->m_wValue : lpTable[j]->m_wKey);
+
+		// Move the entry back unless its home lies cyclically in (i, j]
+		if ((j > i) ? (k <= i || k > j) : (k <= i && k > j))
+		{
+			lpTable[i] = lpTable[j];
+			i = j;
+		}
+	}
+
+	lpTable[i] = NULL;
+}
+
+// Bitmap position of a sequence: ring slots first, then overflow entries
+int CSequenceList::GetSlot(CSequence *lpSequence)
+{
+	if (lpSequence >= m_overflow && lpSequence < &m_overflow[SEQUENCE_OVERFLOW])
+		return SEQUENCE_WINDOW + (int)(lpSequence - m_overflow);
+
+	return (int)(lpSequence - m_sequences);
+}
+
+CSequence *CSequenceList::GetSequence(int nSlot)
+{
+	if (nSlot >= SEQUENCE_WINDOW)
+		return &m_overflow[nSlot - SEQUENCE_WINDOW];
+
+	return &m_sequences[nSlot];
 }
\ No newline at end of file
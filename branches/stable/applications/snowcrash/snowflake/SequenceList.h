@@ -1,6 +1,23 @@
 #pragma once
 
-#include ".\Sequence.h"
+#include "./Sequence.h"
+#include "./PacketBuilder.h"
+
+// Sequences in flight are kept in a ring indexed by sequence number modulo
+// the window. Stragglers whose slot is still taken by an older sequence go
+// to a small overflow pool. Both are fixed size, so nothing is allocated per
+// packet and lookups by key or by value are O(1).
+#define SEQUENCE_WINDOW			1024
+#define SEQUENCE_OVERFLOW		256
+#define SEQUENCE_OVERFLOW_HASH	(SEQUENCE_OVERFLOW * 2)
+
+// Acked and unacked state is mirrored in bitmaps over the ring slots followed
+// by the overflow entries, so pending acks are found a word at a time
+#define SEQUENCE_SLOTS			(SEQUENCE_WINDOW + SEQUENCE_OVERFLOW)
+#define SEQUENCE_BITMAP			(SEQUENCE_SLOTS / 32)
+
+// Most acks a one byte count can carry, in a trailer or a PacketAck
+#define SEQUENCE_MAX_ACKS		0xff
 
 class CSequenceList
 {
@@ -8,12 +25,40 @@ public:
 	CSequenceList(void);
 	~CSequenceList(void);
 
-	CSequence *m_lpSequences;
 	void FreeSequences(void);
-	bool AddSequence(CSequence *lpSequence);
+	CSequence *AddSequence(WORD wKey, WORD wValue);
 	void RemoveSequence(CSequence *lpSequence);
 	CSequence *FindSequenceByKey(WORD wKey);
 	CSequence *FindSequenceByValue(WORD wValue);
+	int CountSequences(void);
+	void SetState(CSequence *lpSequence, WORD wState);
+	int CountAcked(void);
 	void WalkSequences(void);
-	BYTE WriteAckedSequences(char *buf);
-};
+	BYTE WriteAckedSequences(LPDWORD lpIDs, BYTE cMax = SEQUENCE_MAX_ACKS);
+	BYTE AppendAcks(CPacketBuilder *builder);
+	int WritePacketAck(LPCOMMAND lpPacketAck, LPBYTE lpBuffer, int nMaxLen, WORD wSequence);
+
+protected:
+	CSequence m_sequences[SEQUENCE_WINDOW];
+	CSequence *m_lpValues[SEQUENCE_WINDOW];
+
+	CSequence m_overflow[SEQUENCE_OVERFLOW];
+	CSequence *m_lpOverflowFree;
+	CSequence *m_lpOverflowKeys[SEQUENCE_OVERFLOW_HASH];
+	CSequence *m_lpOverflowValues[SEQUENCE_OVERFLOW_HASH];
+	int m_nOverflowValues;
+
+	int m_nSequences;
+
+	DWORD m_dwAcked[SEQUENCE_BITMAP];
+	DWORD m_dwUnacked[SEQUENCE_BITMAP];
+	int m_nAcked;
+
+	int GetSlot(CSequence *lpSequence);
+	CSequence *GetSequence(int nSlot);
+	void Release(CSequence *lpSequence);
+
+	void HashInsert(CSequence **lpTable, CSequence *lpSequence, bool bValue);
+	CSequence *HashFind(CSequence **lpTable, WORD wKey, bool bValue);
+	void HashRemove(CSequence **lpTable, CSequence *lpSequence, bool bValue);
+};
\ No newline at end of file
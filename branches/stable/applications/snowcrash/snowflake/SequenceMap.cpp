@@ -0,0 +1,123 @@
+#include "stdafx.h"
+#include "./SequenceMap.h"
+
+CSequenceMap::CSequenceMap(void)
+{
+	Reset();
+}
+
+CSequenceMap::~CSequenceMap(void)
+{
+}
+
+// Forget every mapping. dwLimit is the highest sequence number before the
+// counter wraps back to zero.
+void CSequenceMap::Reset(DWORD dwLimit, DWORD dwFirst)
+{
+	m_dwLimit = dwLimit;
+	m_dwNext = dwFirst & dwLimit;
+
+	for (int i = 0; i < SEQUENCE_MAP_WINDOW; i++)
+	{
+		m_forward[i].bUsed = false;
+		m_reverse[i].bUsed = false;
+	}
+}
+
+// Hand out the next forwarded sequence, wrapping at the limit
+DWORD CSequenceMap::Take(void)
+{
+	DWORD dwValue = m_dwNext;
+
+	m_dwNext = (m_dwNext == m_dwLimit) ? 0 : m_dwNext + 1;
+
+	return dwValue;
+}
+
+// Free a slot about to be reused, along with the other half of its pairing
+// so neither direction is left translating to a number that moved on
+void CSequenceMap::Evict(SEQUENCEMAPENTRY *lpEntry, SEQUENCEMAPENTRY *lpPartner)
+{
+	if (!lpEntry->bUsed)
+		return;
+
+	if (lpPartner->bUsed && lpPartner->dwKey == lpEntry->dwKey && lpPartner->dwValue == lpEntry->dwValue)
+		lpPartner->bUsed = false;
+
+	lpEntry->bUsed = false;
+}
+
+// Renumber a packet being forwarded and remember the pairing both ways. A
+// resend keeps the number the original went out with, so the peer's ack
+// for either still translates back.
+DWORD CSequenceMap::Map(DWORD dwKey)
+{
+	dwKey &= m_dwLimit;
+
+	SEQUENCEMAPENTRY *forward = &m_forward[dwKey % SEQUENCE_MAP_WINDOW];
+
+	if (forward->bUsed && forward->dwKey == dwKey)
+		return forward->dwValue;
+
+	DWORD dwValue = Take();
+	SEQUENCEMAPENTRY *reverse = &m_reverse[dwValue % SEQUENCE_MAP_WINDOW];
+
+	Evict(forward, &m_reverse[forward->dwValue % SEQUENCE_MAP_WINDOW]);
+	Evict(reverse, &m_forward[reverse->dwKey % SEQUENCE_MAP_WINDOW]);
+
+	forward->dwKey = dwKey;
+	forward->dwValue = dwValue;
+	forward->bUsed = true;
+
+	reverse->dwKey = dwKey;
+	reverse->dwValue = dwValue;
+	reverse->bUsed = true;
+
+	return dwValue;
+}
+
+// Number a packet the proxy made up itself. It has no original, so an ack
+// for it translates to nothing.
+DWORD CSequenceMap::Inject(void)
+{
+	DWORD dwValue = Take();
+	SEQUENCEMAPENTRY *reverse = &m_reverse[dwValue % SEQUENCE_MAP_WINDOW];
+
+	Evict(reverse, &m_forward[reverse->dwKey % SEQUENCE_MAP_WINDOW]);
+
+	return dwValue;
+}
+
+bool CSequenceMap::ToValue(DWORD dwKey, DWORD &dwValue)
+{
+	dwKey &= m_dwLimit;
+
+	SEQUENCEMAPENTRY *forward = &m_forward[dwKey % SEQUENCE_MAP_WINDOW];
+
+	if (!forward->bUsed || forward->dwKey != dwKey)
+		return false;
+
+	dwValue = forward->dwValue;
+
+	return true;
+}
+
+// Translate an ack for a forwarded sequence back to the original one
+bool CSequenceMap::ToKey(DWORD dwValue, DWORD &dwKey)
+{
+	dwValue &= m_dwLimit;
+
+	SEQUENCEMAPENTRY *reverse = &m_reverse[dwValue % SEQUENCE_MAP_WINDOW];
+
+	if (!reverse->bUsed || reverse->dwValue != dwValue)
+		return false;
+
+	dwKey = reverse->dwKey;
+
+	return true;
+}
+
+DWORD CSequenceMap::GetNext(void)
+{
+	return m_dwNext;
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+// Renumbering of one direction of a circuit. When the proxy drops or
+// injects packets the sequence numbers it forwards no longer match the ones
+// it received, so every forwarded packet takes the next number here and the
+// other side's acks are translated back. Both directions are dense tables
+// indexed by sequence modulo the window; nothing is allocated.
+#define SEQUENCE_MAP_WINDOW		4096
+
+#define SEQUENCE_LIMIT_16		0xffff
+#define SEQUENCE_LIMIT_32		0xffffffff
+
+typedef struct
+{
+	DWORD dwKey;
+	DWORD dwValue;
+	bool bUsed;
+} SEQUENCEMAPENTRY;
+
+class CSequenceMap
+{
+public:
+	CSequenceMap(void);
+	~CSequenceMap(void);
+
+	void Reset(DWORD dwLimit = SEQUENCE_LIMIT_16, DWORD dwFirst = 1);
+	DWORD Map(DWORD dwKey);
+	DWORD Inject(void);
+	bool ToValue(DWORD dwKey, DWORD &dwValue);
+	bool ToKey(DWORD dwValue, DWORD &dwKey);
+	DWORD GetNext(void);
+
+protected:
+	DWORD Take(void);
+	void Evict(SEQUENCEMAPENTRY *lpEntry, SEQUENCEMAPENTRY *lpPartner);
+
+	DWORD m_dwLimit;
+	DWORD m_dwNext;
+
+	// Indexed by original sequence and by forwarded sequence
+	SEQUENCEMAPENTRY m_forward[SEQUENCE_MAP_WINDOW];
+	SEQUENCEMAPENTRY m_reverse[SEQUENCE_MAP_WINDOW];
+};
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "stdafx.h"
+#include "./SequenceWindow.h"
+
+CSequenceWindow::CSequenceWindow(void)
+{
+	Reset();
+}
+
+CSequenceWindow::~CSequenceWindow(void)
+{
+}
+
+void CSequenceWindow::Reset(void)
+{
+	ZeroMemory(m_dwSeen, sizeof(m_dwSeen));
+	m_wHighest = 0;
+	m_bStarted = false;
+}
+
+// Record a sequence and say whether it was seen before. Sequence numbers are
+// compared as a signed distance from the highest one, so the window keeps
+// working across the 16 bit wrap.
+int CSequenceWindow::Classify(WORD wSequence, bool bResent)
+{
+	int nBit = wSequence % SEQUENCE_SEEN_WINDOW;
+	DWORD dwBit = 1UL << (nBit % 32);
+	short sDistance = (short)(wSequence - m_wHighest);
+
+	if (!m_bStarted || sDistance > 0)
+	{
+		if (!m_bStarted || sDistance >= SEQUENCE_SEEN_WINDOW)
+			ZeroMemory(m_dwSeen, sizeof(m_dwSeen));
+		else
+		{
+			// Forget the slots the window slides over
+			for (WORD w = m_wHighest + 1; w != wSequence; w++)
+				m_dwSeen[(w % SEQUENCE_SEEN_WINDOW) / 32] &= ~(1UL << (w % 32));
+		}
+
+		m_dwSeen[nBit / 32] |= dwBit;
+		m_wHighest = wSequence;
+		m_bStarted = true;
+
+		return bResent ? SEQ_CLASS_RESENT : SEQ_CLASS_NEW;
+	}
+
+	// Too old to tell. A resend that far back was surely handled already.
+	if (-sDistance >= SEQUENCE_SEEN_WINDOW)
+		return bResent ? SEQ_CLASS_DUPLICATE : SEQ_CLASS_NEW;
+
+	if (m_dwSeen[nBit / 32] & dwBit)
+		return SEQ_CLASS_DUPLICATE;
+
+	m_dwSeen[nBit / 32] |= dwBit;
+
+	return bResent ? SEQ_CLASS_RESENT : SEQ_CLASS_NEW;
+}
\ No newline at end of file
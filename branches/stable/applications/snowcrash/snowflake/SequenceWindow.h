@@ -0,0 +1,29 @@
+#pragma once
+
+// Sliding window of recently seen sequence numbers on one direction of a
+// circuit, one bit per sequence behind the highest seen so far. Lets a
+// resend of something already handled be recognised from the header alone.
+#define SEQUENCE_SEEN_WINDOW	1024
+
+#define SEQ_CLASS_NEW			0	// First sighting
+#define SEQ_CLASS_RESENT		1	// Flagged MSG_RESENT, but the original never arrived
+#define SEQ_CLASS_DUPLICATE		2	// Already seen
+
+// What to do with a packet classified SEQ_CLASS_DUPLICATE
+#define DUPLICATE_DECODE		0	// Decode and dispatch it again
+#define DUPLICATE_SKIP			1	// Forward it untouched without decoding
+
+class CSequenceWindow
+{
+public:
+	CSequenceWindow(void);
+	~CSequenceWindow(void);
+
+	void Reset(void);
+	int Classify(WORD wSequence, bool bResent);
+
+protected:
+	DWORD m_dwSeen[SEQUENCE_SEEN_WINDOW / 32];
+	WORD m_wHighest;
+	bool m_bStarted;
+};
\ No newline at end of file
@@ -1,5 +1,5 @@
-#include "StdAfx.h"
-#include ".\Server.h"
+#include "stdafx.h"
+#include "./Server.h"
 
 CServer::CServer(void)
 {
@@ -9,9 +9,11 @@ CServer::CServer(void)
 	m_ulX = 0;
 	m_ulY = 0;
 	m_ullHandle = 0;
-
-	m_wSequenceSentIndex = 1;
-	m_wSequenceRecvIndex = 1;
+	m_lpShard = NULL;
+	m_lpSequencesSent = NULL;
+	m_lpSequencesRecv = NULL;
+	m_lpMapSent = NULL;
+	m_lpMapRecv = NULL;
 
 	m_lpPrev = NULL;
 	m_lpNext = NULL;
@@ -25,9 +27,11 @@ CServer::CServer(struct sockaddr_in *address)
 	m_ulX = 0;
 	m_ulY = 0;
 	m_ullHandle = 0;
-
-	m_wSequenceSentIndex = 1;
-	m_wSequenceRecvIndex = 1;
+	m_lpShard = NULL;
+	m_lpSequencesSent = NULL;
+	m_lpSequencesRecv = NULL;
+	m_lpMapSent = NULL;
+	m_lpMapRecv = NULL;
 
 	m_lpPrev = NULL;
 	m_lpNext = NULL;
@@ -36,6 +40,10 @@ CServer::CServer(struct sockaddr_in *address)
 CServer::~CServer(void)
 {
 	SAFE_FREE(m_lpszSimName);
+	SAFE_DELETE(m_lpSequencesSent);
+	SAFE_DELETE(m_lpSequencesRecv);
+	SAFE_DELETE(m_lpMapSent);
+	SAFE_DELETE(m_lpMapRecv);
 }
 
 void CServer::SetSimName(char *lpszSimName)
@@ -51,4 +59,39 @@ void CServer::SetSimName(char *lpszSimName)
 		if (m_lpszSimName)
 			memcpy(m_lpszSimName, lpszSimName, stLen + 1);
 	}
+}
+
+// A region handle is the region's south west corner in global meters, x
+// in the high half and y in the low
+void CServer::SetHandle(ULONGLONG ullHandle)
+{
+	m_ullHandle = ullHandle;
+	m_ulX = (ULONG)(ullHandle / REGION_MULTIPLIER) / REGION_WIDTH_UNITS;
+	m_ulY = (ULONG)(ullHandle % REGION_MULTIPLIER) / REGION_WIDTH_UNITS;
+}
+
+// The ack bookkeeping for one direction, made on first use like the
+// renumbering maps below: each list is some 37 KB and the decoder only
+// observes acks. NULL if there's no memory for it.
+CSequenceList *CServer::GetSequences(bool bSent)
+{
+	CSequenceList **lpSequences = bSent ? &m_lpSequencesSent : &m_lpSequencesRecv;
+
+	if (!*lpSequences)
+		*lpSequences = new CSequenceList();
+
+	return *lpSequences;
+}
+
+// The renumbering map for one direction, made on first use since each is
+// nearly 100 KB and nothing but a renumbering proxy needs one. NULL if
+// there's no memory for it.
+CSequenceMap *CServer::GetMap(bool bSent)
+{
+	CSequenceMap **lpMap = bSent ? &m_lpMapSent : &m_lpMapRecv;
+
+	if (!*lpMap)
+		*lpMap = new CSequenceMap();
+
+	return *lpMap;
 }
\ No newline at end of file
@@ -1,6 +1,11 @@
 #pragma once
 
-#include ".\SequenceList.h"
+#include "./SequenceList.h"
+#include "./SequenceMap.h"
+#include "./SequenceWindow.h"
+#include "./Latency.h"
+
+class CShard;
 
 #define SERVER_TYPE_UNKNOWN		0
 #define SERVER_TYPE_USER		1
@@ -14,19 +19,35 @@ public:
 	CServer(struct sockaddr_in *address);
 	~CServer(void);
 	void SetSimName(char *lpszSimName);
+	void SetHandle(ULONGLONG ullHandle);
+	CSequenceList *GetSequences(bool bSent);
+	CSequenceMap *GetMap(bool bSent);
 
 	struct sockaddr_in m_address;
 	char *m_lpszSimName;
 	int m_nType;
-	ULONG m_ulX;
+	ULONG m_ulX;			// Grid coordinates, in regions
 	ULONG m_ulY;
-	ULONG m_ullHandle;
+	ULONGLONG m_ullHandle;	// 0 until a message names the region
 	
-	CSequenceList m_sequencesSent;
-	WORD m_wSequenceSentIndex;
+	CSequenceWindow m_windowSent;
+	CSequenceWindow m_windowAcked;	// Sent sequences the peer has acked
+	CSequenceWindow m_windowRecv;
+
+	// Sequences held each way for acking, only for a proxy that acks on the
+	// client's behalf; NULL until GetSequences() is first asked for one
+	CSequenceList *m_lpSequencesSent;
+	CSequenceList *m_lpSequencesRecv;
+
+	CLatency m_latency;
+
+	// Renumbering each way, only for a proxy that drops or injects packets;
+	// NULL until GetMap() is first asked for one
+	CSequenceMap *m_lpMapSent;
+	CSequenceMap *m_lpMapRecv;
 
-	CSequenceList m_sequencesRecv;
-	WORD m_wSequenceRecvIndex;
+	// Shard that owns the circuit, NULL when decoding inline in the hooks
+	CShard *m_lpShard;
 
 	CServer *m_lpNext;
 	CServer *m_lpPrev;
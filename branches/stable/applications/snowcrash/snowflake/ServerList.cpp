@@ -1,96 +1,270 @@
-#include "StdAfx.h"
-#include ".\ServerList.h"
+#include "stdafx.h"
+#include "./ServerList.h"
+
+DWORD CServerList::HashAddress(struct sockaddr_in *address)
+{
+	DWORD dwHash = address->sin_addr.s_addr * 2654435761UL;
+
+	return dwHash ^ (address->sin_port * 40503UL) ^ (dwHash >> 16);
+}
+
+static bool same_address(struct sockaddr_in *a, struct sockaddr_in *b)
+{
+	return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
 
 CServerList::CServerList(void)
 {
 	m_lpServers = NULL;
+	m_lpTail = NULL;
+	m_lpTable = NULL;
+	m_nServers = 0;
+	m_lpRegions = NULL;
 	m_bAddedUserServer = false;
+
+	InitializeCriticalSection(&m_csWrite);
 }
 
 CServerList::~CServerList(void)
 {
 	FreeServers();
+	DeleteCriticalSection(&m_csWrite);
 }
 
+// Only when nothing is reading any more, e.g. on shutdown
 void CServerList::FreeServers(void)
 {
+	EnterCriticalSection(&m_csWrite);
+
 	CServer *server = m_lpServers;
 
 	while (server)
 	{
-		if (server->m_lpNext)
-		{
-			server = server->m_lpNext;
-
-			if (server->m_lpPrev)
-				SAFE_DELETE(server->m_lpPrev);
-		}
-		else
-			SAFE_DELETE(server);
+		CServer *next = server->m_lpNext;
+		SAFE_DELETE(server);
+		server = next;
 	}
 
+	LPSERVERTABLE lpTable = m_lpTable;
+
+	m_lpTable = NULL;
+	SAFE_FREE(lpTable);
+
+	LPREGIONTABLE lpRegions = m_lpRegions;
+
+	m_lpRegions = NULL;
+	SAFE_FREE(lpRegions);
+
 	m_lpServers = NULL;
+	m_lpTail = NULL;
+	m_nServers = 0;
+
+	m_epoch.Reclaim();
+
+	LeaveCriticalSection(&m_csWrite);
 }
 
-bool CServerList::AddServer(CServer *lpServer)
+void CServerList::BeginRead(void)
 {
-	CServer *server = NULL;
+	m_epoch.Enter();
+}
 
-	if (m_lpServers)
+void CServerList::EndRead(void)
+{
+	m_epoch.Leave();
+}
+
+void CServerList::FreeTable(LPVOID lpData)
+{
+	free(lpData);
+}
+
+void CServerList::FreeServer(LPVOID lpData)
+{
+	delete (CServer *)lpData;
+}
+
+// A fresh table holding every listed circuit but lpSkip
+LPSERVERTABLE CServerList::BuildTable(int nSize, CServer *lpSkip)
+{
+	LPSERVERTABLE lpTable = (LPSERVERTABLE)malloc(sizeof(SERVERTABLE) + (nSize - 1) * sizeof(CServer *));
+
+	if (!lpTable)
+		return NULL;
+
+	lpTable->nSize = nSize;
+	ZeroMemory(lpTable->lpEntries, nSize * sizeof(CServer *));
+
+	for (CServer *server = m_lpServers; server; server = server->m_lpNext)
 	{
-		server = m_lpServers;
+		if (server != lpSkip)
+			Insert(lpTable, server);
+	}
+
+	return lpTable;
+}
+
+// Swap in a new table. Readers already inside may still be probing the old
+// one, so it is only retired.
+void CServerList::Publish(LPSERVERTABLE lpTable)
+{
+	LPSERVERTABLE lpOld = (LPSERVERTABLE)InterlockedExchangePointer((PVOID volatile *)&m_lpTable, lpTable);
+
+	if (lpOld)
+		m_epoch.Retire(lpOld, FreeTable);
+}
+
+// The slot is written with a full barrier, so a reader that sees the
+// pointer also sees the circuit behind it
+void CServerList::Insert(LPSERVERTABLE lpTable, CServer *lpServer)
+{
+	int nMask = lpTable->nSize - 1;
+	int i = HashAddress(&lpServer->m_address) & nMask;
+
+	while (lpTable->lpEntries[i])
+		i = (i + 1) & nMask;
+
+	InterlockedExchangePointer((PVOID volatile *)&lpTable->lpEntries[i], lpServer);
+}
 
-		while (server->m_lpNext)
-			server = server->m_lpNext;
+bool CServerList::AddServer(CServer *lpServer)
+{
+	if (!lpServer) return false;
 
-		server->m_lpNext = lpServer;
+	EnterCriticalSection(&m_csWrite);
 
-		if (!server->m_lpNext) return false;
+	LPSERVERTABLE lpTable = m_lpTable;
 
-		server->m_lpNext->m_lpNext = NULL;
-		server->m_lpNext->m_lpPrev = server;
+	if (!lpTable || (m_nServers + 1) * 2 > lpTable->nSize)
+	{
+		LPSERVERTABLE lpNew = BuildTable(lpTable ? lpTable->nSize * 2 : SERVER_TABLE_SIZE, NULL);
 
-		if (!m_bAddedUserServer)
+		if (!lpNew)
 		{
-			m_bAddedUserServer = true;
-			lpServer->m_nType = SERVER_TYPE_USER;
-			lpServer->SetSimName("User Server");
+			LeaveCriticalSection(&m_csWrite);
+			return false;
 		}
 
-		return true;
+		Publish(lpNew);
+		lpTable = lpNew;
+	}
+
+	lpServer->m_lpNext = NULL;
+	lpServer->m_lpPrev = m_lpTail;
+
+	if (!m_bAddedUserServer)
+	{
+		m_bAddedUserServer = true;
+		lpServer->m_nType = SERVER_TYPE_USER;
+		lpServer->SetSimName("User Server");
 	}
+
+	if (m_lpTail)
+		m_lpTail->m_lpNext = lpServer;
 	else
+		m_lpServers = lpServer;
+
+	m_lpTail = lpServer;
+	m_nServers++;
+
+	Insert(lpTable, lpServer);
+
+	LeaveCriticalSection(&m_csWrite);
+
+	return true;
+}
+
+// Both hooked threads can miss a new circuit at the same time, so the miss
+// is checked again under the writer lock before adding it
+CServer *CServerList::FindOrAddServer(struct sockaddr_in *address)
+{
+	CServer *server = FindServer(address);
+
+	if (server)
+		return server;
+
+	EnterCriticalSection(&m_csWrite);
+
+	server = FindServer(address);
+
+	if (!server)
 	{
-		server = lpServer;
+		server = new CServer(address);
 
-		if (!server) return false;
+		if (server && !AddServer(server))
+			SAFE_DELETE(server);
+	}
 
-		m_lpServers = server;
-		m_lpServers->m_lpNext = NULL;
-		m_lpServers->m_lpPrev = NULL;
+	LeaveCriticalSection(&m_csWrite);
 
-		if (!m_bAddedUserServer)
-		{
-			m_bAddedUserServer = true;
-			lpServer->m_nType = SERVER_TYPE_USER;
-			lpServer->SetSimName("User Server");
-		}
+	return server;
+}
+
+// Unlink a circuit and retire it along with the table that pointed at it.
+// Rebuilding rather than shifting entries back in place means a reader
+// never sees a probe run with a gap in it.
+void CServerList::RemoveServer(CServer *lpServer)
+{
+	if (!lpServer)
+		return;
+
+	EnterCriticalSection(&m_csWrite);
 
-		return true;
+	// CloseCircuit and DisableSimulator can both arrive for one circuit
+	if (FindServer(&lpServer->m_address) != lpServer)
+	{
+		LeaveCriticalSection(&m_csWrite);
+		return;
 	}
 
-	return false;
+	LPSERVERTABLE lpTable = m_lpTable;
+	LPSERVERTABLE lpNew = BuildTable(lpTable->nSize, lpServer);
+
+	if (!lpNew)
+	{
+		LeaveCriticalSection(&m_csWrite);
+		return;
+	}
+
+	Publish(lpNew);
+
+	if (lpServer->m_lpPrev)
+		lpServer->m_lpPrev->m_lpNext = lpServer->m_lpNext;
+	else
+		m_lpServers = lpServer->m_lpNext;
+
+	if (lpServer->m_lpNext)
+		lpServer->m_lpNext->m_lpPrev = lpServer->m_lpPrev;
+	else
+		m_lpTail = lpServer->m_lpPrev;
+
+	m_nServers--;
+
+	if (lpServer->m_ullHandle)
+		BuildRegions();
+
+	m_epoch.Retire(lpServer, FreeServer);
+
+	LeaveCriticalSection(&m_csWrite);
 }
 
 CServer *CServerList::FindServer(struct sockaddr_in *address)
 {
-	CServer *server = m_lpServers;
+	LPSERVERTABLE lpTable = m_lpTable;
+	CServer *server;
 
-	while (server)
+	if (!lpTable)
+		return NULL;
+
+	int nMask = lpTable->nSize - 1;
+	int i = HashAddress(address) & nMask;
+
+	while ((server = lpTable->lpEntries[i]) != NULL)
 	{
-		if (!memcmp(&server->m_address, address, sizeof(server->m_address)))
+		if (same_address(&server->m_address, address))
 			return server;
-		server = server->m_lpNext;
+
+		i = (i + 1) & nMask;
 	}
 
 	return NULL;
@@ -98,14 +272,204 @@ CServer *CServerList::FindServer(struct sockaddr_in *address)
 
 CServer *CServerList::FindServer(int nType)
 {
+	EnterCriticalSection(&m_csWrite);
+
 	CServer *server = m_lpServers;
 
 	while (server)
 	{
 		if (server->m_nType == nType)
-			return server;
+			break;
 		server = server->m_lpNext;
 	}
 
+	LeaveCriticalSection(&m_csWrite);
+
+	return server;
+}
+
+int CServerList::CountServers(void)
+{
+	return m_nServers;
+}
+
+// Handles are in meters, so hash the grid coordinates rather than the
+// handle's halves, whose low bits are always zero
+DWORD CServerList::HashRegion(ULONGLONG ullHandle)
+{
+	DWORD dwX = (DWORD)(ullHandle / REGION_MULTIPLIER) / REGION_WIDTH_UNITS;
+	DWORD dwY = (DWORD)(ullHandle % REGION_MULTIPLIER) / REGION_WIDTH_UNITS;
+	DWORD dwHash = (dwX * 2654435761UL) ^ (dwY * 40503UL);
+
+	return dwHash ^ (dwHash >> 16);
+}
+
+// Index every listed circuit with a known region into a new table. Called
+// with the writer lock held.
+bool CServerList::BuildRegions(void)
+{
+	int nRegions = 0;
+	int nSize = REGION_TABLE_SIZE;
+
+	for (CServer *server = m_lpServers; server; server = server->m_lpNext)
+	{
+		if (server->m_ullHandle)
+			nRegions++;
+	}
+
+	while (nRegions * 2 > nSize)
+		nSize *= 2;
+
+	LPREGIONTABLE lpRegions = (LPREGIONTABLE)malloc(sizeof(REGIONTABLE) + (nSize - 1) * sizeof(REGIONENTRY));
+
+	if (!lpRegions)
+		return false;
+
+	lpRegions->nSize = nSize;
+	ZeroMemory(lpRegions->entries, nSize * sizeof(REGIONENTRY));
+
+	for (CServer *server = m_lpServers; server; server = server->m_lpNext)
+	{
+		if (!server->m_ullHandle)
+			continue;
+
+		int i = HashRegion(server->m_ullHandle) & (nSize - 1);
+
+		while (lpRegions->entries[i].lpServer)
+			i = (i + 1) & (nSize - 1);
+
+		lpRegions->entries[i].ullHandle = server->m_ullHandle;
+		lpRegions->entries[i].lpServer = server;
+	}
+
+	LPREGIONTABLE lpOld = (LPREGIONTABLE)InterlockedExchangePointer((PVOID volatile *)&m_lpRegions, lpRegions);
+
+	if (lpOld)
+		m_epoch.Retire(lpOld, FreeTable);
+
+	return true;
+}
+
+// Record which region a circuit serves. A region is only ever served by
+// one circuit, so whichever circuit named it before loses it.
+bool CServerList::SetRegion(CServer *lpServer, ULONGLONG ullHandle)
+{
+	if (!lpServer || !ullHandle)
+		return false;
+
+	EnterCriticalSection(&m_csWrite);
+
+	if (lpServer->m_ullHandle == ullHandle || FindServer(&lpServer->m_address) != lpServer)
+	{
+		LeaveCriticalSection(&m_csWrite);
+		return lpServer->m_ullHandle == ullHandle;
+	}
+
+	for (CServer *server = m_lpServers; server; server = server->m_lpNext)
+	{
+		if (server->m_ullHandle == ullHandle)
+			server->SetHandle(0);
+	}
+
+	lpServer->SetHandle(ullHandle);
+
+	bool bBuilt = BuildRegions();
+
+	LeaveCriticalSection(&m_csWrite);
+
+	return bBuilt;
+}
+
+// Lookups by region stay valid until EndRead, like those by address
+CServer *CServerList::FindRegion(ULONGLONG ullHandle)
+{
+	LPREGIONTABLE lpRegions = m_lpRegions;
+
+	if (!lpRegions || !ullHandle)
+		return NULL;
+
+	int nMask = lpRegions->nSize - 1;
+	int i = HashRegion(ullHandle) & nMask;
+
+	while (lpRegions->entries[i].lpServer)
+	{
+		if (lpRegions->entries[i].ullHandle == ullHandle)
+			return lpRegions->entries[i].lpServer;
+
+		i = (i + 1) & nMask;
+	}
+
 	return NULL;
+}
+
+CServer *CServerList::FindRegion(ULONG ulX, ULONG ulY)
+{
+	return FindRegion((ULONGLONG)ulX * REGION_WIDTH_UNITS * REGION_MULTIPLIER + (ULONGLONG)ulY * REGION_WIDTH_UNITS);
+}
+
+// Circuits for the regions within nRange grid steps of lpServer's, nearest
+// rings first. Costs one lookup per grid cell, however many circuits there
+// are. Returns how many were written to lpNeighbors.
+int CServerList::FindNeighbors(CServer *lpServer, int nRange, CServer **lpNeighbors, int nMax)
+{
+	int nFound = 0;
+
+	if (!lpServer || !lpServer->m_ullHandle)
+		return 0;
+
+	LONGLONG llX = lpServer->m_ulX;
+	LONGLONG llY = lpServer->m_ulY;
+
+	for (int nRing = 1; nRing <= nRange; nRing++)
+	{
+		for (int dx = -nRing; dx <= nRing; dx++)
+		{
+			for (int dy = -nRing; dy <= nRing; dy++)
+			{
+				// Only the cells on this ring's edge
+				if (dx != -nRing && dx != nRing && dy != -nRing && dy != nRing)
+					continue;
+
+				if (llX + dx < 0 || llY + dy < 0)
+					continue;
+
+				CServer *server = FindRegion((ULONG)(llX + dx), (ULONG)(llY + dy));
+
+				if (!server)
+					continue;
+
+				if (nFound >= nMax)
+					return nFound;
+
+				lpNeighbors[nFound++] = server;
+			}
+		}
+	}
+
+	return nFound;
+}
+
+void CServerList::ReportLatency(FILE *fp, bool bHeader)
+{
+	CServer *server = m_lpServers;
+	char szName[64];
+
+	if (bHeader)
+		fprintf(fp, "Circuit\tKind\tSamples\tSmoothed\tJitter\tMin\tMax\tHistogram\n");
+
+	EnterCriticalSection(&m_csWrite);
+
+	server = m_lpServers;
+
+	while (server)
+	{
+		wsprintf(szName, "%s:%hu", inet_ntoa(server->m_address.sin_addr), ntohs(server->m_address.sin_port));
+
+		server->m_latency.Report(fp, server->m_lpszSimName ? server->m_lpszSimName : szName);
+		server = server->m_lpNext;
+	}
+
+	LeaveCriticalSection(&m_csWrite);
+
+	fflush(fp);
 }
\ No newline at end of file
@@ -1,7 +1,47 @@
 #pragma once
 
-#include ".\Server.h"
+#include "./Server.h"
+#include "./Epoch.h"
 
+// Initial size of the address table, a power of two. It doubles whenever it
+// gets half full.
+#define SERVER_TABLE_SIZE	64
+
+typedef struct
+{
+	int nSize;
+	CServer *lpEntries[1];
+} SERVERTABLE, *LPSERVERTABLE;
+
+// Smallest region table, a power of two, kept at most half full
+#define REGION_TABLE_SIZE	16
+
+typedef struct
+{
+	ULONGLONG ullHandle;
+	CServer *lpServer;
+} REGIONENTRY;
+
+typedef struct
+{
+	int nSize;
+	REGIONENTRY entries[1];
+} REGIONTABLE, *LPREGIONTABLE;
+
+// Circuits are kept in a list, for walking them in the order they were seen,
+// and in an open addressing table keyed by IPv4 address and port for the
+// per-packet lookup.
+//
+// Lookups take no lock, so the sending and receiving threads can both be
+// in the table at once; they must be made between BeginRead and EndRead,
+// and a circuit found stays valid until EndRead. Writers are serialised.
+// A new circuit is published into a free slot of the live table; growing
+// or removing builds a new table and swaps it in, and the old table and
+// any removed circuit are freed once no reader can still see them.
+//
+// Circuits whose region is known are also indexed by region handle, in a
+// table that is rebuilt and swapped in the same way whenever a region is
+// learned, so finding a region or its neighbours never walks the list.
 class CServerList
 {
 public:
@@ -11,7 +51,39 @@ public:
 	CServer	*m_lpServers;
 	void FreeServers(void);
 	bool AddServer(CServer *lpServer);
+	CServer *FindOrAddServer(struct sockaddr_in *address);
+	void RemoveServer(CServer *lpServer);
 	CServer *FindServer(struct sockaddr_in *address);
 	CServer *FindServer(int nType);
+	int CountServers(void);
+	void ReportLatency(FILE *fp, bool bHeader = true);
+	static DWORD HashAddress(struct sockaddr_in *address);
 	bool m_bAddedUserServer;
-};
+
+	bool SetRegion(CServer *lpServer, ULONGLONG ullHandle);
+	CServer *FindRegion(ULONGLONG ullHandle);
+	CServer *FindRegion(ULONG ulX, ULONG ulY);
+	int FindNeighbors(CServer *lpServer, int nRange, CServer **lpNeighbors, int nMax);
+
+	void BeginRead(void);
+	void EndRead(void);
+
+protected:
+	CServer *m_lpTail;
+
+	LPSERVERTABLE volatile m_lpTable;
+	int m_nServers;
+
+	LPREGIONTABLE volatile m_lpRegions;
+
+	CEpoch m_epoch;
+	CRITICAL_SECTION m_csWrite;
+
+	LPSERVERTABLE BuildTable(int nSize, CServer *lpSkip);
+	void Publish(LPSERVERTABLE lpTable);
+	bool BuildRegions(void);
+	static DWORD HashRegion(ULONGLONG ullHandle);
+	static void Insert(LPSERVERTABLE lpTable, CServer *lpServer);
+	static void FreeTable(LPVOID lpData);
+	static void FreeServer(LPVOID lpData);
+};
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "stdafx.h"
+#include "./Shard.h"
+
+CShard::CShard(void)
+{
+	m_dwProcessed = 0;
+	m_dwDropped = 0;
+
+	m_lpQueue = NULL;
+	m_lHead = 0;
+	m_lTail = 0;
+	m_hWake = NULL;
+	m_hThread = NULL;
+	m_bStop = false;
+
+	// The viewer's own login circuit is only labelled in the main list
+	m_servers.m_bAddedUserServer = true;
+
+	InitializeCriticalSection(&m_csSubmit);
+}
+
+CShard::~CShard(void)
+{
+	Stop();
+	DeleteCriticalSection(&m_csSubmit);
+}
+
+bool CShard::Start(int nCommands)
+{
+	Stop();
+
+	m_lpQueue = (LPSHARDPACKET)malloc(SHARD_QUEUE_DEPTH * sizeof(SHARDPACKET));
+
+	if (!m_lpQueue || !m_scratch.Init(nCommands))
+	{
+		Stop();
+		return false;
+	}
+
+	m_lHead = 0;
+	m_lTail = 0;
+	m_dwProcessed = 0;
+	m_dwDropped = 0;
+	m_bStop = false;
+
+	m_hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	if (!m_hWake)
+	{
+		Stop();
+		return false;
+	}
+
+	m_hThread = CreateThread(NULL, 0, ThreadProc, this, 0, NULL);
+
+	if (!m_hThread)
+	{
+		Stop();
+		return false;
+	}
+
+	return true;
+}
+
+// Let the worker finish what is queued, then free everything
+void CShard::Stop(void)
+{
+	if (m_hThread)
+	{
+		m_bStop = true;
+		SetEvent(m_hWake);
+		WaitForSingleObject(m_hThread, INFINITE);
+		CloseHandle(m_hThread);
+		m_hThread = NULL;
+	}
+
+	if (m_hWake)
+	{
+		CloseHandle(m_hWake);
+		m_hWake = NULL;
+	}
+
+	m_servers.FreeServers();
+	m_scratch.Free();
+
+	SAFE_FREE(m_lpQueue);
+}
+
+// Copy a packet into the next free slot. Producers are serialised, but the
+// worker never takes the lock.
+bool CShard::Submit(LPBYTE lpData, int nLen, struct sockaddr_in *address, bool bSent, bool bWait, ULONGLONG ullTime)
+{
+	if (!m_hThread || nLen <= 0 || nLen > SHARD_PACKET_LEN)
+		return false;
+
+	EnterCriticalSection(&m_csSubmit);
+
+	while (m_lHead - m_lTail >= SHARD_QUEUE_DEPTH)
+	{
+		if (!bWait)
+		{
+			m_dwDropped++;
+			LeaveCriticalSection(&m_csSubmit);
+			return false;
+		}
+
+		SetEvent(m_hWake);
+		Sleep(0);
+	}
+
+	LPSHARDPACKET lpPacket = &m_lpQueue[m_lHead % SHARD_QUEUE_DEPTH];
+
+	lpPacket->ullTime = ullTime;
+	memcpy(&lpPacket->address, address, sizeof(lpPacket->address));
+	lpPacket->bSent = bSent;
+	lpPacket->nLen = nLen;
+	memcpy(lpPacket->bData, lpData, nLen);
+
+	InterlockedIncrement(&m_lHead);
+
+	LeaveCriticalSection(&m_csSubmit);
+
+	SetEvent(m_hWake);
+
+	return true;
+}
+
+// Block until everything queued so far has been processed
+void CShard::Wait(void)
+{
+	while (m_hThread && m_lTail != m_lHead)
+		Sleep(1);
+}
+
+DWORD WINAPI CShard::ThreadProc(LPVOID lpParam)
+{
+	((CShard *)lpParam)->Run();
+
+	return 0;
+}
+
+void CShard::Run(void)
+{
+	for (;;)
+	{
+		while (m_lTail != m_lHead)
+		{
+			process_packet(this, &m_lpQueue[m_lTail % SHARD_QUEUE_DEPTH]);
+			m_dwProcessed++;
+			InterlockedIncrement(&m_lTail);
+		}
+
+		if (m_bStop)
+			break;
+
+		WaitForSingleObject(m_hWake, 100);
+	}
+}
+
+CShardPool::CShardPool(void)
+{
+	m_lpShards = NULL;
+	m_nShards = 0;
+}
+
+CShardPool::~CShardPool(void)
+{
+	Stop();
+}
+
+bool CShardPool::Start(int nShards, int nCommands)
+{
+	Stop();
+
+	if (nShards <= 0)
+		return true;
+
+	if (nShards > MAX_SHARDS)
+		nShards = MAX_SHARDS;
+
+	m_lpShards = new CShard[nShards];
+
+	if (!m_lpShards)
+		return false;
+
+	m_nShards = nShards;
+
+	for (int i = 0; i < nShards; i++)
+	{
+		if (!m_lpShards[i].Start(nCommands))
+		{
+			Stop();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// The hooks may still be submitting. Once the count reads zero nothing new
+// reaches the shards, and whoever was already inside is waited for.
+void CShardPool::Stop(void)
+{
+	CShard *lpShards = m_lpShards;
+
+	m_nShards = 0;
+	m_epoch.Synchronize();
+
+	m_lpShards = NULL;
+	SAFE_DELETE_ARRAY(lpShards);
+}
+
+// The high half of the hash picks the shard; the circuit table inside the
+// shard uses the low bits, so the two don't correlate
+CShard *CShardPool::GetShard(struct sockaddr_in *address)
+{
+	int nShards = m_nShards;
+
+	if (!nShards)
+		return NULL;
+
+	DWORD dwHash = CServerList::HashAddress(address);
+
+	return &m_lpShards[(dwHash >> 16) % nShards];
+}
+
+bool CShardPool::Submit(LPBYTE lpData, int nLen, struct sockaddr_in *address, bool bSent, bool bWait, ULONGLONG ullTime)
+{
+	m_epoch.Enter();
+
+	CShard *shard = GetShard(address);
+	bool bQueued = shard && shard->Submit(lpData, nLen, address, bSent, bWait, ullTime);
+
+	m_epoch.Leave();
+
+	return bQueued;
+}
+
+void CShardPool::Wait(void)
+{
+	for (int i = 0; i < m_nShards; i++)
+		m_lpShards[i].Wait();
+}
+
+// Fold the shards' counters into the message types' own, once the shards
+// are idle
+void CShardPool::MergeStats(void)
+{
+	for (int i = 0; i < m_nShards; i++)
+		m_lpShards[i].m_scratch.MergeStats();
+}
+
+DWORD CShardPool::GetProcessed(void)
+{
+	DWORD dwProcessed = 0;
+
+	for (int i = 0; i < m_nShards; i++)
+		dwProcessed += m_lpShards[i].m_dwProcessed;
+
+	return dwProcessed;
+}
+
+DWORD CShardPool::GetDropped(void)
+{
+	DWORD dwDropped = 0;
+
+	for (int i = 0; i < m_nShards; i++)
+		dwDropped += m_lpShards[i].m_dwDropped;
+
+	return dwDropped;
+}
\ No newline at end of file
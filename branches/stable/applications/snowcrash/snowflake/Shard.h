@@ -0,0 +1,85 @@
+#pragma once
+
+#include "./Template.h"
+#include "./ServerList.h"
+#include "./Scratch.h"
+#include "./Epoch.h"
+
+#define MAX_SHARDS			64
+
+// Packets waiting on one shard. A full queue drops new packets rather than
+// stall the hooked thread, unless the producer asks to wait.
+#define SHARD_QUEUE_DEPTH	256
+#define SHARD_PACKET_LEN	8192
+
+typedef struct
+{
+	ULONGLONG ullTime;				// When the hook saw it, for the trace
+	struct sockaddr_in address;
+	bool bSent;
+	int nLen;
+	BYTE bData[SHARD_PACKET_LEN];
+} SHARDPACKET, *LPSHARDPACKET;
+
+// A worker thread with its own circuits and sequence windows, and a
+// scratch for its decode buffer, message pool and per message type
+// counters. Only the parsed template is shared between shards, and it is
+// only read.
+class CShard
+{
+public:
+	CShard(void);
+	~CShard(void);
+
+	CServerList m_servers;
+	CScratch m_scratch;
+
+	DWORD m_dwProcessed;
+	DWORD m_dwDropped;
+
+	bool Start(int nCommands);
+	void Stop(void);
+	bool Submit(LPBYTE lpData, int nLen, struct sockaddr_in *address, bool bSent, bool bWait, ULONGLONG ullTime);
+	void Wait(void);
+
+protected:
+	static DWORD WINAPI ThreadProc(LPVOID lpParam);
+	void Run(void);
+
+	LPSHARDPACKET m_lpQueue;
+	volatile LONG m_lHead;		// Packets queued so far, advanced by producers
+	volatile LONG m_lTail;		// Packets processed so far, advanced by the worker
+	CRITICAL_SECTION m_csSubmit;
+	HANDLE m_hWake;
+	HANDLE m_hThread;
+	volatile bool m_bStop;
+};
+
+// Spreads circuits over shards by a hash of their address, so every packet
+// of a circuit is handled in order by the same worker. The hooks submit
+// inside a read section of m_epoch, so Stop can wait them out before the
+// shards go.
+class CShardPool
+{
+public:
+	CShardPool(void);
+	~CShardPool(void);
+
+	CShard *m_lpShards;
+	volatile int m_nShards;
+
+	bool Start(int nShards, int nCommands);
+	void Stop(void);
+	CShard *GetShard(struct sockaddr_in *address);
+	bool Submit(LPBYTE lpData, int nLen, struct sockaddr_in *address, bool bSent, bool bWait, ULONGLONG ullTime);
+	void Wait(void);
+	void MergeStats(void);
+	DWORD GetProcessed(void);
+	DWORD GetDropped(void);
+
+protected:
+	CEpoch m_epoch;
+};
+
+// Decodes and dispatches one queued packet; lives with the hooks
+void process_packet(CShard *shard, LPSHARDPACKET lpPacket);
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+// Parsed message template, shared by the decoder, the packet builder and
+// the message handlers
+
+struct COMMANDVAR
+{
+	char *lpszVar;
+	int nKeywordPos;
+	int nType;
+	int nTypeLen;
+	struct COMMANDVAR *lpNext;
+	struct COMMANDVAR *lpPrev;
+} typedef COMMANDVARS;
+
+typedef COMMANDVAR * LPCOMMANDVAR;
+typedef COMMANDVARS * LPCOMMANDVARS;
+
+struct COMMANDSTRUCT
+{
+	char *lpszStruct;
+	int nKeywordPos;
+	int nType;
+	BYTE cItems;
+	LPCOMMANDVARS vars;
+	struct COMMANDSTRUCT *lpNext;
+	struct COMMANDSTRUCT *lpPrev;
+} typedef COMMANDSTRUCTS;
+
+typedef COMMANDSTRUCT * LPCOMMANDSTRUCT;
+typedef COMMANDSTRUCTS * LPCOMMANDSTRUCTS;
+
+// Runtime counters kept per message type
+typedef struct
+{
+	DWORD dwDecoded;
+	DWORD dwVerified;
+	DWORD dwMismatched;
+	int nMismatchOffset;	// First differing body byte of the last mismatch
+	int nMismatchLen;		// Body length of the last mismatch
+	int nMismatchPacked;	// Re-packed length of the last mismatch
+	DWORD dwResent;			// Flagged MSG_RESENT whose original was never seen
+	DWORD dwDuplicates;		// Seen before, by sequence number
+} COMMANDSTATS;
+
+typedef struct
+{
+	char *lpszCmd;
+	bool bZerocoded;
+	bool bTrusted;
+	WORD wFrequency;	// MSG_FREQ_HIGH, MSG_FREQ_MED or MSG_FREQ_LOW
+	WORD wID;
+	int nIndex;			// Dense index over all commands, for per type tables
+	LPCOMMANDSTRUCTS structs;
+	COMMANDSTATS stats;
+} COMMAND;
+
+typedef COMMAND * LPCOMMAND;
+
+#define MAX_COMMANDS_LOW	65536
+#define MAX_COMMANDS_MEDIUM	256
+#define MAX_COMMANDS_HIGH	256
+
+extern COMMAND cmds_low[MAX_COMMANDS_LOW];
+extern COMMAND cmds_med[MAX_COMMANDS_MEDIUM];
+extern COMMAND cmds_high[MAX_COMMANDS_HIGH];
+extern int cmds_count;
@@ -0,0 +1,82 @@
+#include "stdafx.h"
+#include "./Trace.h"
+#include "./Server.h"
+#include "./Protocol.h"
+
+CTrace::CTrace(void)
+{
+	m_dwDropped = 0;
+	m_fp = NULL;
+}
+
+CTrace::~CTrace(void)
+{
+	Close();
+}
+
+// LOG_BLOCK for offline decoding, where nothing should be lost
+bool CTrace::Create(const char *lpszPath, int nPolicy)
+{
+	TRACEHEADER header;
+
+	Close();
+
+	m_fp = fopen(lpszPath, "wb");
+
+	if (!m_fp)
+		return false;
+
+	header.dwMagic = TRACE_MAGIC;
+	header.dwVersion = TRACE_VERSION;
+
+	if (fwrite(&header, sizeof(header), 1, m_fp) != 1 || !m_log.Start(m_fp, nPolicy, TRACE_RING_LEN, false))
+	{
+		Close();
+		return false;
+	}
+
+	m_dwDropped = 0;
+
+	return true;
+}
+
+// Queue one decoded message, stamped with when its packet was seen; a copy
+// and nothing more
+void CTrace::Write(ULONGLONG ullTime, LPCOMMAND lpCommand, CServer *server, bool bSent, LPBYTE lpData, int nLen)
+{
+	TRACERECORD record;
+
+	if (!m_fp || !lpCommand || nLen <= 0 || nLen > 0xffff)
+		return;
+
+	record.ullTime = ullTime;
+	record.dwMessage = command_number(lpCommand);
+	record.dwAddress = server ? server->m_address.sin_addr.s_addr : 0;
+	record.wPort = server ? server->m_address.sin_port : 0;
+	record.cFlags = bSent ? TRACE_SENT : 0;
+	record.cReserved = 0;
+	record.wLen = (WORD)nLen;
+	record.wReserved = 0;
+
+	m_log.Write((LPBYTE)&record, sizeof(record), lpData, nLen);
+}
+
+bool CTrace::IsOpen(void)
+{
+	return m_fp != NULL;
+}
+
+// Only once no thread is in the hooks any more
+void CTrace::Close(void)
+{
+	if (m_log.IsRunning())
+		m_dwDropped = m_log.GetDropped();
+
+	m_log.Stop();
+
+	if (m_fp)
+	{
+		fclose(m_fp);
+		m_fp = NULL;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "./Template.h"
+#include "./Log.h"
+
+class CServer;
+
+#define TRACE_MAGIC			0x52544e53	// "SNTR"
+#define TRACE_VERSION		1
+
+#define TRACE_SENT			0x01		// Sent by the viewer, otherwise received
+
+#define TRACE_RING_LEN		(1024 * 1024)
+
+#pragma pack(push, 1)
+
+typedef struct
+{
+	DWORD dwMagic;
+	DWORD dwVersion;
+} TRACEHEADER;
+
+// One dispatched message, followed by wLen bytes of the decoded packet:
+// header, message number and body, without any appended acks
+typedef struct
+{
+	ULONGLONG ullTime;		// Microseconds since the epoch the packet was seen
+	DWORD dwMessage;		// Wire message number, see command_number()
+	DWORD dwAddress;		// Circuit's IPv4 address, network order
+	WORD wPort;				// Circuit's port, network order
+	BYTE cFlags;
+	BYTE cReserved;
+	WORD wLen;
+	WORD wReserved;
+} TRACERECORD;
+
+#pragma pack(pop)
+
+// Binary record of every message the handlers see. Nothing is formatted
+// on the packet path; the raw decoded bytes are copied to a per-thread
+// ring and written out by the log's flusher, and snowtrace renders them
+// against the template afterwards. Records of one circuit are in order, but
+// with more than one thread decoding, circuits interleave as the rings are
+// flushed; ullTime is what orders them.
+class CTrace
+{
+public:
+	CTrace(void);
+	~CTrace(void);
+
+	bool Create(const char *lpszPath, int nPolicy);
+	void Write(ULONGLONG ullTime, LPCOMMAND lpCommand, CServer *server, bool bSent, LPBYTE lpData, int nLen);
+	bool IsOpen(void);
+	void Close(void);
+
+	DWORD m_dwDropped;		// Records lost to full rings, once closed
+
+protected:
+	FILE *m_fp;
+	CLog m_log;
+};
\ No newline at end of file
@@ -0,0 +1,351 @@
+#include "stdafx.h"
+#include "./Uring.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+// There's no liburing to lean on, so straight to the system calls
+static int uring_setup(unsigned uEntries, struct io_uring_params *lpParams)
+{
+	return (int)syscall(__NR_io_uring_setup, uEntries, lpParams);
+}
+
+static int uring_enter(int nRing, unsigned uSubmit, unsigned uComplete, unsigned uFlags, LPVOID lpArg, size_t stArg)
+{
+	return (int)syscall(__NR_io_uring_enter, nRing, uSubmit, uComplete, uFlags, lpArg, stArg);
+}
+
+static int uring_register(int nRing, unsigned uOpcode, LPVOID lpArg, unsigned uArgs)
+{
+	return (int)syscall(__NR_io_uring_register, nRing, uOpcode, lpArg, uArgs);
+}
+
+CUring::CUring(void)
+{
+	m_nRing = -1;
+	m_lpRingMap = NULL;
+	m_stRingMap = 0;
+	m_lpSqes = NULL;
+	m_stSqes = 0;
+	m_uPending = 0;
+
+	ZeroMemory(m_groups, sizeof(m_groups));
+}
+
+CUring::~CUring(void)
+{
+	Close();
+}
+
+// Completions are only ever run when this thread asks for them, and the
+// completion queue is deep enough for a burst of multishot receives. Older
+// kernels that don't know those flags get a plain ring.
+bool CUring::Open(int nEntries)
+{
+	struct io_uring_params params;
+
+	Close();
+
+	ZeroMemory(&params, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	params.cq_entries = nEntries * 4;
+
+	if ((m_nRing = uring_setup(nEntries, &params)) < 0 && errno == EINVAL)
+	{
+		ZeroMemory(&params, sizeof(params));
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = nEntries * 4;
+
+		m_nRing = uring_setup(nEntries, &params);
+	}
+
+	// Waiting with a timeout needs IORING_FEAT_EXT_ARG
+	if (m_nRing < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+	{
+		Close();
+		return false;
+	}
+
+	m_stRingMap = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+
+	if (m_stRingMap < params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe))
+		m_stRingMap = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+	m_stSqes = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	LPVOID lpRingMap = mmap(NULL, m_stRingMap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_nRing, IORING_OFF_SQ_RING);
+	LPVOID lpSqes = mmap(NULL, m_stSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_nRing, IORING_OFF_SQES);
+
+	m_lpRingMap = (lpRingMap != MAP_FAILED) ? lpRingMap : NULL;
+	m_lpSqes = (lpSqes != MAP_FAILED) ? (struct io_uring_sqe *)lpSqes : NULL;
+
+	if (!m_lpRingMap || !m_lpSqes)
+	{
+		Close();
+		return false;
+	}
+
+	LPBYTE lpRing = (LPBYTE)m_lpRingMap;
+
+	m_lpSqHead = (unsigned *)(lpRing + params.sq_off.head);
+	m_lpSqTail = (unsigned *)(lpRing + params.sq_off.tail);
+	m_uSqMask = *(unsigned *)(lpRing + params.sq_off.ring_mask);
+	m_uSqEntries = params.sq_entries;
+	m_uSqTail = *m_lpSqTail;
+	m_uPending = 0;
+
+	m_lpCqHead = (unsigned *)(lpRing + params.cq_off.head);
+	m_lpCqTail = (unsigned *)(lpRing + params.cq_off.tail);
+	m_uCqMask = *(unsigned *)(lpRing + params.cq_off.ring_mask);
+	m_lpCqes = (struct io_uring_cqe *)(lpRing + params.cq_off.cqes);
+
+	// Every slot of the submission array points at its own entry, once
+	unsigned *lpArray = (unsigned *)(lpRing + params.sq_off.array);
+
+	for (unsigned i = 0; i < params.sq_entries; i++)
+		lpArray[i] = i;
+
+	return true;
+}
+
+// Closing the ring cancels whatever is still in flight and drops the
+// buffer rings registered with it
+void CUring::Close(void)
+{
+	if (m_lpSqes)
+		munmap(m_lpSqes, m_stSqes);
+
+	if (m_lpRingMap)
+		munmap(m_lpRingMap, m_stRingMap);
+
+	if (m_nRing >= 0)
+		close(m_nRing);
+
+	m_nRing = -1;
+	m_lpRingMap = NULL;
+	m_lpSqes = NULL;
+	m_uPending = 0;
+
+	for (int i = 0; i < URING_MAX_GROUPS; i++)
+	{
+		if (m_groups[i].lpRing)
+			munmap(m_groups[i].lpRing, m_groups[i].stRingLen);
+
+		SAFE_FREE(m_groups[i].lpBuffers);
+	}
+
+	ZeroMemory(m_groups, sizeof(m_groups));
+}
+
+// Register nBuffers of nLen bytes as group nGroup, all of them available.
+// The ring they're offered on has to be page aligned, so it's mapped.
+bool CUring::AddBuffers(int nGroup, int nBuffers, int nLen)
+{
+	if (m_nRing < 0 || nGroup < 0 || nGroup >= URING_MAX_GROUPS || m_groups[nGroup].lpRing ||
+		nBuffers < 1 || nBuffers > 32768 || (nBuffers & (nBuffers - 1)) || nLen < 1)
+		return false;
+
+	URINGBUFFERS *group = &m_groups[nGroup];
+	struct io_uring_buf_reg reg;
+
+	group->stRingLen = nBuffers * sizeof(struct io_uring_buf);
+
+	LPVOID lpRing = mmap(NULL, group->stRingLen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	group->lpRing = (lpRing != MAP_FAILED) ? (struct io_uring_buf_ring *)lpRing : NULL;
+	group->lpBuffers = (LPBYTE)malloc((size_t)nBuffers * nLen);
+	group->nBuffers = nBuffers;
+	group->nLen = nLen;
+	group->wTail = 0;
+
+	ZeroMemory(&reg, sizeof(reg));
+	reg.ring_addr = (ULONGLONG)(uintptr_t)group->lpRing;
+	reg.ring_entries = nBuffers;
+	reg.bgid = (WORD)nGroup;
+
+	if (!group->lpRing || !group->lpBuffers || uring_register(m_nRing, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+	{
+		if (group->lpRing)
+			munmap(group->lpRing, group->stRingLen);
+
+		SAFE_FREE(group->lpBuffers);
+		ZeroMemory(group, sizeof(*group));
+
+		return false;
+	}
+
+	for (int i = 0; i < nBuffers; i++)
+		ReturnBuffer(nGroup, i);
+
+	return true;
+}
+
+LPBYTE CUring::GetBuffer(int nGroup, int nBuffer)
+{
+	return &m_groups[nGroup].lpBuffers[(size_t)nBuffer * m_groups[nGroup].nLen];
+}
+
+// Offer a buffer to the kernel again. It sees the new tail straight away,
+// without a system call. The ring is indexed as the plain array it is:
+// compiled as C++, the header's flexible bufs member lands 8 bytes in.
+void CUring::ReturnBuffer(int nGroup, int nBuffer)
+{
+	URINGBUFFERS *group = &m_groups[nGroup];
+	struct io_uring_buf *lpBuf = (struct io_uring_buf *)group->lpRing + (group->wTail & (group->nBuffers - 1));
+
+	lpBuf->addr = (ULONGLONG)(uintptr_t)GetBuffer(nGroup, nBuffer);
+	lpBuf->len = group->nLen;
+	lpBuf->bid = (WORD)nBuffer;
+
+	__atomic_store_n(&group->lpRing->tail, ++group->wTail, __ATOMIC_RELEASE);
+}
+
+// The next free submission entry, cleared. A full queue is submitted to
+// make room.
+struct io_uring_sqe *CUring::GetSqe(void)
+{
+	if (m_nRing < 0)
+		return NULL;
+
+	if (m_uSqTail - __atomic_load_n(m_lpSqHead, __ATOMIC_ACQUIRE) >= m_uSqEntries)
+	{
+		if (Submit(0) < 0 || m_uSqTail - __atomic_load_n(m_lpSqHead, __ATOMIC_ACQUIRE) >= m_uSqEntries)
+			return NULL;
+	}
+
+	struct io_uring_sqe *lpSqe = &m_lpSqes[m_uSqTail & m_uSqMask];
+
+	ZeroMemory(lpSqe, sizeof(*lpSqe));
+	m_uSqTail++;
+	m_uPending++;
+
+	return lpSqe;
+}
+
+// Receive from nSocket into group nGroup's buffers until told otherwise.
+// Each packet completes separately, laid out as io_uring_recvmsg_out, the
+// source address, and the payload; see GetPayload(). lpHeader says how
+// much room the address gets and has to outlive the receive.
+bool CUring::RecvMultishot(int nSocket, int nGroup, struct msghdr *lpHeader, ULONGLONG ullData)
+{
+	struct io_uring_sqe *lpSqe = GetSqe();
+
+	if (!lpSqe)
+		return false;
+
+	lpSqe->opcode = IORING_OP_RECVMSG;
+	lpSqe->fd = nSocket;
+	lpSqe->addr = (ULONGLONG)(uintptr_t)lpHeader;
+	lpSqe->ioprio = IORING_RECV_MULTISHOT;
+	lpSqe->flags = IOSQE_BUFFER_SELECT;
+	lpSqe->buf_group = (WORD)nGroup;
+	lpSqe->user_data = ullData;
+
+	return true;
+}
+
+// lpHeader and everything it points at have to outlive the send
+bool CUring::SendMsg(int nSocket, struct msghdr *lpHeader, ULONGLONG ullData)
+{
+	struct io_uring_sqe *lpSqe = GetSqe();
+
+	if (!lpSqe)
+		return false;
+
+	lpSqe->opcode = IORING_OP_SENDMSG;
+	lpSqe->fd = nSocket;
+	lpSqe->addr = (ULONGLONG)(uintptr_t)lpHeader;
+	lpSqe->len = 1;
+	lpSqe->user_data = ullData;
+
+	return true;
+}
+
+// Submit whatever has been queued, all in one system call, and wait up to
+// nWaitMs for a completion: none if 0, for ever if negative. Returns how
+// many were submitted, or -1.
+int CUring::Submit(int nWaitMs)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned uFlags = IORING_ENTER_GETEVENTS;
+	LPVOID lpArg = NULL;
+	size_t stArg = 0;
+
+	if (m_nRing < 0)
+		return -1;
+
+	__atomic_store_n(m_lpSqTail, m_uSqTail, __ATOMIC_RELEASE);
+
+	if (nWaitMs > 0)
+	{
+		ts.tv_sec = nWaitMs / 1000;
+		ts.tv_nsec = (nWaitMs % 1000) * 1000000LL;
+
+		ZeroMemory(&arg, sizeof(arg));
+		arg.sigmask_sz = _NSIG / 8;
+		arg.ts = (ULONGLONG)(uintptr_t)&ts;
+
+		uFlags |= IORING_ENTER_EXT_ARG;
+		lpArg = &arg;
+		stArg = sizeof(arg);
+	}
+
+	int nRes = uring_enter(m_nRing, m_uPending, nWaitMs ? 1 : 0, uFlags, lpArg, stArg);
+
+	if (nRes < 0)
+		return (errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY) ? 0 : -1;
+
+	m_uPending -= nRes;
+
+	return nRes;
+}
+
+// Copy out up to nMax completions and hand their slots back
+int CUring::Reap(struct io_uring_cqe *lpCqes, int nMax)
+{
+	if (m_nRing < 0)
+		return 0;
+
+	unsigned uHead = *m_lpCqHead;
+	unsigned uTail = __atomic_load_n(m_lpCqTail, __ATOMIC_ACQUIRE);
+	int nReaped = 0;
+
+	while (uHead != uTail && nReaped < nMax)
+		lpCqes[nReaped++] = m_lpCqes[uHead++ & m_uCqMask];
+
+	__atomic_store_n(m_lpCqHead, uHead, __ATOMIC_RELEASE);
+
+	return nReaped;
+}
+
+// Whether this kernel lets us have a ring with buffer rings registered
+bool CUring::Supported(void)
+{
+	CUring ring;
+
+	return ring.Open(8) && ring.AddBuffers(0, 1, 64);
+}
+
+// Where the payload of a multishot receive starts in its buffer, given how
+// many bytes of the buffer the completion says were used. NULL if it was
+// cut short. lpName gets the source address if it fit.
+LPBYTE CUring::GetPayload(LPBYTE lpBuffer, int nUsed, struct msghdr *lpHeader, int &nLen, LPVOID *lpName)
+{
+	struct io_uring_recvmsg_out *lpOut = (struct io_uring_recvmsg_out *)lpBuffer;
+	size_t stHeader = sizeof(*lpOut) + lpHeader->msg_namelen + lpHeader->msg_controllen;
+
+	if (nUsed < 0 || (size_t)nUsed < stHeader || (lpOut->flags & MSG_TRUNC) || (size_t)nUsed < stHeader + lpOut->payloadlen)
+		return NULL;
+
+	if (lpName)
+		*lpName = (lpOut->namelen <= lpHeader->msg_namelen) ? lpBuffer + sizeof(*lpOut) : NULL;
+
+	nLen = (int)lpOut->payloadlen;
+
+	return lpBuffer + stHeader;
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+
+// Provided buffer groups one ring can have registered
+#define URING_MAX_GROUPS		4
+
+// One provided buffer group: buffers the kernel picks from as packets
+// arrive, each handed back once whatever came in it is done with
+typedef struct
+{
+	struct io_uring_buf_ring *lpRing;
+	size_t stRingLen;
+	LPBYTE lpBuffers;
+	int nBuffers;			// A power of two
+	int nLen;
+	WORD wTail;
+} URINGBUFFERS;
+
+// A bare io_uring, set up and driven with the raw system calls, with just
+// what a UDP front end needs: multishot receives into registered buffer
+// rings and sends straight from those buffers. Linux only.
+class CUring
+{
+public:
+	CUring(void);
+	~CUring(void);
+
+	bool Open(int nEntries);
+	void Close(void);
+	bool AddBuffers(int nGroup, int nBuffers, int nLen);
+	LPBYTE GetBuffer(int nGroup, int nBuffer);
+	void ReturnBuffer(int nGroup, int nBuffer);
+	bool RecvMultishot(int nSocket, int nGroup, struct msghdr *lpHeader, ULONGLONG ullData);
+	bool SendMsg(int nSocket, struct msghdr *lpHeader, ULONGLONG ullData);
+	int Submit(int nWaitMs);
+	int Reap(struct io_uring_cqe *lpCqes, int nMax);
+
+	static bool Supported(void);
+	static LPBYTE GetPayload(LPBYTE lpBuffer, int nUsed, struct msghdr *lpHeader, int &nLen, LPVOID *lpName);
+
+protected:
+	struct io_uring_sqe *GetSqe(void);
+
+	int m_nRing;
+
+	LPVOID m_lpRingMap;
+	size_t m_stRingMap;
+	struct io_uring_sqe *m_lpSqes;
+	size_t m_stSqes;
+
+	// Submission queue, shared with the kernel. Tail is ours to advance,
+	// published when submitted.
+	unsigned *m_lpSqHead;
+	unsigned *m_lpSqTail;
+	unsigned m_uSqMask;
+	unsigned m_uSqEntries;
+	unsigned m_uSqTail;
+	unsigned m_uPending;
+
+	// Completion queue, the other way round
+	unsigned *m_lpCqHead;
+	unsigned *m_lpCqTail;
+	unsigned m_uCqMask;
+	struct io_uring_cqe *m_lpCqes;
+
+	URINGBUFFERS m_groups[URING_MAX_GROUPS];
+};
\ No newline at end of file
@@ -1,6 +1,6 @@
-#include "StdAfx.h"
-#include ".\Var.h"
-#include ".\keywords.h"
+#include "stdafx.h"
+#include "./Var.h"
+#include "./keywords.h"
 
 CVar::CVar(void)
 {
@@ -9,35 +9,15 @@ CVar::CVar(void)
 	m_nTypeLen = 0;
 	m_nLen = 0;
 	m_lpData = NULL;
-
-	m_lpPrev = NULL;
-	m_lpNext = NULL;
 }
 
 CVar::~CVar(void)
 {
-	SAFE_FREE(m_lpszVar);
-	SAFE_FREE(m_lpData);
 }
 
 void CVar::SetVar(char *lpszVar)
 {
-	if (lpszVar)
-	{
-		int nLen = (int)strlen(lpszVar);
-
-		if (nLen > 0)
-		{
-			SAFE_FREE(m_lpszVar);
-			m_lpszVar = (char *)malloc(nLen + 1);
-
-			if (m_lpszVar)
-			{
-				strncpy(m_lpszVar, lpszVar, nLen);
-				m_lpszVar[nLen] = '\0';
-			}
-		}
-	}
+	m_lpszVar = lpszVar;
 }
 
 void CVar::SetType(int nType, int nTypeLen)
@@ -70,7 +50,7 @@ void CVar::GetString(char &lpszStr)
 			{
 				DWORD dwData;
 				memcpy(&dwData, m_lpData, sizeof(dwData));
-				sprintf(&lpszStr, "%lu", dwData);
+				sprintf(&lpszStr, "%u", dwData);
 			}
 			break;
 
@@ -78,7 +58,7 @@ void CVar::GetString(char &lpszStr)
 			{
 				ULONGLONG ullData;
 				memcpy(&ullData, m_lpData, sizeof(ullData));
-				sprintf(&lpszStr, "%I64u", ullData);
+				sprintf(&lpszStr, "%" PRINTF_INT64 "u", ullData);
 			}
 			break;
 
@@ -102,7 +82,7 @@ void CVar::GetString(char &lpszStr)
 			{
 				LONG nData;
 				memcpy(&nData, m_lpData, sizeof(nData));
-				sprintf(&lpszStr, "%ld", nData);
+				sprintf(&lpszStr, "%d", nData);
 			}
 			break;
 
@@ -281,366 +261,97 @@ void CVar::GetBool(bool &lpbBool)
 	}
 }
 
-int CVar::SetData(LPBYTE lpData)
+// Number of bytes a field of the given type occupies on the wire, including
+// the length prefix of Variable fields
+int CVar::GetWireSize(int nType, int nTypeLen, LPBYTE lpData)
 {
-	SAFE_FREE(m_lpData);
-	m_nLen = 0;
-
-	int nRead = 0;
-
-	switch (m_nType)
+	switch (nType)
 	{
 		case LLTYPE_U8:
-			{
-				m_nLen = sizeof(unsigned char);
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
-
-		case LLTYPE_U16:
-			{
-				m_nLen = sizeof(WORD);
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
-
-		case LLTYPE_U32:
-			{
-				m_nLen = sizeof(DWORD);
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
-
-		case LLTYPE_U64:
-			{
-				m_nLen = sizeof(ULONGLONG);
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
-
 		case LLTYPE_S8:
-			{
-				m_nLen = sizeof(BYTE);
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
+		case LLTYPE_BOOL:
+			return sizeof(BYTE);
 
+		case LLTYPE_U16:
 		case LLTYPE_S16:
-			{
-				m_nLen = sizeof(SHORT);
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
+		case LLTYPE_IPPORT:
+			return sizeof(WORD);
 
+		case LLTYPE_U32:
 		case LLTYPE_S32:
-			{
-				m_nLen = sizeof(LONG);
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
-
-		case LLTYPE_S64:
-			break;
-
-		case LLTYPE_F8:
-			break;
-
-		case LLTYPE_F16:
-			break;
-
 		case LLTYPE_F32:
-			{
-				m_nLen = sizeof(FLOAT);
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
+		case LLTYPE_IPADDR:
+			return sizeof(DWORD);
 
+		case LLTYPE_U64:
 		case LLTYPE_F64:
-			{
-				m_nLen = sizeof(double);
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
+			return sizeof(ULONGLONG);
 
 		case LLTYPE_LLUUID:
-			{
-				m_nLen = sizeof(BYTE) * 16;
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
-
-		case LLTYPE_BOOL:
-			{
-				m_nLen = sizeof(BYTE);
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
+			return sizeof(BYTE) * 16;
 
 		case LLTYPE_LLVECTOR3:
-			{
-				m_nLen = sizeof(FLOAT) * 3;
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
+			return sizeof(FLOAT) * 3;
 
 		case LLTYPE_LLVECTOR3D:
-			{
-				m_nLen = sizeof(double) * 3;
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
+			return sizeof(double) * 3;
 
 		case LLTYPE_QUATERNION:
-			{
-				m_nLen = sizeof(FLOAT) * 4;
+			return sizeof(FLOAT) * 4;
 
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
-
-		case LLTYPE_IPADDR:
-			{
-				m_nLen = sizeof(BYTE) * 4;
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
-
-		case LLTYPE_IPPORT:
-			{
-				m_nLen = sizeof(WORD);
-
-				m_lpData = (LPBYTE)malloc(m_nLen);
-				
-				if (m_lpData)
-				{
-					memcpy(m_lpData, lpData, m_nLen);
-					nRead += m_nLen;
-				}
-				else
-					m_nLen = 0;
-			}
-			break;
+		case LLTYPE_FIXED:
+			return (nTypeLen > 0) ? nTypeLen : 0;
 
 		case LLTYPE_VARIABLE:
 			{
-				if (m_nTypeLen == 1)
+				if (nTypeLen == 1)
 				{
 					BYTE cDataLen;
-
 					memcpy(&cDataLen, lpData, sizeof(cDataLen));
-					nRead += sizeof(cDataLen);
-					lpData += sizeof(cDataLen);
-
-					m_nLen = cDataLen;
-
-					if (m_nLen > 0)
-					{
-						m_lpData = (LPBYTE)malloc(m_nLen);
-
-						if (m_lpData)
-						{
-							memcpy(m_lpData, lpData, m_nLen);
-							nRead += m_nLen;
-						}
-						else
-							m_nLen = 0;
-					}
-					else
-						m_nLen = 0;
+					return sizeof(cDataLen) + cDataLen;
 				}
-				else if (m_nTypeLen == 2)
+				else if (nTypeLen == 2)
 				{
 					WORD cDataLen;
-
 					memcpy(&cDataLen, lpData, sizeof(cDataLen));
-					nRead += sizeof(cDataLen);
-					lpData += sizeof(cDataLen);
-
-					m_nLen = cDataLen;
-
-					if (m_nLen > 0)
-					{
-						m_lpData = (LPBYTE)malloc(m_nLen);
-
-						if (m_lpData)
-						{
-							memcpy(m_lpData, lpData, m_nLen);
-							nRead += m_nLen;
-						}
-						else
-							m_nLen = 0;
-					}
-					else
-						m_nLen = 0;
-				}
-			}
-			break;
-
-		case LLTYPE_FIXED:
-			{
-				m_nLen = m_nTypeLen;
-
-				if (m_nLen > 0)
-				{
-					m_lpData = (LPBYTE)malloc(m_nLen);
-
-					if (m_lpData)
-					{
-						memcpy(m_lpData, lpData, m_nLen);
-						nRead += m_nLen;
-					}
-					else
-						m_nLen = 0;
+					return sizeof(cDataLen) + cDataLen;
 				}
-				else
-					m_nLen = 0;
 			}
 			break;
 
+		case LLTYPE_S64:
+		case LLTYPE_F8:
+		case LLTYPE_F16:
 		case LLTYPE_SINGLE:
 		case LLTYPE_MULTIPLE:
 		case LLTYPE_NULL:
 		default:
-			{
-				m_nLen = 0;
-			}
 			break;
 	}
 
+	return 0;
+}
+
+// Point the field at its bytes in the message body, no copy is made
+int CVar::SetData(LPBYTE lpData)
+{
+	int nRead = GetWireSize(m_nType, m_nTypeLen, lpData);
+
+	m_lpData = lpData;
+	m_nLen = nRead;
+
+	if (m_nType == LLTYPE_VARIABLE)
+	{
+		m_lpData += m_nTypeLen;
+		m_nLen -= m_nTypeLen;
+	}
+
+	if (m_nLen <= 0)
+	{
+		m_lpData = NULL;
+		m_nLen = 0;
+	}
+
 	return nRead;
 }
 
@@ -668,7 +379,7 @@ void CVar::Dump(void)
 			{
 				DWORD dwData;
 				memcpy(&dwData, m_lpData, sizeof(dwData));
-				dprintf("%s: %lu\n", m_lpszVar, dwData);
+				dprintf("%s: %u\n", m_lpszVar, dwData);
 			}
 			break;
 
@@ -676,7 +387,7 @@ void CVar::Dump(void)
 			{
 				ULONGLONG ullData;
 				memcpy(&ullData, m_lpData, sizeof(ullData));
-				dprintf("%s: %I64u\n", m_lpszVar, ullData);
+				dprintf("%s: %" PRINTF_INT64 "u\n", m_lpszVar, ullData);
 			}
 			break;
 
@@ -700,7 +411,7 @@ void CVar::Dump(void)
 			{
 				LONG nData;
 				memcpy(&nData, m_lpData, sizeof(nData));
-				dprintf("%s: %ld\n", m_lpszVar, nData);
+				dprintf("%s: %d\n", m_lpszVar, nData);
 			}
 			break;
 
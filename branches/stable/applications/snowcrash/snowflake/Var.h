@@ -6,14 +6,14 @@ public:
 	CVar(void);
 	~CVar(void);
 
+	// Points into the message template, not owned
 	char *m_lpszVar;
 	int m_nType;
 	int m_nTypeLen;
 	int m_nLen;
+	// Points into the owning message's body, not owned
 	LPBYTE m_lpData;
 
-	CVar *m_lpNext;
-	CVar *m_lpPrev;
 	void SetVar(char *lpszVar);
 	void SetType(int nType, int nTypeLen = 0);
 	int SetData(LPBYTE lpData);
@@ -21,4 +21,6 @@ public:
 	void GetBool(bool &lpbBool);
 	void Dump(void);
 	int Pack(LPBYTE lpData);
+
+	static int GetWireSize(int nType, int nTypeLen, LPBYTE lpData);
 };
@@ -0,0 +1,128 @@
+#include "stdafx.h"
+#include "./Verifier.h"
+#include "./PacketBuilder.h"
+
+CVerifier::CVerifier(void)
+{
+	m_nMode = VERIFY_ALL;
+	m_dwCount = 1;
+}
+
+CVerifier::~CVerifier(void)
+{
+}
+
+void CVerifier::SetMode(int nMode, DWORD dwCount)
+{
+	m_nMode = nMode;
+	m_dwCount = (dwCount > 0) ? dwCount : 1;
+}
+
+// Count a decoded message and decide whether it gets verified. The counters
+// are the message type's own, or a shard's copy of them.
+bool CVerifier::Sample(COMMANDSTATS *stats)
+{
+	DWORD dwDecoded = stats->dwDecoded++;
+
+	switch (m_nMode)
+	{
+		case VERIFY_ALL:
+			return true;
+
+		case VERIFY_SAMPLE:
+			return (dwDecoded % m_dwCount) == 0;
+
+		case VERIFY_FIRST:
+			return dwDecoded < m_dwCount;
+
+		case VERIFY_OFF:
+		default:
+			break;
+	}
+
+	return false;
+}
+
+// Re-pack a decoded message and compare it with the decoded buffer it came
+// from, message ID included. Returns false on a mismatch.
+bool CVerifier::Verify(LPCOMMAND lpCommand, COMMANDSTATS *stats, CMessage *msg, char *zerobuf, int nEnd)
+{
+	BYTE bPack[8192];
+	PACKETSEGMENT segments[PACKET_SEGMENTS];
+	CPacketBuilder packet;
+
+	packet.Begin(bPack, sizeof(bPack), 0, 0);
+	packet.SetCommand(lpCommand);
+	packet.AddMessage(msg);
+
+	int nPackedSize = packet.End(segments);
+	int nBodyLen = nEnd - MSG_HEADER_LEN;
+	int nOffset = -1;
+
+	stats->dwVerified++;
+
+	if (nPackedSize > 0)
+	{
+		LPBYTE lpPacked = segments[PACKET_SEGMENT_BODY].lpData;
+		int nPackedLen = segments[PACKET_SEGMENT_BODY].nLen;
+		int nLen = (nPackedLen < nBodyLen) ? nPackedLen : nBodyLen;
+
+		for (int i = 0; i < nLen; i++)
+		{
+			if (lpPacked[i] != (BYTE)zerobuf[MSG_HEADER_LEN + i])
+			{
+				nOffset = i;
+				break;
+			}
+		}
+
+		if (nOffset < 0 && nPackedLen == nBodyLen)
+			return true;
+
+		if (nOffset < 0)
+			nOffset = nLen;
+
+		nPackedSize = nPackedLen;
+	}
+
+	if (!stats->dwMismatched)
+		msg->Dump();
+
+	stats->dwMismatched++;
+	stats->nMismatchOffset = nOffset;
+	stats->nMismatchLen = nBodyLen;
+	stats->nMismatchPacked = nPackedSize;
+
+	dprintf("PACKED: %s %d / %d ===> %d\n", lpCommand->lpszCmd, nPackedSize, nBodyLen, nOffset);
+
+	return false;
+}
+
+static void report_commands(FILE *fp, LPCOMMAND lpCommands, int nCommands, char *lpszFrequency)
+{
+	for (int i = 0; i < nCommands; i++)
+	{
+		COMMANDSTATS *stats = &lpCommands[i].stats;
+
+		if (lpCommands[i].lpszCmd && (stats->dwDecoded || stats->dwDuplicates))
+		{
+			fprintf(fp, "%s\t%s\t%u\t%u\t%u\t%u\t%u\t%u\t%d\t%d\t%d\n", lpCommands[i].lpszCmd, lpszFrequency, i,
+				stats->dwDecoded, stats->dwResent, stats->dwDuplicates, stats->dwVerified, stats->dwMismatched,
+				stats->dwMismatched ? stats->nMismatchOffset : -1,
+				stats->dwMismatched ? stats->nMismatchLen : -1,
+				stats->dwMismatched ? stats->nMismatchPacked : -1);
+		}
+	}
+}
+
+// Tab separated report, one line per message type seen
+void CVerifier::Report(FILE *fp)
+{
+	fprintf(fp, "Command\tFrequency\tID\tDecoded\tResent\tDuplicates\tVerified\tMismatched\tMismatchOffset\tMismatchLen\tMismatchPacked\n");
+
+	report_commands(fp, cmds_high, MAX_COMMANDS_HIGH, "High");
+	report_commands(fp, cmds_med, MAX_COMMANDS_MEDIUM, "Medium");
+	report_commands(fp, cmds_low, MAX_COMMANDS_LOW, "Low");
+
+	fflush(fp);
+}
\ No newline at end of file
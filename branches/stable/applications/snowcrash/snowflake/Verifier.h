@@ -0,0 +1,27 @@
+#pragma once
+
+#include "./Template.h"
+#include "./Message.h"
+
+#define VERIFY_OFF		0	// Never re-pack decoded messages
+#define VERIFY_ALL		1	// Re-pack and compare every message
+#define VERIFY_SAMPLE	2	// Every Nth message of each type
+#define VERIFY_FIRST	3	// The first N messages of each type
+
+// Round trip check of the decoder: a decoded message is re-packed and
+// compared against the bytes it was decoded from, and the outcome is
+// counted against its message type
+class CVerifier
+{
+public:
+	CVerifier(void);
+	~CVerifier(void);
+
+	int m_nMode;
+	DWORD m_dwCount;
+
+	void SetMode(int nMode, DWORD dwCount);
+	bool Sample(COMMANDSTATS *stats);
+	bool Verify(LPCOMMAND lpCommand, COMMANDSTATS *stats, CMessage *msg, char *zerobuf, int nEnd);
+	void Report(FILE *fp);
+};
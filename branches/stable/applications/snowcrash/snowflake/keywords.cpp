@@ -1,5 +1,5 @@
-#include "StdAfx.h"
-#include ".\keywords.h"
+#include "stdafx.h"
+#include "./keywords.h"
 
 TCHAR *LLTYPES[] = {
 	_T("U8"),
@@ -0,0 +1,256 @@
+#include "stdafx.h"
+#include "./Protocol.h"
+#include "./Decoder.h"
+#include "./Latency.h"
+#include "./PcapReader.h"
+#include "./CaptureDecoder.h"
+#include "./Archive.h"
+
+// Packets read from the capture at a time
+#define DECODE_BATCH	256
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: snowdecode [-j threads] [-b max threads] [-c copies] [-o listing] [-a archive]\n");
+	fprintf(stderr, "                  [-t trace]\n");
+	fprintf(stderr, "                  <message_template.msg> <capture> [viewer address[:port]]\n");
+}
+
+// A viewer given without a port matches any port at that address
+static bool is_viewer(struct sockaddr_in *address, struct sockaddr_in *viewer)
+{
+	return address->sin_addr.s_addr == viewer->sin_addr.s_addr && (!viewer->sin_port || address->sin_port == viewer->sin_port);
+}
+
+// One line per packet in timestamp order: time, circuit, direction and
+// message type, or - for a packet that was not dispatched
+static bool write_listing(CCaptureDecoder *decoder, const char *lpszPath)
+{
+	FILE *fp = fopen(lpszPath, "w");
+
+	if (!fp)
+		return false;
+
+	for (DWORD i = 0; i < decoder->m_dwPackets; i++)
+	{
+		LPDECODERESULT lpResult = &decoder->m_lpResults[i];
+		LPDECODESTREAM stream = &decoder->m_lpStreams[lpResult->nStream];
+
+		fprintf(fp, "%" PRINTF_INT64 "u.%06u\t%s:%u\t%s\t%s\n",
+			lpResult->ullTime / 1000000, (DWORD)(lpResult->ullTime % 1000000),
+			inet_ntoa(stream->address.sin_addr), ntohs(stream->address.sin_port),
+			lpResult->bSent ? "out" : "in",
+			lpResult->lpCommand ? lpResult->lpCommand->lpszCmd : "-");
+	}
+
+	fclose(fp);
+
+	return true;
+}
+
+// Decodes every UDP packet of a pcap or pcapng capture as the hooks would
+// have seen it, one thread per circuit at a time, and reports the rate.
+// Circuits are keyed by the simulator's end, so each packet needs to be
+// known as sent or received: from the viewer given, or else the first one
+// to send UseCircuitCode.
+//
+// -b decodes the capture again on 1 to N threads and reports the scaling.
+// -c adds every packet that many times, each copy on a circuit of its own
+// one port up from the last, making a multi circuit capture out of one.
+// -a writes the capture's packets out as an archive on the way through,
+// -t records every dispatched message as snowtrace reads them.
+int main(int argc, char *argv[])
+{
+	struct sockaddr_in viewer;
+	bool bViewer = false;
+	int nThreads = 0;
+	int nBenchmark = 0;
+	int nCopies = 1;
+	char *lpszListing = NULL;
+	char *lpszArchive = NULL;
+	char *lpszTrace = NULL;
+	int nArg = 1;
+	SYSTEM_INFO si;
+
+	for (; nArg + 1 < argc && argv[nArg][0] == '-'; nArg += 2)
+	{
+		if (!strcmp(argv[nArg], "-j"))
+			nThreads = atoi(argv[nArg + 1]);
+		else if (!strcmp(argv[nArg], "-b"))
+			nBenchmark = atoi(argv[nArg + 1]);
+		else if (!strcmp(argv[nArg], "-c"))
+			nCopies = atoi(argv[nArg + 1]);
+		else if (!strcmp(argv[nArg], "-o"))
+			lpszListing = argv[nArg + 1];
+		else if (!strcmp(argv[nArg], "-a"))
+			lpszArchive = argv[nArg + 1];
+		else if (!strcmp(argv[nArg], "-t"))
+			lpszTrace = argv[nArg + 1];
+		else
+			break;
+	}
+
+	if (argc - nArg < 2 || nCopies < 1)
+	{
+		usage();
+		return 1;
+	}
+
+	GetSystemInfo(&si);
+
+	if (nThreads <= 0)
+		nThreads = (int)si.dwNumberOfProcessors;
+
+	ZeroMemory(&viewer, sizeof(viewer));
+	viewer.sin_family = AF_INET;
+
+	if (argc - nArg > 2)
+	{
+		char szAddress[64];
+		char *lpszPort;
+
+		strncpy(szAddress, argv[nArg + 2], sizeof(szAddress) - 1);
+		szAddress[sizeof(szAddress) - 1] = '\0';
+
+		if ((lpszPort = strchr(szAddress, ':')) != NULL)
+		{
+			*lpszPort++ = '\0';
+			viewer.sin_port = htons((WORD)atoi(lpszPort));
+		}
+
+		viewer.sin_addr.s_addr = inet_addr(szAddress);
+		bViewer = true;
+	}
+
+	if (load_template(argv[nArg]) < 0)
+	{
+		fprintf(stderr, "snowdecode: can't load template %s\n", argv[nArg]);
+		return 1;
+	}
+
+	CPcapReader reader;
+
+	if (!reader.Open(argv[nArg + 1]))
+	{
+		fprintf(stderr, "snowdecode: can't read capture %s\n", argv[nArg + 1]);
+		return 1;
+	}
+
+	if (!engine.Start(cmds_count))
+		return 1;
+
+	LPCOMMAND use_circuit_code = find_command("UseCircuitCode");
+	LPPCAPPACKET lpPackets = (LPPCAPPACKET)malloc(DECODE_BATCH * sizeof(PCAPPACKET));
+	CCaptureDecoder decoder;
+	CArchive archive;
+	ULONGLONG ullBytes = 0;
+	int nRead;
+
+	if (!lpPackets)
+		return 1;
+
+	// Converting, so wait for the writers rather than drop anything
+	if (lpszTrace && !trace.Create(lpszTrace, LOG_BLOCK))
+	{
+		fprintf(stderr, "snowdecode: can't create trace %s\n", lpszTrace);
+		return 1;
+	}
+
+	if (lpszArchive && !archive.Create(lpszArchive, true))
+	{
+		fprintf(stderr, "snowdecode: can't create archive %s\n", lpszArchive);
+		return 1;
+	}
+
+	DWORD dwStart = CLatency::GetTime();
+
+	while ((nRead = reader.Read(lpPackets, DECODE_BATCH)) > 0)
+	{
+		for (int i = 0; i < nRead; i++)
+		{
+			LPPCAPPACKET lpPacket = &lpPackets[i];
+
+			if (!bViewer && use_circuit_code && lpPacket->nLen > MSG_HEADER_LEN &&
+				peek_command(lpPacket->lpData, lpPacket->nLen, NULL) == use_circuit_code)
+			{
+				viewer = lpPacket->source;
+				bViewer = true;
+			}
+
+			bool bSent = bViewer && is_viewer(&lpPacket->source, &viewer);
+
+			// Anything not to or from the viewer is someone else's traffic
+			if (bViewer && !bSent && !is_viewer(&lpPacket->dest, &viewer))
+				continue;
+
+			struct sockaddr_in address = bSent ? lpPacket->dest : lpPacket->source;
+
+			if (lpszArchive)
+				archive.Write(lpPacket->lpData, lpPacket->nLen, &address, bSent, lpPacket->ullTime);
+
+			for (int c = 0; c < nCopies; c++)
+			{
+				if (!decoder.Add(lpPacket->ullTime, &address, lpPacket->lpData, lpPacket->nLen, bSent))
+					return 1;
+
+				address.sin_port = htons(ntohs(address.sin_port) + 1);
+			}
+
+			ullBytes += (ULONGLONG)lpPacket->nLen * nCopies;
+		}
+	}
+
+	if (!decoder.Index())
+		return 1;
+
+	if (lpszArchive)
+		archive.Close();
+
+	DWORD dwIndexed = CLatency::GetTime() - dwStart;
+
+	printf("%u frames, %u skipped%s\n", reader.m_dwFrames, reader.m_dwSkipped, reader.m_bTruncated ? ", capture truncated" : "");
+	printf("%u packets, %" PRINTF_INT64 "u bytes on %d circuits, indexed in %.3f seconds\n", decoder.m_dwPackets, ullBytes, decoder.m_nStreams, dwIndexed / 1000000.0);
+
+	if (nBenchmark > 0)
+		printf("Threads\tPackets\tMilliseconds\tPacketsPerSecond\tMBPerSecond\tSpeedup\tStolen\n");
+
+	double dBase = 0;
+
+	for (int t = (nBenchmark > 0) ? 1 : nThreads; t <= ((nBenchmark > 0) ? nBenchmark : nThreads); t++)
+	{
+		dwStart = CLatency::GetTime();
+
+		if (!decoder.Decode(t, cmds_count))
+		{
+			fprintf(stderr, "snowdecode: decode on %d threads failed\n", t);
+			return 1;
+		}
+
+		double dSeconds = (CLatency::GetTime() - dwStart) / 1000000.0;
+
+		// Only the first pass is traced
+		if (trace.IsOpen())
+			trace.Close();
+		double dRate = (dSeconds > 0) ? decoder.m_dwPackets / dSeconds : 0;
+		double dMB = (dSeconds > 0) ? ullBytes / dSeconds / 1048576.0 : 0;
+
+		if (!dBase)
+			dBase = dRate;
+
+		if (nBenchmark > 0)
+			printf("%d\t%u\t%.0f\t%.0f\t%.1f\t%.2f\t%u\n", t, decoder.m_dwPackets, dSeconds * 1000, dRate, dMB, dBase ? dRate / dBase : 0, decoder.m_dwStolen);
+		else
+			printf("%u dispatched on %d threads in %.3f seconds, %.0f packets/s, %.1f MB/s\n", decoder.m_dwDecoded, t, dSeconds, dRate, dMB);
+	}
+
+	if (lpszListing && !write_listing(&decoder, lpszListing))
+	{
+		fprintf(stderr, "snowdecode: can't write %s\n", lpszListing);
+		return 1;
+	}
+
+	free(lpPackets);
+	engine.Stop();
+
+	return 0;
+}
\ No newline at end of file
@@ -2,14 +2,25 @@
 //
 
 #include "stdafx.h"
-#include ".\snowflake.h"
-#include ".\MainFrame.h"
-#include ".\Server.h"
-#include ".\ServerList.h"
-#include ".\Message.h"
-#include ".\Block.h"
-#include ".\Var.h"
-#include ".\Config.h"
+#include "./snowflake.h"
+#include "./MainFrame.h"
+#include "./Server.h"
+#include "./ServerList.h"
+#include "./Message.h"
+#include "./Block.h"
+#include "./Var.h"
+#include "./Config.h"
+#include "./Template.h"
+#include "./PacketBuilder.h"
+#include "./AckTrailer.h"
+#include "./Verifier.h"
+#include "./MessagePool.h"
+#include "./Shard.h"
+#include "./Engine.h"
+#include "./Capture.h"
+#include "./Protocol.h"
+#include "./Decoder.h"
+#include "./Log.h"
 #include <tlhelp32.h>
 #include <wininet.h>
 #include <wincrypt.h>
@@ -18,63 +29,10 @@
 #include <math.h>
 #include <winuser.h>
 #include <time.h>
-#include ".\keywords.h"
+#include "./keywords.h"
 
 #pragma pack(1)
 
-struct COMMANDVAR
-{
-	char *lpszVar;
-	int nKeywordPos;
-	int nType;
-	int nTypeLen;
-	struct COMMANDVAR *lpNext;
-	struct COMMANDVAR *lpPrev;
-} typedef COMMANDVARS;
-
-typedef COMMANDVAR * LPCOMMANDVAR;
-typedef COMMANDVARS * LPCOMMANDVARS;
-
-struct COMMANDSTRUCT
-{
-	char *lpszStruct;
-	int nKeywordPos;
-	int nType;
-	BYTE cItems;
-	LPCOMMANDVARS vars;
-	struct COMMANDSTRUCT *lpNext;
-	struct COMMANDSTRUCT *lpPrev;
-} typedef COMMANDSTRUCTS;
-
-typedef COMMANDSTRUCT * LPCOMMANDSTRUCT;
-typedef COMMANDSTRUCTS * LPCOMMANDSTRUCTS;
-
-typedef struct
-{
-	char *lpszCmd;
-	bool bZerocoded;
-	bool bTrusted;
-	LPCOMMANDSTRUCTS structs;
-} COMMAND;
-
-typedef COMMAND * LPCOMMAND;
-
-#define MAX_COMMANDS_LOW	65536
-#define MAX_COMMANDS_MEDIUM	256
-#define MAX_COMMANDS_HIGH	256
-
-COMMAND cmds_low[MAX_COMMANDS_LOW];
-COMMAND cmds_med[MAX_COMMANDS_MEDIUM];
-COMMAND cmds_high[MAX_COMMANDS_HIGH];
-
-typedef struct
-{
-	LPCTSTR	szCommand;
-	PROC	pProc;
-} CMDHOOK, *LPCMDHOOK;
-
-CMDHOOK	pCMDHooks[];
-
 #pragma data_seg(".shared")
 HHOOK h_hCBTHook = NULL;
 #pragma data_seg()
@@ -88,8 +46,6 @@ CMessageLoop g_msgLoop;
 CConfig* g_pConfig = NULL;
 BOOL g_bAllowSub = TRUE;
 
-CServerList servers;
-
 typedef struct
 {
 	LPCTSTR	szPatch;
@@ -127,1212 +83,45 @@ enum APIHOOKS
 	APIHOOK_INTERNETOPENURLA,
 	APIHOOK_CPENCRYPT,
 	APIHOOK_PEEKMESSAGEA,
-	APIHOOK_GLGETERROR,
-	APIHOOK_GLBEGIN,
-	APIHOOK_GLENABLE,
-	APIHOOK_GLISENABLED,
-	APIHOOK_GLTRANSLATED,
-	APIHOOK_GLTRANSLATEF,
-	APIHOOK_GLTEXCOORD2F,
-	APIHOOK_GLTEXCOORD2FV,
-	APIHOOK_GLVERTEX2F,
-	APIHOOK_GLVERTEX3F,
-	APIHOOK_GLVERTEX3FV,
-	APIHOOK_GLVERTEX4F,
-	APIHOOK_GLVERTEX4FV,
-	APIHOOK_GLVERTEXPOINTER,
-	APIHOOK_GLTEXCOORDPOINTER,
-	APIHOOK_GLNORMALPOINTER,
-	APIHOOK_GLDRAWELEMENTS,
-	APIHOOK_GLDRAWARRAYS,
-	APIHOOK_GLDRAWPIXELS,
-	APIHOOK_GLTEXIMAGE2D,
-	APIHOOK_GLCOLOR3F,
-	APIHOOK_GLCOLOR3FV,
-	APIHOOK_GLCOLOR4F,
-	APIHOOK_GLCOLOR4FV,
-	APIHOOK_GLCOLOR4UBV,
-	APIHOOK_GLCOLORPOINTER,
-	APIHOOK_GLVIEWPORT,
-	APIHOOK_GLFLUSH,
-	APIHOOK_GLUPERSPECTIVE,
-	APIHOOK_GLUQUADRICDRAWSTYLE,
-	APIHOOK_GLUTESSVERTEX,
-	APIHOOK_NULL
-};
-
-bool InstallSLHooks(HWND hwnd);
-bool RemoveSLHooks();
-void InstallImportHooks();
-void RemoveImportHooks();
-void SaveImportHooks();
-
-int ZeroDecode(char *src, int srclen, char *dest, int destlen)
-{
-	int zerolen = 0;
-
-	if (src[0] & MSG_ZEROCODED)
-	{
-		memcpy(dest, src, 4);
-		zerolen += 4;
-
-		for (int i = zerolen; i < srclen; i++)
-		{
-			if ((unsigned char)src[i] == 0x00)
-			{
-				for (unsigned char j = 0; j < (unsigned char)src[i+1]; j++)
-					dest[zerolen++] = 0x00;
-
-				i++;
-			}
-			else
-				dest[zerolen++] = src[i];
-		}
-	}
-	else
-	{
-		memcpy(dest, src, srclen);
-		zerolen = srclen;
-	}
-
-	return zerolen;
-}
-
-int ZeroEncode(char *src, int srclen, char *dest, int destlen)
-{
-	int zerolen = 0;
-	unsigned char zerocount = 0;
-
-	if (src[0] & MSG_ZEROCODED)
-	{
-		memcpy(dest, src, 4);
-		zerolen += 4;
-
-		for (int i = zerolen; i < srclen; i++)
-		{
-			if ((unsigned char)src[i] == 0x00)
-			{
-				zerocount++;
-
-				if (zerocount == 0)
-				{
-					dest[zerolen++] = 0x00;
-					dest[zerolen++] = 0xff;
-					zerocount++;
-				}
-			}
-			else
-			{
-				if (zerocount)
-				{
-					dest[zerolen++] = 0x00;
-					dest[zerolen++] = zerocount;
-					zerocount = 0;
-				}
-
-				dest[zerolen++] = src[i];
-			}
-		}
-
-		if (zerocount)
-		{
-			dest[zerolen++] = 0x00;
-			dest[zerolen++] = zerocount;
-		}
-	}
-	else
-	{
-		memcpy(dest, src, srclen);
-		zerolen = srclen;
-	}
-
-	return zerolen;
-}
-
-// Convert a "hex string" to an integer by Anders Molin
-int httoi(const TCHAR *value)
-{
-	struct HEXMAP
-	{
-		TCHAR c;
-		int value;
-	};
-
-	const int nHexMap = 16;
-	
-	HEXMAP hmLookup[nHexMap] =
-	{
-		{'0', 0}, {'1', 1},
-		{'2', 2}, {'3', 3},
-		{'4', 4}, {'5', 5},
-		{'6', 6}, {'7', 7},
-		{'8', 8}, {'9', 9},
-		{'A', 10}, {'B', 11},
-		{'C', 12}, {'D', 13},
-		{'E', 14}, {'F', 15}
-	};
-
-	TCHAR *mstr = _tcsupr(_tcsdup(value));
-	TCHAR *s = mstr;
-	int result = 0;
-	
-	if (*s == '0' && *(s + 1) == 'X')
-		s += 2;
-	
-	bool firsttime = true;
-	
-	while (*s != '\0')
-	{
-		bool found = false;
-
-		for (int i = 0; i < nHexMap; i++)
-		{
-			if (*s == hmLookup[i].c)
-			{
-				if (!firsttime)
-					result <<= 4;
-				
-				result |= hmLookup[i].value;
-				found = true;
-				break;
-			}
-		}
-		
-		if (!found)
-			break;
-		
-		s++;
-		firsttime = false;
-	}
-
-	free(mstr);
-	
-	return result;
-}
-
-// Trim beginning, ending, and excess embedded whitespace from a string
-char *trim(char *szStr)
-{
-	char *iBuf, *oBuf;
-
-	if (szStr)
-	{
-		for (iBuf = oBuf = szStr; *iBuf;)
-		{
-			while (*iBuf && (isspace(*iBuf)))
-				iBuf++;
-			
-			if (*iBuf && (oBuf != szStr))
-				*(oBuf++) = ' ';
-			
-			while (*iBuf && (!isspace(*iBuf)))
-				*(oBuf++) = *(iBuf++);
-		}
-		
-		*oBuf = NULL;
-	}
-
-	return(szStr);
-}
-
-int get_var_type(TCHAR *lptszType)
-{
-	int i = 0;
-
-	while (LLTYPES[i])
-	{
-		if (!_tcscmp(lptszType, LLTYPES[i]))
-		{
-			//printf("Type: %s\n", LLTYPES[i]);
-			return i;
-		}
-
-		i++;
-	}
-
-	return -1;
-}
-
-int get_keyword_pos(TCHAR *lptszKeyword)
-{
-	int i = 0;
-
-	while (LLKEYWORDS[i])
-	{
-		if (!_tcscmp(lptszKeyword, LLKEYWORDS[i]))
-		{
-			//printf("Keyword: %s\n", LLKEYWORDS[i]);
-			return i;
-		}
-
-		i++;
-	}
-
-	dprintf("Unhandled keyword: %s\n", lptszKeyword);
-	return -1;
-}
-
-// Get message template block deliminator positions
-bool get_block_markers(LPBYTE lpBuffer, DWORD &dwStart, DWORD &dwEnd, DWORD &dwChildren)
-{
-	DWORD dwStartBlock = 0;
-	DWORD dwEndBlock = 0;
-	DWORD dwDepth = 0;
-	
-	dwChildren = 0;
-
-	for (DWORD dwPos = dwStart; dwPos <= dwEnd; dwPos++)
-	{
-		if (lpBuffer[dwPos] == '{')
-		{
-			dwDepth++;
-
-			if (dwDepth == 1)
-				dwStartBlock = dwPos;
-			else if (dwDepth == 2 && !dwChildren)
-				dwChildren = dwPos;
-		}
-		
-		else if (lpBuffer[dwPos] == '}')
-		{
-			dwDepth--;
-
-			if (dwDepth == 0 && dwStartBlock)
-			{
-				dwEndBlock = dwPos;
-				dwStart = dwStartBlock;
-				dwEnd = dwEndBlock;
-				return true;
-			}
-		}
-	}
-
-	return false;
-}
-
-// Parse the variables message template block of a struct
-bool get_var_blocks(LPCOMMANDSTRUCT lpStruct, LPBYTE lpBuffer, DWORD dwStart, DWORD dwEnd)
-{
-	DWORD dwVarStart = dwStart;
-	DWORD dwVarEnd = dwEnd;
-	DWORD dwVarChildren = 0;
-
-	while (get_block_markers(lpBuffer, dwVarStart, dwVarEnd, dwVarChildren))
-	{
-		char szVarLine[256];
-		DWORD dwVarLen = (dwVarChildren ? dwVarChildren - 1 : dwVarEnd - 1) - dwVarStart;
-
-		memcpy(&szVarLine, &lpBuffer[dwVarStart+1], dwVarLen);
-		szVarLine[dwVarLen] = '\0';
-		trim(szVarLine);
-		
-		//printf("\t\t%s\n", szVarLine);
-
-		char *lpszVar = strtok(szVarLine, " ");
-		char *lpszType = strtok(NULL, " ");
-		char *lpszTypeLen = NULL;
-		int nKeywordPos = get_keyword_pos(lpszVar);
-		int nVarType = get_var_type(lpszType);
-
-		LPCOMMANDVAR lpVar = lpStruct->vars;
-
-		if (lpVar)
-		{
-			// Insert after an item
-			if (nKeywordPos > lpVar->nKeywordPos)
-			{
-				while (lpVar->lpNext && nKeywordPos > lpVar->lpNext->nKeywordPos)
-					lpVar = lpVar->lpNext;
-
-				LPCOMMANDVAR lpBelow = lpVar->lpNext;
-
-				lpVar->lpNext = (LPCOMMANDVAR)malloc(sizeof(COMMANDVAR));
-				
-				if (!lpVar->lpNext)
-					return false;
-
-				ZeroMemory(lpVar->lpNext, sizeof(COMMANDVAR));
-				lpVar->lpNext->lpPrev = lpVar;
-				lpVar->lpNext->lpNext = lpBelow;
-				lpVar = lpVar->lpNext;
-			}
-			// Insert before all items
-			else
-			{
-				lpVar->lpPrev = (LPCOMMANDVAR)malloc(sizeof(COMMANDVAR));
-				
-				if (!lpVar->lpPrev)
-					return false;
-
-				ZeroMemory(lpVar->lpPrev, sizeof(COMMANDVAR));
-
-				lpVar->lpPrev->lpNext = lpVar;
-				lpVar->lpPrev->lpPrev = NULL;
-				lpVar = lpVar->lpPrev;
-				lpStruct->vars = lpVar;
-			}
-		}
-		// No existing list, create a new list with our entry
-		else
-		{
-			lpVar = (LPCOMMANDVAR)malloc(sizeof(COMMANDVAR));
-			
-			if (!lpVar)
-				return false;
-
-			ZeroMemory(lpVar, sizeof(COMMANDVAR));
-			lpStruct->vars = lpVar;
-		}
-
-		lpVar->lpszVar = strdup(lpszVar);
-		lpVar->nType = nVarType;
-		lpVar->nKeywordPos = nKeywordPos;
-
-		if (nVarType == LLTYPE_VARIABLE || nVarType == LLTYPE_FIXED)
-		{
-			lpszTypeLen = strtok(NULL, " ");
-			lpVar->nTypeLen = atoi(lpszTypeLen);
-		}
-
-		dwVarStart = dwVarEnd + 1;
-		dwVarEnd = dwEnd;
-	}
-
-	return true;
-}
-
-// Parse the struct message template block of a command
-bool get_struct_blocks(LPCOMMAND lpCmd, LPBYTE lpBuffer, DWORD dwStart, DWORD dwEnd)
-{
-	DWORD dwStructStart = dwStart;
-	DWORD dwStructEnd = dwEnd;
-	DWORD dwStructChildren = 0;
-
-	while (get_block_markers(lpBuffer, dwStructStart, dwStructEnd, dwStructChildren))
-	{
-		char szStructLine[256];
-		DWORD dwStructLen = (dwStructChildren ? dwStructChildren - 1 : dwStructEnd - 1) - dwStructStart;
-
-		memcpy(&szStructLine, &lpBuffer[dwStructStart+1], dwStructLen);
-		szStructLine[dwStructLen] = '\0';
-		trim(szStructLine);
-		
-		//printf("\t%s\n", szStructLine);
-
-		char *lpszStruct = strtok(szStructLine, " ");
-		char *lpszType = strtok(NULL, " ");
-		int nKeywordPos = get_keyword_pos(lpszStruct);
-		int nVarType = get_var_type(lpszType);
-
-		LPCOMMANDSTRUCT lpStruct = lpCmd->structs;
-
-		if (lpStruct)
-		{
-			// Insert after an item
-			if (nKeywordPos > lpStruct->nKeywordPos)
-			{
-				while (lpStruct->lpNext && nKeywordPos > lpStruct->lpNext->nKeywordPos)
-					lpStruct = lpStruct->lpNext;
-
-				LPCOMMANDSTRUCT lpBelow = lpStruct->lpNext;
-
-				lpStruct->lpNext = (LPCOMMANDSTRUCT)malloc(sizeof(COMMANDSTRUCT));
-			
-				if (!lpStruct->lpNext)
-					return false;
-
-				ZeroMemory(lpStruct->lpNext, sizeof(COMMANDSTRUCT));
-				lpStruct->lpNext->lpPrev = lpStruct;
-				lpStruct->lpNext->lpNext = lpBelow;
-				lpStruct = lpStruct->lpNext;
-			}
-			// Insert before all items
-			else
-			{
-				lpStruct->lpPrev = (LPCOMMANDSTRUCT)malloc(sizeof(COMMANDSTRUCT));
-				
-				if (!lpStruct->lpPrev)
-					return false;
-
-				ZeroMemory(lpStruct->lpPrev, sizeof(COMMANDSTRUCT));
-
-				lpStruct->lpPrev->lpNext = lpStruct;
-				lpStruct->lpPrev->lpPrev = NULL;
-				lpStruct = lpStruct->lpPrev;
-				lpCmd->structs = lpStruct;
-			}
-		}
-		// No existing list, create a new list with our entry
-		else
-		{
-			lpCmd->structs = (LPCOMMANDSTRUCT)malloc(sizeof(COMMANDSTRUCT));
-			
-			if (!lpCmd->structs)
-				return false;
-
-			ZeroMemory(lpCmd->structs, sizeof(COMMANDSTRUCT));
-			lpStruct = lpCmd->structs;
-		}
-
-		lpStruct->lpszStruct = strdup(lpszStruct);
-		lpStruct->nKeywordPos = nKeywordPos;
-		lpStruct->nType = nVarType;
-
-		if (nVarType == LLTYPE_VARIABLE)
-		{
-			lpStruct->cItems = 1;
-		}
-		else if (nVarType == LLTYPE_MULTIPLE)
-		{
-			char *lpszTypeLen = strtok(NULL, " ");
-			lpStruct->cItems = atoi(lpszTypeLen);
-		}
-
-		get_var_blocks(lpStruct, lpBuffer, dwStructStart + 1, dwStructEnd - 1);
-
-		dwStructStart = dwStructEnd + 1;
-		dwStructEnd = dwEnd;
-	}
-
-	return true;
-}
-
-// Parse the command message template blocks
-bool get_command_blocks(LPBYTE lpBuffer, DWORD dwStart, DWORD dwEnd)
-{
-	DWORD dwCmdStart = dwStart;
-	DWORD dwCmdEnd = dwEnd;
-	DWORD dwCmdChildren = 0;
-	
-	while (get_block_markers(lpBuffer, dwCmdStart, dwCmdEnd, dwCmdChildren))
-	{
-		char szCmdLine[256];
-		DWORD dwCmdLen = (dwCmdChildren ? dwCmdChildren - 1 : dwCmdEnd - 1) - dwCmdStart;
-
-		memcpy(&szCmdLine, &lpBuffer[dwCmdStart+1], dwCmdLen);
-		szCmdLine[dwCmdLen] = '\0';
-		trim(szCmdLine);
-		
-		//printf("%s\n", szCmdLine);
-
-		char *lpszCmd = strtok(szCmdLine, " ");
-		char *lpszFreq = strtok(NULL, " ");
-		char *lpszFixed = NULL;
-		char *lpszTrust = NULL;
-		char *lpszCoding = NULL;
-		static DWORD dwLow = 1;
-		static DWORD dwMed = 1;
-		static DWORD dwHigh = 1;
-		COMMAND *lpCmd = NULL;
-
-		// Get the commands frequency
-		if (!strnicmp(lpszFreq, "Fixed", 6))
-		{
-			lpszFixed = strtok(NULL, " ");
-			DWORD dwFixed = (DWORD)httoi(lpszFixed) ^ 0xffff0000;
-			lpCmd = &cmds_low[dwFixed];
-		}
-		else if (!strnicmp(lpszFreq, "Low", 4))
-		{
-			lpCmd = &cmds_low[dwLow++];
-		}
-		else if (!strnicmp(lpszFreq, "Medium", 7))
-		{
-			lpCmd = &cmds_med[dwMed++];
-		}
-		else if (!strnicmp(lpszFreq, "High", 5))
-		{
-			lpCmd = &cmds_high[dwHigh++];
-		}
-
-		lpszTrust = strtok(NULL, " ");
-		lpszCoding = strtok(NULL, " ");
-		
-		lpCmd->lpszCmd = strdup(lpszCmd);
-		
-		// Is the command zero encoded?
-		if (!strnicmp(lpszCoding, "Zerocoded", 10))
-		{
-			lpCmd->bZerocoded = true;
-		}
-
-		// Is the command trusted?
-		if (!strnicmp(lpszTrust, "Trusted", 8))
-		{
-			lpCmd->bTrusted = true;
-		}
-
-		get_struct_blocks(lpCmd, lpBuffer, dwCmdStart + 1, dwCmdEnd - 1);
-
-		//printf("----------------------\n");
-
-		dwCmdStart = dwCmdEnd + 1;
-		dwCmdEnd = dwEnd;
-	}
-
-	return true;
-}
-
-void dump_structs(LPCOMMANDSTRUCT lpStruct)
-{
-	while (lpStruct)
-	{
-		//dprintf("\t%04d %s (%s / %hu)\n", lpStruct->nKeywordPos, lpStruct->lpszStruct, LLTYPES[lpStruct->nType], lpStruct->cItems);
-
-		LPCOMMANDVAR lpVar = lpStruct->vars;
-
-		while (lpVar)
-		{
-			//dprintf("\t\t%04d %s (%s / %d)\n", lpVar->nKeywordPos, lpVar->lpszVar, LLTYPES[lpVar->nType], lpVar->nTypeLen);
-			lpVar = lpVar->lpNext;
-		}
-
-//		if (lpStruct->lpNext)
-//		{
-			lpStruct = lpStruct->lpNext;
-//			SAFE_FREE(lpStruct->lpPrev->lpszStruct);
-//			SAFE_FREE(lpStruct->lpPrev);
-//		}
-//		else
-//		{
-//			SAFE_FREE(lpStruct->lpszStruct);
-//			SAFE_FREE(lpStruct);
-//		}
-	}
-}
-
-void WINAPI parse_command(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
-{
-	//dprintf("--- %s ---\n", lpCommand->lpszCmd);
-
-	LPCOMMANDSTRUCT lpStruct = lpCommand->structs;
-
-	while (lpStruct)
-	{
-		//dprintf("\t%04d %s (%s / %hu)\n", lpStruct->nKeywordPos, lpStruct->lpszStruct, LLTYPES[lpStruct->nType], lpStruct->cItems);
-		BYTE cItems = 1;
-
-		if (lpStruct->nType == LLTYPE_VARIABLE)
-		{
-			memcpy(&cItems, &zerobuf[pos], sizeof(cItems));
-			pos += sizeof(cItems);
-		}
-		else if (lpStruct->nType == LLTYPE_MULTIPLE)
-		{
-			cItems = lpStruct->cItems;
-		}
-
-		for (BYTE c = 0; c < cItems; c++)
-		{
-			//dprintf("--- %s ----\n", lpStruct->lpszStruct);
-
-			LPCOMMANDVAR lpVar = lpStruct->vars;
-
-			while (lpVar)
-			{
-				//dprintf("\t\t%04d %s (%s / %d)\n", lpVar->nKeywordPos, lpVar->lpszVar, LLTYPES[lpVar->nType], lpVar->nTypeLen);
-
-				switch (lpVar->nType)
-				{
-					case LLTYPE_U8:
-						{
-							unsigned char ubData;
-							memcpy(&ubData, &zerobuf[pos], sizeof(ubData));
-							pos += sizeof(ubData);
-							//dprintf("%s: %hu\n", lpVar->lpszVar, ubData);
-						}
-						break;
-
-					case LLTYPE_U16:
-						{
-							WORD wData;
-							memcpy(&wData, &zerobuf[pos], sizeof(wData));
-							pos += sizeof(wData);
-							//dprintf("%s: %u\n", lpVar->lpszVar, wData);
-						}
-						break;
-
-					case LLTYPE_U32:
-						{
-							DWORD dwData;
-							memcpy(&dwData, &zerobuf[pos], sizeof(dwData));
-							pos += sizeof(dwData);
-							//dprintf("%s: %lu\n", lpVar->lpszVar, dwData);
-						}
-						break;
-
-					case LLTYPE_U64:
-						{
-							ULONGLONG ullData;
-							memcpy(&ullData, &zerobuf[pos], sizeof(ullData));
-							pos += sizeof(ullData);
-							//dprintf("%s: %I64u\n", lpVar->lpszVar, ullData);
-						}
-						break;
-
-					case LLTYPE_S8:
-						{
-							BYTE bData;
-							memcpy(&bData, &zerobuf[pos], sizeof(bData));
-							pos += sizeof(bData);
-							//dprintf("%s: %hd\n", lpVar->lpszVar, bData);
-						}
-						break;
-
-					case LLTYPE_S16:
-						{
-							SHORT sData;
-							memcpy(&sData, &zerobuf[pos], sizeof(sData));
-							pos += sizeof(sData);
-							//dprintf("%s: %d\n", lpVar->lpszVar, sData);
-						}
-						break;
-
-					case LLTYPE_S32:
-						{
-							LONG nData;
-							memcpy(&nData, &zerobuf[pos], sizeof(nData));
-							pos += sizeof(nData);
-							//dprintf("%s: %ld\n", lpVar->lpszVar, nData);
-						}
-						break;
-
-					case LLTYPE_S64:
-						break;
-
-					case LLTYPE_F8:
-						break;
-
-					case LLTYPE_F16:
-						break;
-
-					case LLTYPE_F32:
-						{
-							FLOAT fData;
-							memcpy(&fData, &zerobuf[pos], sizeof(fData));
-							pos += sizeof(fData);
-							//dprintf("%s: %f\n", lpVar->lpszVar, fData);
-						}
-						break;
-
-					case LLTYPE_F64:
-						{
-							double dData;
-							memcpy(&dData, &zerobuf[pos], sizeof(dData));
-							pos += sizeof(dData);
-							//dprintf("%s: %f\n", lpVar->lpszVar, dData);
-						}
-						break;
-
-					case LLTYPE_LLUUID:
-						{
-							BYTE bData[16];
-							memcpy(&bData, &zerobuf[pos], sizeof(bData));
-							pos += sizeof(bData);
-							//dprintf("%s: ", lpVar->lpszVar);
-							//for (int u = 0; u < sizeof(bData); u++)
-								//dprintf("%02x", bData[u]);
-							//dprintf("\n");
-						}
-						break;
-
-					case LLTYPE_BOOL:
-						{
-							BYTE bData;
-							memcpy(&bData, &zerobuf[pos], sizeof(bData));
-							pos += sizeof(bData);
-							//dprintf("%s: %s\n", lpVar->lpszVar, (bData) ? "True" : "False");
-						}
-						break;
-
-					case LLTYPE_LLVECTOR3:
-						{
-							FLOAT fData[3];
-							memcpy(&fData, &zerobuf[pos], sizeof(fData));
-							pos += sizeof(fData);
-							//dprintf("%s: %f, %f, %f\n", lpVar->lpszVar, fData[0], fData[1], fData[2]);
-						}
-						break;
-
-					case LLTYPE_LLVECTOR3D:
-						{
-							double dData[3];
-							memcpy(&dData, &zerobuf[pos], sizeof(dData));
-							pos += sizeof(dData);
-							//dprintf("%s: %f, %f, %f\n", lpVar->lpszVar, dData[0], dData[1], dData[2]);
-						}
-						break;
-					
-					/*case LLTYPE_VECTOR4:
-						{
-							FLOAT fData[4];
-							memcpy(&fData, &zerobuf[pos], sizeof(fData));
-							pos += sizeof(fData);
-							dprintf("%s: %f, %f, %f, %f\n", lpVar->lpszVar, fData[0], fData[1], fData[2], fData[3]);
-						}
-						break;*/
-
-					case LLTYPE_QUATERNION:
-						{
-							FLOAT fData[4];
-							memcpy(&fData, &zerobuf[pos], sizeof(fData));
-							pos += sizeof(fData);
-							//dprintf("%s: %f, %f, %f, %f\n", lpVar->lpszVar, fData[0], fData[1], fData[2], fData[3]);
-						}
-						break;
-
-					case LLTYPE_IPADDR:
-						{
-							BYTE ipData[4];
-							memcpy(&ipData, &zerobuf[pos], sizeof(ipData));
-							pos += sizeof(ipData);
-							//dprintf("%s: %hu.%hu.%hu.%hu\n", lpVar->lpszVar, ipData[0], ipData[1], ipData[2], ipData[3]);
-						}
-						break;
-
-					case LLTYPE_IPPORT:
-						{
-							WORD wData;
-							memcpy(&wData, &zerobuf[pos], sizeof(wData));
-							pos += sizeof(wData);
-							//dprintf("%s: %hu\n", lpVar->lpszVar, htons(wData));
-						}
-						break;
-
-					case LLTYPE_VARIABLE:
-						{
-							if (lpVar->nTypeLen == 1)
-							{
-								BYTE cDataLen;
-								LPBYTE lpData = NULL;
-
-								memcpy(&cDataLen, &zerobuf[pos], sizeof(cDataLen));
-								pos += sizeof(cDataLen);
-							
-								if (cDataLen > 0)
-									lpData = (LPBYTE)malloc(cDataLen);
-
-								if (lpData)
-									memcpy(lpData, &zerobuf[pos], cDataLen);
-
-								pos += cDataLen;
-
-								if (lpData)
-								{
-									bool bPrintable = true;
-
-									for (int j = 0; j < cDataLen - 1; j++)
-									{
-										if (((unsigned char)lpData[j] < 0x20 || (unsigned char)lpData[j] > 0x7E) && (unsigned char)lpData[j] != 0x09 && (unsigned char)lpData[j] != 0x0D)
-											bPrintable = false;
-									}
-
-									if (bPrintable && lpData[cDataLen - 1] == '\0')
-									{
-										//dprintf("%s: %s\n", lpVar->lpszVar, lpData);
-									}
-									else
-									{
-										for (int j = 0; j < cDataLen; j += 16)
-										{
-											//dprintf("%s: ", lpVar->lpszVar);
-
-											for (int k = 0; k < 16; k++)
-											{
-												if ((j + k) < cDataLen)
-												{
-													//dprintf("%02x ", (unsigned char)lpData[j+k]);
-												}
-												else
-												{
-													//dprintf("   ");
-												}
-											}
-
-											for (int k = 0; k < 16 && (j + k) < cDataLen; k++)
-											{
-												//dprintf("%c", ((unsigned char)lpData[j+k] >= 0x20 && (unsigned char)lpData[j+k] <= 0x7E) ? (unsigned char)lpData[j+k] : '.');
-											}
-
-											//dprintf("\n");
-										}
-									}
-								}
-
-								SAFE_FREE(lpData);
-							}
-							else if (lpVar->nTypeLen == 2)
-							{
-								WORD cDataLen;
-								LPBYTE lpData = NULL;
-
-								memcpy(&cDataLen, &zerobuf[pos], sizeof(cDataLen));
-								pos += sizeof(cDataLen);
-							
-								if (cDataLen > 0)
-									lpData = (LPBYTE)malloc(cDataLen);
-
-								if (lpData)
-									memcpy(lpData, &zerobuf[pos], cDataLen);
-
-								pos += cDataLen;
-
-								if (lpData)
-								{
-									bool bPrintable = true;
-
-									for (int j = 0; j < cDataLen - 1; j++)
-									{
-										if (((unsigned char)lpData[j] < 0x20 || (unsigned char)lpData[j] > 0x7E) && (unsigned char)lpData[j] != 0x09 && (unsigned char)lpData[j] != 0x0D)
-											bPrintable = false;
-									}
-
-									if (bPrintable && lpData[cDataLen - 1] == '\0')
-									{
-										//dprintf("%s: %s\n", lpVar->lpszVar, lpData);
-									}
-									else
-									{
-										for (int j = 0; j < cDataLen; j += 16)
-										{
-											//dprintf("%s: ", lpVar->lpszVar);
-
-											for (int k = 0; k < 16; k++)
-											{
-												if ((j + k) < cDataLen)
-												{
-													//dprintf("%02x ", (unsigned char)lpData[j+k]);
-												}
-												else
-												{
-													//dprintf("   ");
-												}
-											}
-
-											for (int k = 0; k < 16 && (j + k) < cDataLen; k++)
-											{
-												//dprintf("%c", ((unsigned char)lpData[j+k] >= 0x20 && (unsigned char)lpData[j+k] <= 0x7E) ? (unsigned char)lpData[j+k] : '.');
-											}
-
-											//dprintf("\n");
-										}
-									}
-								}
-			
-								SAFE_FREE(lpData);
-							}
-						}
-						break;
-
-					case LLTYPE_FIXED:
-						{
-							LPBYTE lpData = NULL;
-
-							if (lpVar->nTypeLen > 0)
-								lpData = (LPBYTE)malloc(lpVar->nTypeLen);
-
-							if (lpData)
-								memcpy(lpData, &zerobuf[pos], lpVar->nTypeLen);
-
-							pos += lpVar->nTypeLen;
-
-							if (lpData)
-							{
-								bool bPrintable = true;
-
-								for (int j = 0; j < lpVar->nTypeLen - 1; j++)
-								{
-									if (((unsigned char)lpData[j] < 0x20 || (unsigned char)lpData[j] > 0x7E) && (unsigned char)lpData[j] != 0x09 && (unsigned char)lpData[j] != 0x0D)
-										bPrintable = false;
-								}
-
-								if (bPrintable && lpData[lpVar->nTypeLen - 1] == '\0')
-								{
-									//dprintf("%s: %s\n", lpVar->lpszVar, lpData);
-								}
-								else
-								{
-									for (int j = 0; j < lpVar->nTypeLen; j += 16)
-									{
-										//dprintf("%s: ", lpVar->lpszVar);
-
-										for (int k = 0; k < 16; k++)
-										{
-											if ((j + k) < lpVar->nTypeLen)
-											{
-												//dprintf("%02x ", (unsigned char)lpData[j+k]);
-											}
-											else
-											{
-												//dprintf("   ");
-											}
-										}
-
-										for (int k = 0; k < 16 && (j + k) < lpVar->nTypeLen; k++)
-										{
-											//dprintf("%c", ((unsigned char)lpData[j+k] >= 0x20 && (unsigned char)lpData[j+k] <= 0x7E) ? (unsigned char)lpData[j+k] : '.');
-										}
-
-										//dprintf("\n");
-									}
-								}
-							}
-
-							SAFE_FREE(lpData);
-						}
-						break;
-
-					case LLTYPE_SINGLE:
-					case LLTYPE_MULTIPLE:
-					case LLTYPE_NULL:
-					default:
-						break;
-				}
-				
-				lpVar = lpVar->lpNext;
-			}
-		}
-
-		lpStruct = lpStruct->lpNext;
-	}
-}
-
-CMessage * WINAPI map_command(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
-{
-//	dprintf("--- %s ---\n", lpCommand->lpszCmd);
-
-	int oldPos = pos;
-
-	CMessage *msg = new CMessage;
-
-	if (!msg)
-		return NULL;
-
-	msg->SetCommand(lpCommand->lpszCmd);
-
-	LPCOMMANDSTRUCT lpStruct = lpCommand->structs;
-
-	while (lpStruct)
-	{
-		//dprintf("\t%04d %s (%s / %hu)\n", lpStruct->nKeywordPos, lpStruct->lpszStruct, LLTYPES[lpStruct->nType], lpStruct->cItems);
-		BYTE cItems = 1;
-
-		if (lpStruct->nType == LLTYPE_VARIABLE)
-		{
-			memcpy(&cItems, &zerobuf[pos], sizeof(cItems));
-			pos += sizeof(cItems);
-		}
-		else if (lpStruct->nType == LLTYPE_MULTIPLE)
-		{
-			cItems = lpStruct->cItems;
-		}
-
-		for (BYTE c = 0; c < cItems; c++)
-		{
-			//dprintf("--- %s ----\n", lpStruct->lpszStruct);
-			CBlock *block = new CBlock;
-			msg->AddBlock(lpStruct->lpszStruct, lpStruct->nType, block);
-
-			LPCOMMANDVAR lpVar = lpStruct->vars;
-
-			while (lpVar)
-			{
-				//dprintf("\t\t%04d %s (%s / %d)\n", lpVar->nKeywordPos, lpVar->lpszVar, LLTYPES[lpVar->nType], lpVar->nTypeLen);
-				CVar *var = new CVar;
-				var->SetVar(lpVar->lpszVar);
-				var->SetType(lpVar->nType, lpVar->nTypeLen);
-				pos += var->SetData((LPBYTE)&zerobuf[pos]);
-				block->AddVar(var);
-				lpVar = lpVar->lpNext;
-			}
-		}
-
-		lpStruct = lpStruct->lpNext;
-	}
-
-	BYTE bPack[4096];
-	int nPackedSize = msg->Pack(bPack);
-	int diff = memcmp(bPack, &zerobuf[oldPos], nPackedSize);
-
-	if (diff)
-	{
-		msg->Dump();
-		dprintf("PACKED: %d / %d (%d) ===> %d\n", nPackedSize, *len, oldPos, diff);
-	}
-
-	return msg;
-}
-
-void WINAPI cmd_Silent(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
-{
-}
-
-void WINAPI cmd_Default(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
-{
-	//dprintf("Flags: %u\n", zerobuf[0]);
-	CMessage *msg = map_command(lpCommand, server, zerobuf, len, pos);
-	msg->Dump();
-	SAFE_DELETE(msg);
-}
-
-void WINAPI cmd_LoginReply(LPCOMMAND lpCommand, CServer *server, char *zerobuf, int *len, int pos)
-{
-	parse_command(lpCommand, server, zerobuf, len, pos);
-}
-
-CMDHOOK pCMDHooks[] = {
-	{ _T("Default"),					(PROC)cmd_Default			},
-	{ _T("DirLandReply"),				(PROC)cmd_Silent			}, // Silence the most common
-	{ _T("AvatarAnimation"),			(PROC)cmd_Silent			}, // packets
-	{ _T("CoarseLocationUpdate"),		(PROC)cmd_Silent			},
-	{ _T("CompletePingCheck"),			(PROC)cmd_Silent			},
-	{ _T("LayerData"),					(PROC)cmd_Silent			},
-	{ _T("PacketAck"),					(PROC)cmd_Silent			},
-	{ _T("StartPingCheck"),				(PROC)cmd_Silent			},
-	{ _T("SimulatorViewerTimeMessage"),	(PROC)cmd_Silent			},
-	{ _T("ImagePacket"),				(PROC)cmd_Silent			},
-	{ _T("TransferPacket"),				(PROC)cmd_Silent			},
-	{ _T("ObjectUpdate"),				(PROC)cmd_Silent			},
-	{ _T("ObjectUpdateCompressed"),		(PROC)cmd_Silent			},
-	{ _T("AgentThrottle"),				(PROC)cmd_Silent			},
-	{ _T("CoarseLocationUpdate"),		(PROC)cmd_Silent			},
-	{ _T("UUIDNameReply"),				(PROC)cmd_Silent			},
-	{ _T("RequestImage"),				(PROC)cmd_Silent			},
-	{ _T("ImageData"),					(PROC)cmd_Silent			},
-	{ _T("SimStats"),					(PROC)cmd_Silent			},
-	{ _T("ViewerEffect"),				(PROC)cmd_Silent			},
-	{ _T("TransferRequest"),			(PROC)cmd_Silent			},
-	{ _T("DirClassifiedReply"),			(PROC)cmd_Silent			},
-	{ _T("DirEventsReply"),				(PROC)cmd_Silent			},
-	{ _T("DirPopularReply"),			(PROC)cmd_Silent			},
-	{ _T("DirLandReply"),				(PROC)cmd_Silent			},
-	{ _T("AgentUpdate"),				(PROC)cmd_Silent			},
-	{ _T("ObjectUpdateCached"),			(PROC)cmd_Silent			},
-	{ _T("ImprovedTerseObjectUpdate"),	(PROC)cmd_Silent			},
-	{ _T("RequestMultipleObjects"),		(PROC)cmd_Silent			},
-	{ _T("AttachedSound"),				(PROC)cmd_Silent			},
-	{ _T("ViewerStats"),				(PROC)cmd_Silent			},
-	{ _T("TransferInfo"),				(PROC)cmd_Silent			},
-	{ _T("ParcelOverlay"),				(PROC)cmd_Silent			},
-	{ _T("SendXferPacket"),				(PROC)cmd_Silent			},
-	{ _T("DirPlacesReply"),				(PROC)cmd_Silent			},
-	{ NULL,								NULL						}
-};
-
-int decomm()
-{
-	FILE *fpComm;
-	FILE *fpMsg;
-
-	fpComm = fopen(g_pConfig->m_pCommDatPath, "rb");
-
-	if (!fpComm)
-	{
-		printf("Couldn't open %s for reading, aborting...\n", g_pConfig->m_pCommDatPath);
-		return -1;
-	}
-
-	fpMsg = fopen(g_pConfig->m_pMessageTemplatePath, "wb");
-
-	if (!fpMsg)
-	{
-		printf("Couldn't open %s for writing, aborting...\n", g_pConfig->m_pMessageTemplatePath);
-		return -1;
-	}
-
-	printf("Decrypting %s to %s\n", g_pConfig->m_pCommDatPath, g_pConfig->m_pMessageTemplatePath);
-	static unsigned char ucMagicKey = 0;
-	long lTemplateSize = 0;
-
-	fseek(fpComm, 0, SEEK_END);
-	lTemplateSize = ftell(fpComm);
-	fseek(fpComm, 0, SEEK_SET);
-
-	BYTE buffer[2048];
-	BYTE stripped[2048];
-	LPBYTE lpTemplate = (LPBYTE)malloc(lTemplateSize);
-	DWORD dwTemplateWrote = 0;
-
-	if (!lpTemplate)
-		return -1;
-
-	bool bComment = false;
-
-	while (!feof(fpComm))
-	{
-		size_t stRead = fread(&buffer, 1, sizeof(buffer), fpComm);
-		size_t stStripped = 0;
-
-		for (size_t stCount = 0; stCount < stRead; stCount++)
-		{
-			buffer[stCount] ^= ucMagicKey;
-
-			if (!bComment && buffer[stCount] != '/')
-				stripped[stStripped++] = buffer[stCount];
-
-			if (bComment && buffer[stCount] == '\n')
-				bComment = false;
-
-			if (!bComment && buffer[stCount] == '/')
-				bComment = true;
-
-			ucMagicKey += 43;
-		}
-
-		memcpy(lpTemplate + dwTemplateWrote, &stripped, stStripped);
-		dwTemplateWrote += (DWORD)stStripped;
-		
-		size_t stWrote = fwrite(&stripped, 1, stStripped, fpMsg);
-
-		printf(".");
-		fflush(stdout);
-	}
-
-	printf("\nDone.\n");
-
-	printf("template size: %ld\n", lTemplateSize);
-
-	ZeroMemory(&cmds_low, sizeof(cmds_low));
-	ZeroMemory(&cmds_med, sizeof(cmds_med));
-	ZeroMemory(&cmds_high, sizeof(cmds_high));
-
-	get_command_blocks(lpTemplate, 0, lTemplateSize);
-	
-	fclose(fpComm);
-	fclose(fpMsg);
-
-	for (int i = 1; i < MAX_COMMANDS_LOW; i++)
-	{
-		if (cmds_low[i].lpszCmd)
-		{
-			//dprintf("LOW %05d - %s - %s - %s\n", i, cmds_low[i].lpszCmd, cmds_low[i].bTrusted ? "Trusted" : "Untrusted", cmds_low[i].bZerocoded ? "Zerocoded" : "Unencoded");
-			dump_structs(cmds_low[i].structs);
-			//SAFE_FREE(cmds_low[i].lpszCmd);
-		}
-	}
-
-	for (int i = 1; i < MAX_COMMANDS_MEDIUM; i++)
-	{
-		if (cmds_med[i].lpszCmd)
-		{
-			//dprintf("Medium %05d - %s\n", i, cmds_med[i].lpszCmd);
-			dump_structs(cmds_med[i].structs);
-			//SAFE_FREE(cmds_med[i].lpszCmd);
-		}
-	}
-
-	for (int i = 1; i < MAX_COMMANDS_HIGH; i++)
-	{
-		if (cmds_high[i].lpszCmd)
-		{
-			//dprintf("High %05d - %s\n", i, cmds_high[i].lpszCmd);
-			dump_structs(cmds_high[i].structs);
-			//SAFE_FREE(cmds_high[i].lpszCmd);
-		}
-	}
+	APIHOOK_GLGETERROR,
+	APIHOOK_GLBEGIN,
+	APIHOOK_GLENABLE,
+	APIHOOK_GLISENABLED,
+	APIHOOK_GLTRANSLATED,
+	APIHOOK_GLTRANSLATEF,
+	APIHOOK_GLTEXCOORD2F,
+	APIHOOK_GLTEXCOORD2FV,
+	APIHOOK_GLVERTEX2F,
+	APIHOOK_GLVERTEX3F,
+	APIHOOK_GLVERTEX3FV,
+	APIHOOK_GLVERTEX4F,
+	APIHOOK_GLVERTEX4FV,
+	APIHOOK_GLVERTEXPOINTER,
+	APIHOOK_GLTEXCOORDPOINTER,
+	APIHOOK_GLNORMALPOINTER,
+	APIHOOK_GLDRAWELEMENTS,
+	APIHOOK_GLDRAWARRAYS,
+	APIHOOK_GLDRAWPIXELS,
+	APIHOOK_GLTEXIMAGE2D,
+	APIHOOK_GLCOLOR3F,
+	APIHOOK_GLCOLOR3FV,
+	APIHOOK_GLCOLOR4F,
+	APIHOOK_GLCOLOR4FV,
+	APIHOOK_GLCOLOR4UBV,
+	APIHOOK_GLCOLORPOINTER,
+	APIHOOK_GLVIEWPORT,
+	APIHOOK_GLFLUSH,
+	APIHOOK_GLUPERSPECTIVE,
+	APIHOOK_GLUQUADRICDRAWSTYLE,
+	APIHOOK_GLUTESSVERTEX,
+	APIHOOK_NULL
+};
 
-	return 0;
-}
+bool InstallSLHooks(HWND hwnd);
+bool RemoveSLHooks();
+void InstallImportHooks();
+void RemoveImportHooks();
+void SaveImportHooks();
 
 HMODULE WINAPI new_LoadLibraryA(
 	LPCSTR lpLibFileName
@@ -1558,12 +347,6 @@ int WINAPI new_recvfrom(
 	)
 {
 	int nRes = 0;
-	WORD wSeq = 0;
-	int zerolen = 0;
-	static char zerobuf[8192];
-	bool bZerocoded = false;
-	CServer *server = NULL;
-	CSequence *sequence = NULL;
 
 	nRes = ((int (WINAPI *)(SOCKET, char *, int, int, struct sockaddr *, int *))pAPIHooks[APIHOOK_RECVFROM].pOldProc)(s, buf, len, flags, from, fromlen);
 
@@ -1574,118 +357,23 @@ int WINAPI new_recvfrom(
 	{
 		//dprintf("Receiving %u bytes\n", nRes);
 
-		// Get packet sequence number
-		memcpy(&wSeq, &buf[2], sizeof(wSeq));
-		wSeq = htons(wSeq);
-
-		// Get current server
-		server = servers.FindServer((struct sockaddr_in *)from);
-
-		// If server isn't in our list add it as new
-		if (!server)
-		{
-			server = new CServer((struct sockaddr_in *)from);
-			servers.AddServer(server);
-		}
-
-		// Handle packet acks
-		BYTE bAppended[4096];
-		int nAppendedLen = 0;
-
-		if (buf[0] & MSG_APPENDED_ACKS)
-		{
-			//dprintf("APPENDED ACKS\n");
-
-			BYTE cPacketsItems = buf[nRes - 1];
-			
-			int nOldRes = nRes;
-
-			nRes = nOldRes - 1 - (cPacketsItems * sizeof(DWORD));
-			//dprintf("NEW AND OLD: %d / %d\n", nRes, nOldRes);
-			nAppendedLen = nOldRes - nRes;
-			memcpy(bAppended, &buf[nRes], nAppendedLen);
-		}
-		zerolen = ZeroDecode(buf, nRes, zerobuf, sizeof(zerobuf));
-
-		if ((unsigned char)buf[4] != 0xff)
-		{
-			// High
-			//dprintf("parse high: %hu\n", zerobuf[4]);
-
-			bool bCmdFound = false;
-
-			for (int j = 0; pCMDHooks[j].szCommand; j++)
-			{
-				if (_tcsicmp(cmds_high[zerobuf[4]].lpszCmd, pCMDHooks[j].szCommand) == 0 && pCMDHooks[j].pProc != NULL && !IsBadCodePtr(pCMDHooks[j].pProc))
-				{
-					bCmdFound = true;
-					((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pCMDHooks[j].pProc)(&cmds_high[zerobuf[4]], server, zerobuf, &zerolen, 5);
-					break;
-				}
-			}
-
-			if (!bCmdFound)
-			{
-				((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pCMDHooks[0].pProc)(&cmds_high[zerobuf[4]], server, zerobuf, &zerolen, 5);
-			}
-		}
-
-		else if ((unsigned char)buf[5] != 0xff)
-		{
-			// Medium
-			//dprintf("parse med: %hu\n", zerobuf[5]);
-
-			bool bCmdFound = false;
-
-			for (int j = 0; pCMDHooks[j].szCommand; j++)
-			{
-				if (!_tcsicmp(cmds_med[zerobuf[5]].lpszCmd, pCMDHooks[j].szCommand) && pCMDHooks[j].pProc != NULL && !IsBadCodePtr(pCMDHooks[j].pProc))
-				{
-					bCmdFound = true;
-					((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pCMDHooks[j].pProc)(&cmds_med[zerobuf[5]], server, zerobuf, &zerolen, 6);
-					break;
-				}
-			}
+		capture.Write((LPBYTE)buf, nRes, (struct sockaddr_in *)from, false);
+		archive.Write((LPBYTE)buf, nRes, (struct sockaddr_in *)from, false);
 
-			if (!bCmdFound)
-			{
-				((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pCMDHooks[0].pProc)(&cmds_med[zerobuf[5]], server, zerobuf, &zerolen, 6);
-			}
-		}
-		
-		else if ((unsigned char)buf[4] == 0xff && (unsigned char)buf[5] == 0xff)
+		// Sharded decoding only observes, so the packet goes back as it came
+		if (shards.m_nShards)
 		{
-			// Fixed
-			// Low
-
-			//dprintf("parse low: %hu\n", htons(wFreq));
-
-			bool bCmdFound = false;
-			WORD wFreq;
-			memcpy(&wFreq, &zerobuf[6], sizeof(wFreq));
-
-			for (int j = 0; pCMDHooks[j].szCommand; j++)
-			{
-				if (!_tcsicmp(cmds_low[htons(wFreq)].lpszCmd, pCMDHooks[j].szCommand) && pCMDHooks[j].pProc != NULL && !IsBadCodePtr(pCMDHooks[j].pProc))
-				{
-					bCmdFound = true;
-					((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pCMDHooks[j].pProc)(&cmds_low[htons(wFreq)], server, zerobuf, &zerolen, 8);
-					break;
-				}
-			}
-
-			if (!bCmdFound)
-			{
-				((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pCMDHooks[0].pProc)(&cmds_low[htons(wFreq)], server, zerobuf, &zerolen, 8);
-			}
+			shards.Submit((LPBYTE)buf, nRes, (struct sockaddr_in *)from, false, false, CLatency::GetWallTime());
+			return nRes;
 		}
 
-		nRes = ZeroEncode(zerobuf, zerolen, buf, len);
+		nRes = receive_packet(&servers, (LPBYTE)buf, nRes, len, (struct sockaddr_in *)from, NULL);
 
-		if (nAppendedLen > 0)
+		if (nRes < 0)
 		{
-			memcpy(&buf[nRes], bAppended, nAppendedLen);
-			nRes += nAppendedLen;
+			dprintf("[recvfrom] Re-encoded packet doesn't fit in %d bytes\n", len);
+			WSASetLastError(WSAEMSGSIZE);
+			nRes = SOCKET_ERROR;
 		}
 	}
 	else
@@ -1713,6 +401,24 @@ int WINAPI new_send(
 	return nRes;
 }
 
+// The original sendto, called by send_packet once the body is decoded
+typedef struct
+{
+	SOCKET s;
+	char *buf;
+	int len;
+	int flags;
+	struct sockaddr *to;
+	int tolen;
+} SENDTOARGS;
+
+static int send_original(LPVOID lpParam)
+{
+	SENDTOARGS *args = (SENDTOARGS *)lpParam;
+
+	return ((int (WINAPI *)(SOCKET, char *, int, int, struct sockaddr *, int))pAPIHooks[APIHOOK_SENDTO].pOldProc)(args->s, args->buf, args->len, args->flags, args->to, args->tolen);
+}
+
 int WINAPI new_sendto(
 	SOCKET s,
 	char *buf,
@@ -1722,186 +428,18 @@ int WINAPI new_sendto(
 	int tolen
 	)
 {
-	int nRes = 0;
-	WORD wSeq = 0;
-	int zerolen = 0;
-	char *zerobuf = NULL;
-	bool bZerocoded = false;
-	CServer *server = NULL;
-	CSequence *sequence = NULL;
-
-	// Get packet sequence number
-	memcpy(&wSeq, &buf[2], sizeof(wSeq));
-	wSeq = htons(wSeq);
-
-	// Get current server
-	server = servers.FindServer((struct sockaddr_in *)to);
-
-	// If server isn't in our list add it as new
-	if (!server)
-	{
-		server = new CServer((struct sockaddr_in *)to);
-		servers.AddServer(server);
-	}
-
-	static int nDropPacket = 0;
-
-	if (buf[0] & MSG_ZEROCODED)
-	{
-		bZerocoded = true;
-		zerolen = 4;
-
-		for (int i = 4; i < len; i++)
-		{
-			if ((unsigned char)buf[i] == 0x00)
-				zerolen += (unsigned char)buf[++i];
-			else
-				zerolen++;
-		}
-
-		zerobuf = (char *)malloc(zerolen);
-
-		if (!zerobuf)
-		{
-			dprintf("Couldn't allocate memory for zerocoded buffer\n");
-			return -1;
-		}
-
-		int j = 4;
-		memcpy(zerobuf, buf, 4);
-		
-		for (int i = 4; i < len; i++)
-		{
-			if ((unsigned char)buf[i] == 0x00)
-			{
-				for (int z = 0; z < (unsigned char)buf[i+1]; z++)
-					zerobuf[j++] = 0x00;
-
-				i++;
-			}
-			else
-				zerobuf[j++] = buf[i];
-		}
-	}
-	else
-	{
-		zerolen = len;
-		zerobuf = buf;
-	}
-
-	nRes = ((int (WINAPI *)(SOCKET, char *, int, int, struct sockaddr *, int))pAPIHooks[APIHOOK_SENDTO].pOldProc)(s, buf, len, flags, to, tolen);
-
-	// !!!
-	//return nRes;
-
-	//dprintf("Sending %u bytes\n", nRes);
-
-	if ((unsigned char)buf[4] != 0xff)
-	{
-		// High
-		//dprintf("parse high: %hu\n", zerobuf[4]);
-
-		bool bCmdFound = false;
-
-		for (int j = 0; pCMDHooks[j].szCommand; j++)
-		{
-			if (_tcsicmp(cmds_high[zerobuf[4]].lpszCmd, pCMDHooks[j].szCommand) == 0 && pCMDHooks[j].pProc != NULL && !IsBadCodePtr(pCMDHooks[j].pProc))
-			{
-				bCmdFound = true;
-				((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pCMDHooks[j].pProc)(&cmds_high[zerobuf[4]], server, zerobuf, &zerolen, 5);
-				break;
-			}
-		}
-
-		if (!bCmdFound)
-		{
-			((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pCMDHooks[0].pProc)(&cmds_high[zerobuf[4]], server, zerobuf, &zerolen, 5);
-		}
-	}
-
-	else if ((unsigned char)buf[5] != 0xff)
-	{
-		// Medium
-		//dprintf("parse med: %hu\n", zerobuf[5]);
-
-		bool bCmdFound = false;
-
-		for (int j = 0; pCMDHooks[j].szCommand; j++)
-		{
-			if (!_tcsicmp(cmds_med[zerobuf[5]].lpszCmd, pCMDHooks[j].szCommand) && pCMDHooks[j].pProc != NULL && !IsBadCodePtr(pCMDHooks[j].pProc))
-			{
-				bCmdFound = true;
-				((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pCMDHooks[j].pProc)(&cmds_med[zerobuf[5]], server, zerobuf, &zerolen, 6);
-				break;
-			}
-		}
-
-		if (!bCmdFound)
-		{
-			((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pCMDHooks[0].pProc)(&cmds_med[zerobuf[5]], server, zerobuf, &zerolen, 6);
-		}
-	}
-	
-	else if ((unsigned char)buf[4] == 0xff && (unsigned char)buf[5] == 0xff)
-	{
-		// Fixed
-		// Low
+	SENDTOARGS args = { s, buf, len, flags, to, tolen };
 
-		//dprintf("parse low: %hu\n", htons(wFreq));
-
-		bool bCmdFound = false;
-		WORD wFreq;
-		memcpy(&wFreq, &zerobuf[6], sizeof(wFreq));
-
-		for (int j = 0; pCMDHooks[j].szCommand; j++)
-		{
-			if (!_tcsicmp(cmds_low[htons(wFreq)].lpszCmd, pCMDHooks[j].szCommand) && pCMDHooks[j].pProc != NULL && !IsBadCodePtr(pCMDHooks[j].pProc))
-			{
-				bCmdFound = true;
-				((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pCMDHooks[j].pProc)(&cmds_low[htons(wFreq)], server, zerobuf, &zerolen, 8);
-				break;
-			}
-		}
+	capture.Write((LPBYTE)buf, len, (struct sockaddr_in *)to, true);
+	archive.Write((LPBYTE)buf, len, (struct sockaddr_in *)to, true);
 
-		if (!bCmdFound)
-		{
-			((void (WINAPI *)(LPCOMMAND, CServer *, char *, int *, int))pCMDHooks[0].pProc)(&cmds_low[htons(wFreq)], server, zerobuf, &zerolen, 8);
-		}
-	}
-	else
+	if (shards.m_nShards)
 	{
-		dprintf("[sendto] *** UNKNOWN FREQUENCY TYPE ***\n", s);
-		int i, j;
-
-		for (i = 0; i < len + 16; i += 16)
-		{
-			for (j = 0; j < 16; j++)
-			{
-				if ((i + j) < len)
-				{
-					dprintf("%02x ", (unsigned char)buf[i+j]);
-				}
-				else
-				{
-					dprintf("   ");
-				}
-			}
-			
-			for (j = 0; j < 16 && (i + j) < len; j++)
-			{
-				dprintf("%c", isprint(buf[i+j]) ? (unsigned char)buf[i+j] : '.');
-			}
-
-			dprintf("\n");
-		}
-
-		dprintf("\n");
+		shards.Submit((LPBYTE)buf, len, (struct sockaddr_in *)to, true, false, CLatency::GetWallTime());
+		return send_original(&args);
 	}
 
-	if (bZerocoded && zerobuf)
-		free(zerobuf);
-
-	return nRes;
+	return send_packet(&servers, (LPBYTE)buf, len, (struct sockaddr_in *)to, send_original, &args, NULL);
 }
 
 /*
@@ -2773,6 +1311,113 @@ void RemoveImportHooks()
 	}
 }
 
+// Packets replayed per shard count, repeating the capture as needed
+#define SHARD_BENCHMARK_PACKETS	200000
+
+// rundll32 snowflake.dll,ShardBenchmark <capture> [max shards]
+// Replays a capture through 1 to N shards, N defaulting to the number of
+// processors, and writes the throughput of each to <capture>.shards.txt
+extern "C" void CALLBACK ShardBenchmark(HWND hwnd, HINSTANCE hinst, LPSTR lpszCmdLine, int nCmdShow)
+{
+	char szCapture[MAX_PATH];
+	char szReport[MAX_PATH + 16];
+	char *lpszArgs = lpszCmdLine;
+	int nLen = 0;
+	SYSTEM_INFO si;
+
+	while (*lpszArgs == ' ')
+		lpszArgs++;
+
+	char cEnd = (*lpszArgs == '"') ? *lpszArgs++ : ' ';
+
+	while (*lpszArgs && *lpszArgs != cEnd && nLen < MAX_PATH - 1)
+		szCapture[nLen++] = *lpszArgs++;
+
+	szCapture[nLen] = '\0';
+
+	if (*lpszArgs)
+		lpszArgs++;
+
+	GetSystemInfo(&si);
+
+	int nMaxShards = atoi(lpszArgs);
+
+	if (nMaxShards <= 0)
+		nMaxShards = (int)si.dwNumberOfProcessors;
+
+	if (!g_pConfig)
+		g_pConfig = new CConfig();
+
+	if (!cmds_count && decomm(g_pConfig->m_pCommDatPath, g_pConfig->m_pMessageTemplatePath) < 0)
+		return;
+
+	CCapture replay;
+
+	if (!replay.Load(szCapture) || !replay.m_nRecords)
+		return;
+
+	wsprintf(szReport, "%s.shards.txt", szCapture);
+
+	FILE *fp = fopen(szReport, "w");
+
+	if (!fp)
+		return;
+
+	// Every pass replays the same sequence numbers, so don't let the
+	// duplicate window skip the later ones
+	duplicate_policy = DUPLICATE_DECODE;
+
+	int nPasses = (SHARD_BENCHMARK_PACKETS + replay.m_nRecords - 1) / replay.m_nRecords;
+	double dBase = 0;
+
+	fprintf(fp, "Shards\tPackets\tMilliseconds\tPacketsPerSecond\tSpeedup\n");
+
+	for (int nShards = 1; nShards <= nMaxShards; nShards++)
+	{
+		if (!shards.Start(nShards, cmds_count))
+			break;
+
+		DWORD dwStart = CLatency::GetTime();
+
+		for (int i = 0; i < nPasses; i++)
+		{
+			CAPTURERECORD *record;
+			LPBYTE lpData;
+			struct sockaddr_in address;
+
+			ZeroMemory(&address, sizeof(address));
+			address.sin_family = AF_INET;
+
+			replay.Rewind();
+
+			while (replay.Next(&record, &lpData))
+			{
+				address.sin_addr.s_addr = record->dwAddress;
+				address.sin_port = record->wPort;
+				shards.Submit(lpData, record->wLen, &address, (record->cFlags & CAPTURE_SENT) != 0, true, CLatency::GetWallTime());
+			}
+		}
+
+		shards.Wait();
+
+		DWORD dwElapsed = CLatency::GetTime() - dwStart;
+		DWORD dwProcessed = shards.GetProcessed();
+		double dRate = dwElapsed ? dwProcessed * 1000000.0 / dwElapsed : 0;
+
+		if (nShards == 1)
+			dBase = dRate;
+
+		fprintf(fp, "%d\t%lu\t%lu\t%.0f\t%.2f\n", nShards, dwProcessed, dwElapsed / 1000, dRate, dBase ? dRate / dBase : 0);
+		fflush(fp);
+
+		shards.Stop();
+	}
+
+	fclose(fp);
+}
+
+#pragma comment(linker, "/EXPORT:ShardBenchmark=_ShardBenchmark@16")
+
 BOOL APIENTRY DllMain( HANDLE hModule, 
                        DWORD  ul_reason_for_call, 
                        LPVOID lpReserved
@@ -2800,10 +1445,43 @@ BOOL APIENTRY DllMain( HANDLE hModule,
 				
 				if (!fpLog)
 					fpLog = fopen(g_pConfig->m_pSnowcrashTxtPath, "w");
+
+				// Console and log writes happen on the flusher, not the hooked threads
+				logger.Start(fpLog, g_pConfig->GetConfigInt("Log", "Policy", LOG_DROP), g_pConfig->GetConfigInt("Log", "RingSize", LOG_RING_LEN));
 #endif
 				dprintf(_T("[snowflake] %s\n"), szPath);
 
-				decomm();
+				verifier.SetMode(g_pConfig->GetConfigInt("Verify", "Mode", VERIFY_SAMPLE), g_pConfig->GetConfigInt("Verify", "Count", 64));
+				duplicate_policy = g_pConfig->GetConfigInt("Duplicates", "Policy", DUPLICATE_SKIP);
+
+				decomm(g_pConfig->m_pCommDatPath, g_pConfig->m_pMessageTemplatePath);
+
+				engine.Start(cmds_count);
+				shards.Start(g_pConfig->GetConfigInt("Shards", "Count", 0), cmds_count);
+
+				char szCapture[MAX_PATH];
+				UINT nCaptureLen = sizeof(szCapture);
+
+				g_pConfig->GetConfigString("Capture", "Path", szCapture, &nCaptureLen, "");
+
+				if (szCapture[0])
+					capture.Create(szCapture);
+
+				char szArchive[MAX_PATH];
+				UINT nArchiveLen = sizeof(szArchive);
+
+				g_pConfig->GetConfigString("Archive", "Path", szArchive, &nArchiveLen, "");
+
+				if (szArchive[0])
+					archive.Create(szArchive);
+
+				char szTrace[MAX_PATH];
+				UINT nTraceLen = sizeof(szTrace);
+
+				g_pConfig->GetConfigString("Trace", "Path", szTrace, &nTraceLen, "");
+
+				if (szTrace[0])
+					trace.Create(szTrace, g_pConfig->GetConfigInt("Trace", "Policy", LOG_DROP));
 
 				SaveImportHooks();
 				InstallImportHooks();
@@ -2813,6 +1491,15 @@ BOOL APIENTRY DllMain( HANDLE hModule,
 	{
 		RemoveSLHooks();
 		RemoveImportHooks();
+
+		// This holds the loader lock: no thread can be waited for. At process
+		// exit the workers are already gone, so there is nothing to save;
+		// otherwise StopSnowflake() has had to run before the unload.
+		if (lpReserved)
+			return TRUE;
+
+		engine.Stop();
+		capture.Close();
 #ifdef ECHO
 		FreeConsole();
 		
@@ -2828,6 +1515,59 @@ BOOL APIENTRY DllMain( HANDLE hModule,
 	return TRUE;
 }
 
+static volatile LONG lStopped = 0;
+
+// Unhook, drain the shards, write the reports, and stop the workers and
+// writers, flushing what they still hold. Runs when the viewer's window
+// goes, or from whoever loaded us before calling FreeLibrary; never from
+// DllMain, where none of those threads can be joined.
+SNOWFLAKE_API void StopSnowflake(void)
+{
+	if (InterlockedExchange(&lStopped, 1))
+		return;
+
+	RemoveImportHooks();
+
+	shards.Wait();
+	shards.MergeStats();
+	engine.MergeStats();
+
+	if (g_pConfig && verifier.m_nMode != VERIFY_OFF)
+	{
+		FILE *fpReport = fopen(g_pConfig->m_pVerifyReportPath, "w");
+
+		if (fpReport)
+		{
+			verifier.Report(fpReport);
+			fclose(fpReport);
+		}
+	}
+
+	if (g_pConfig)
+	{
+		FILE *fpLatency = fopen(g_pConfig->m_pLatencyReportPath, "w");
+
+		if (fpLatency)
+		{
+			servers.ReportLatency(fpLatency);
+
+			for (int i = 0; i < shards.m_nShards; i++)
+				shards.m_lpShards[i].m_servers.ReportLatency(fpLatency, false);
+
+			fclose(fpLatency);
+		}
+	}
+
+	shards.Stop();
+	archive.Close();
+	trace.Close();
+
+#ifdef ECHO
+	// Anything logged from here on is written straight out
+	logger.Stop();
+#endif
+}
+
 LRESULT CALLBACK CBTHookProc(int nCode, WPARAM wParam, LPARAM lParam)
 {
 	switch(nCode)
@@ -2888,6 +1628,7 @@ LRESULT CALLBACK CBTHookProc(int nCode, WPARAM wParam, LPARAM lParam)
 					{
 						dprintf(_T("[snowflake] SL window destroyed\n"));
 						RemoveSLHooks();
+						StopSnowflake();
 					}
 				}
 			}
@@ -12,3 +12,4 @@
 
 SNOWFLAKE_API bool InstallSystemHook(void);
 SNOWFLAKE_API BOOL RemoveSystemHook();
+SNOWFLAKE_API void StopSnowflake(void);
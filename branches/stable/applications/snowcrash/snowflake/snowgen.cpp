@@ -0,0 +1,583 @@
+#include "stdafx.h"
+#include "./Protocol.h"
+#include "./Decoder.h"
+#include "./Generator.h"
+#include "./PcapReader.h"
+
+// Packets generated ahead of each timed run through the packet paths
+#define GEN_BATCH			1024
+
+// Room for a packet a handler has lengthened, as a viewer's buffer would have
+#define GEN_PACKET_LEN		16384
+
+// Failed checks described in full; later ones are only counted
+#define GEN_MAX_REPORTS		16
+
+#define GEN_VIEWER_ADDRESS	0x0a000002		// 10.0.0.2
+#define GEN_VIEWER_PORT		49152
+
+typedef struct
+{
+	GENERATEDPACKET info;
+	int nLen;
+	bool bFuzzed;
+} GENPACKET, *LPGENPACKET;
+
+static DWORD dwFailed = 0;
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: snowgen [-m mix] [-n packets] [-d seconds] [-s seed] [-c] [-z fuzz]\n");
+	fprintf(stderr, "               [-o capture.pcap] [-r rate] [-b min:max] [-v length] [-0 zeros]\n");
+	fprintf(stderr, "               [-e zerocoded] [-R reliable] [-x resent] [-a acks[:max]]\n");
+	fprintf(stderr, "               [-S sent] [-k circuits] [-l length] <message_template.msg>\n");
+	fprintf(stderr, "  mix is observed, uniform, @capture or name[:weight],...; shares are percentages\n");
+}
+
+// Weight every message type by how often it turns up in a capture
+static bool load_mix(CGenerator *generator, const char *lpszPath)
+{
+	CPcapReader reader;
+	PCAPPACKET packets[GEN_BATCH];
+	DWORD *lpCounts = (DWORD *)calloc(cmds_count, sizeof(DWORD));
+	LPCOMMAND *lpCommands = (LPCOMMAND *)calloc(cmds_count, sizeof(LPCOMMAND));
+	int nRead;
+
+	if (!lpCounts || !lpCommands || !reader.Open(lpszPath))
+	{
+		SAFE_FREE(lpCounts);
+		SAFE_FREE(lpCommands);
+		return false;
+	}
+
+	while ((nRead = reader.Read(packets, GEN_BATCH)) > 0)
+	{
+		for (int i = 0; i < nRead; i++)
+		{
+			LPCOMMAND lpCommand = (packets[i].nLen > MSG_HEADER_LEN) ? peek_command(packets[i].lpData, packets[i].nLen, NULL) : NULL;
+
+			if (lpCommand && lpCommand->nIndex >= 0 && lpCommand->nIndex < cmds_count)
+			{
+				lpCounts[lpCommand->nIndex]++;
+				lpCommands[lpCommand->nIndex] = lpCommand;
+			}
+		}
+	}
+
+	for (int i = 0; i < cmds_count; i++)
+	{
+		if (lpCounts[i])
+			generator->AddMix(lpCommands[i], lpCounts[i]);
+	}
+
+	SAFE_FREE(lpCounts);
+	SAFE_FREE(lpCommands);
+
+	return true;
+}
+
+static bool write_pcap_header(FILE *fp)
+{
+	DWORD dwHeader[6] = { PCAP_MAGIC, 0x00040002, 0, 0, 65535, PCAP_LINK_RAW };
+
+	return fwrite(dwHeader, sizeof(dwHeader), 1, fp) == 1;
+}
+
+// One packet as a bare IPv4 UDP datagram between the viewer and the
+// circuit's simulator
+static bool write_pcap_packet(FILE *fp, ULONGLONG ullTime, LPGENERATEDPACKET lpInfo, LPBYTE lpData, int nLen)
+{
+	BYTE bHeaders[28];
+	DWORD dwRecord[4];
+	DWORD dwViewer = htonl(GEN_VIEWER_ADDRESS);
+	WORD wViewer = htons(GEN_VIEWER_PORT);
+	WORD wTotal = htons((WORD)(sizeof(bHeaders) + nLen));
+	WORD wUDP = htons((WORD)(8 + nLen));
+	DWORD dwSum = 0;
+
+	ZeroMemory(bHeaders, sizeof(bHeaders));
+	bHeaders[0] = 0x45;
+	memcpy(&bHeaders[2], &wTotal, sizeof(wTotal));
+	bHeaders[8] = 64;
+	bHeaders[9] = 17;
+	memcpy(&bHeaders[12], lpInfo->bSent ? &dwViewer : &lpInfo->address.sin_addr.s_addr, sizeof(DWORD));
+	memcpy(&bHeaders[16], lpInfo->bSent ? &lpInfo->address.sin_addr.s_addr : &dwViewer, sizeof(DWORD));
+
+	for (int i = 0; i < 20; i += 2)
+		dwSum += (bHeaders[i] << 8) | bHeaders[i + 1];
+
+	while (dwSum >> 16)
+		dwSum = (dwSum & 0xffff) + (dwSum >> 16);
+
+	bHeaders[10] = (BYTE)(~dwSum >> 8);
+	bHeaders[11] = (BYTE)~dwSum;
+
+	memcpy(&bHeaders[20], lpInfo->bSent ? &wViewer : &lpInfo->address.sin_port, sizeof(WORD));
+	memcpy(&bHeaders[22], lpInfo->bSent ? &lpInfo->address.sin_port : &wViewer, sizeof(WORD));
+	memcpy(&bHeaders[24], &wUDP, sizeof(wUDP));
+
+	dwRecord[0] = (DWORD)(ullTime / 1000000);
+	dwRecord[1] = (DWORD)(ullTime % 1000000);
+	dwRecord[2] = dwRecord[3] = (DWORD)(sizeof(bHeaders) + nLen);
+
+	return fwrite(dwRecord, sizeof(dwRecord), 1, fp) == 1 && fwrite(bHeaders, sizeof(bHeaders), 1, fp) == 1 &&
+		fwrite(lpData, nLen, 1, fp) == 1;
+}
+
+static void report_failure(LPGENERATEDPACKET lpInfo, const char *lpszCheck)
+{
+	if (dwFailed++ < GEN_MAX_REPORTS)
+		printf("FAILED %s: %s seq %u, %d body bytes, %u acks\n", lpszCheck, lpInfo->lpCommand->lpszCmd, lpInfo->wSequence, lpInfo->nBodyLen, lpInfo->cAcks);
+}
+
+// Length of the message ID after the header, as the packet builder writes it
+static int id_len(LPCOMMAND lpCommand)
+{
+	if (lpCommand->wFrequency == MSG_FREQ_HIGH)
+		return 1;
+	else if (lpCommand->wFrequency == MSG_FREQ_MED)
+		return 2;
+
+	return 4;
+}
+
+// Check a packet reads back as generated: its type, its acks, its body
+// once zero decoded, and that the template walks it to the last byte.
+// The round trip of the decoded fields is left to the verifier.
+static void check_packet(LPGENERATEDPACKET lpInfo, LPBYTE lpPacket, int nLen, LPBYTE lpPlain)
+{
+	char zerobuf[SCRATCH_PACKET_LEN];
+	CAckTrailer trailer;
+	int nBlocks, nItems, nVars;
+
+	if (peek_command(lpPacket, nLen, NULL) != lpInfo->lpCommand)
+		report_failure(lpInfo, "message type");
+
+	if (!trailer.Parse(lpPacket, nLen) || trailer.m_cAcks != lpInfo->cAcks)
+	{
+		report_failure(lpInfo, "ack count");
+		return;
+	}
+
+	for (int i = 0; i < trailer.m_cAcks; i++)
+	{
+		if (trailer.GetAck(i) != lpInfo->dwAcks[i])
+		{
+			report_failure(lpInfo, "acks");
+			break;
+		}
+	}
+
+	int zerolen = ZeroDecode((char *)lpPacket, trailer.m_nBodyLen, zerobuf, sizeof(zerobuf));
+
+	if (zerolen != lpInfo->nBodyLen || (BYTE)(zerobuf[0] & ~MSG_ZEROCODED) != lpPlain[0] ||
+		memcmp(&zerobuf[1], &lpPlain[1], zerolen - 1))
+	{
+		report_failure(lpInfo, "zero decoding");
+		return;
+	}
+
+	if (measure_command(lpInfo->lpCommand, zerobuf, zerolen, MSG_HEADER_LEN + id_len(lpInfo->lpCommand), nBlocks, nItems, nVars) != zerolen)
+		report_failure(lpInfo, "template walk");
+}
+
+// Every pairing one way must translate straight back the other; anything
+// left over from a reused slot would not
+static bool check_pairings(CSequenceMap *map)
+{
+	DWORD dwValue, dwKey;
+
+	for (DWORD i = 0; i <= SEQUENCE_LIMIT_16; i++)
+	{
+		if (map->ToValue(i, dwValue) && (!map->ToKey(dwValue, dwKey) || dwKey != i))
+			return false;
+
+		if (map->ToKey(i, dwKey) && (!map->ToValue(dwKey, dwValue) || dwValue != i))
+			return false;
+	}
+
+	return true;
+}
+
+// Renumber long enough to wrap the 16 bit counter several times, with
+// drops and injections skewing the two tables against each other, and
+// check resends keep their number and no stale pairing survives
+static void check_sequence_map(CGenerator *generator)
+{
+	CSequenceMap *map = new CSequenceMap();
+	const char *lpszFailed = NULL;
+	DWORD i;
+
+	for (i = 0; i < 4 * (SEQUENCE_LIMIT_16 + 1) && !lpszFailed; i++)
+	{
+		DWORD dwKey = i & SEQUENCE_LIMIT_16;
+		DWORD dwRoll = generator->Random(100);
+		DWORD dwValue, dwOld, dwOldValue;
+
+		// Dropped, or forwarded after one of the proxy's own
+		if (dwRoll < 10)
+			continue;
+		else if (dwRoll < 20)
+			map->Inject();
+
+		dwValue = map->Map(dwKey);
+
+		if (!map->ToKey(dwValue, dwOld) || dwOld != dwKey)
+			lpszFailed = "translation";
+
+		// A resend of something a little way back
+		dwOld = (i - generator->Random(64)) & SEQUENCE_LIMIT_16;
+
+		if (map->ToValue(dwOld, dwOldValue) && map->Map(dwOld) != dwOldValue)
+			lpszFailed = "resend";
+
+		if (!(i % 16384) && !check_pairings(map))
+			lpszFailed = "stale pairing";
+	}
+
+	if (lpszFailed && dwFailed++ < GEN_MAX_REPORTS)
+		printf("FAILED sequence map: %s at original %u\n", lpszFailed, i - 1);
+
+	delete map;
+}
+
+// Damage a packet the ways a network or a hostile peer could: flipped
+// bytes, cut short, or trailing garbage that reads as acks
+static int fuzz_packet(CGenerator *generator, LPBYTE lpPacket, int nLen, int nMaxLen)
+{
+	switch (generator->Random(3))
+	{
+		case 0:
+			for (DWORD i = generator->Random(4) + 1; i > 0; i--)
+				lpPacket[generator->Random((DWORD)nLen)] ^= (BYTE)(generator->Random(255) + 1);
+			break;
+
+		case 1:
+			nLen = (int)generator->Random((DWORD)nLen) + 1;
+			break;
+
+		default:
+			for (DWORD i = generator->Random(64) + 1; i > 0 && nLen < nMaxLen; i--)
+				lpPacket[nLen++] = (BYTE)generator->Random(256);
+			break;
+	}
+
+	return nLen;
+}
+
+static int send_nothing(LPVOID lpParam)
+{
+	return *(int *)lpParam;
+}
+
+static LONGLONG ticks(void)
+{
+	LARGE_INTEGER liNow;
+
+	QueryPerformanceCounter(&liNow);
+
+	return liNow.QuadPart;
+}
+
+// Synthesizes traffic from the template, for as long as it's asked to.
+// By default every packet runs through the same receive and send paths the
+// hooks do, timed apart from generating it. With -c each packet is also
+// checked to decode back to what was generated and every decoded message
+// is verified; with -z a share of packets is damaged first, which only has
+// to be survived. With -o the packets are written to a pcap instead.
+int main(int argc, char *argv[])
+{
+	CGenerator generator;
+	LPGENERATOROPTIONS lpOptions = &generator.m_options;
+	char *lpszMix = "observed";
+	char *lpszOutput = NULL;
+	DWORD dwPackets = 100000;
+	double dSeconds = 0;
+	double dRate = 1000;
+	int nFuzz = 0;
+	bool bCheck = false;
+	int nArg = 1;
+
+	generator.Seed(1);
+
+	while (nArg + 1 < argc && argv[nArg][0] == '-')
+	{
+		char *lpszValue = argv[nArg + 1];
+
+		if (!strcmp(argv[nArg], "-c"))
+		{
+			bCheck = true;
+			nArg++;
+			continue;
+		}
+
+		if (!strcmp(argv[nArg], "-m"))
+			lpszMix = lpszValue;
+		else if (!strcmp(argv[nArg], "-n"))
+			dwPackets = (DWORD)strtoul(lpszValue, NULL, 10);
+		else if (!strcmp(argv[nArg], "-d"))
+			dSeconds = atof(lpszValue);
+		else if (!strcmp(argv[nArg], "-s"))
+			generator.Seed(strtoull(lpszValue, NULL, 10));
+		else if (!strcmp(argv[nArg], "-z"))
+			nFuzz = atoi(lpszValue);
+		else if (!strcmp(argv[nArg], "-o"))
+			lpszOutput = lpszValue;
+		else if (!strcmp(argv[nArg], "-r"))
+			dRate = atof(lpszValue);
+		else if (!strcmp(argv[nArg], "-b"))
+		{
+			lpOptions->nMinItems = lpOptions->nMaxItems = atoi(lpszValue);
+
+			if (strchr(lpszValue, ':'))
+				lpOptions->nMaxItems = atoi(strchr(lpszValue, ':') + 1);
+		}
+		else if (!strcmp(argv[nArg], "-v"))
+			lpOptions->nMaxVarLen = atoi(lpszValue);
+		else if (!strcmp(argv[nArg], "-0"))
+			lpOptions->nZeros = atoi(lpszValue);
+		else if (!strcmp(argv[nArg], "-e"))
+			lpOptions->nZerocoded = atoi(lpszValue);
+		else if (!strcmp(argv[nArg], "-R"))
+			lpOptions->nReliable = atoi(lpszValue);
+		else if (!strcmp(argv[nArg], "-x"))
+			lpOptions->nResent = atoi(lpszValue);
+		else if (!strcmp(argv[nArg], "-a"))
+		{
+			lpOptions->nAcks = atoi(lpszValue);
+
+			if (strchr(lpszValue, ':'))
+				lpOptions->nMaxAcks = atoi(strchr(lpszValue, ':') + 1);
+		}
+		else if (!strcmp(argv[nArg], "-S"))
+			lpOptions->nSent = atoi(lpszValue);
+		else if (!strcmp(argv[nArg], "-k"))
+			lpOptions->nCircuits = atoi(lpszValue);
+		else if (!strcmp(argv[nArg], "-l"))
+			lpOptions->nMaxLen = atoi(lpszValue);
+		else
+			break;
+
+		nArg += 2;
+	}
+
+	// Nothing longer decodes, so there's no point generating it
+	if (argc - nArg != 1 || (!dwPackets && dSeconds <= 0) || dSeconds < 0 || dRate <= 0 || nFuzz < 0 || nFuzz > 100 ||
+		lpOptions->nCircuits < 1 || lpOptions->nMaxLen < MSG_HEADER_LEN || lpOptions->nMaxLen > SCRATCH_PACKET_LEN)
+	{
+		usage();
+		return 1;
+	}
+
+	if (load_template(argv[nArg]) < 0)
+	{
+		fprintf(stderr, "snowgen: can't load template %s\n", argv[nArg]);
+		return 1;
+	}
+
+	if (!((lpszMix[0] == '@') ? load_mix(&generator, &lpszMix[1]) : generator.AddMix(lpszMix)) || !generator.CountMix())
+	{
+		fprintf(stderr, "snowgen: no message types to generate from %s\n", lpszMix);
+		return 1;
+	}
+
+	FILE *fp = NULL;
+
+	if (lpszOutput && (!(fp = fopen(lpszOutput, "wb")) || !write_pcap_header(fp)))
+	{
+		fprintf(stderr, "snowgen: can't write %s\n", lpszOutput);
+		return 1;
+	}
+
+	if (!fp && !engine.Start(cmds_count))
+		return 1;
+
+	// Resends are decoded again, so every packet gets checked
+	if (bCheck)
+	{
+		verifier.SetMode(VERIFY_ALL, 1);
+		duplicate_policy = DUPLICATE_DECODE;
+	}
+
+	// Zero coding can grow a body by half, and fuzzing adds a little more
+	int nSlotLen = lpOptions->nMaxLen * 2 + 64;
+	LPGENPACKET lpBatch = (LPGENPACKET)malloc(GEN_BATCH * sizeof(GENPACKET));
+	LPBYTE lpWire = (LPBYTE)malloc(GEN_BATCH * nSlotLen);
+	LPBYTE lpPlain = bCheck ? (LPBYTE)malloc(GEN_BATCH * lpOptions->nMaxLen) : NULL;
+
+	if (!lpBatch || !lpWire || (bCheck && !lpPlain))
+		return 1;
+
+	LARGE_INTEGER liFrequency;
+
+	QueryPerformanceFrequency(&liFrequency);
+
+	BYTE bPacket[GEN_PACKET_LEN];
+	ULONGLONG ullPackets = 0;
+	ULONGLONG ullBytes = 0;
+	ULONGLONG ullTime = CLatency::GetWallTime();
+	DWORD dwSent = 0;
+	DWORD dwZerocoded = 0;
+	DWORD dwAcked = 0;
+	DWORD dwFuzzed = 0;
+	DWORD dwUnfit = 0;
+	LONGLONG llGenerate = 0;
+	LONGLONG llPath = 0;
+	LONGLONG llStart = ticks();
+	LONGLONG llEnd = llStart + (LONGLONG)(dSeconds * liFrequency.QuadPart);
+
+	while ((!dwPackets || ullPackets < dwPackets) && (dSeconds <= 0 || ticks() < llEnd))
+	{
+		int nBatch = GEN_BATCH;
+
+		if (dwPackets && dwPackets - ullPackets < (ULONGLONG)nBatch)
+			nBatch = (int)(dwPackets - ullPackets);
+
+		LONGLONG llMark = ticks();
+
+		for (int i = 0; i < nBatch; i++)
+		{
+			LPGENPACKET lpGen = &lpBatch[i];
+			LPBYTE lpData = &lpWire[i * nSlotLen];
+
+			lpGen->nLen = generator.Next(lpData, nSlotLen, &lpGen->info, bCheck ? &lpPlain[i * lpOptions->nMaxLen] : NULL);
+			lpGen->bFuzzed = false;
+
+			if (lpGen->nLen > 0 && nFuzz && generator.Random(100) < (DWORD)nFuzz)
+			{
+				lpGen->nLen = fuzz_packet(&generator, lpData, lpGen->nLen, nSlotLen);
+				lpGen->bFuzzed = true;
+			}
+		}
+
+		llGenerate += ticks() - llMark;
+
+		for (int i = 0; i < nBatch; i++)
+		{
+			LPGENPACKET lpGen = &lpBatch[i];
+			LPBYTE lpData = &lpWire[i * nSlotLen];
+
+			if (lpGen->nLen <= 0)
+			{
+				dwUnfit++;
+				continue;
+			}
+
+			ullPackets++;
+			ullBytes += lpGen->nLen;
+
+			if (lpGen->info.bSent)
+				dwSent++;
+
+			if (lpData[0] & MSG_ZEROCODED)
+				dwZerocoded++;
+
+			if (lpGen->info.cAcks)
+				dwAcked++;
+
+			if (lpGen->bFuzzed)
+				dwFuzzed++;
+			else if (bCheck)
+				check_packet(&lpGen->info, lpData, lpGen->nLen, &lpPlain[i * lpOptions->nMaxLen]);
+
+			if (fp)
+			{
+				ullTime += (ULONGLONG)(1000000 / dRate);
+
+				if (!write_pcap_packet(fp, ullTime, &lpGen->info, lpData, lpGen->nLen))
+				{
+					fprintf(stderr, "snowgen: can't write %s\n", lpszOutput);
+					return 1;
+				}
+			}
+		}
+
+		if (fp)
+			continue;
+
+		llMark = ticks();
+
+		for (int i = 0; i < nBatch; i++)
+		{
+			LPGENPACKET lpGen = &lpBatch[i];
+
+			if (lpGen->nLen <= 0)
+				continue;
+
+			memcpy(bPacket, &lpWire[i * nSlotLen], lpGen->nLen);
+
+			if (lpGen->info.bSent)
+				send_packet(&servers, bPacket, lpGen->nLen, &lpGen->info.address, send_nothing, &lpGen->nLen, NULL);
+			else
+				receive_packet(&servers, bPacket, lpGen->nLen, sizeof(bPacket), &lpGen->info.address, NULL);
+		}
+
+		llPath += ticks() - llMark;
+	}
+
+	double dElapsed = (double)(ticks() - llStart) / liFrequency.QuadPart;
+	double dGenerate = (double)llGenerate / liFrequency.QuadPart;
+	double dPath = (double)llPath / liFrequency.QuadPart;
+
+	printf("%" PRINTF_INT64 "u packets from %d message types, %u sent and %" PRINTF_INT64 "u received, %" PRINTF_INT64 "u bytes\n",
+		ullPackets, generator.CountMix(), dwSent, ullPackets - dwSent, ullBytes);
+	printf("%u zerocoded, %u with appended acks, %u fuzzed, %u that didn't fit\n", dwZerocoded, dwAcked, dwFuzzed, dwUnfit);
+	printf("%.3f seconds, generated at %.0f packets/s\n", dElapsed, (dGenerate > 0) ? ullPackets / dGenerate : 0);
+
+	if (fp)
+	{
+		fclose(fp);
+		printf("written to %s\n", lpszOutput);
+	}
+	else
+	{
+		printf("packet paths ran at %.0f packets/s, %.1f MB/s\n", (dPath > 0) ? ullPackets / dPath : 0,
+			(dPath > 0) ? ullBytes / dPath / 1048576.0 : 0);
+
+		servers.FreeServers();
+		engine.MergeStats();
+		engine.Stop();
+	}
+
+	if (bCheck && !fp)
+	{
+		DWORD dwVerified = 0;
+		DWORD dwMismatched = 0;
+
+		for (int i = 0; i < MAX_COMMANDS_LOW; i++)
+		{
+			LPCOMMAND lpCommands[3] = { (i < MAX_COMMANDS_HIGH) ? &cmds_high[i] : NULL, (i < MAX_COMMANDS_MEDIUM) ? &cmds_med[i] : NULL, &cmds_low[i] };
+
+			for (int j = 0; j < 3; j++)
+			{
+				if (lpCommands[j] && lpCommands[j]->lpszCmd)
+				{
+					dwVerified += lpCommands[j]->stats.dwVerified;
+					dwMismatched += lpCommands[j]->stats.dwMismatched;
+				}
+			}
+		}
+
+		printf("%u messages verified, %u mismatched\n", dwVerified, dwMismatched);
+
+		if (dwMismatched)
+		{
+			printf("\n");
+			verifier.Report(stdout);
+		}
+
+		dwFailed += dwMismatched;
+	}
+
+	if (bCheck)
+	{
+		check_sequence_map(&generator);
+		printf("%u failed checks\n", dwFailed);
+	}
+
+	SAFE_FREE(lpBatch);
+	SAFE_FREE(lpWire);
+	SAFE_FREE(lpPlain);
+
+	return (dwFailed) ? 1 : 0;
+}
\ No newline at end of file
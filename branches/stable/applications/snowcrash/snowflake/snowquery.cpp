@@ -0,0 +1,117 @@
+#include "stdafx.h"
+#include "./Protocol.h"
+#include "./Latency.h"
+#include "./Archive.h"
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: snowquery [-m message] [-c address[:port]] [-f from] [-t to]\n");
+	fprintf(stderr, "                 <message_template.msg> <archive>\n");
+}
+
+// Seconds since the epoch, fractions allowed
+static ULONGLONG parse_time(const char *lpszTime)
+{
+	return (ULONGLONG)(atof(lpszTime) * 1000000.0 + 0.5);
+}
+
+// Lists the packets of an archive that match a message type, a circuit
+// and a time range, e.g. every ChatFromSimulator on one simulator between
+// two times. Segments whose footer rules them out are never decompressed.
+int main(int argc, char *argv[])
+{
+	ARCHIVEQUERY query;
+	char *lpszMessage = NULL;
+	int nArg = 1;
+
+	ZeroMemory(&query, sizeof(query));
+	query.dwMessage = ARCHIVE_ANY_MESSAGE;
+
+	for (; nArg + 1 < argc && argv[nArg][0] == '-'; nArg += 2)
+	{
+		if (!strcmp(argv[nArg], "-m"))
+			lpszMessage = argv[nArg + 1];
+		else if (!strcmp(argv[nArg], "-f"))
+			query.ullFrom = parse_time(argv[nArg + 1]);
+		else if (!strcmp(argv[nArg], "-t"))
+			query.ullTo = parse_time(argv[nArg + 1]);
+		else if (!strcmp(argv[nArg], "-c"))
+		{
+			char szAddress[64];
+			char *lpszPort;
+
+			strncpy(szAddress, argv[nArg + 1], sizeof(szAddress) - 1);
+			szAddress[sizeof(szAddress) - 1] = '\0';
+
+			if ((lpszPort = strchr(szAddress, ':')) != NULL)
+			{
+				*lpszPort++ = '\0';
+				query.wPort = htons((WORD)atoi(lpszPort));
+			}
+
+			query.dwAddress = inet_addr(szAddress);
+		}
+		else
+			break;
+	}
+
+	if (argc - nArg != 2)
+	{
+		usage();
+		return 1;
+	}
+
+	if (load_template(argv[nArg]) < 0)
+	{
+		fprintf(stderr, "snowquery: can't load template %s\n", argv[nArg]);
+		return 1;
+	}
+
+	if (lpszMessage)
+	{
+		LPCOMMAND lpCommand = find_command(lpszMessage);
+
+		if (!lpCommand)
+		{
+			fprintf(stderr, "snowquery: no message %s in the template\n", lpszMessage);
+			return 1;
+		}
+
+		query.dwMessage = command_number(lpCommand);
+	}
+
+	CArchiveReader reader;
+
+	if (!reader.Open(argv[nArg + 1]))
+	{
+		fprintf(stderr, "snowquery: can't read archive %s\n", argv[nArg + 1]);
+		return 1;
+	}
+
+	ARCHIVEPACKET packet;
+	DWORD dwMatched = 0;
+	DWORD dwStart = CLatency::GetTime();
+
+	reader.Seek(&query);
+
+	while (reader.Next(&packet))
+	{
+		LPCOMMAND lpCommand = number_command(packet.dwMessage);
+
+		printf("%" PRINTF_INT64 "u.%06u\t%s:%u\t%s\t%s\t%d\n",
+			packet.ullTime / 1000000, (DWORD)(packet.ullTime % 1000000),
+			inet_ntoa(packet.address.sin_addr), ntohs(packet.address.sin_port),
+			packet.bSent ? "out" : "in",
+			(lpCommand && lpCommand->lpszCmd) ? lpCommand->lpszCmd : "?",
+			packet.nLen);
+
+		dwMatched++;
+	}
+
+	DWORD dwElapsed = CLatency::GetTime() - dwStart;
+
+	fprintf(stderr, "%u of %u packets, %d of %d segments decompressed, %.3f seconds\n",
+		dwMatched, reader.m_dwPackets, reader.m_nLoaded, reader.m_nSegments, dwElapsed / 1000000.0);
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,1116 @@
+#include "stdafx.h"
+#include "./Protocol.h"
+#include "./Decoder.h"
+#include "./Generator.h"
+#include "./Uring.h"
+
+#include <sys/socket.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+
+// Packets taken from a socket per recvmmsg unless told otherwise
+#define RELAY_BATCH				64
+#define RELAY_MAX_BATCH			1024
+
+// Room for a packet a handler has lengthened, as a viewer's buffer would have
+#define RELAY_PACKET_LEN		16384
+
+// Deep socket buffers ride out a burst while a batch is being decoded
+#define RELAY_SOCKET_BUFFER		(4 * 1024 * 1024)
+
+// How often a relay waiting on quiet sockets looks at its stop flag
+#define RELAY_POLL_MS			200
+
+// The io_uring front end's buffers, per socket. Each holds the completion
+// header and source address ahead of the packet, and a buffer stays out of
+// the ring until the packet in it has been sent on.
+#define RELAY_RING_ENTRIES		1024
+#define RELAY_RING_BUFFERS		1024
+#define RELAY_RING_BUFFER_LEN	4096
+#define RELAY_RING_CQES			256
+
+// What a completion was for, in its user data along with the direction and
+// the buffer
+#define RING_RECV				1
+#define RING_SEND				2
+#define RING_DATA(op, d, buf)	((ULONGLONG)(op) << 32 | (ULONGLONG)(d) << 16 | (ULONGLONG)(buf))
+
+// Benchmark defaults. Latency is measured one packet in flight at a time,
+// throughput with a window of them.
+#define BENCH_PACKETS			200000
+#define BENCH_LATENCY_PACKETS	20000
+#define BENCH_WINDOW			256
+#define BENCH_TIMEOUT_MS		1000
+
+#define RELAY_UP				0	// Viewer to simulator
+#define RELAY_DOWN				1	// Simulator to viewer
+
+// How packets get off and on the sockets
+#define FRONT_PLAIN				0	// recvfrom and sendto, a packet at a time, as the hooks see it
+#define FRONT_MMSG				1	// recvmmsg and sendmmsg, a batch at a time
+#define FRONT_URING				2	// io_uring multishot receives into registered buffer rings
+#define FRONT_ENDS				3
+
+static const char *lpszFrontEnds[FRONT_ENDS] = { "plain", "mmsg", "uring" };
+
+// One socket's batches: what recvmmsg fills and what goes out the other
+// side with sendmmsg
+typedef struct
+{
+	int nSocket;
+	struct mmsghdr *lpIn;
+	struct iovec *lpInVecs;
+	struct sockaddr_in *lpFrom;
+	LPBYTE lpBuffers;
+	struct mmsghdr *lpOut;
+	struct iovec *lpOutVecs;
+	int nOut;
+} RELAYSIDE;
+
+typedef struct
+{
+	RELAYSIDE sides[2];			// Indexed by the direction packets arrive in
+	struct sockaddr_in listen;
+	struct sockaddr_in server;
+	struct sockaddr_in client;
+	bool bClient;				// The viewer has been heard from
+	int nBatch;
+	int nFrontEnd;
+	volatile LONG lStop;
+
+	ULONGLONG ullPackets[2];
+	ULONGLONG ullBytes[2];
+	ULONGLONG ullBatches[2];
+	DWORD dwDropped;			// Rewritten too long, or no viewer to send to
+	DWORD dwSendErrors;
+	DWORD dwOverruns;			// The ring ran out of buffers
+} RELAY, *LPRELAY;
+
+// Everything a send from one of the ring's buffers needs until it completes
+typedef struct
+{
+	struct msghdr header;
+	struct iovec vec;
+	struct sockaddr_in to;
+} RINGSLOT;
+
+// A packet on its way out, for the front end's SENDPROC
+typedef struct
+{
+	RELAYSIDE *lpOut;			// mmsg: the batch it joins
+	int nSocket;				// plain and uring: the socket it goes out on
+	CUring *lpRing;				// uring: the ring, and the slot of the buffer it's in
+	RINGSLOT *lpSlot;
+	ULONGLONG ullData;
+	bool bPassed;				// Sent or queued
+	struct sockaddr_in *lpTo;	// NULL on the connected simulator socket
+	LPBYTE lpData;
+	int nLen;
+} RELAYSEND;
+
+static volatile LONG lInterrupted = 0;
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: snowrelay [-f plain|mmsg|uring] [-b batch] <message_template.msg> <[address:]port> <server address:port>\n");
+	fprintf(stderr, "       snowrelay -B [-f plain|mmsg|uring] [-b batch] [-n packets] [-w window] <message_template.msg>\n");
+}
+
+static void on_interrupt(int nSignal)
+{
+	lInterrupted = 1;
+}
+
+// "address:port" or just "port", which listens on every address
+static bool parse_address(const char *lpszAddress, struct sockaddr_in *address)
+{
+	char szAddress[64];
+	char *lpszPort;
+
+	strncpy(szAddress, lpszAddress, sizeof(szAddress) - 1);
+	szAddress[sizeof(szAddress) - 1] = '\0';
+
+	ZeroMemory(address, sizeof(*address));
+	address->sin_family = AF_INET;
+	address->sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if ((lpszPort = strchr(szAddress, ':')) != NULL)
+	{
+		*lpszPort++ = '\0';
+		address->sin_addr.s_addr = inet_addr(szAddress);
+	}
+	else
+		lpszPort = szAddress;
+
+	address->sin_port = htons((WORD)atoi(lpszPort));
+
+	return address->sin_addr.s_addr != INADDR_NONE && address->sin_port != 0;
+}
+
+static ULONGLONG now_ns(void)
+{
+	static LONGLONG llFrequency = 0;
+	LARGE_INTEGER liNow;
+
+	if (!llFrequency)
+	{
+		LARGE_INTEGER liFrequency;
+
+		QueryPerformanceFrequency(&liFrequency);
+		llFrequency = liFrequency.QuadPart;
+	}
+
+	QueryPerformanceCounter(&liNow);
+
+	return (ULONGLONG)(liNow.QuadPart / llFrequency) * 1000000000 + (ULONGLONG)(liNow.QuadPart % llFrequency) * 1000000000 / llFrequency;
+}
+
+// A UDP socket bound to lpBind, connected to lpConnect if given
+static int open_socket(struct sockaddr_in *lpBind, struct sockaddr_in *lpConnect)
+{
+	int nSocket = socket(AF_INET, SOCK_DGRAM, 0);
+	int nBuffer = RELAY_SOCKET_BUFFER;
+	socklen_t nLen = sizeof(*lpBind);
+
+	if (nSocket < 0)
+		return -1;
+
+	setsockopt(nSocket, SOL_SOCKET, SO_RCVBUF, &nBuffer, sizeof(nBuffer));
+	setsockopt(nSocket, SOL_SOCKET, SO_SNDBUF, &nBuffer, sizeof(nBuffer));
+
+	if (bind(nSocket, (struct sockaddr *)lpBind, sizeof(*lpBind)) < 0 ||
+		(lpConnect && connect(nSocket, (struct sockaddr *)lpConnect, sizeof(*lpConnect)) < 0) ||
+		getsockname(nSocket, (struct sockaddr *)lpBind, &nLen) < 0)
+	{
+		close(nSocket);
+		return -1;
+	}
+
+	return nSocket;
+}
+
+static bool open_side(RELAYSIDE *side, int nSocket, int nBatch)
+{
+	ZeroMemory(side, sizeof(*side));
+	side->nSocket = nSocket;
+
+	side->lpIn = (struct mmsghdr *)calloc(nBatch, sizeof(struct mmsghdr));
+	side->lpInVecs = (struct iovec *)calloc(nBatch, sizeof(struct iovec));
+	side->lpFrom = (struct sockaddr_in *)calloc(nBatch, sizeof(struct sockaddr_in));
+	side->lpBuffers = (LPBYTE)malloc(nBatch * RELAY_PACKET_LEN);
+	side->lpOut = (struct mmsghdr *)calloc(nBatch, sizeof(struct mmsghdr));
+	side->lpOutVecs = (struct iovec *)calloc(nBatch, sizeof(struct iovec));
+
+	if (!side->lpIn || !side->lpInVecs || !side->lpFrom || !side->lpBuffers || !side->lpOut || !side->lpOutVecs)
+		return false;
+
+	for (int i = 0; i < nBatch; i++)
+	{
+		side->lpInVecs[i].iov_base = &side->lpBuffers[i * RELAY_PACKET_LEN];
+		side->lpIn[i].msg_hdr.msg_iov = &side->lpInVecs[i];
+		side->lpIn[i].msg_hdr.msg_iovlen = 1;
+		side->lpIn[i].msg_hdr.msg_name = &side->lpFrom[i];
+		side->lpOut[i].msg_hdr.msg_iov = &side->lpOutVecs[i];
+		side->lpOut[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	return true;
+}
+
+static void close_side(RELAYSIDE *side)
+{
+	if (side->nSocket >= 0)
+		close(side->nSocket);
+
+	side->nSocket = -1;
+
+	SAFE_FREE(side->lpIn);
+	SAFE_FREE(side->lpInVecs);
+	SAFE_FREE(side->lpFrom);
+	SAFE_FREE(side->lpBuffers);
+	SAFE_FREE(side->lpOut);
+	SAFE_FREE(side->lpOutVecs);
+}
+
+static void relay_close(LPRELAY relay)
+{
+	close_side(&relay->sides[RELAY_UP]);
+	close_side(&relay->sides[RELAY_DOWN]);
+}
+
+// Listen for the viewer on relay->listen and talk to the simulator at
+// relay->server from a socket of our own. A zero listen port picks one.
+static bool relay_open(LPRELAY relay, int nFrontEnd, int nBatch)
+{
+	struct sockaddr_in any;
+
+	ZeroMemory(relay->sides, sizeof(relay->sides));
+	relay->sides[RELAY_UP].nSocket = relay->sides[RELAY_DOWN].nSocket = -1;
+
+	relay->nBatch = nBatch;
+	relay->nFrontEnd = nFrontEnd;
+	relay->bClient = false;
+	relay->lStop = 0;
+
+	ZeroMemory(relay->ullPackets, sizeof(relay->ullPackets));
+	ZeroMemory(relay->ullBytes, sizeof(relay->ullBytes));
+	ZeroMemory(relay->ullBatches, sizeof(relay->ullBatches));
+	relay->dwDropped = 0;
+	relay->dwSendErrors = 0;
+	relay->dwOverruns = 0;
+
+	ZeroMemory(&any, sizeof(any));
+	any.sin_family = AF_INET;
+	any.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	int nClient = open_socket(&relay->listen, NULL);
+	int nServer = (nClient >= 0) ? open_socket(&any, &relay->server) : -1;
+
+	if (!open_side(&relay->sides[RELAY_UP], nClient, nBatch) || !open_side(&relay->sides[RELAY_DOWN], nServer, nBatch) ||
+		nClient < 0 || nServer < 0)
+	{
+		relay_close(relay);
+		return false;
+	}
+
+	return true;
+}
+
+// Run one packet through the same path the matching hook does and hand
+// it to lpProc to pass on, rewritten only if a handler did. Packets from
+// the simulator that can't be passed on are dropped.
+static void relay_packet(LPRELAY relay, int nDirection, LPBYTE lpData, int nLen, int nMaxLen, struct sockaddr_in *lpFrom, SENDPROC lpProc, RELAYSEND *lpSend)
+{
+	relay->ullPackets[nDirection]++;
+	relay->ullBytes[nDirection] += nLen;
+
+	lpSend->lpData = lpData;
+	lpSend->nLen = nLen;
+	lpSend->bPassed = false;
+
+	if (nDirection == RELAY_UP)
+	{
+		// Replies go back to whoever spoke last
+		relay->client = *lpFrom;
+		relay->bClient = true;
+
+		lpSend->lpTo = NULL;
+		send_packet(&servers, lpData, nLen, &relay->server, lpProc, lpSend, NULL);
+	}
+	else
+	{
+		lpSend->lpTo = &relay->client;
+		lpSend->nLen = receive_packet(&servers, lpData, nLen, nMaxLen, &relay->server, NULL);
+
+		if (lpSend->nLen < 0 || !relay->bClient)
+			relay->dwDropped++;
+		else
+			lpProc(lpSend);
+	}
+}
+
+// The plain front end's SENDPROC: straight out with sendto
+static int send_now(LPVOID lpParam)
+{
+	RELAYSEND *lpSend = (RELAYSEND *)lpParam;
+	int nRes = sendto(lpSend->nSocket, lpSend->lpData, lpSend->nLen, 0, (struct sockaddr *)lpSend->lpTo, lpSend->lpTo ? sizeof(*lpSend->lpTo) : 0);
+
+	lpSend->bPassed = (nRes >= 0);
+
+	return nRes;
+}
+
+// The mmsg front end's SENDPROC: the packet joins the outgoing batch instead
+static int queue_packet(LPVOID lpParam)
+{
+	RELAYSEND *lpSend = (RELAYSEND *)lpParam;
+	RELAYSIDE *lpOut = lpSend->lpOut;
+	struct msghdr *lpHeader = &lpOut->lpOut[lpOut->nOut].msg_hdr;
+
+	lpOut->lpOutVecs[lpOut->nOut].iov_base = lpSend->lpData;
+	lpOut->lpOutVecs[lpOut->nOut].iov_len = lpSend->nLen;
+	lpHeader->msg_name = lpSend->lpTo;
+	lpHeader->msg_namelen = lpSend->lpTo ? sizeof(*lpSend->lpTo) : 0;
+	lpOut->nOut++;
+	lpSend->bPassed = true;
+
+	return lpSend->nLen;
+}
+
+// The uring front end's SENDPROC: a send from the buffer the packet came
+// in, submitted with the next batch. The viewer's address is copied, as it
+// may have moved on by the time the send goes out.
+static int queue_ring_send(LPVOID lpParam)
+{
+	RELAYSEND *lpSend = (RELAYSEND *)lpParam;
+	RINGSLOT *lpSlot = lpSend->lpSlot;
+
+	lpSlot->vec.iov_base = lpSend->lpData;
+	lpSlot->vec.iov_len = lpSend->nLen;
+	lpSlot->header.msg_name = NULL;
+	lpSlot->header.msg_namelen = 0;
+
+	if (lpSend->lpTo)
+	{
+		lpSlot->to = *lpSend->lpTo;
+		lpSlot->header.msg_name = &lpSlot->to;
+		lpSlot->header.msg_namelen = sizeof(lpSlot->to);
+	}
+
+	lpSend->bPassed = lpSend->lpRing->SendMsg(lpSend->nSocket, &lpSlot->header, lpSend->ullData);
+
+	return lpSend->bPassed ? lpSend->nLen : -1;
+}
+
+static void flush_side(LPRELAY relay, RELAYSIDE *side, int nSocket)
+{
+	int nSent = 0;
+
+	while (nSent < side->nOut)
+	{
+		int nRes = sendmmsg(nSocket, &side->lpOut[nSent], side->nOut - nSent, 0);
+
+		if (nRes < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			relay->dwSendErrors += side->nOut - nSent;
+			break;
+		}
+
+		nSent += nRes;
+	}
+
+	side->nOut = 0;
+}
+
+// What the hooks do: one recvfrom, one decode and one sendto per packet.
+// Returns 0 once the socket is drained.
+static int relay_single(LPRELAY relay, int nDirection)
+{
+	RELAYSIDE *side = &relay->sides[nDirection];
+	socklen_t nFromLen = sizeof(side->lpFrom[0]);
+	RELAYSEND send;
+
+	int nLen = recvfrom(side->nSocket, side->lpBuffers, RELAY_PACKET_LEN, MSG_DONTWAIT, (struct sockaddr *)&side->lpFrom[0], &nFromLen);
+
+	if (nLen < 0)
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+
+	relay->ullBatches[nDirection]++;
+
+	send.nSocket = relay->sides[!nDirection].nSocket;
+	relay_packet(relay, nDirection, side->lpBuffers, nLen, RELAY_PACKET_LEN, &side->lpFrom[0], send_now, &send);
+
+	if (!send.bPassed && (nDirection == RELAY_UP || send.nLen >= 0))
+		relay->dwSendErrors++;
+
+	return 1;
+}
+
+// Take one batch off a socket, run every packet through the hook path, and
+// pass the batch on in one go, sent from the buffers it arrived in
+static int relay_batch(LPRELAY relay, int nDirection)
+{
+	RELAYSIDE *side = &relay->sides[nDirection];
+	int nOther = relay->sides[!nDirection].nSocket;
+
+	for (int i = 0; i < relay->nBatch; i++)
+	{
+		side->lpInVecs[i].iov_len = RELAY_PACKET_LEN;
+		side->lpIn[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	}
+
+	int nRead = recvmmsg(side->nSocket, side->lpIn, relay->nBatch, MSG_DONTWAIT, NULL);
+
+	if (nRead <= 0)
+		return nRead;
+
+	relay->ullBatches[nDirection]++;
+
+	for (int i = 0; i < nRead; i++)
+	{
+		RELAYSEND send;
+
+		send.lpOut = side;
+		relay_packet(relay, nDirection, (LPBYTE)side->lpInVecs[i].iov_base, (int)side->lpIn[i].msg_len, RELAY_PACKET_LEN,
+			&side->lpFrom[i], queue_packet, &send);
+	}
+
+	flush_side(relay, side, nOther);
+
+	return nRead;
+}
+
+// One completion off the ring. A packet is decoded in the buffer the
+// kernel put it in and sent on from there; the buffer goes back to the
+// ring when the send completes, or straight away if there's nothing to
+// send. A receive that has stopped is rearmed by the caller.
+static void relay_completion(LPRELAY relay, CUring *lpRing, RINGSLOT *lpSlots, struct msghdr *lpHeaders, bool *lpArmed,
+	struct io_uring_cqe *lpCqe)
+{
+	int nOp = (int)(lpCqe->user_data >> 32);
+	int nDirection = (int)(lpCqe->user_data >> 16) & 0xffff;
+	int nBuffer = (int)lpCqe->user_data & 0xffff;
+
+	if (nOp == RING_SEND)
+	{
+		if (lpCqe->res < 0)
+			relay->dwSendErrors++;
+
+		lpRing->ReturnBuffer(nDirection, nBuffer);
+		return;
+	}
+
+	if (!(lpCqe->flags & IORING_CQE_F_MORE))
+		lpArmed[nDirection] = false;
+
+	if (!(lpCqe->flags & IORING_CQE_F_BUFFER))
+	{
+		if (lpCqe->res == -ENOBUFS)
+			relay->dwOverruns++;
+
+		return;
+	}
+
+	nBuffer = lpCqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+	LPBYTE lpBuffer = lpRing->GetBuffer(nDirection, nBuffer);
+	LPVOID lpFrom = NULL;
+	int nLen = 0;
+	LPBYTE lpData = CUring::GetPayload(lpBuffer, lpCqe->res, &lpHeaders[nDirection], nLen, &lpFrom);
+	RELAYSEND send;
+
+	if (!lpData || (nDirection == RELAY_UP && !lpFrom))
+	{
+		relay->dwDropped++;
+		lpRing->ReturnBuffer(nDirection, nBuffer);
+		return;
+	}
+
+	send.nSocket = relay->sides[!nDirection].nSocket;
+	send.lpRing = lpRing;
+	send.lpSlot = &lpSlots[nDirection * RELAY_RING_BUFFERS + nBuffer];
+	send.ullData = RING_DATA(RING_SEND, nDirection, nBuffer);
+
+	relay_packet(relay, nDirection, lpData, nLen, RELAY_RING_BUFFER_LEN - (int)(lpData - lpBuffer), (struct sockaddr_in *)lpFrom,
+		queue_ring_send, &send);
+
+	if (!send.bPassed)
+	{
+		if (nDirection == RELAY_UP || send.nLen >= 0)
+			relay->dwSendErrors++;
+
+		lpRing->ReturnBuffer(nDirection, nBuffer);
+	}
+}
+
+// Relay through io_uring until told to stop. Each socket has a multishot
+// receive over its own buffer ring, so packets arrive without a system
+// call of their own; each pass decodes everything that has completed and
+// submits the sends in the same io_uring_enter that waits for more.
+static bool relay_ring(LPRELAY relay)
+{
+	CUring ring;
+	struct msghdr headers[2];
+	struct io_uring_cqe cqes[RELAY_RING_CQES];
+	bool bArmed[2] = { false, false };
+	RINGSLOT *lpSlots = (RINGSLOT *)calloc(2 * RELAY_RING_BUFFERS, sizeof(RINGSLOT));
+
+	if (!lpSlots || !ring.Open(RELAY_RING_ENTRIES) || !ring.AddBuffers(RELAY_UP, RELAY_RING_BUFFERS, RELAY_RING_BUFFER_LEN) ||
+		!ring.AddBuffers(RELAY_DOWN, RELAY_RING_BUFFERS, RELAY_RING_BUFFER_LEN))
+	{
+		SAFE_FREE(lpSlots);
+		return false;
+	}
+
+	for (int i = 0; i < 2 * RELAY_RING_BUFFERS; i++)
+	{
+		lpSlots[i].header.msg_iov = &lpSlots[i].vec;
+		lpSlots[i].header.msg_iovlen = 1;
+	}
+
+	// Room for the source address ahead of each packet
+	ZeroMemory(headers, sizeof(headers));
+	headers[RELAY_UP].msg_namelen = headers[RELAY_DOWN].msg_namelen = sizeof(struct sockaddr_in);
+
+	while (!relay->lStop && !lInterrupted)
+	{
+		for (int d = RELAY_UP; d <= RELAY_DOWN; d++)
+		{
+			if (!bArmed[d])
+				bArmed[d] = ring.RecvMultishot(relay->sides[d].nSocket, d, &headers[d], RING_DATA(RING_RECV, d, 0));
+		}
+
+		if (ring.Submit(RELAY_POLL_MS) < 0)
+			break;
+
+		int nCqes = ring.Reap(cqes, RELAY_RING_CQES);
+		bool bBatch[2] = { false, false };
+
+		for (int i = 0; i < nCqes; i++)
+		{
+			if ((cqes[i].user_data >> 32) == RING_RECV)
+				bBatch[(cqes[i].user_data >> 16) & 0xffff] = true;
+
+			relay_completion(relay, &ring, lpSlots, headers, bArmed, &cqes[i]);
+		}
+
+		for (int d = RELAY_UP; d <= RELAY_DOWN; d++)
+		{
+			if (bBatch[d])
+				relay->ullBatches[d]++;
+		}
+	}
+
+	// Cancels the sends still in flight before their slots go
+	ring.Close();
+	SAFE_FREE(lpSlots);
+
+	return true;
+}
+
+// Relay until told to stop, draining each readable socket as it comes up
+static bool relay_run(LPRELAY relay)
+{
+	struct pollfd fds[2];
+
+	if (relay->nFrontEnd == FRONT_URING)
+		return relay_ring(relay);
+
+	fds[RELAY_UP].fd = relay->sides[RELAY_UP].nSocket;
+	fds[RELAY_DOWN].fd = relay->sides[RELAY_DOWN].nSocket;
+
+	while (!relay->lStop && !lInterrupted)
+	{
+		fds[RELAY_UP].events = fds[RELAY_DOWN].events = POLLIN;
+
+		if (poll(fds, 2, RELAY_POLL_MS) <= 0)
+			continue;
+
+		for (int d = RELAY_UP; d <= RELAY_DOWN; d++)
+		{
+			if (!(fds[d].revents & POLLIN))
+				continue;
+
+			if (relay->nFrontEnd == FRONT_PLAIN)
+			{
+				while (relay_single(relay, d) > 0 && !relay->lStop)
+					;
+			}
+			else
+			{
+				while (relay_batch(relay, d) == relay->nBatch && !relay->lStop)
+					;
+			}
+		}
+	}
+
+	return true;
+}
+
+static void relay_report(LPRELAY relay)
+{
+	for (int d = RELAY_UP; d <= RELAY_DOWN; d++)
+	{
+		printf("%s %s\t%" PRINTF_INT64 "u packets, %" PRINTF_INT64 "u bytes, %.1f packets per batch\n", lpszFrontEnds[relay->nFrontEnd],
+			(d == RELAY_UP) ? "up  " : "down", relay->ullPackets[d], relay->ullBytes[d],
+			relay->ullBatches[d] ? (double)relay->ullPackets[d] / relay->ullBatches[d] : 0);
+	}
+
+	if (relay->dwDropped || relay->dwSendErrors || relay->dwOverruns)
+		printf("%s %u dropped, %u failed to send, %u ring overruns\n", lpszFrontEnds[relay->nFrontEnd], relay->dwDropped,
+			relay->dwSendErrors, relay->dwOverruns);
+}
+
+static DWORD WINAPI relay_thread(LPVOID lpParam)
+{
+	return relay_run((LPRELAY)lpParam) ? 0 : 1;
+}
+
+typedef struct
+{
+	int nSocket;
+	volatile LONG lStop;
+} ECHO, *LPECHO;
+
+// The stand-in simulator: every packet goes straight back to its sender
+static DWORD WINAPI echo_thread(LPVOID lpParam)
+{
+	LPECHO echo = (LPECHO)lpParam;
+	RELAYSIDE side;
+	struct pollfd fd;
+
+	if (!open_side(&side, echo->nSocket, RELAY_BATCH))
+		return 1;
+
+	fd.fd = echo->nSocket;
+	fd.events = POLLIN;
+
+	while (!echo->lStop)
+	{
+		if (poll(&fd, 1, RELAY_POLL_MS) <= 0)
+			continue;
+
+		for (int i = 0; i < RELAY_BATCH; i++)
+		{
+			side.lpInVecs[i].iov_len = RELAY_PACKET_LEN;
+			side.lpIn[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		}
+
+		int nRead = recvmmsg(echo->nSocket, side.lpIn, RELAY_BATCH, MSG_DONTWAIT, NULL);
+
+		for (int i = 0; i < nRead; i++)
+		{
+			side.lpInVecs[i].iov_len = side.lpIn[i].msg_len;
+			side.lpIn[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		}
+
+		for (int nSent = 0; nSent < nRead; )
+		{
+			int nRes = sendmmsg(echo->nSocket, &side.lpIn[nSent], nRead - nSent, 0);
+
+			if (nRes < 0 && errno != EINTR)
+				break;
+
+			if (nRes > 0)
+				nSent += nRes;
+		}
+	}
+
+	side.nSocket = -1;
+	close_side(&side);
+
+	return 0;
+}
+
+typedef struct
+{
+	DWORD dwDone;
+	DWORD dwLost;
+	double dSeconds;
+	LPDWORD lpSamples;			// Round trips in nanoseconds
+	int nSamples;
+} BENCHRESULT;
+
+static int compare_dword(const void *a, const void *b)
+{
+	DWORD dwA = *(const DWORD *)a;
+	DWORD dwB = *(const DWORD *)b;
+
+	return (dwA > dwB) - (dwA < dwB);
+}
+
+static DWORD percentile(BENCHRESULT *result, double dShare)
+{
+	if (!result->nSamples)
+		return 0;
+
+	return result->lpSamples[(int)(result->nSamples * dShare)];
+}
+
+// Play the packets at target with up to nWindow in flight, timing each
+// round trip by the sequence number it comes back with. Whatever hasn't
+// come back within BENCH_TIMEOUT_MS of the last reply is counted lost.
+static bool bench_run(struct sockaddr_in *target, LPBYTE lpPackets, size_t *lpOffsets, int nPackets, int nWindow, BENCHRESULT *result)
+{
+	struct sockaddr_in local;
+	static ULONGLONG ullSentAt[65536];
+	struct mmsghdr msgs[RELAY_MAX_BATCH];
+	struct iovec vecs[RELAY_MAX_BATCH];
+	LPBYTE lpReplies = (LPBYTE)malloc(RELAY_MAX_BATCH * RELAY_PACKET_LEN);
+	struct pollfd fd;
+
+	ZeroMemory(&local, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	ZeroMemory(result, sizeof(*result));
+	result->lpSamples = (LPDWORD)malloc(nPackets * sizeof(DWORD));
+
+	int nSocket = open_socket(&local, target);
+
+	if (nSocket < 0 || !lpReplies || !result->lpSamples)
+	{
+		SAFE_FREE(lpReplies);
+		return false;
+	}
+
+	fd.fd = nSocket;
+	fd.events = POLLIN;
+
+	if (nWindow > RELAY_MAX_BATCH)
+		nWindow = RELAY_MAX_BATCH;
+
+	int nNext = 0;
+	int nOutstanding = 0;
+	ULONGLONG ullStart = now_ns();
+
+	while ((DWORD)nNext < (DWORD)nPackets || nOutstanding > 0)
+	{
+		// Top the window up in one sendmmsg
+		int nBurst = 0;
+
+		while (nNext < nPackets && nOutstanding + nBurst < nWindow)
+		{
+			vecs[nBurst].iov_base = &lpPackets[lpOffsets[nNext]];
+			vecs[nBurst].iov_len = lpOffsets[nNext + 1] - lpOffsets[nNext];
+			ZeroMemory(&msgs[nBurst].msg_hdr, sizeof(msgs[nBurst].msg_hdr));
+			msgs[nBurst].msg_hdr.msg_iov = &vecs[nBurst];
+			msgs[nBurst].msg_hdr.msg_iovlen = 1;
+			nBurst++;
+			nNext++;
+		}
+
+		if (nBurst)
+		{
+			ULONGLONG ullNow = now_ns();
+
+			for (int i = 0; i < nBurst; i++)
+				ullSentAt[((LPBYTE)vecs[i].iov_base)[2] << 8 | ((LPBYTE)vecs[i].iov_base)[3]] = ullNow;
+
+			for (int nSent = 0; nSent < nBurst; )
+			{
+				int nRes = sendmmsg(nSocket, &msgs[nSent], nBurst - nSent, 0);
+
+				if (nRes < 0 && errno != EINTR)
+				{
+					result->dwLost += nBurst - nSent;
+					nOutstanding -= nBurst - nSent;
+					break;
+				}
+
+				if (nRes > 0)
+					nSent += nRes;
+			}
+
+			nOutstanding += nBurst;
+		}
+
+		if (poll(&fd, 1, BENCH_TIMEOUT_MS) <= 0)
+		{
+			result->dwLost += nOutstanding;
+			nOutstanding = 0;
+			continue;
+		}
+
+		for (int i = 0; i < RELAY_MAX_BATCH; i++)
+		{
+			vecs[i].iov_base = &lpReplies[i * RELAY_PACKET_LEN];
+			vecs[i].iov_len = RELAY_PACKET_LEN;
+			ZeroMemory(&msgs[i].msg_hdr, sizeof(msgs[i].msg_hdr));
+			msgs[i].msg_hdr.msg_iov = &vecs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		int nRead = recvmmsg(nSocket, msgs, RELAY_MAX_BATCH, MSG_DONTWAIT, NULL);
+		ULONGLONG ullNow = now_ns();
+
+		for (int i = 0; i < nRead; i++)
+		{
+			LPBYTE lpReply = (LPBYTE)vecs[i].iov_base;
+
+			if (msgs[i].msg_len < MSG_HEADER_LEN)
+				continue;
+
+			if (result->nSamples < nPackets)
+				result->lpSamples[result->nSamples++] = (DWORD)(ullNow - ullSentAt[lpReply[2] << 8 | lpReply[3]]);
+
+			result->dwDone++;
+
+			if (nOutstanding > 0)
+				nOutstanding--;
+		}
+	}
+
+	result->dSeconds = (now_ns() - ullStart) / 1000000000.0;
+
+	qsort(result->lpSamples, result->nSamples, sizeof(DWORD), compare_dword);
+
+	close(nSocket);
+	SAFE_FREE(lpReplies);
+
+	return true;
+}
+
+static void bench_report(const char *lpszPath, int nWindow, BENCHRESULT *result)
+{
+	printf("%-8s\t%d\t%u\t%u\t%.0f\t%.1f\t%.1f\t%.1f\n", lpszPath, nWindow, result->dwDone, result->dwLost,
+		(result->dSeconds > 0) ? result->dwDone / result->dSeconds : 0,
+		percentile(result, 0.50) / 1000.0, percentile(result, 0.99) / 1000.0, percentile(result, 0.999) / 1000.0);
+}
+
+// Measure the relay over loopback against a stand-in simulator that echoes
+// everything back: round trips straight to it, then through the relay with
+// each front end in turn, the plain recvfrom loop the hooks amount to
+// first. One packet at a time gives the latency a relay adds, a window at a
+// time its throughput. Each packet the relay passes is decoded twice, once
+// on the way up and once on the way back.
+static int bench(int nFrontEnd, int nBatch, int nPackets, int nWindow)
+{
+	CGenerator generator;
+	GENERATEDPACKET info;
+	ECHO echo;
+	RELAY relays[FRONT_ENDS];
+	struct sockaddr_in server;
+
+	// One circuit, all from the viewer and never resent, so each packet's
+	// sequence number tells its round trip apart
+	generator.m_options.nCircuits = 1;
+	generator.m_options.nSent = 100;
+	generator.m_options.nResent = 0;
+	generator.AddMix("observed");
+
+	// Packed back to back, each ending where the next starts
+	LPBYTE lpPackets = (LPBYTE)malloc((size_t)nPackets * generator.m_options.nMaxLen * 2);
+	size_t *lpOffsets = (size_t *)malloc((nPackets + 1) * sizeof(size_t));
+
+	if (!lpPackets || !lpOffsets)
+		return 1;
+
+	lpOffsets[0] = 0;
+
+	for (int i = 0; i < nPackets; i++)
+	{
+		int nLen = generator.Next(&lpPackets[lpOffsets[i]], generator.m_options.nMaxLen * 2, &info);
+
+		if (nLen < 0)
+			return 1;
+
+		lpOffsets[i + 1] = lpOffsets[i] + nLen;
+	}
+
+	// Every run replays the same sequence numbers
+	duplicate_policy = DUPLICATE_DECODE;
+
+	ZeroMemory(&server, sizeof(server));
+	server.sin_family = AF_INET;
+	server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	echo.lStop = 0;
+
+	if ((echo.nSocket = open_socket(&server, NULL)) < 0)
+	{
+		fprintf(stderr, "snowrelay: can't open loopback sockets\n");
+		return 1;
+	}
+
+	HANDLE hEcho = CreateThread(NULL, 0, echo_thread, &echo, 0, NULL);
+	BENCHRESULT direct[2];
+	BENCHRESULT results[FRONT_ENDS][2];
+	bool bRan[FRONT_ENDS];
+	int nLatency = (nPackets < BENCH_LATENCY_PACKETS) ? nPackets : BENCH_LATENCY_PACKETS;
+
+	ZeroMemory(results, sizeof(results));
+
+	printf("%d packets of %d message types, relay batches of up to %d\n\n", nPackets, generator.CountMix(), nBatch);
+	printf("Path    \tWindow\tDone\tLost\tpackets/s\tp50 us\tp99 us\tp99.9 us\n");
+
+	bench_run(&server, lpPackets, lpOffsets, nLatency, 1, &direct[0]);
+	bench_report("direct", 1, &direct[0]);
+	bench_run(&server, lpPackets, lpOffsets, nPackets, nWindow, &direct[1]);
+	bench_report("direct", nWindow, &direct[1]);
+
+	for (int f = 0; f < FRONT_ENDS; f++)
+	{
+		RELAY *relay = &relays[f];
+
+		bRan[f] = false;
+
+		if (nFrontEnd >= 0 && f != nFrontEnd)
+			continue;
+
+		if (f == FRONT_URING && !CUring::Supported())
+		{
+			printf("%-8s\tio_uring with buffer rings isn't available here\n", lpszFrontEnds[f]);
+			continue;
+		}
+
+		relay->server = server;
+		relay->listen = server;
+		relay->listen.sin_port = 0;
+
+		if (!relay_open(relay, f, nBatch))
+		{
+			fprintf(stderr, "snowrelay: can't open loopback sockets\n");
+			continue;
+		}
+
+		HANDLE hRelay = CreateThread(NULL, 0, relay_thread, relay, 0, NULL);
+
+		bench_run(&relay->listen, lpPackets, lpOffsets, nLatency, 1, &results[f][0]);
+		bench_report(lpszFrontEnds[f], 1, &results[f][0]);
+		bench_run(&relay->listen, lpPackets, lpOffsets, nPackets, nWindow, &results[f][1]);
+		bench_report(lpszFrontEnds[f], nWindow, &results[f][1]);
+
+		relay->lStop = 1;
+
+		WaitForSingleObject(hRelay, INFINITE);
+		CloseHandle(hRelay);
+
+		bRan[f] = true;
+	}
+
+	printf("\n");
+
+	for (int f = 0; f < FRONT_ENDS; f++)
+	{
+		if (!bRan[f])
+			continue;
+
+		printf("%-6s adds p50 %.1f us, p99 %.1f us one in flight; %.0f packets/s each way with %d in flight\n", lpszFrontEnds[f],
+			((double)percentile(&results[f][0], 0.50) - percentile(&direct[0], 0.50)) / 1000.0,
+			((double)percentile(&results[f][0], 0.99) - percentile(&direct[0], 0.99)) / 1000.0,
+			(results[f][1].dSeconds > 0) ? results[f][1].dwDone / results[f][1].dSeconds : 0, nWindow);
+	}
+
+	printf("\n");
+
+	for (int f = 0; f < FRONT_ENDS; f++)
+	{
+		if (!bRan[f])
+			continue;
+
+		relay_report(&relays[f]);
+		relay_close(&relays[f]);
+	}
+
+	echo.lStop = 1;
+
+	WaitForSingleObject(hEcho, INFINITE);
+	CloseHandle(hEcho);
+	close(echo.nSocket);
+
+	for (int i = 0; i < 2; i++)
+	{
+		SAFE_FREE(direct[i].lpSamples);
+
+		for (int f = 0; f < FRONT_ENDS; f++)
+			SAFE_FREE(results[f][i].lpSamples);
+	}
+
+	SAFE_FREE(lpPackets);
+	SAFE_FREE(lpOffsets);
+
+	return 0;
+}
+
+// A standalone front end for the engine: a UDP relay between a viewer and
+// a simulator that decodes every packet both ways as the hooks would and
+// passes it on, batched with recvmmsg and sendmmsg, or through io_uring
+// with -f uring. Linux only. With -B it benchmarks itself over loopback
+// instead, every front end unless -f picks one.
+int main(int argc, char *argv[])
+{
+	int nFrontEnd = -1;
+	int nBatch = RELAY_BATCH;
+	int nPackets = BENCH_PACKETS;
+	int nWindow = BENCH_WINDOW;
+	bool bBench = false;
+	int nArg = 1;
+
+	while (nArg < argc && argv[nArg][0] == '-')
+	{
+		if (!strcmp(argv[nArg], "-B"))
+			bBench = true;
+		else if (!strcmp(argv[nArg], "-f") && nArg + 1 < argc)
+		{
+			const char *lpszFrontEnd = argv[++nArg];
+
+			for (nFrontEnd = FRONT_ENDS - 1; nFrontEnd >= 0; nFrontEnd--)
+			{
+				if (!strcmp(lpszFrontEnd, lpszFrontEnds[nFrontEnd]))
+					break;
+			}
+
+			if (nFrontEnd < 0)
+			{
+				usage();
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[nArg], "-b") && nArg + 1 < argc)
+			nBatch = atoi(argv[++nArg]);
+		else if (!strcmp(argv[nArg], "-n") && nArg + 1 < argc)
+			nPackets = atoi(argv[++nArg]);
+		else if (!strcmp(argv[nArg], "-w") && nArg + 1 < argc)
+			nWindow = atoi(argv[++nArg]);
+		else
+			break;
+
+		nArg++;
+	}
+
+	if (argc - nArg != (bBench ? 1 : 3) || nBatch < 1 || nBatch > RELAY_MAX_BATCH || nPackets < 1 || nWindow < 1)
+	{
+		usage();
+		return 1;
+	}
+
+	if (load_template(argv[nArg]) < 0)
+	{
+		fprintf(stderr, "snowrelay: can't load template %s\n", argv[nArg]);
+		return 1;
+	}
+
+	if (!engine.Start(cmds_count))
+		return 1;
+
+	signal(SIGINT, on_interrupt);
+	signal(SIGTERM, on_interrupt);
+
+	if (bBench)
+	{
+		int nRes = bench(nFrontEnd, nBatch, nPackets, nWindow);
+
+		servers.FreeServers();
+		engine.Stop();
+
+		return nRes;
+	}
+
+	RELAY relay;
+
+	if (!parse_address(argv[nArg + 1], &relay.listen) || !parse_address(argv[nArg + 2], &relay.server) ||
+		relay.server.sin_addr.s_addr == htonl(INADDR_ANY))
+	{
+		usage();
+		return 1;
+	}
+
+	if (nFrontEnd < 0)
+		nFrontEnd = FRONT_MMSG;
+
+	if (!relay_open(&relay, nFrontEnd, nBatch))
+	{
+		fprintf(stderr, "snowrelay: can't listen on %s\n", argv[nArg + 1]);
+		return 1;
+	}
+
+	printf("relaying %s:%u to %s\n", inet_ntoa(relay.listen.sin_addr), ntohs(relay.listen.sin_port), argv[nArg + 2]);
+	fflush(stdout);
+
+	ULONGLONG ullStart = now_ns();
+
+	if (!relay_run(&relay))
+	{
+		fprintf(stderr, "snowrelay: can't set up io_uring with buffer rings\n");
+		relay_close(&relay);
+		return 1;
+	}
+
+	double dSeconds = (now_ns() - ullStart) / 1000000000.0;
+
+	printf("\n%.1f seconds, %.0f packets/s\n", dSeconds,
+		(dSeconds > 0) ? (relay.ullPackets[RELAY_UP] + relay.ullPackets[RELAY_DOWN]) / dSeconds : 0);
+	relay_report(&relay);
+	relay_close(&relay);
+
+	servers.FreeServers();
+	engine.Stop();
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,504 @@
+#include "stdafx.h"
+#include "./Protocol.h"
+#include "./Decoder.h"
+#include "./Latency.h"
+#include "./PcapReader.h"
+#include "./Archive.h"
+
+// Packets read from a pcap at a time
+#define REPLAY_BATCH		256
+
+// Room for a packet a handler has lengthened, as a viewer's buffer would have
+#define REPLAY_PACKET_LEN	16384
+
+// Per packet stage timings kept for the percentiles; later ones are only summed
+#define REPLAY_MAX_SAMPLES	(4 * 1024 * 1024)
+
+// The whole packet, lookup to re-encode, after the stages
+#define REPLAY_TOTAL		MAX_STAGES
+
+typedef struct
+{
+	ULONGLONG ullTime;			// Microseconds since the epoch
+	struct sockaddr_in address;
+	bool bSent;
+	int nLen;
+	size_t stOffset;			// Into the replay's data
+} REPLAYPACKET, *LPREPLAYPACKET;
+
+static LPREPLAYPACKET lpPackets = NULL;
+static int nPackets = 0;
+static int nMaxPackets = 0;
+static LPBYTE lpData = NULL;
+static size_t stData = 0;
+static size_t stMaxData = 0;
+
+static const char *lpszStages[] = { "lookup", "acks", "decode", "dispatch", "encode", "total" };
+
+// Allocations are counted by standing in for the C library's allocator,
+// which new goes through as well
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+#define REPLAY_COUNT_ALLOCS
+
+static volatile LONG lAllocs = 0;
+
+extern "C"
+{
+	void *__libc_malloc(size_t stSize);
+	void *__libc_calloc(size_t stCount, size_t stSize);
+	void *__libc_realloc(void *lpPtr, size_t stSize);
+
+	void *malloc(size_t stSize)
+	{
+		InterlockedIncrement(&lAllocs);
+		return __libc_malloc(stSize);
+	}
+
+	void *calloc(size_t stCount, size_t stSize)
+	{
+		InterlockedIncrement(&lAllocs);
+		return __libc_calloc(stCount, stSize);
+	}
+
+	void *realloc(void *lpPtr, size_t stSize)
+	{
+		InterlockedIncrement(&lAllocs);
+		return __libc_realloc(lpPtr, stSize);
+	}
+}
+#endif
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: snowreplay [-s speed] [-n passes] [-f] <message_template.msg> <capture>\n");
+	fprintf(stderr, "                  [viewer address[:port]]\n");
+}
+
+// A viewer given without a port matches any port at that address
+static bool is_viewer(struct sockaddr_in *address, struct sockaddr_in *viewer)
+{
+	return address->sin_addr.s_addr == viewer->sin_addr.s_addr && (!viewer->sin_port || address->sin_port == viewer->sin_port);
+}
+
+static bool add_packet(ULONGLONG ullTime, struct sockaddr_in *address, bool bSent, LPBYTE lpPacket, int nLen)
+{
+	if (nLen <= 0 || nLen > REPLAY_PACKET_LEN)
+		return true;
+
+	if (nPackets == nMaxPackets)
+	{
+		int nNewMax = nMaxPackets ? nMaxPackets * 2 : 4096;
+		LPREPLAYPACKET lpNew = (LPREPLAYPACKET)realloc(lpPackets, nNewMax * sizeof(REPLAYPACKET));
+
+		if (!lpNew)
+			return false;
+
+		lpPackets = lpNew;
+		nMaxPackets = nNewMax;
+	}
+
+	if (stData + nLen > stMaxData)
+	{
+		size_t stNewMax = stMaxData ? stMaxData * 2 : 1024 * 1024;
+
+		while (stNewMax < stData + nLen)
+			stNewMax *= 2;
+
+		LPBYTE lpNew = (LPBYTE)realloc(lpData, stNewMax);
+
+		if (!lpNew)
+			return false;
+
+		lpData = lpNew;
+		stMaxData = stNewMax;
+	}
+
+	LPREPLAYPACKET lpReplay = &lpPackets[nPackets++];
+
+	lpReplay->ullTime = ullTime;
+	lpReplay->address = *address;
+	lpReplay->bSent = bSent;
+	lpReplay->nLen = nLen;
+	lpReplay->stOffset = stData;
+
+	memcpy(&lpData[stData], lpPacket, nLen);
+	stData += nLen;
+
+	return true;
+}
+
+// A pcap or pcapng capture, telling the viewer's packets apart as
+// snowdecode does
+static bool load_pcap(const char *lpszPath, struct sockaddr_in *viewer, bool bViewer)
+{
+	CPcapReader reader;
+	PCAPPACKET packets[REPLAY_BATCH];
+	LPCOMMAND use_circuit_code = find_command("UseCircuitCode");
+	int nRead;
+
+	if (!reader.Open(lpszPath))
+		return false;
+
+	while ((nRead = reader.Read(packets, REPLAY_BATCH)) > 0)
+	{
+		for (int i = 0; i < nRead; i++)
+		{
+			LPPCAPPACKET lpPacket = &packets[i];
+
+			if (!bViewer && use_circuit_code && lpPacket->nLen > MSG_HEADER_LEN &&
+				peek_command(lpPacket->lpData, lpPacket->nLen, NULL) == use_circuit_code)
+			{
+				*viewer = lpPacket->source;
+				bViewer = true;
+			}
+
+			bool bSent = bViewer && is_viewer(&lpPacket->source, viewer);
+
+			if (bViewer && !bSent && !is_viewer(&lpPacket->dest, viewer))
+				continue;
+
+			if (!add_packet(lpPacket->ullTime, bSent ? &lpPacket->dest : &lpPacket->source, bSent, lpPacket->lpData, lpPacket->nLen))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static bool load_archive(const char *lpszPath)
+{
+	CArchiveReader reader;
+	ARCHIVEQUERY query;
+	ARCHIVEPACKET packet;
+
+	if (!reader.Open(lpszPath))
+		return false;
+
+	ZeroMemory(&query, sizeof(query));
+	query.dwMessage = ARCHIVE_ANY_MESSAGE;
+
+	reader.Seek(&query);
+
+	while (reader.Next(&packet))
+	{
+		if (!add_packet(packet.ullTime, &packet.address, packet.bSent, packet.lpData, packet.nLen))
+			return false;
+	}
+
+	return true;
+}
+
+// The hooks' own capture format, stamped in milliseconds
+static bool load_capture(const char *lpszPath)
+{
+	CCapture capture;
+	CAPTURERECORD *record;
+	LPBYTE lpPacket;
+
+	if (!capture.Load(lpszPath))
+		return false;
+
+	while (capture.Next(&record, &lpPacket))
+	{
+		struct sockaddr_in address;
+
+		ZeroMemory(&address, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = record->dwAddress;
+		address.sin_port = record->wPort;
+
+		if (!add_packet((ULONGLONG)record->dwTime * 1000, &address, (record->cFlags & CAPTURE_SENT) != 0, lpPacket, record->wLen))
+			return false;
+	}
+
+	return true;
+}
+
+static int send_nothing(LPVOID lpParam)
+{
+	return *(int *)lpParam;
+}
+
+static int compare_dword(const void *a, const void *b)
+{
+	DWORD dwA = *(const DWORD *)a;
+	DWORD dwB = *(const DWORD *)b;
+
+	return (dwA > dwB) - (dwA < dwB);
+}
+
+// Percentiles of a set of samples. For a stage only the packets that
+// reached it count; those that never did have no time at all.
+static void report_stage(const char *lpszStage, LPDWORD lpSamples, int nSamples, bool bAll)
+{
+	int nUsed = 0;
+
+	for (int i = 0; i < nSamples; i++)
+	{
+		if (lpSamples[i] || bAll)
+			lpSamples[nUsed++] = lpSamples[i];
+	}
+
+	if (!nUsed)
+	{
+		printf("%-10s\t%d\n", lpszStage, 0);
+		return;
+	}
+
+	qsort(lpSamples, nUsed, sizeof(DWORD), compare_dword);
+
+	printf("%-10s\t%d\t%u\t%u\t%u\t%u\t%u\n", lpszStage, nUsed,
+		lpSamples[(int)(nUsed * 0.50)], lpSamples[(int)(nUsed * 0.90)],
+		lpSamples[(int)(nUsed * 0.99)], lpSamples[(int)(nUsed * 0.999)],
+		lpSamples[nUsed - 1]);
+}
+
+static ULONGLONG now_us(LONGLONG llFrequency)
+{
+	LARGE_INTEGER liNow;
+
+	QueryPerformanceCounter(&liNow);
+
+	return (ULONGLONG)(liNow.QuadPart / llFrequency) * 1000000 + (ULONGLONG)(liNow.QuadPart % llFrequency) * 1000000 / llFrequency;
+}
+
+// The reference load test for the engine. Replays a capture through the
+// same receive and send paths the hooks run, circuit lookup through
+// handlers and re-encoding, either flat out or on the capture's own clock,
+// optionally sped up. Reports throughput, per stage latency percentiles and
+// allocations per packet.
+int main(int argc, char *argv[])
+{
+	struct sockaddr_in viewer;
+	bool bViewer = false;
+	double dSpeed = 0;
+	int nPasses = 1;
+	bool bStages = true;
+	int nArg = 1;
+
+	while (nArg < argc && argv[nArg][0] == '-')
+	{
+		if (!strcmp(argv[nArg], "-s") && nArg + 1 < argc)
+			dSpeed = atof(argv[++nArg]);
+		else if (!strcmp(argv[nArg], "-n") && nArg + 1 < argc)
+			nPasses = atoi(argv[++nArg]);
+		else if (!strcmp(argv[nArg], "-f"))
+			bStages = false;
+		else
+			break;
+
+		nArg++;
+	}
+
+	if (argc - nArg < 2 || nPasses < 1 || dSpeed < 0)
+	{
+		usage();
+		return 1;
+	}
+
+	ZeroMemory(&viewer, sizeof(viewer));
+	viewer.sin_family = AF_INET;
+
+	if (argc - nArg > 2)
+	{
+		char szAddress[64];
+		char *lpszPort;
+
+		strncpy(szAddress, argv[nArg + 2], sizeof(szAddress) - 1);
+		szAddress[sizeof(szAddress) - 1] = '\0';
+
+		if ((lpszPort = strchr(szAddress, ':')) != NULL)
+		{
+			*lpszPort++ = '\0';
+			viewer.sin_port = htons((WORD)atoi(lpszPort));
+		}
+
+		viewer.sin_addr.s_addr = inet_addr(szAddress);
+		bViewer = true;
+	}
+
+	if (load_template(argv[nArg]) < 0)
+	{
+		fprintf(stderr, "snowreplay: can't load template %s\n", argv[nArg]);
+		return 1;
+	}
+
+	if (!load_pcap(argv[nArg + 1], &viewer, bViewer) && !load_archive(argv[nArg + 1]) && !load_capture(argv[nArg + 1]))
+	{
+		fprintf(stderr, "snowreplay: can't read capture %s\n", argv[nArg + 1]);
+		return 1;
+	}
+
+	if (!nPackets || !engine.Start(cmds_count))
+	{
+		fprintf(stderr, "snowreplay: nothing to replay in %s\n", argv[nArg + 1]);
+		return 1;
+	}
+
+	// Every pass replays the same sequence numbers, so don't let the
+	// duplicate window skip the later ones
+	if (nPasses > 1)
+		duplicate_policy = DUPLICATE_DECODE;
+
+	LARGE_INTEGER liFrequency;
+
+	QueryPerformanceFrequency(&liFrequency);
+
+	LONGLONG llFrequency = liFrequency.QuadPart;
+	ULONGLONG ullTotal = (ULONGLONG)nPackets * nPasses;
+	int nSamples = (ullTotal < REPLAY_MAX_SAMPLES) ? (int)ullTotal : REPLAY_MAX_SAMPLES;
+	LPDWORD lpSamples[MAX_STAGES + 1];
+	LPDWORD lpLag = NULL;
+
+	ZeroMemory(lpSamples, sizeof(lpSamples));
+
+	if (bStages)
+	{
+		for (int i = 0; i <= MAX_STAGES; i++)
+		{
+			lpSamples[i] = (LPDWORD)calloc(nSamples, sizeof(DWORD));
+
+			if (!lpSamples[i])
+				return 1;
+		}
+	}
+
+	if (dSpeed > 0 && !(lpLag = (LPDWORD)calloc(nSamples, sizeof(DWORD))))
+		return 1;
+
+	BYTE bPacket[REPLAY_PACKET_LEN];
+	LONGLONG llStageTicks[MAX_STAGES + 1];
+	ULONGLONG ullBytes = 0;
+	DWORD dwReceived = 0;
+	DWORD dwSent = 0;
+	DWORD dwOversized = 0;
+
+	ZeroMemory(llStageTicks, sizeof(llStageTicks));
+
+#ifdef REPLAY_COUNT_ALLOCS
+	LONG lAllocsBefore = lAllocs;
+#endif
+
+	ULONGLONG ullStart = now_us(llFrequency);
+	ULONGLONG ullClock = ullStart;
+
+	for (int p = 0; p < nPasses; p++)
+	{
+		ULONGLONG ullFirst = lpPackets[0].ullTime;
+
+		// Recorded timing restarts with every pass
+		ullClock = now_us(llFrequency);
+
+		for (int i = 0; i < nPackets; i++)
+		{
+			LPREPLAYPACKET lpReplay = &lpPackets[i];
+			LONGLONG llStages[MAX_STAGES];
+			ULONGLONG ullSample = (ULONGLONG)p * nPackets + i;
+
+			if (dSpeed > 0)
+			{
+				ULONGLONG ullDue = ullClock + (ULONGLONG)((lpReplay->ullTime - ullFirst) / dSpeed);
+				ULONGLONG ullNow;
+
+				// Sleep while there's time to, then spin the rest
+				while ((ullNow = now_us(llFrequency)) < ullDue)
+				{
+					if (ullDue - ullNow > 2000)
+						Sleep(1);
+				}
+
+				if (ullSample < (ULONGLONG)nSamples)
+					lpLag[ullSample] = (DWORD)(ullNow - ullDue);
+			}
+
+			memcpy(bPacket, &lpData[lpReplay->stOffset], lpReplay->nLen);
+			ZeroMemory(llStages, sizeof(llStages));
+
+			if (lpReplay->bSent)
+			{
+				send_packet(&servers, bPacket, lpReplay->nLen, &lpReplay->address, send_nothing, &lpReplay->nLen, bStages ? llStages : NULL);
+				dwSent++;
+			}
+			else
+			{
+				if (receive_packet(&servers, bPacket, lpReplay->nLen, sizeof(bPacket), &lpReplay->address, bStages ? llStages : NULL) < 0)
+					dwOversized++;
+
+				dwReceived++;
+			}
+
+			ullBytes += lpReplay->nLen;
+
+			if (!bStages)
+				continue;
+
+			LONGLONG llTotal = 0;
+
+			for (int s = 0; s < MAX_STAGES; s++)
+			{
+				llStageTicks[s] += llStages[s];
+				llTotal += llStages[s];
+
+				if (ullSample < (ULONGLONG)nSamples)
+					lpSamples[s][ullSample] = (DWORD)(llStages[s] * 1000000000 / llFrequency);
+			}
+
+			llStageTicks[REPLAY_TOTAL] += llTotal;
+
+			if (ullSample < (ULONGLONG)nSamples)
+				lpSamples[REPLAY_TOTAL][ullSample] = (DWORD)(llTotal * 1000000000 / llFrequency);
+		}
+	}
+
+	double dSeconds = (now_us(llFrequency) - ullStart) / 1000000.0;
+
+#ifdef REPLAY_COUNT_ALLOCS
+	LONG lAllocsDuring = lAllocs - lAllocsBefore;
+#endif
+
+	printf("%" PRINTF_INT64 "u packets, %u received and %u sent, %" PRINTF_INT64 "u bytes, %d passes on %s timing\n",
+		ullTotal, dwReceived, dwSent, ullBytes, nPasses, (dSpeed > 0) ? "recorded" : "no");
+	printf("%.3f seconds, %.0f packets/s, %.1f MB/s\n", dSeconds,
+		(dSeconds > 0) ? ullTotal / dSeconds : 0, (dSeconds > 0) ? ullBytes / dSeconds / 1048576.0 : 0);
+
+#ifdef REPLAY_COUNT_ALLOCS
+	printf("%.3f allocations per packet\n", (double)lAllocsDuring / ullTotal);
+#else
+	printf("allocations not counted in this build\n");
+#endif
+
+	if (dwOversized)
+		printf("%u rewritten packets no longer fit\n", dwOversized);
+
+	if (bStages)
+	{
+		printf("\nStage     \tPackets\tp50 ns\tp90 ns\tp99 ns\tp99.9 ns\tmax ns\n");
+
+		for (int s = 0; s <= MAX_STAGES; s++)
+			report_stage(lpszStages[s], lpSamples[s], nSamples, false);
+
+		printf("\nStage     \tShare of total\n");
+
+		for (int s = 0; s < MAX_STAGES; s++)
+			printf("%-10s\t%.1f%%\n", lpszStages[s], llStageTicks[REPLAY_TOTAL] ? 100.0 * llStageTicks[s] / llStageTicks[REPLAY_TOTAL] : 0);
+	}
+
+	// How far behind the capture's clock packets went in
+	if (lpLag)
+	{
+		printf("\n          \tPackets\tp50 us\tp90 us\tp99 us\tp99.9 us\tmax us\n");
+		report_stage("late", lpLag, nSamples, true);
+	}
+
+	for (int i = 0; i <= MAX_STAGES; i++)
+		SAFE_FREE(lpSamples[i]);
+
+	SAFE_FREE(lpLag);
+	SAFE_FREE(lpPackets);
+	SAFE_FREE(lpData);
+
+	servers.FreeServers();
+	engine.Stop();
+
+	return 0;
+}
\ No newline at end of file
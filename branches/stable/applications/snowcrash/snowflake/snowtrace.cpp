@@ -0,0 +1,411 @@
+#include "stdafx.h"
+#include "./Protocol.h"
+#include "./PacketIndex.h"
+#include "./MappedFile.h"
+#include "./Trace.h"
+#include "./keywords.h"
+#include <float.h>
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: snowtrace [-j] [-m message] <message_template.msg> <trace>\n");
+}
+
+// Quoted and escaped for JSON, or as is for text
+static void print_string(LPBYTE lpData, int nLen, bool bJson)
+{
+	if (!bJson)
+	{
+		fwrite(lpData, 1, nLen, stdout);
+		return;
+	}
+
+	putchar('"');
+
+	for (int i = 0; i < nLen; i++)
+	{
+		if (lpData[i] == '"' || lpData[i] == '\\')
+			printf("\\%c", lpData[i]);
+		else if (lpData[i] < 0x20)
+			printf("\\u%04x", lpData[i]);
+		else
+			putchar(lpData[i]);
+	}
+
+	putchar('"');
+}
+
+static void print_hex(LPBYTE lpData, int nLen, bool bJson)
+{
+	if (bJson)
+		putchar('"');
+
+	for (int i = 0; i < nLen; i++)
+		printf("%02x", lpData[i]);
+
+	if (bJson)
+		putchar('"');
+}
+
+// JSON has no NaN or infinity
+static void print_float(double dValue, bool bJson)
+{
+	if (bJson && dValue != dValue)
+		printf("null");
+	else if (bJson && (dValue > DBL_MAX || dValue < -DBL_MAX))
+		printf("null");
+	else
+		printf(bJson ? "%.9g" : "%f", dValue);
+}
+
+static void print_floats(LPBYTE lpData, int nCount, bool bDouble, bool bJson)
+{
+	if (bJson && nCount > 1)
+		putchar('[');
+
+	for (int i = 0; i < nCount; i++)
+	{
+		double dValue;
+
+		if (bDouble)
+			memcpy(&dValue, &lpData[i * sizeof(double)], sizeof(double));
+		else
+		{
+			FLOAT fValue;
+			memcpy(&fValue, &lpData[i * sizeof(FLOAT)], sizeof(FLOAT));
+			dValue = fValue;
+		}
+
+		if (i)
+			printf(", ");
+
+		print_float(dValue, bJson);
+	}
+
+	if (bJson && nCount > 1)
+		putchar(']');
+}
+
+// One field's value, rendered the way CVar::Dump does for text
+static void print_value(LPCOMMANDVAR lpVar, LPBYTE lpData, int nLen, bool bJson)
+{
+	switch (lpVar->nType)
+	{
+		case LLTYPE_U8:
+			printf("%u", lpData[0]);
+			break;
+
+		case LLTYPE_U16:
+			{
+				WORD wData;
+				memcpy(&wData, lpData, sizeof(wData));
+				printf("%u", wData);
+			}
+			break;
+
+		case LLTYPE_U32:
+			{
+				DWORD dwData;
+				memcpy(&dwData, lpData, sizeof(dwData));
+				printf("%u", dwData);
+			}
+			break;
+
+		case LLTYPE_U64:
+			{
+				ULONGLONG ullData;
+				memcpy(&ullData, lpData, sizeof(ullData));
+				printf("%" PRINTF_INT64 "u", ullData);
+			}
+			break;
+
+		case LLTYPE_S8:
+			printf("%d", (signed char)lpData[0]);
+			break;
+
+		case LLTYPE_S16:
+			{
+				SHORT sData;
+				memcpy(&sData, lpData, sizeof(sData));
+				printf("%d", sData);
+			}
+			break;
+
+		case LLTYPE_S32:
+			{
+				LONG nData;
+				memcpy(&nData, lpData, sizeof(nData));
+				printf("%d", nData);
+			}
+			break;
+
+		case LLTYPE_F32:
+			print_floats(lpData, 1, false, bJson);
+			break;
+
+		case LLTYPE_F64:
+			print_floats(lpData, 1, true, bJson);
+			break;
+
+		case LLTYPE_BOOL:
+			if (bJson)
+				printf(lpData[0] ? "true" : "false");
+			else
+				printf(lpData[0] ? "True" : "False");
+			break;
+
+		case LLTYPE_LLVECTOR3:
+			print_floats(lpData, 3, false, bJson);
+			break;
+
+		case LLTYPE_LLVECTOR3D:
+			print_floats(lpData, 3, true, bJson);
+			break;
+
+		case LLTYPE_QUATERNION:
+			print_floats(lpData, 4, false, bJson);
+			break;
+
+		case LLTYPE_IPADDR:
+			printf(bJson ? "\"%u.%u.%u.%u\"" : "%u.%u.%u.%u", lpData[0], lpData[1], lpData[2], lpData[3]);
+			break;
+
+		case LLTYPE_IPPORT:
+			{
+				WORD wData;
+				memcpy(&wData, lpData, sizeof(wData));
+				printf("%u", ntohs(wData));
+			}
+			break;
+
+		case LLTYPE_VARIABLE:
+			{
+				bool bPrintable = nLen > 0 && lpData[nLen - 1] == '\0';
+
+				for (int i = 0; i < nLen - 1 && bPrintable; i++)
+				{
+					if ((lpData[i] < 0x20 || lpData[i] > 0x7e) && lpData[i] != 0x09 && lpData[i] != 0x0d && lpData[i] != 0x0a)
+						bPrintable = false;
+				}
+
+				if (bPrintable)
+					print_string(lpData, nLen - 1, bJson);
+				else
+					print_hex(lpData, nLen, bJson);
+			}
+			break;
+
+		// UUIDs, fixed blobs and the types Dump leaves out
+		default:
+			print_hex(lpData, nLen, bJson);
+			break;
+	}
+}
+
+// Every field of every block against the template
+static void print_blocks(CPacketIndex *index, bool bJson)
+{
+	if (bJson)
+		printf(", \"blocks\": {");
+
+	for (int b = 0; b < index->m_nBlocks; b++)
+	{
+		LPPACKETBLOCK block = &index->m_lpBlocks[b];
+		char *lpszBlock = block->lpStruct->lpszStruct ? block->lpStruct->lpszStruct : (char *)"?";
+
+		if (bJson)
+			printf("%s\"%s\": [", b ? ", " : "", lpszBlock);
+
+		for (int i = 0; i < block->cItems; i++)
+		{
+			if (bJson)
+				printf("%s{", i ? ", " : "");
+
+			for (int v = 0; v < block->nVars; v++)
+			{
+				LPCOMMANDVAR lpVar = index->m_lpVars[block->nFirstVar + v];
+				char *lpszVar = lpVar->lpszVar ? lpVar->lpszVar : (char *)"?";
+				int nLen;
+				LPBYTE lpData = index->GetVar(b, i, v, nLen);
+
+				if (bJson)
+					printf("%s\"%s\": ", v ? ", " : "", lpszVar);
+				else if (block->cItems > 1 || block->lpStruct->nType != LLTYPE_SINGLE)
+					printf("\t%s[%d].%s: ", lpszBlock, i, lpszVar);
+				else
+					printf("\t%s.%s: ", lpszBlock, lpszVar);
+
+				print_value(lpVar, lpData, nLen, bJson);
+
+				if (!bJson)
+					putchar('\n');
+			}
+
+			if (bJson)
+				putchar('}');
+		}
+
+		if (bJson)
+			putchar(']');
+	}
+
+	if (bJson)
+		putchar('}');
+}
+
+// Renders a trace written by the hooks or by snowdecode -t, as text or as
+// one JSON object per line. All the formatting the packet path skipped
+// happens here, against the same template.
+int main(int argc, char *argv[])
+{
+	bool bJson = false;
+	char *lpszMessage = NULL;
+	int nArg = 1;
+
+	while (nArg < argc && argv[nArg][0] == '-')
+	{
+		if (!strcmp(argv[nArg], "-j"))
+			bJson = true;
+		else if (!strcmp(argv[nArg], "-m") && nArg + 1 < argc)
+			lpszMessage = argv[++nArg];
+		else
+			break;
+
+		nArg++;
+	}
+
+	if (argc - nArg != 2)
+	{
+		usage();
+		return 1;
+	}
+
+	if (load_template(argv[nArg]) < 0)
+	{
+		fprintf(stderr, "snowtrace: can't load template %s\n", argv[nArg]);
+		return 1;
+	}
+
+	DWORD dwFilter = 0;
+	bool bFilter = false;
+
+	if (lpszMessage)
+	{
+		LPCOMMAND lpCommand = find_command(lpszMessage);
+
+		if (!lpCommand)
+		{
+			fprintf(stderr, "snowtrace: no message %s in the template\n", lpszMessage);
+			return 1;
+		}
+
+		dwFilter = command_number(lpCommand);
+		bFilter = true;
+	}
+
+	CMappedFile file;
+	TRACEHEADER header;
+
+	if (!file.Open(argv[nArg + 1]) || file.m_stLen < sizeof(header))
+	{
+		fprintf(stderr, "snowtrace: can't read trace %s\n", argv[nArg + 1]);
+		return 1;
+	}
+
+	memcpy(&header, file.m_lpData, sizeof(header));
+
+	if (header.dwMagic != TRACE_MAGIC || header.dwVersion != TRACE_VERSION)
+	{
+		fprintf(stderr, "snowtrace: %s is not a trace\n", argv[nArg + 1]);
+		return 1;
+	}
+
+	CPacketIndex index;
+	size_t stPos = sizeof(header);
+	DWORD dwRecords = 0;
+	DWORD dwShown = 0;
+	DWORD dwShort = 0;
+
+	// A record cut short by a crash ends the trace
+	while (stPos + sizeof(TRACERECORD) <= file.m_stLen)
+	{
+		TRACERECORD record;
+
+		memcpy(&record, &file.m_lpData[stPos], sizeof(record));
+
+		if (stPos + sizeof(record) + record.wLen > file.m_stLen)
+			break;
+
+		LPBYTE lpData = &file.m_lpData[stPos + sizeof(record)];
+		int nLen = record.wLen;
+
+		stPos += sizeof(record) + record.wLen;
+		dwRecords++;
+
+		if (bFilter && record.dwMessage != dwFilter)
+			continue;
+
+		LPCOMMAND lpCommand = number_command(record.dwMessage);
+		char *lpszCmd = (lpCommand && lpCommand->lpszCmd) ? lpCommand->lpszCmd : (char *)"?";
+		struct in_addr address;
+		WORD wSequence = 0;
+		int nPos = (record.dwMessage < 0xff00) ? 5 : (record.dwMessage < 0xffff0000) ? 6 : 8;
+
+		address.s_addr = record.dwAddress;
+
+		if (nLen >= MSG_HEADER_LEN)
+		{
+			memcpy(&wSequence, &lpData[2], sizeof(wSequence));
+			wSequence = ntohs(wSequence);
+		}
+
+		// Decoded copies are stored, so the zerocoded flag is history
+		BYTE cFlags = (nLen > 0) ? lpData[0] : 0;
+
+		if (bJson)
+		{
+			printf("{\"time\": %" PRINTF_INT64 "u.%06u, \"circuit\": \"%s:%u\", \"direction\": \"%s\", \"message\": \"%s\", \"number\": %u, \"sequence\": %u, \"flags\": %u, \"length\": %d",
+				record.ullTime / 1000000, (DWORD)(record.ullTime % 1000000),
+				inet_ntoa(address), ntohs(record.wPort),
+				(record.cFlags & TRACE_SENT) ? "out" : "in",
+				lpszCmd, record.dwMessage, wSequence, cFlags, nLen);
+		}
+		else
+		{
+			printf("%" PRINTF_INT64 "u.%06u\t%s:%u\t%s\t%s\t#%u%s%s\n",
+				record.ullTime / 1000000, (DWORD)(record.ullTime % 1000000),
+				inet_ntoa(address), ntohs(record.wPort),
+				(record.cFlags & TRACE_SENT) ? "out" : "in",
+				lpszCmd, wSequence,
+				(cFlags & MSG_RELIABLE) ? " reliable" : "",
+				(cFlags & MSG_RESENT) ? " resent" : "");
+		}
+
+		if (lpCommand && lpCommand->lpszCmd && index.Build(lpCommand, lpData, nLen, nPos, nLen))
+			print_blocks(&index, bJson);
+		else
+		{
+			if (bJson)
+				printf(", \"raw\": ");
+			else
+				printf("\traw: ");
+
+			print_hex(lpData, nLen, bJson);
+
+			if (!bJson)
+				putchar('\n');
+
+			dwShort++;
+		}
+
+		if (bJson)
+			putchar('}');
+
+		putchar('\n');
+		dwShown++;
+	}
+
+	fprintf(stderr, "%u of %u records, %u left raw\n", dwShown, dwRecords, dwShort);
+
+	return 0;
+}
\ No newline at end of file
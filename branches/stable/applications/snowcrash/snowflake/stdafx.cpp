@@ -5,34 +5,50 @@
 #include "stdafx.h"
 
 #ifdef ECHO
+#include "./Log.h"
+
 FILE *fpLog = NULL;
-#endif
 
-#ifdef ECHODEBUG
-void dprintf(TCHAR *format, ...)
+// Hand a line to the logger, or write it here if the logger isn't running
+static void echo_line(TCHAR *format, va_list args)
 {
-	LPTSTR pBuffer = new TCHAR[8192];
+	TCHAR szBuffer[LOG_LINE_LEN];
+	int nLen = _vsntprintf(szBuffer, LOG_LINE_LEN, format, args);
 
-	if (pBuffer != NULL)
+	if (nLen < 0 || nLen >= LOG_LINE_LEN)
 	{
-		va_list args;
-		DWORD dwWrote;
+		nLen = LOG_LINE_LEN - 1;
+		szBuffer[nLen] = '\0';
+	}
 
-		va_start(args, format);
-		_vsntprintf(pBuffer, 8192, format, args);
-		va_end(args);
+	if (logger.Write(szBuffer, nLen))
+		return;
 
-		WriteConsole(GetStdHandle(STD_OUTPUT_HANDLE), pBuffer, (DWORD)_tcslen(pBuffer), &dwWrote, NULL);
+#ifdef _WIN32
+	DWORD dwWrote;
 
-		if (fpLog)
-		{
-			fwrite(pBuffer, 1, _tcslen(pBuffer), fpLog);
-			fflush(fpLog);
-		}
+	WriteConsole(GetStdHandle(STD_OUTPUT_HANDLE), szBuffer, (DWORD)nLen, &dwWrote, NULL);
+#else
+	fputs(szBuffer, stdout);
+#endif
 
-		delete [] pBuffer;
+	if (fpLog)
+	{
+		fwrite(szBuffer, 1, nLen, fpLog);
+		fflush(fpLog);
 	}
 }
+#endif
+
+#ifdef ECHODEBUG
+void dprintf(TCHAR *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	echo_line(format, args);
+	va_end(args);
+}
 #else
 #define dprintf
 #endif
@@ -40,27 +56,11 @@ void dprintf(TCHAR *format, ...)
 #ifdef ECHONORMAL
 void myprintf(TCHAR *format, ...)
 {
-	LPTSTR pBuffer = new TCHAR[8192];
-
-	if (pBuffer != NULL)
-	{
-		va_list args;
-		DWORD dwWrote;
-
-		va_start(args, format);
-		_vsntprintf(pBuffer, 8192, format, args);
-		va_end(args);
-
-		WriteConsole(GetStdHandle(STD_OUTPUT_HANDLE), pBuffer, (DWORD)_tcslen(pBuffer), &dwWrote, NULL);
+	va_list args;
 
-		if (fpLog)
-		{
-			fwrite(pBuffer, 1, _tcslen(pBuffer), fpLog);
-			fflush(fpLog);
-		}
-
-		delete [] pBuffer;
-	}
+	va_start(args, format);
+	echo_line(format, args);
+	va_end(args);
 }
 #else
 #define myprintf
@@ -6,6 +6,7 @@
 #pragma once
 
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN		// Exclude rarely-used stuff from Windows headers
 // Windows Header Files:
 #include <windows.h>
@@ -28,6 +29,10 @@ extern CAppModule _Module;
 #include <atlddx.h>
 #include <atlcoll.h>
 #include "resource.h"
+#endif
+
+// The protocol core's view of everything else
+#include "Platform.h"
 
 //-----------------------------------------------------------------------------
 // Miscellaneous helper functions
@@ -99,8 +104,11 @@ extern FILE *fpLog;
 #define MSG_RELIABLE			0x40
 #define MSG_ZEROCODED			0x80
 
+#define MSG_HEADER_LEN			4
+
 #define MSG_FREQ_HIGH			0x0000
 #define MSG_FREQ_MED			0xFF00
 #define MSG_FREQ_LOW			0xFFFF
 
-#define REGION_MULTIPLIER		4294967296
\ No newline at end of file
+#define REGION_MULTIPLIER		4294967296
+#define REGION_WIDTH_UNITS		256
\ No newline at end of file